@@ -6,6 +6,8 @@ using System;
 using System.Collections.Concurrent;
 using System.Collections.Generic;
 using System.IO;
+using System.Linq;
+using System.Security.Cryptography;
 using System.Text;
 using System.Threading;
 
@@ -18,6 +20,11 @@ namespace FastFetch.Git
         private const ushort ExtendedBit = 0x4000;
         private const ushort SkipWorktreeBit = 0x4000;
 
+        // Number of entries in each block of the Index Entry Offset Table (IEOT) extension, which lets readers parse
+        // the index's blocks in parallel.  Git also uses blocks of at least 10000 entries.
+        private const uint EntriesPerOffsetTableBlock = 10000;
+        private const uint EntryOffsetTableVersion = 1;
+
         private static readonly byte[] PaddingBytes = new byte[8];
 
         private static readonly byte[] IndexHeader = new byte[]
@@ -25,6 +32,9 @@ namespace FastFetch.Git
             (byte)'D', (byte)'I', (byte)'R', (byte)'C', // Magic Signature
         };
 
+        private static readonly byte[] EntryOffsetTableSignature = Encoding.ASCII.GetBytes("IEOT");
+        private static readonly byte[] EndOfIndexEntriesSignature = Encoding.ASCII.GetBytes("EOIE");
+
         // We can't accurated fill times and length in realtime, so we block write the zeroes and probably save time.
         private static readonly byte[] EntryHeader = new byte[] 
         {
@@ -48,6 +58,9 @@ namespace FastFetch.Git
 
         private uint entryCount = 0;
 
+        // Offset of the first entry of each block, for the IEOT extension
+        private List<uint> entryBlockOffsets = new List<uint>();
+
         private BlockingCollection<LsTreeEntry> entryQueue = new BlockingCollection<LsTreeEntry>();
         
         public GitIndexGenerator(ITracer tracer, Enlistment enlistment, bool shouldHashIndex)
@@ -114,9 +127,17 @@ namespace FastFetch.Git
                             sparseCheckoutEntries != null && 
                             !sparseCheckoutEntries.Contains(entry.Filename) && 
                             !sparseCheckoutEntries.Contains(this.GetDirectoryNameForGitPath(entry.Filename));
+
+                        if (this.entryCount % EntriesPerOffsetTableBlock == 0)
+                        {
+                            this.entryBlockOffsets.Add((uint)writer.BaseStream.Position);
+                        }
+
                         this.WriteEntry(writer, version, entry.Sha, entry.Filename, skipWorkTree, ref lastStringLength);
                     }
 
+                    this.WriteEntryOffsetTable(writer);
+
                     // Update entry count
                     writer.BaseStream.Position = EntryCountOffset;
                     writer.Write(EndianHelper.Swap(this.entryCount));
@@ -133,6 +154,55 @@ namespace FastFetch.Git
             }
         }
 
+        /// <summary>
+        /// Write the Index Entry Offset Table (IEOT) extension, followed by the End Of Index Entries (EOIE) extension
+        /// that git and GitIndexReader use to find it.  Both are optional extensions, which versions of git that do
+        /// not know them ignore.
+        /// </summary>
+        /// <remarks>
+        /// WriteEntry never shares a path prefix with the previous entry in a version 4 index, and so every entry can
+        /// start a block.
+        /// </remarks>
+        private void WriteEntryOffsetTable(BinaryWriter writer)
+        {
+            if (this.entryBlockOffsets.Count < 2)
+            {
+                return;
+            }
+
+            uint extensionsOffset = (uint)writer.BaseStream.Position;
+
+            // IEOT is a version followed by an (offset, entry count) pair for each block
+            byte[] entryOffsetTableHeader = EntryOffsetTableSignature
+                .Concat(BitConverter.GetBytes(EndianHelper.Swap((uint)(4 + (8 * this.entryBlockOffsets.Count)))))
+                .ToArray();
+
+            writer.Write(entryOffsetTableHeader);
+            writer.Write(EndianHelper.Swap(EntryOffsetTableVersion));
+            for (int i = 0; i < this.entryBlockOffsets.Count; i++)
+            {
+                uint blockEntryCount =
+                    i < this.entryBlockOffsets.Count - 1 ?
+                    EntriesPerOffsetTableBlock :
+                    this.entryCount - (EntriesPerOffsetTableBlock * (uint)i);
+
+                writer.Write(EndianHelper.Swap(this.entryBlockOffsets[i]));
+                writer.Write(EndianHelper.Swap(blockEntryCount));
+            }
+
+            // EOIE holds the offset of the first extension and a SHA-1 of the headers of the extensions before it
+            byte[] extensionHeadersHash;
+            using (SHA1 sha1 = SHA1.Create())
+            {
+                extensionHeadersHash = sha1.ComputeHash(entryOffsetTableHeader);
+            }
+
+            writer.Write(EndOfIndexEntriesSignature);
+            writer.Write(EndianHelper.Swap((uint)(4 + extensionHeadersHash.Length)));
+            writer.Write(EndianHelper.Swap(extensionsOffset));
+            writer.Write(extensionHeadersHash);
+        }
+
         private string GetDirectoryNameForGitPath(string filename)
         {
             int idx = filename.LastIndexOf('/');
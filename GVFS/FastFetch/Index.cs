@@ -3,12 +3,12 @@ using System.Collections.Concurrent;
 using System.Collections.Generic;
 using System.IO;
 using System.IO.MemoryMappedFiles;
-using System.Linq;
 using System.Text;
 using System.Threading;
 using System.Threading.Tasks;
 using FastFetch.Git;
 using GVFS.Common;
+using GVFS.Common.Git;
 using GVFS.Common.Tracing;
 using Microsoft.Diagnostics.Tracing;
 
@@ -23,17 +23,10 @@ namespace FastFetch
 
         // Constants used for parsing an index entry
         private const ushort ExtendedBit = 0x4000;
-        private const ushort SkipWorktreeBit = 0x4000;
-        private const int BaseEntryLength = 62;
-
-        // Buffer used to get path from index entry
-        private const int MaxPathBufferSize = 4096;
 
         // Index default names
         private const string UpdatedIndexName = "index.updated";
 
-        private static readonly byte[] MagicSignature = new byte[] { (byte)'D', (byte)'I', (byte)'R', (byte)'C' };
-
         // Location of the version marker file
         private readonly string versionMarkerFile;
         
@@ -154,7 +147,7 @@ namespace FastFetch
         {
             using (ITracer activity = this.tracer.StartActivity("ParseIndex", EventLevel.Informational, Keywords.Telemetry, new EventMetadata() { { "Index", this.updatedIndexPath } }))
             {
-                using (Stream indexStream = new FileStream(this.updatedIndexPath, FileMode.Open, FileAccess.Read, FileShare.Read))
+                using (FileStream indexStream = new FileStream(this.updatedIndexPath, FileMode.Open, FileAccess.Read, FileShare.Read))
                 {
                     this.ParseIndex(indexStream);
                 }
@@ -362,127 +355,68 @@ namespace FastFetch
             return false;
         }
 
-        private void ParseIndex(Stream indexStream)
+        private void ParseIndex(FileStream indexStream)
         {
-            byte[] buffer = new byte[40];
-            indexStream.Position = 0;
-
-            byte[] signature = new byte[4];
-            indexStream.Read(signature, 0, 4);
-            if (!Enumerable.SequenceEqual(MagicSignature, signature))
-            {
-                throw new InvalidDataException("Incorrect magic signature for index: " + string.Join(string.Empty, signature.Select(c => (char)c)));
-            }
-
-            this.IndexVersion = this.ReadUInt32(buffer, indexStream);
-
-            if (this.IndexVersion < 2 || this.IndexVersion > 4)
+            using (GitIndexReader indexReader = new GitIndexReader(indexStream))
             {
-                throw new InvalidDataException("Unsupported index version: " + this.IndexVersion);
-            }
-
-            this.entryCount = this.ReadUInt32(buffer, indexStream);
+                this.IndexVersion = indexReader.Version;
+                this.entryCount = indexReader.EntryCount;
 
-            this.tracer.RelatedEvent(EventLevel.Informational, "IndexData", new EventMetadata() { { "Index", this.updatedIndexPath }, { "Version", this.IndexVersion }, { "entryCount", this.entryCount } }, Keywords.Telemetry);
+                List<GitIndexEntryBlock> entryBlocks = indexReader.GetEntryBlocks();
 
-            this.indexEntryOffsets = new Dictionary<string, long>((int)this.entryCount, StringComparer.OrdinalIgnoreCase);
+                this.tracer.RelatedEvent(EventLevel.Informational, "IndexData", new EventMetadata() { { "Index", this.updatedIndexPath }, { "Version", this.IndexVersion }, { "entryCount", this.entryCount }, { "EntryBlocks", entryBlocks.Count } }, Keywords.Telemetry);
 
-            int previousPathLength = 0;
-            byte[] pathBuffer = new byte[MaxPathBufferSize];
-            for (int i = 0; i < this.entryCount; i++)
-            {
-                // See https://github.com/git/git/blob/867b1c1bf68363bcfd17667d6d4b9031fa6a1300/Documentation/technical/index-format.txt#L38
-                long entryOffset = indexStream.Position;
-
-                int entryLength = BaseEntryLength;
+                this.indexEntryOffsets = new Dictionary<string, long>((int)this.entryCount, StringComparer.OrdinalIgnoreCase);
 
-                // Skip the next 60 bytes.
-                // 40 bytes encapsulated by IndexEntry but not needed now.
-                // 20 bytes of sha
-                indexStream.Position += 60;
+                if (entryBlocks.Count == 1)
+                {
+                    indexReader.ForEachEntry(
+                        entry =>
+                        {
+                            if (!entry.SkipWorktree)
+                            {
+                                // Examine only the things we're not skipping...
+                                this.indexEntryOffsets[entry.GetPath()] = entry.Offset;
+                            }
 
-                ushort flags = this.ReadUInt16(buffer, indexStream);
-                bool isExtended = (flags & ExtendedBit) == ExtendedBit;
-                ushort pathLength = (ushort)(flags & 0xFFF);
-                entryLength += pathLength;
+                            return true;
+                        });
 
-                bool skipWorktree = false;
-                if (isExtended && (this.IndexVersion > 2))
-                {
-                    ushort extendedFlags = this.ReadUInt16(buffer, indexStream);
-                    skipWorktree = (extendedFlags & SkipWorktreeBit) == SkipWorktreeBit;
-                    entryLength += 2;
+                    return;
                 }
 
-                if (this.IndexVersion == 4)
-                {
-                    int replaceLength = this.ReadReplaceLength(indexStream);
-                    int replaceIndex = previousPathLength - replaceLength;
-                    indexStream.Read(pathBuffer, replaceIndex, pathLength - replaceIndex + 1);
-                    previousPathLength = pathLength;
-                }
-                else
-                {
-                    // Simple paths but 1 - 8 nul bytes as necessary to pad the entry to a multiple of eight bytes
-                    int numNulBytes = 8 - (entryLength % 8);
-                    indexStream.Read(pathBuffer, 0, pathLength + numNulBytes);
-                }
+                // The index has an Index Entry Offset Table, decode the paths of each block on its own thread and then
+                // add them in index order, so that a path that is in the index more than once gets the same offset
+                List<KeyValuePair<string, long>>[] blockEntries = new List<KeyValuePair<string, long>>[entryBlocks.Count];
+                Parallel.For(
+                    0,
+                    entryBlocks.Count,
+                    blockIndex =>
+                    {
+                        List<KeyValuePair<string, long>> entries = new List<KeyValuePair<string, long>>((int)entryBlocks[blockIndex].EntryCount);
+                        indexReader.ForEachEntry(
+                            entryBlocks[blockIndex],
+                            entry =>
+                            {
+                                if (!entry.SkipWorktree)
+                                {
+                                    entries.Add(new KeyValuePair<string, long>(entry.GetPath(), entry.Offset));
+                                }
 
-                if (!skipWorktree)
-                {
-                    // Examine only the things we're not skipping...
-                    // Potential Future Perf Optimization: Perform this work on multiple threads.  If we take the first byte and % by number of threads,
-                    // we can ensure that all entries for a given folder end up in the same dictionary              
-                    string path = Encoding.UTF8.GetString(pathBuffer, 0, pathLength);
-                    this.indexEntryOffsets[path] = entryOffset;
-                }
-            }
-        }
+                                return true;
+                            });
 
-        /// <summary>
-        /// Get the length of the replacement string.  For definition of data, see:
-        /// https://github.com/git/git/blob/867b1c1bf68363bcfd17667d6d4b9031fa6a1300/Documentation/technical/index-format.txt#L38
-        /// </summary>
-        /// <param name="stream">stream to read bytes from</param>
-        /// <returns></returns>
-        private int ReadReplaceLength(Stream stream)
-        {
-            int headerByte = stream.ReadByte();
-            int offset = headerByte & 0x7f;
+                        blockEntries[blockIndex] = entries;
+                    });
 
-            // Terminate the loop when the high bit is no longer set.
-            for (int i = 0; (headerByte & 0x80) != 0; i++)
-            {
-                headerByte = stream.ReadByte();
-                if (headerByte < 0)
+                foreach (List<KeyValuePair<string, long>> entries in blockEntries)
                 {
-                    throw new EndOfStreamException("Index file has been truncated.");
+                    foreach (KeyValuePair<string, long> entry in entries)
+                    {
+                        this.indexEntryOffsets[entry.Key] = entry.Value;
+                    }
                 }
-
-                offset += 1;
-                offset = (offset << 7) + (headerByte & 0x7f);
             }
-
-            return offset;
-        }
-
-        private uint ReadUInt32(byte[] buffer, Stream stream)
-        {
-            buffer[3] = (byte)stream.ReadByte();
-            buffer[2] = (byte)stream.ReadByte();
-            buffer[1] = (byte)stream.ReadByte();
-            buffer[0] = (byte)stream.ReadByte();
-
-            return BitConverter.ToUInt32(buffer, 0);
-        }
-
-        private ushort ReadUInt16(byte[] buffer, Stream stream)
-        {
-            buffer[1] = (byte)stream.ReadByte();
-            buffer[0] = (byte)stream.ReadByte();
-
-            // (ushort)BitConverter.ToInt16 avoids the running the duplicated checks in ToUInt16
-            return (ushort)BitConverter.ToInt16(buffer, 0);
         }
 
         /// <summary>
@@ -91,7 +91,8 @@ namespace FastFetch.Jobs
                                 () => request.ObjectIds.Except(successfulDownloads),
                                 onSuccess: (tryCount, response) => this.WriteObjectOrPack(request, tryCount, response, successfulDownloads),
                                 onFailure: RetryWrapper<GitObjectsHttpRequestor.GitObjectTaskResult>.StandardErrorHandler(activity, request.RequestId, DownloadAreaPath),
-                                preferBatchedLooseObjects: true);
+                                preferBatchedLooseObjects: true,
+                                cancellationToken: CancellationToken.None);
 
                         if (!result.Succeeded)
                         {
@@ -37,11 +37,23 @@ namespace GVFS.Common
             public const string TimeoutSecondsConfig = GVFSPrefix + "timeout-seconds";
             public const string EnlistmentId = GVFSPrefix + "enlistment-id";
             public const string CacheServer = GVFSPrefix + "cache-server";
+            public const string SpeculativePrefetchBytesPerSecond = GVFSPrefix + "speculative-prefetch-bytes-per-second";
+            public const string HookStandbyHosts = GVFSPrefix + "hook-standby-hosts";
             public const string DeprecatedCacheEndpointSuffix = ".cache-server-url";
             public const string HooksPrefix = GitConfig.GVFSPrefix + "clone.default-";
             public const string HooksExtension = ".hooks";
         }
 
+        public static class StandbyHooks
+        {
+            // Standby hosts are started with "--standby <mount process ID> <enlistment root>", and serve that
+            // enlistment until the mount process exits
+            public const string StandbyArg = "--standby";
+
+            // Enough for the pre-command and post-command hooks of a git command to both find a host waiting
+            public const int MaxStandbyHosts = 2;
+        }
+
         public static class Service
         {
             public const string ServiceName = "GVFS.Service";
@@ -141,6 +153,7 @@ namespace GVFS.Common
                 public static readonly string PreCommandPath = Path.Combine(Hooks.Root, PreCommandHookName);
                 public static readonly string PostCommandPath = Path.Combine(Hooks.Root, PostCommandHookName);
                 public static readonly string ReadObjectPath = Path.Combine(Hooks.Root, ReadObjectName);
+                public static readonly string ReadObjectEnlistmentCachePath = ReadObjectPath + ".enlistment";
             }
 
             public static class Info
@@ -269,6 +269,9 @@ namespace GVFS.Common
             private int numSizeQueries;
             private long sizeQueryTimeMs;
 
+            private int numReadObjectHookLocalHits;
+            private int numReadObjectHookLocalMisses;
+
             public ActiveGitCommandStats()
             {
                 this.lockAcquiredTime = Stopwatch.StartNew();
@@ -309,6 +312,12 @@ namespace GVFS.Common
                 Interlocked.Add(ref this.sizeQueryTimeMs, queryTimeMs);
             }
 
+            public void RecordReadObjectHookLocalObjects(int localHits, int localMisses)
+            {
+                Interlocked.Add(ref this.numReadObjectHookLocalHits, localHits);
+                Interlocked.Add(ref this.numReadObjectHookLocalMisses, localMisses);
+            }
+
             public void AddStatsToTelemetry(EventMetadata metadata)
             {
                 metadata.Add("DurationMS", this.lockAcquiredTime.ElapsedMilliseconds);
@@ -324,6 +333,9 @@ namespace GVFS.Common
 
                 metadata.Add("SizeQueries", this.numSizeQueries);
                 metadata.Add("SizeQueryTimeMS", this.sizeQueryTimeMs);
+
+                metadata.Add("ReadObjectHookLocalHits", this.numReadObjectHookLocalHits);
+                metadata.Add("ReadObjectHookLocalMisses", this.numReadObjectHookLocalMisses);
             }
         }
     }
@@ -1,25 +1,35 @@
 ﻿using GVFS.Common.Http;
+using GVFS.Common.NetworkStreams;
 using GVFS.Common.Tracing;
 using System;
 using System.Collections.Concurrent;
 using System.Collections.Generic;
 using System.IO;
+using System.IO.Compression;
+using System.Linq;
 using System.Net;
 using System.Threading;
+using System.Threading.Tasks;
 
 namespace GVFS.Common.Git
 {
     public class GVFSGitObjects : GitObjects
     {
         private static readonly TimeSpan NegativeCacheTTL = TimeSpan.FromSeconds(30);
+        private static readonly byte[] LooseBlobHeader = new byte[] { (byte)'b', (byte)'l', (byte)'o', (byte)'b', (byte)' ' };
+        private static readonly Task AlreadySaved = Task.FromResult(true);
 
         private ConcurrentDictionary<string, DateTime> objectNegativeCache;
-        
+
+        // Objects downloaded by TryDownloadObjectContent that are still being written to disk, keyed by SHA
+        private ConcurrentDictionary<string, PendingLooseObjectWrite> pendingLooseObjectWrites;
+
         public GVFSGitObjects(GVFSContext context, GitObjectsHttpRequestor objectRequestor)
             : base(context.Tracer, context.Enlistment, objectRequestor, context.FileSystem)
         {
             this.Context = context;
             this.objectNegativeCache = new ConcurrentDictionary<string, DateTime>(StringComparer.OrdinalIgnoreCase);
+            this.pendingLooseObjectWrites = new ConcurrentDictionary<string, PendingLooseObjectWrite>(StringComparer.OrdinalIgnoreCase);
         }
 
         public enum RequestSource
@@ -28,10 +38,43 @@ namespace GVFS.Common.Git
             FileStreamCallback,
             GVFSVerb,
             NamedPipeMessage,
+            SpeculativePrefetch,
         }
 
         protected GVFSContext Context { get; private set; }
 
+        /// <summary>
+        /// Returns true if looseObjectContent (the compressed content of a loose object) is a blob
+        /// </summary>
+        public static bool IsLooseObjectBlob(byte[] looseObjectContent)
+        {
+            try
+            {
+                // The DeflateStream header starts 2 bytes into the zlib header, but they are otherwise compatible
+                using (MemoryStream content = new MemoryStream(looseObjectContent, 2, looseObjectContent.Length - 2))
+                using (DeflateStream deflate = new DeflateStream(content, CompressionMode.Decompress))
+                {
+                    byte[] header = new byte[LooseBlobHeader.Length];
+                    int headerLength = 0;
+                    int bytesRead;
+                    while (headerLength < header.Length && (bytesRead = deflate.Read(header, headerLength, header.Length - headerLength)) > 0)
+                    {
+                        headerLength += bytesRead;
+                    }
+
+                    return headerLength == header.Length && header.SequenceEqual(LooseBlobHeader);
+                }
+            }
+            catch (InvalidDataException)
+            {
+                return false;
+            }
+            catch (ArgumentException)
+            {
+                return false;
+            }
+        }
+
         public virtual bool TryCopyBlobContentStream(
             string sha, 
             CancellationToken cancellationToken,
@@ -74,7 +117,8 @@ namespace GVFS.Common.Git
                     else
                     {
                         // Pass in false for retryOnFailure because the retrier in this method manages multiple attempts
-                        if (this.TryDownloadAndSaveObject(sha, cancellationToken, requestSource, retryOnFailure: false) == DownloadAndSaveObjectResult.Success)
+                        long bytesDownloaded;
+                        if (this.TryDownloadAndSaveObject(sha, cancellationToken, requestSource, retryOnFailure: false, bytesDownloaded: out bytesDownloaded) == DownloadAndSaveObjectResult.Success)
                         {
                             if (this.Context.Repository.TryCopyBlobContentStream(sha, writeAction))
                             {
@@ -91,7 +135,204 @@ namespace GVFS.Common.Git
 
         public DownloadAndSaveObjectResult TryDownloadAndSaveObject(string objectId, RequestSource requestSource)
         {
-            return this.TryDownloadAndSaveObject(objectId, CancellationToken.None, requestSource, retryOnFailure: true);
+            long bytesDownloaded;
+            return this.TryDownloadAndSaveObject(objectId, CancellationToken.None, requestSource, retryOnFailure: true, bytesDownloaded: out bytesDownloaded);
+        }
+
+        public Dictionary<string, DownloadAndSaveObjectResult> TryDownloadAndSaveObjects(IEnumerable<string> objectIds, RequestSource requestSource)
+        {
+            long bytesDownloaded;
+            return this.TryDownloadAndSaveObjects(objectIds, requestSource, CancellationToken.None, out bytesDownloaded);
+        }
+
+        /// <summary>
+        /// Download the specified objects using a single batched request and save them to the objects folder.
+        /// </summary>
+        /// <param name="cancellationToken">
+        /// Cancels the request while it is waiting for a connection or for the server to respond (an
+        /// OperationCanceledException is thrown), but not once the response is being saved
+        /// </param>
+        /// <param name="bytesDownloaded">The size of the response(s) that were read</param>
+        /// <returns>The result of the download for each of the (distinct) requested objects</returns>
+        public virtual Dictionary<string, DownloadAndSaveObjectResult> TryDownloadAndSaveObjects(
+            IEnumerable<string> objectIds,
+            RequestSource requestSource,
+            CancellationToken cancellationToken,
+            out long bytesDownloaded)
+        {
+            bytesDownloaded = 0;
+            Dictionary<string, DownloadAndSaveObjectResult> results = new Dictionary<string, DownloadAndSaveObjectResult>(StringComparer.OrdinalIgnoreCase);
+            HashSet<string> objectsToDownload = new HashSet<string>(StringComparer.OrdinalIgnoreCase);
+            foreach (string objectId in objectIds)
+            {
+                if (results.ContainsKey(objectId) || objectsToDownload.Contains(objectId))
+                {
+                    continue;
+                }
+
+                if (objectId == GVFSConstants.AllZeroSha)
+                {
+                    results[objectId] = DownloadAndSaveObjectResult.Error;
+                }
+                else if (this.IsInNegativeCache(objectId))
+                {
+                    results[objectId] = DownloadAndSaveObjectResult.ObjectNotOnServer;
+                }
+                else
+                {
+                    objectsToDownload.Add(objectId);
+                }
+            }
+
+            if (objectsToDownload.Count == 0)
+            {
+                return results;
+            }
+
+            if (objectsToDownload.Count == 1)
+            {
+                string objectId = objectsToDownload.First();
+                results[objectId] = this.TryDownloadAndSaveObject(objectId, cancellationToken, requestSource, retryOnFailure: true, bytesDownloaded: out bytesDownloaded);
+                return results;
+            }
+
+            // If the request is from git.exe (i.e. NamedPipeMessage) then we should assume that if there is an
+            // object on disk it's corrupt somehow (which is why git is asking for it)
+            bool overwriteExistingObjects = requestSource == RequestSource.NamedPipeMessage;
+
+            HashSet<string> successfulDownloads = new HashSet<string>(StringComparer.OrdinalIgnoreCase);
+            long responseBytes = 0;
+            this.GitObjectRequestor.TryDownloadObjects(
+                () => objectsToDownload.Except(successfulDownloads),
+                onSuccess: (tryCount, response) =>
+                {
+                    CountingStream responseStream = response.CountBytesRead();
+                    try
+                    {
+                        return this.TrySavePackOrLooseObject(
+                            objectsToDownload.Except(successfulDownloads).ToList(),
+                            unpackObjects: false,
+                            responseData: response,
+                            overwriteExistingObjects: overwriteExistingObjects,
+                            savedObjects: successfulDownloads);
+                    }
+                    finally
+                    {
+                        responseBytes += responseStream.BytesRead;
+                    }
+                },
+                onFailure: errorArgs =>
+                {
+                    EventMetadata metadata = new EventMetadata();
+                    metadata.Add("ObjectCount", objectsToDownload.Count);
+                    metadata.Add("SuccessfulDownloads", successfulDownloads.Count);
+                    metadata.Add("AttemptNumber", errorArgs.TryCount);
+                    metadata.Add("WillRetry", errorArgs.WillRetry);
+                    metadata.Add("RequestSource", requestSource.ToString());
+                    if (errorArgs.Error != null)
+                    {
+                        metadata.Add("Exception", errorArgs.Error.ToString());
+                    }
+
+                    this.Tracer.RelatedWarning(metadata, nameof(this.TryDownloadAndSaveObjects) + ": Failed to download batch", Keywords.Network | Keywords.Telemetry);
+                },
+                preferBatchedLooseObjects: true,
+                cancellationToken: cancellationToken);
+
+            bytesDownloaded = responseBytes;
+            foreach (string objectId in objectsToDownload)
+            {
+                results[objectId] = successfulDownloads.Contains(objectId) ? DownloadAndSaveObjectResult.Success : DownloadAndSaveObjectResult.Error;
+            }
+
+            return results;
+        }
+
+        /// <summary>
+        /// Download the specified object and return its loose object content (i.e. the compressed bytes that
+        /// would be written to the objects folder) without waiting for it to be written to disk.  The object is
+        /// saved on a background thread, and until it has been saved other requests for it are served from memory.
+        /// </summary>
+        /// <param name="looseObjectSaved">Completes once the object has been written to disk (or the write has failed)</param>
+        public virtual DownloadAndSaveObjectResult TryDownloadObjectContent(
+            string objectId,
+            RequestSource requestSource,
+            out byte[] looseObjectContent,
+            out Task looseObjectSaved)
+        {
+            PendingLooseObjectWrite pendingWrite;
+            if (this.pendingLooseObjectWrites.TryGetValue(objectId, out pendingWrite))
+            {
+                looseObjectContent = pendingWrite.Content;
+                looseObjectSaved = pendingWrite.Saved;
+                return DownloadAndSaveObjectResult.Success;
+            }
+
+            looseObjectContent = null;
+            looseObjectSaved = AlreadySaved;
+            if (objectId == GVFSConstants.AllZeroSha)
+            {
+                return DownloadAndSaveObjectResult.Error;
+            }
+
+            if (this.IsInNegativeCache(objectId))
+            {
+                return DownloadAndSaveObjectResult.ObjectNotOnServer;
+            }
+
+            byte[] downloadedContent = null;
+            RetryWrapper<GitObjectsHttpRequestor.GitObjectTaskResult>.InvocationResult output = this.GitObjectRequestor.TryDownloadLooseObject(
+                objectId,
+                retryOnFailure: true,
+                cancellationToken: CancellationToken.None,
+                requestSource: requestSource.ToString(),
+                onSuccess: (tryCount, response) =>
+                {
+                    using (MemoryStream content = new MemoryStream())
+                    {
+                        response.Stream.CopyTo(content);
+                        if (content.Length == 0)
+                        {
+                            throw new RetryableException($"Loose object '{objectId}' was downloaded with 0 bytes");
+                        }
+
+                        downloadedContent = content.ToArray();
+                    }
+
+                    return new RetryWrapper<GitObjectsHttpRequestor.GitObjectTaskResult>.CallbackResult(new GitObjectsHttpRequestor.GitObjectTaskResult(true));
+                });
+
+            if (output.Result != null)
+            {
+                if (output.Succeeded && output.Result.Success && downloadedContent != null)
+                {
+                    // If the request is from git.exe (i.e. NamedPipeMessage) then we should assume that if there is an
+                    // object on disk it's corrupt somehow (which is why git is asking for it)
+                    bool overwriteExistingObject = requestSource == RequestSource.NamedPipeMessage;
+                    pendingWrite = new PendingLooseObjectWrite(downloadedContent);
+                    if (this.pendingLooseObjectWrites.TryAdd(objectId, pendingWrite))
+                    {
+                        Task.Run(() => this.SavePendingLooseObject(objectId, pendingWrite, overwriteExistingObject));
+                        looseObjectSaved = pendingWrite.Saved;
+                    }
+                    else if (this.pendingLooseObjectWrites.TryGetValue(objectId, out pendingWrite))
+                    {
+                        // Another request downloaded the object at the same time, and is still writing it
+                        looseObjectSaved = pendingWrite.Saved;
+                    }
+
+                    looseObjectContent = downloadedContent;
+                    return DownloadAndSaveObjectResult.Success;
+                }
+
+                if (output.Result.HttpStatusCodeResult == HttpStatusCode.NotFound)
+                {
+                    this.objectNegativeCache.AddOrUpdate(objectId, DateTime.Now, (unused1, unused2) => DateTime.Now);
+                    return DownloadAndSaveObjectResult.ObjectNotOnServer;
+                }
+            }
+
+            return DownloadAndSaveObjectResult.Error;
         }
 
         public bool TryGetBlobSizeLocally(string sha, out long length)
@@ -108,27 +349,37 @@ namespace GVFS.Common.Git
             string objectId, 
             CancellationToken cancellationToken, 
             RequestSource requestSource, 
-            bool retryOnFailure)
+            bool retryOnFailure,
+            out long bytesDownloaded)
         {
+            bytesDownloaded = 0;
             if (objectId == GVFSConstants.AllZeroSha)
             {
                 return DownloadAndSaveObjectResult.Error;
             }
 
-            DateTime negativeCacheRequestTime;
-            if (this.objectNegativeCache.TryGetValue(objectId, out negativeCacheRequestTime))
+            if (this.IsInNegativeCache(objectId))
             {
-                if (negativeCacheRequestTime > DateTime.Now.Subtract(NegativeCacheTTL))
-                {
-                    return DownloadAndSaveObjectResult.ObjectNotOnServer;
-                }
-
-                this.objectNegativeCache.TryRemove(objectId, out negativeCacheRequestTime);
+                return DownloadAndSaveObjectResult.ObjectNotOnServer;
             }
 
             // To reduce allocations, reuse the same buffer when writing objects in this batch
             byte[] bufToCopyWith = new byte[StreamUtil.DefaultCopyBufferSize];
 
+            // If TryDownloadObjectContent has already downloaded the object, the caller needs it on disk now
+            // rather than waiting for the background write
+            PendingLooseObjectWrite pendingWrite;
+            if (this.pendingLooseObjectWrites.TryGetValue(objectId, out pendingWrite))
+            {
+                using (MemoryStream content = new MemoryStream(pendingWrite.Content, writable: false))
+                {
+                    this.WriteLooseObject(content, objectId, overwriteExistingObject: false, bufToCopyWith: bufToCopyWith);
+                }
+
+                return DownloadAndSaveObjectResult.Success;
+            }
+
+            long responseBytes = 0;
             RetryWrapper<GitObjectsHttpRequestor.GitObjectTaskResult>.InvocationResult output = this.GitObjectRequestor.TryDownloadLooseObject(
                 objectId,
                 retryOnFailure,
@@ -136,17 +387,26 @@ namespace GVFS.Common.Git
                 requestSource.ToString(),
                 onSuccess: (tryCount, response) =>
                 {
-                    // If the request is from git.exe (i.e. NamedPipeMessage) then we should assume that if there is an
-                    // object on disk it's corrupt somehow (which is why git is asking for it)
-                    this.WriteLooseObject(
-                        response.Stream,
-                        objectId,
-                        overwriteExistingObject: requestSource == RequestSource.NamedPipeMessage,
-                        bufToCopyWith: bufToCopyWith);
+                    CountingStream responseStream = response.CountBytesRead();
+                    try
+                    {
+                        // If the request is from git.exe (i.e. NamedPipeMessage) then we should assume that if there is an
+                        // object on disk it's corrupt somehow (which is why git is asking for it)
+                        this.WriteLooseObject(
+                            responseStream,
+                            objectId,
+                            overwriteExistingObject: requestSource == RequestSource.NamedPipeMessage,
+                            bufToCopyWith: bufToCopyWith);
+                    }
+                    finally
+                    {
+                        responseBytes += responseStream.BytesRead;
+                    }
 
                     return new RetryWrapper<GitObjectsHttpRequestor.GitObjectTaskResult>.CallbackResult(new GitObjectsHttpRequestor.GitObjectTaskResult(true));
                 });
 
+            bytesDownloaded = responseBytes;
             if (output.Result != null)
             {
                 if (output.Succeeded && output.Result.Success)
@@ -163,5 +423,69 @@ namespace GVFS.Common.Git
 
             return DownloadAndSaveObjectResult.Error;
         }
+
+        private bool IsInNegativeCache(string objectId)
+        {
+            DateTime negativeCacheRequestTime;
+            if (this.objectNegativeCache.TryGetValue(objectId, out negativeCacheRequestTime))
+            {
+                if (negativeCacheRequestTime > DateTime.Now.Subtract(NegativeCacheTTL))
+                {
+                    return true;
+                }
+
+                this.objectNegativeCache.TryRemove(objectId, out negativeCacheRequestTime);
+            }
+
+            return false;
+        }
+
+        private void SavePendingLooseObject(string objectId, PendingLooseObjectWrite pendingWrite, bool overwriteExistingObject)
+        {
+            try
+            {
+                using (MemoryStream content = new MemoryStream(pendingWrite.Content, writable: false))
+                {
+                    this.WriteLooseObject(content, objectId, overwriteExistingObject, new byte[StreamUtil.DefaultCopyBufferSize]);
+                }
+            }
+            catch (Exception e)
+            {
+                // The object will be downloaded again the next time that it's needed
+                EventMetadata metadata = new EventMetadata();
+                metadata.Add("sha", objectId);
+                metadata.Add("Exception", e.ToString());
+                this.Tracer.RelatedWarning(metadata, nameof(this.SavePendingLooseObject) + ": Failed to save downloaded object", Keywords.Telemetry);
+            }
+            finally
+            {
+                PendingLooseObjectWrite unused;
+                this.pendingLooseObjectWrites.TryRemove(objectId, out unused);
+                pendingWrite.SetSaved();
+            }
+        }
+
+        private class PendingLooseObjectWrite
+        {
+            private TaskCompletionSource<bool> saved;
+
+            public PendingLooseObjectWrite(byte[] content)
+            {
+                this.Content = content;
+                this.saved = new TaskCompletionSource<bool>();
+            }
+
+            public byte[] Content { get; }
+
+            public Task Saved
+            {
+                get { return this.saved.Task; }
+            }
+
+            public void SetSaved()
+            {
+                this.saved.TrySetResult(true);
+            }
+        }
     }
 }
\ No newline at end of file
@@ -0,0 +1,93 @@
+﻿using System;
+using System.Runtime.InteropServices;
+using System.Text;
+
+namespace GVFS.Common.Git
+{
+    /// <summary>
+    /// An entry in a git index, as decoded by <see cref="GitIndexReader"/>.  The reader uses the same GitIndexEntry
+    /// (and the same buffers) for every entry, so callbacks must copy anything that they keep.
+    /// </summary>
+    public class GitIndexEntry
+    {
+        public const int MaxPathBufferSize = 4096;
+
+        private const int ShaOffset = 40;
+        private const int ShaLength = 20;
+        private const ushort ExtendedBit = 0x4000;
+
+        private byte[] shaBuffer = new byte[ShaLength];
+        private bool shaBufferIsCurrent;
+        private IntPtr entryStart;
+
+        public GitIndexEntry()
+        {
+            this.PathBuffer = new byte[MaxPathBufferSize];
+        }
+
+        /// <summary>
+        /// Offset of the entry from the start of the index file
+        /// </summary>
+        public long Offset { get; private set; }
+
+        public ushort Flags { get; private set; }
+
+        public int MergeStage
+        {
+            get { return (this.Flags >> 12) & 3; }
+        }
+
+        public bool IsExtended
+        {
+            get { return (this.Flags & ExtendedBit) == ExtendedBit; }
+        }
+
+        public bool SkipWorktree { get; private set; }
+
+        /// <summary>
+        /// The entry's path (UTF8, not NUL terminated) is in PathBuffer[0] through PathBuffer[PathLength - 1], and
+        /// PathBuffer[PathLength] is 0
+        /// </summary>
+        public byte[] PathBuffer { get; private set; }
+
+        public int PathLength { get; private set; }
+
+        /// <summary>
+        /// The bytes of PathBuffer before ReplaceIndex are the same as they were for the previous entry
+        /// </summary>
+        public int ReplaceIndex { get; private set; }
+
+        /// <summary>
+        /// The entry's SHA-1.  The bytes are only copied out of the index when this is first read for an entry.
+        /// </summary>
+        public byte[] Sha
+        {
+            get
+            {
+                if (!this.shaBufferIsCurrent)
+                {
+                    Marshal.Copy(this.entryStart + ShaOffset, this.shaBuffer, 0, ShaLength);
+                    this.shaBufferIsCurrent = true;
+                }
+
+                return this.shaBuffer;
+            }
+        }
+
+        public string GetPath()
+        {
+            return Encoding.UTF8.GetString(this.PathBuffer, 0, this.PathLength);
+        }
+
+        internal void Update(long offset, IntPtr start, ushort flags, bool skipWorktree, int pathLength, int replaceIndex)
+        {
+            this.Offset = offset;
+            this.entryStart = start;
+            this.shaBufferIsCurrent = false;
+            this.Flags = flags;
+            this.SkipWorktree = skipWorktree;
+            this.PathLength = pathLength;
+            this.ReplaceIndex = replaceIndex;
+        }
+    }
+}
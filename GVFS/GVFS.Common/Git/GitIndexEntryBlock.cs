@@ -0,0 +1,22 @@
+﻿namespace GVFS.Common.Git
+{
+    /// <summary>
+    /// A run of consecutive entries in a git index that can be read without reading the entries before it.  Git
+    /// records these in the index's Index Entry Offset Table (IEOT) extension.
+    /// </summary>
+    public class GitIndexEntryBlock
+    {
+        public GitIndexEntryBlock(long offset, uint entryCount)
+        {
+            this.Offset = offset;
+            this.EntryCount = entryCount;
+        }
+
+        /// <summary>
+        /// Offset of the block's first entry from the start of the index file
+        /// </summary>
+        public long Offset { get; }
+
+        public uint EntryCount { get; }
+    }
+}
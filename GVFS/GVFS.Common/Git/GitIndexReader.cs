@@ -0,0 +1,543 @@
+﻿using System;
+using System.Collections.Generic;
+using System.IO;
+using System.IO.MemoryMappedFiles;
+using System.Security.Cryptography;
+
+namespace GVFS.Common.Git
+{
+    /// <summary>
+    /// Reads the entries of a version 2, 3 or 4 git index through a read-only memory map of the index file.  Entries
+    /// are decoded in place into a single reused <see cref="GitIndexEntry"/>, and scanning for path terminators and
+    /// shared path prefixes is done eight bytes at a time.  When the index has an Index Entry Offset Table, its blocks of
+    /// entries can be read on separate threads (see <see cref="GetEntryBlocks"/>).  For the index format see:
+    /// https://github.com/git/git/blob/867b1c1bf68363bcfd17667d6d4b9031fa6a1300/Documentation/technical/index-format.txt
+    /// </summary>
+    public class GitIndexReader : IDisposable
+    {
+        private const int HeaderLength = 12;
+        private const int ChecksumLength = 20;
+
+        // ctime + mtime + dev + ino + mode + uid + gid + size + sha
+        private const int FlagsOffset = 60;
+        private const int BaseEntryLength = 62;
+        private const int ExtendedFlagsLength = 2;
+
+        private const ushort ExtendedBit = 0x4000;
+        private const ushort SkipWorktreeBit = 0x4000;
+        private const int PathLengthMask = 0xFFF;
+
+        // The End Of Index Entries extension (EOIE) is the last extension, and records where the extensions start
+        // (followed by a hash of the extension headers), so that the Index Entry Offset Table (IEOT) can be found
+        // without reading the entries
+        private const string EndOfIndexEntriesSignature = "EOIE";
+        private const int EndOfIndexEntriesLength = 8 + 4 + 20;
+        private const string EntryOffsetTableSignature = "IEOT";
+        private const uint EntryOffsetTableVersion = 1;
+        private const int ExtensionHeaderLength = 8;
+
+        private const ulong LowBitOfEachByte = 0x0101010101010101;
+        private const ulong HighBitOfEachByte = 0x8080808080808080;
+
+        private MemoryMappedFile indexMapping;
+        private MemoryMappedViewAccessor indexView;
+        private unsafe byte* indexStart;
+        private long indexLength;
+
+        /// <summary>
+        /// Maps the index in indexStream and reads its header.  indexStream must stay open until the GitIndexReader is
+        /// disposed, and is not closed by it.
+        /// </summary>
+        public GitIndexReader(FileStream indexStream)
+        {
+            this.indexLength = indexStream.Length;
+            if (this.indexLength < HeaderLength + ChecksumLength)
+            {
+                throw new EndOfStreamException("Unexpected end of stream while reading git index.");
+            }
+
+            this.indexMapping = MemoryMappedFile.CreateFromFile(
+                indexStream,
+                mapName: null,
+                capacity: 0,
+                access: MemoryMappedFileAccess.Read,
+                memoryMappedFileSecurity: null,
+                inheritability: HandleInheritability.None,
+                leaveOpen: true);
+            this.indexView = this.indexMapping.CreateViewAccessor(0, 0, MemoryMappedFileAccess.Read);
+
+            unsafe
+            {
+                byte* viewStart = null;
+                this.indexView.SafeMemoryMappedViewHandle.AcquirePointer(ref viewStart);
+                this.indexStart = viewStart + this.indexView.PointerOffset;
+
+                if (this.indexStart[0] != 'D' ||
+                    this.indexStart[1] != 'I' ||
+                    this.indexStart[2] != 'R' ||
+                    this.indexStart[3] != 'C')
+                {
+                    string signature = new string(new char[] { (char)this.indexStart[0], (char)this.indexStart[1], (char)this.indexStart[2], (char)this.indexStart[3] });
+                    this.Dispose();
+                    throw new InvalidDataException("Incorrect magic signature for index: " + signature);
+                }
+
+                this.Version = ReadUInt32(this.indexStart + 4);
+                this.EntryCount = ReadUInt32(this.indexStart + 8);
+            }
+
+            if (this.Version < 2 || this.Version > 4)
+            {
+                uint version = this.Version;
+                this.Dispose();
+                throw new InvalidDataException("Unsupported index version: " + version);
+            }
+        }
+
+        public uint Version { get; private set; }
+
+        public uint EntryCount { get; private set; }
+
+        /// <summary>
+        /// Returns the index of the first byte in buffer[startIndex] through buffer[startIndex + count - 1] that is value,
+        /// or -1 if none of them are
+        /// </summary>
+        public static int IndexOf(byte[] buffer, int startIndex, int count, byte value)
+        {
+            if (startIndex < 0 || count < 0 || startIndex > buffer.Length - count)
+            {
+                throw new ArgumentOutOfRangeException(nameof(count));
+            }
+
+            if (count == 0)
+            {
+                return -1;
+            }
+
+            unsafe
+            {
+                fixed (byte* start = &buffer[startIndex])
+                {
+                    int index = IndexOf(start, start + count, value);
+                    return index < 0 ? -1 : startIndex + index;
+                }
+            }
+        }
+
+        /// <summary>
+        /// Returns the blocks in the index's Index Entry Offset Table, or a single block of all the entries if the index
+        /// does not have a valid one.  Each block can be passed to ForEachEntry on its own thread.
+        /// </summary>
+        public List<GitIndexEntryBlock> GetEntryBlocks()
+        {
+            List<GitIndexEntryBlock> entryBlocks;
+            if (!this.TryReadEntryOffsetTable(out entryBlocks))
+            {
+                entryBlocks = new List<GitIndexEntryBlock>() { new GitIndexEntryBlock(HeaderLength, this.EntryCount) };
+            }
+
+            return entryBlocks;
+        }
+
+        /// <summary>
+        /// Decodes each entry in turn and passes it to visitEntry, stopping early if visitEntry returns false
+        /// </summary>
+        /// <returns>false if visitEntry stopped the read early, true otherwise</returns>
+        /// <exception cref="InvalidDataException">The index is corrupt</exception>
+        /// <exception cref="EndOfStreamException">The index has been truncated</exception>
+        public bool ForEachEntry(Func<GitIndexEntry, bool> visitEntry)
+        {
+            return this.ForEachEntry(new GitIndexEntryBlock(HeaderLength, this.EntryCount), visitEntry);
+        }
+
+        /// <summary>
+        /// Decodes each entry in entryBlock (from <see cref="GetEntryBlocks"/>) and passes it to visitEntry, stopping
+        /// early if visitEntry returns false.  Different blocks can be read at the same time on different threads.
+        /// </summary>
+        /// <returns>false if visitEntry stopped the read early, true otherwise</returns>
+        /// <exception cref="InvalidDataException">The index is corrupt</exception>
+        /// <exception cref="EndOfStreamException">The index has been truncated</exception>
+        public bool ForEachEntry(GitIndexEntryBlock entryBlock, Func<GitIndexEntry, bool> visitEntry)
+        {
+            GitIndexEntry entry = new GitIndexEntry();
+            long position = entryBlock.Offset;
+            for (uint i = 0; i < entryBlock.EntryCount; i++)
+            {
+                position = this.ReadEntry(entry, position, i);
+                if (!visitEntry(entry))
+                {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        /// <summary>
+        /// Decodes the entries one at a time, for callers that cannot be driven by ForEachEntry (e.g. to walk two
+        /// indexes side by side).  As with ForEachEntry, the same GitIndexEntry is returned for every entry.
+        /// </summary>
+        /// <exception cref="InvalidDataException">The index is corrupt</exception>
+        /// <exception cref="EndOfStreamException">The index has been truncated</exception>
+        public IEnumerable<GitIndexEntry> EnumerateEntries()
+        {
+            GitIndexEntry entry = new GitIndexEntry();
+            long position = HeaderLength;
+            for (uint i = 0; i < this.EntryCount; i++)
+            {
+                position = this.ReadEntry(entry, position, i);
+                yield return entry;
+            }
+        }
+
+        public void Dispose()
+        {
+            if (this.indexView != null)
+            {
+                unsafe
+                {
+                    if (this.indexStart != null)
+                    {
+                        this.indexView.SafeMemoryMappedViewHandle.ReleasePointer();
+                        this.indexStart = null;
+                    }
+                }
+
+                this.indexView.Dispose();
+                this.indexView = null;
+            }
+
+            if (this.indexMapping != null)
+            {
+                this.indexMapping.Dispose();
+                this.indexMapping = null;
+            }
+        }
+
+        private static unsafe bool HasSignature(byte* position, string signature)
+        {
+            for (int i = 0; i < signature.Length; i++)
+            {
+                if (position[i] != signature[i])
+                {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        private static unsafe ushort ReadUInt16(byte* position)
+        {
+            return (ushort)((position[0] << 8) | position[1]);
+        }
+
+        private static unsafe uint ReadUInt32(byte* position)
+        {
+            return ((uint)position[0] << 24) | ((uint)position[1] << 16) | ((uint)position[2] << 8) | position[3];
+        }
+
+        private static unsafe void EnsureAvailable(byte* position, byte* end, long count)
+        {
+            if (end - position < count)
+            {
+                throw new EndOfStreamException("Unexpected end of stream while reading git index.");
+            }
+        }
+
+        private static void EnsurePathFits(int pathLength, uint entryNumber)
+        {
+            if (pathLength >= GitIndexEntry.MaxPathBufferSize)
+            {
+                throw new InvalidDataException("Path too long in git index entry " + entryNumber);
+            }
+        }
+
+        /// <summary>
+        /// Reads the length of the previous path to replace (an offset encoded integer, see index-format.txt)
+        /// </summary>
+        private static unsafe int ReadReplaceLength(ref byte* position, byte* end)
+        {
+            EnsureAvailable(position, end, 1);
+            int headerByte = *position++;
+            int offset = headerByte & 0x7f;
+
+            // Terminate the loop when the high bit is no longer set.
+            while ((headerByte & 0x80) != 0)
+            {
+                EnsureAvailable(position, end, 1);
+                headerByte = *position++;
+
+                offset += 1;
+                offset = (offset << 7) + (headerByte & 0x7f);
+            }
+
+            return offset;
+        }
+
+        /// <summary>
+        /// Returns the offset of the first byte from start up to (but not including) end that is value, or -1
+        /// </summary>
+        private static unsafe int IndexOf(byte* start, byte* end, byte value)
+        {
+            // A byte of word is zero exactly when that byte matched value.  (word - LowBitOfEachByte) & ~word sets the high
+            // bit of the lowest zero byte, and can only set false positives in the bytes above it.
+            ulong pattern = LowBitOfEachByte * value;
+            byte* position = start;
+            while (end - position >= sizeof(ulong))
+            {
+                ulong word = *(ulong*)position ^ pattern;
+                ulong matches = (word - LowBitOfEachByte) & ~word & HighBitOfEachByte;
+                if (matches != 0)
+                {
+                    return (int)(position - start) + IndexOfLowestNonZeroByte(matches);
+                }
+
+                position += sizeof(ulong);
+            }
+
+            for (; position < end; position++)
+            {
+                if (*position == value)
+                {
+                    return (int)(position - start);
+                }
+            }
+
+            return -1;
+        }
+
+        private static unsafe int CommonPrefixLength(byte* first, byte* second, int maxLength)
+        {
+            int index = 0;
+            while (maxLength - index >= sizeof(ulong))
+            {
+                ulong differences = *(ulong*)(first + index) ^ *(ulong*)(second + index);
+                if (differences != 0)
+                {
+                    return index + IndexOfLowestNonZeroByte(differences);
+                }
+
+                index += sizeof(ulong);
+            }
+
+            while (index < maxLength && first[index] == second[index])
+            {
+                index++;
+            }
+
+            return index;
+        }
+
+        /// <summary>
+        /// The index (in memory order, which is little-endian on every platform GVFS runs on) of the first non-zero
+        /// byte in value, which must not be 0
+        /// </summary>
+        private static int IndexOfLowestNonZeroByte(ulong value)
+        {
+            int index = 0;
+            while ((value & 0xFF) == 0)
+            {
+                value >>= 8;
+                index++;
+            }
+
+            return index;
+        }
+
+        /// <summary>
+        /// Decodes the entry at offset into entry, and returns the offset of the entry after it
+        /// </summary>
+        /// <param name="entryNumber">Number of the entry in its block.  The first entry of a block (0) does not share
+        /// a prefix with the entry before it.</param>
+        private unsafe long ReadEntry(GitIndexEntry entry, long offset, uint entryNumber)
+        {
+            fixed (byte* pathBuffer = entry.PathBuffer)
+            {
+                // Entries are followed by extensions (if any) and the checksum
+                byte* entriesEnd = this.indexStart + this.indexLength - ChecksumLength;
+                byte* position = this.indexStart + offset;
+                int previousPathLength = entryNumber == 0 ? 0 : entry.PathLength;
+
+                byte* entryStart = position;
+                EnsureAvailable(position, entriesEnd, BaseEntryLength);
+
+                ushort flags = ReadUInt16(entryStart + FlagsOffset);
+                position += BaseEntryLength;
+
+                bool skipWorktree = false;
+                if ((flags & ExtendedBit) == ExtendedBit && this.Version > 2)
+                {
+                    EnsureAvailable(position, entriesEnd, ExtendedFlagsLength);
+                    ushort extendedFlags = ReadUInt16(position);
+                    skipWorktree = (extendedFlags & SkipWorktreeBit) == SkipWorktreeBit;
+                    position += ExtendedFlagsLength;
+                }
+
+                int pathLength;
+                int replaceIndex;
+                if (this.Version == 4)
+                {
+                    // The path is the previous entry's path, less its last replaceLength bytes, followed by a
+                    // NUL terminated suffix.  The length in flags is capped at 0xFFF, so the NUL is what ends it.
+                    // As in git, the first entry of a block does not share a prefix with the entry before it,
+                    // whatever its replace length says
+                    int replaceLength = ReadReplaceLength(ref position, entriesEnd);
+                    replaceIndex = entryNumber == 0 ? 0 : previousPathLength - replaceLength;
+                    if (replaceIndex < 0)
+                    {
+                        throw new InvalidDataException("Invalid path prefix length in git index entry " + entryNumber);
+                    }
+
+                    int suffixLength = IndexOf(position, entriesEnd, 0);
+                    if (suffixLength < 0)
+                    {
+                        throw new EndOfStreamException("Unexpected end of stream while reading git index.");
+                    }
+
+                    pathLength = replaceIndex + suffixLength;
+                    EnsurePathFits(pathLength, entryNumber);
+                    Buffer.MemoryCopy(position, pathBuffer + replaceIndex, GitIndexEntry.MaxPathBufferSize - replaceIndex, suffixLength);
+                    position += suffixLength + 1;
+                }
+                else
+                {
+                    pathLength = flags & PathLengthMask;
+                    if (pathLength == PathLengthMask)
+                    {
+                        pathLength = IndexOf(position, entriesEnd, 0);
+                        if (pathLength < 0)
+                        {
+                            throw new EndOfStreamException("Unexpected end of stream while reading git index.");
+                        }
+                    }
+
+                    EnsurePathFits(pathLength, entryNumber);
+
+                    // 1 - 8 NUL bytes pad the entry to a multiple of eight bytes
+                    long entryLength = (position - entryStart) + pathLength;
+                    long paddedEntryLength = (entryLength + 8) & ~7L;
+                    EnsureAvailable(entryStart, entriesEnd, paddedEntryLength);
+
+                    // v2 and v3 paths are not prefix compressed, but sorted paths share long prefixes, and
+                    // callers use ReplaceIndex to skip re-parsing them (e.g. when an entry is in the same folder
+                    // as the one before it)
+                    replaceIndex = CommonPrefixLength(pathBuffer, position, Math.Min(previousPathLength, pathLength));
+                    Buffer.MemoryCopy(position + replaceIndex, pathBuffer + replaceIndex, GitIndexEntry.MaxPathBufferSize - replaceIndex, pathLength - replaceIndex);
+                    position = entryStart + paddedEntryLength;
+                }
+
+                pathBuffer[pathLength] = 0;
+                entry.Update(entryStart - this.indexStart, (IntPtr)entryStart, flags, skipWorktree, pathLength, replaceIndex);
+                return position - this.indexStart;
+            }
+        }
+
+        private unsafe bool TryReadEntryOffsetTable(out List<GitIndexEntryBlock> entryBlocks)
+        {
+            entryBlocks = null;
+
+            long endOfEntriesOffset = this.indexLength - ChecksumLength - EndOfIndexEntriesLength;
+            if (endOfEntriesOffset < HeaderLength)
+            {
+                return false;
+            }
+
+            byte* endOfEntries = this.indexStart + endOfEntriesOffset;
+            if (!HasSignature(endOfEntries, EndOfIndexEntriesSignature) ||
+                ReadUInt32(endOfEntries + 4) != EndOfIndexEntriesLength - ExtensionHeaderLength)
+            {
+                return false;
+            }
+
+            long extensionsOffset = ReadUInt32(endOfEntries + ExtensionHeaderLength);
+            if (extensionsOffset < HeaderLength || extensionsOffset > endOfEntriesOffset)
+            {
+                return false;
+            }
+
+            // The EOIE hash covers the header (signature and size) of every extension before it, which also checks
+            // that the extensions offset really is where the extensions start
+            byte* entryOffsetTable = null;
+            uint entryOffsetTableLength = 0;
+            byte[] extensionHeader = new byte[ExtensionHeaderLength];
+            byte[] hash;
+            using (SHA1 extensionsHash = SHA1.Create())
+            {
+                long extensionOffset = extensionsOffset;
+                while (extensionOffset < endOfEntriesOffset)
+                {
+                    if (endOfEntriesOffset - extensionOffset < ExtensionHeaderLength)
+                    {
+                        return false;
+                    }
+
+                    byte* extension = this.indexStart + extensionOffset;
+                    uint extensionLength = ReadUInt32(extension + 4);
+                    if (HasSignature(extension, EntryOffsetTableSignature))
+                    {
+                        entryOffsetTable = extension + ExtensionHeaderLength;
+                        entryOffsetTableLength = extensionLength;
+                    }
+
+                    for (int i = 0; i < ExtensionHeaderLength; i++)
+                    {
+                        extensionHeader[i] = extension[i];
+                    }
+
+                    extensionsHash.TransformBlock(extensionHeader, 0, ExtensionHeaderLength, null, 0);
+                    extensionOffset += ExtensionHeaderLength + extensionLength;
+                }
+
+                extensionsHash.TransformFinalBlock(extensionHeader, 0, 0);
+                if (extensionOffset != endOfEntriesOffset)
+                {
+                    return false;
+                }
+
+                hash = extensionsHash.Hash;
+            }
+
+            for (int i = 0; i < hash.Length; i++)
+            {
+                if (hash[i] != endOfEntries[ExtensionHeaderLength + 4 + i])
+                {
+                    return false;
+                }
+            }
+
+            // IEOT is a version followed by an (offset, entry count) pair for each block
+            if (entryOffsetTable == null ||
+                entryOffsetTableLength < 4 ||
+                (entryOffsetTableLength - 4) % 8 != 0 ||
+                ReadUInt32(entryOffsetTable) != EntryOffsetTableVersion)
+            {
+                return false;
+            }
+
+            List<GitIndexEntryBlock> blocks = new List<GitIndexEntryBlock>();
+            long previousBlockOffset = 0;
+            long totalEntryCount = 0;
+            for (byte* blockData = entryOffsetTable + 4; blockData < entryOffsetTable + entryOffsetTableLength; blockData += 8)
+            {
+                GitIndexEntryBlock block = new GitIndexEntryBlock(ReadUInt32(blockData), ReadUInt32(blockData + 4));
+                if (block.Offset <= previousBlockOffset || block.Offset >= extensionsOffset)
+                {
+                    return false;
+                }
+
+                blocks.Add(block);
+                previousBlockOffset = block.Offset;
+                totalEntryCount += block.EntryCount;
+            }
+
+            if (blocks.Count == 0 || blocks[0].Offset != HeaderLength || totalEntryCount != this.EntryCount)
+            {
+                return false;
+            }
+
+            entryBlocks = blocks;
+            return true;
+        }
+    }
+}
@@ -313,9 +313,15 @@ namespace GVFS.Common.Git
             return true;
         }
 
-        public virtual GitProcess.Result IndexTempPackFile(string tempPackPath)
+        public GitProcess.Result IndexTempPackFile(string tempPackPath)
         {
-            string packfilePath = GetRandomPackName(this.Enlistment.GitPackRoot);
+            string packfilePath;
+            return this.IndexTempPackFile(tempPackPath, out packfilePath);
+        }
+
+        public virtual GitProcess.Result IndexTempPackFile(string tempPackPath, out string packfilePath)
+        {
+            packfilePath = GetRandomPackName(this.Enlistment.GitPackRoot);
 
             Exception moveFileException = null;
             try
@@ -447,6 +453,79 @@ namespace GVFS.Common.Git
             return new string[0];
         }
 
+        /// <summary>
+        /// Saves the loose object, batched loose objects or pack in responseData
+        /// </summary>
+        /// <param name="overwriteExistingObjects">true to overwrite loose objects for objectShas that are already on disk</param>
+        /// <param name="savedObjects">
+        /// If not null, each of objectShas that was written as a loose object, or that is in the saved pack's index, is
+        /// added to savedObjects.  Objects are not added when unpackObjects is true.
+        /// </param>
+        protected RetryWrapper<GitObjectsHttpRequestor.GitObjectTaskResult>.CallbackResult TrySavePackOrLooseObject(
+            IEnumerable<string> objectShas,
+            bool unpackObjects,
+            GitEndPointResponseData responseData,
+            bool overwriteExistingObjects = false,
+            HashSet<string> savedObjects = null)
+        {
+            HashSet<string> requestedObjects = new HashSet<string>(objectShas, StringComparer.OrdinalIgnoreCase);
+            if (responseData.ContentType == GitObjectContentType.LooseObject)
+            {
+                if (requestedObjects.Count != 1)
+                {
+                    return new RetryWrapper<GitObjectsHttpRequestor.GitObjectTaskResult>.CallbackResult(new InvalidOperationException("Received loose object when multiple objects were requested."), shouldRetry: false);
+                }
+
+                // To reduce allocations, reuse the same buffer when writing objects in this batch
+                byte[] bufToCopyWith = new byte[StreamUtil.DefaultCopyBufferSize];
+
+                string objectSha = requestedObjects.Single();
+                this.WriteLooseObject(responseData.Stream, objectSha, overwriteExistingObject: overwriteExistingObjects, bufToCopyWith: bufToCopyWith);
+                savedObjects?.Add(objectSha);
+            }
+            else if (responseData.ContentType == GitObjectContentType.BatchedLooseObjects)
+            {
+                // To reduce allocations, reuse the same buffer when writing objects in this batch
+                byte[] bufToCopyWith = new byte[StreamUtil.DefaultCopyBufferSize];
+
+                BatchedLooseObjectDeserializer deserializer = new BatchedLooseObjectDeserializer(
+                    responseData.Stream,
+                    (stream, sha) =>
+                    {
+                        // Objects that were not requested are saved, but only existing copies of requested objects are overwritten
+                        bool isRequested = requestedObjects.Contains(sha);
+                        this.WriteLooseObject(stream, sha, overwriteExistingObject: overwriteExistingObjects && isRequested, bufToCopyWith: bufToCopyWith);
+                        if (isRequested)
+                        {
+                            savedObjects?.Add(sha);
+                        }
+                    });
+                deserializer.ProcessObjects();
+            }
+            else
+            {
+                string packfilePath;
+                GitProcess.Result result = this.TryAddPackFile(responseData.Stream, unpackObjects, out packfilePath);
+                if (result.HasErrors)
+                {
+                    return new RetryWrapper<GitObjectsHttpRequestor.GitObjectTaskResult>.CallbackResult(new InvalidOperationException("Could not add pack file: " + result.Errors), shouldRetry: false);
+                }
+
+                if (savedObjects != null && packfilePath != null)
+                {
+                    // A requested object that is not in the new pack has not been saved, even if there is already a copy
+                    // of it on disk (which could be corrupt)
+                    string idxPath = Path.ChangeExtension(packfilePath, ".idx");
+                    using (Stream idxStream = this.fileSystem.OpenFileStream(idxPath, FileMode.Open, FileAccess.Read, FileShare.Read, callFlushFileBuffers: false))
+                    {
+                        savedObjects.UnionWith(GitPackIndex.GetShas(idxStream).Where(requestedObjects.Contains));
+                    }
+                }
+            }
+
+            return new RetryWrapper<GitObjectsHttpRequestor.GitObjectTaskResult>.CallbackResult(new GitObjectsHttpRequestor.GitObjectTaskResult(true));
+        }
+
         private static string GetRandomPackName(string packRoot)
         {
             string packName = "pack-" + Guid.NewGuid().ToString("N") + ".pack";
@@ -889,46 +968,10 @@ namespace GVFS.Common.Git
             }
         }
 
-        private RetryWrapper<GitObjectsHttpRequestor.GitObjectTaskResult>.CallbackResult TrySavePackOrLooseObject(IEnumerable<string> objectShas, bool unpackObjects, GitEndPointResponseData responseData)
-        {
-            if (responseData.ContentType == GitObjectContentType.LooseObject)
-            {
-                List<string> objectShaList = objectShas.Distinct().ToList();
-                if (objectShaList.Count != 1)
-                {
-                    return new RetryWrapper<GitObjectsHttpRequestor.GitObjectTaskResult>.CallbackResult(new InvalidOperationException("Received loose object when multiple objects were requested."), shouldRetry: false);
-                }
-
-                // To reduce allocations, reuse the same buffer when writing objects in this batch
-                byte[] bufToCopyWith = new byte[StreamUtil.DefaultCopyBufferSize];
-
-                this.WriteLooseObject(responseData.Stream, objectShaList[0], overwriteExistingObject: false, bufToCopyWith: bufToCopyWith);
-            }
-            else if (responseData.ContentType == GitObjectContentType.BatchedLooseObjects)
-            {
-                // To reduce allocations, reuse the same buffer when writing objects in this batch
-                byte[] bufToCopyWith = new byte[StreamUtil.DefaultCopyBufferSize];
-
-                BatchedLooseObjectDeserializer deserializer = new BatchedLooseObjectDeserializer(
-                    responseData.Stream,
-                    (stream, sha) => this.WriteLooseObject(stream, sha, overwriteExistingObject: false, bufToCopyWith: bufToCopyWith));
-                deserializer.ProcessObjects();
-            }
-            else
-            {
-                GitProcess.Result result = this.TryAddPackFile(responseData.Stream, unpackObjects);
-                if (result.HasErrors)
-                {
-                    return new RetryWrapper<GitObjectsHttpRequestor.GitObjectTaskResult>.CallbackResult(new InvalidOperationException("Could not add pack file: " + result.Errors), shouldRetry: false);
-                }
-            }
-
-            return new RetryWrapper<GitObjectsHttpRequestor.GitObjectTaskResult>.CallbackResult(new GitObjectsHttpRequestor.GitObjectTaskResult(true));
-        }
-
-        private GitProcess.Result TryAddPackFile(Stream contents, bool unpackObjects)
+        private GitProcess.Result TryAddPackFile(Stream contents, bool unpackObjects, out string packfilePath)
         {
             GitProcess.Result result;
+            packfilePath = null;
 
             this.fileSystem.CreateDirectory(this.Enlistment.GitPackRoot);
 
@@ -939,7 +982,7 @@ namespace GVFS.Common.Git
             else
             {
                 string tempPackPath = this.WriteTempPackFile(contents);
-                return this.IndexTempPackFile(tempPackPath);
+                return this.IndexTempPackFile(tempPackPath, out packfilePath);
             }
 
             return result;
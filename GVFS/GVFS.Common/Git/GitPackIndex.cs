@@ -1,26 +1,27 @@
 ﻿using System;
 using System.Collections.Generic;
 using System.IO;
-using System.Linq;
 
-namespace FastFetch.Git
+namespace GVFS.Common.Git
 {
     public class GitPackIndex
     {
         private const uint PackIndexSignature = 0xff744f63;
         private const int Sha1ByteLength = 20;
 
-        public static IEnumerable<string> GetShas(string filePath)
+        /// <summary>
+        /// Returns the SHAs of the objects in the (version 2) pack index that is read from stream
+        /// </summary>
+        public static IEnumerable<string> GetShas(Stream stream)
         {
-            using (FileStream stream = File.OpenRead(filePath))
-            using (BigEndianReader binReader = new BigEndianReader(stream))
+            using (BinaryReader binReader = new BinaryReader(stream))
             {
                 VerifyHeader(binReader);
 
                 // Fanout table has 256 4-byte buckets corresponding to the number of objects prefixed by the bucket number
                 // Number is cumulative, so the total is always the last bucket value.
                 stream.Position += 255 * sizeof(uint);
-                uint totalObjects = binReader.ReadUInt32();
+                uint totalObjects = ReadBigEndianUInt32(binReader);
                 for (int i = 0; i < totalObjects; ++i)
                 {
                     yield return BitConverter.ToString(binReader.ReadBytes(Sha1ByteLength)).Replace("-", string.Empty);
@@ -30,17 +31,28 @@ namespace FastFetch.Git
 
         private static void VerifyHeader(BinaryReader binReader)
         {
-            uint signature = binReader.ReadUInt32();
+            uint signature = ReadBigEndianUInt32(binReader);
             if (signature != PackIndexSignature)
             {
                 throw new InvalidDataException("Bad pack header");
             }
 
-            uint version = binReader.ReadUInt32();
+            uint version = ReadBigEndianUInt32(binReader);
             if (version != 2)
             {
                 throw new InvalidDataException("Unsupported pack index version");
             }
         }
+
+        private static uint ReadBigEndianUInt32(BinaryReader binReader)
+        {
+            byte[] bytes = binReader.ReadBytes(sizeof(uint));
+            if (bytes.Length != sizeof(uint))
+            {
+                throw new EndOfStreamException();
+            }
+
+            return ((uint)bytes[0] << 24) | ((uint)bytes[1] << 16) | ((uint)bytes[2] << 8) | bytes[3];
+        }
     }
-}
\ No newline at end of file
+}
@@ -86,6 +86,22 @@ namespace GVFS.Common.Git
             return output;
         }
 
+        /// <returns>The SHAs of the commit's parents, or null if commitSha is not a commit that is available locally</returns>
+        public virtual string[] GetCommitParentShas(string commitSha)
+        {
+            string[] output = null;
+            this.libgit2RepoPool.TryInvoke(repo => repo.GetCommitParentShas(commitSha), out output);
+            return output;
+        }
+
+        /// <returns>The SHAs of the tree's entries, or null if treeSha is not a tree that is available locally</returns>
+        public virtual string[] GetTreeEntryShas(string treeSha)
+        {
+            string[] output = null;
+            this.libgit2RepoPool.TryInvoke(repo => repo.GetTreeEntryShas(treeSha), out output);
+            return output;
+        }
+
         public virtual bool ObjectExists(string blobSha)
         {
             bool output = false;
@@ -1,6 +1,7 @@
 ﻿using GVFS.Common.Tracing;
 using Microsoft.Win32.SafeHandles;
 using System;
+using System.Collections.Generic;
 using System.IO;
 using System.Runtime.InteropServices;
 
@@ -103,6 +104,74 @@ namespace GVFS.Common.Git
             return this.ObjectExists(treeSha.ToString());
         }
 
+        /// <returns>The SHAs of the commit's parents, or null if sha is not a commit that exists locally</returns>
+        public virtual string[] GetCommitParentShas(string sha)
+        {
+            IntPtr objHandle;
+            if (Native.RevParseSingle(out objHandle, this.RepoHandle, sha) != Native.SuccessCode)
+            {
+                return null;
+            }
+
+            try
+            {
+                if (Native.Object.GetType(objHandle) != Native.ObjectTypes.Commit)
+                {
+                    return null;
+                }
+
+                string[] parentShas = new string[Native.Commit.GetParentCount(objHandle)];
+                for (uint i = 0; i < parentShas.Length; ++i)
+                {
+                    parentShas[i] = Native.IntPtrToGitOid(Native.Commit.GetParentId(objHandle, i)).ToString();
+                }
+
+                return parentShas;
+            }
+            finally
+            {
+                Native.Object.Free(objHandle);
+            }
+        }
+
+        /// <returns>
+        /// The SHAs of the trees and blobs in the tree (submodule commits are skipped), or null if sha is
+        /// not a tree that exists locally
+        /// </returns>
+        public virtual string[] GetTreeEntryShas(string sha)
+        {
+            IntPtr objHandle;
+            if (Native.RevParseSingle(out objHandle, this.RepoHandle, sha) != Native.SuccessCode)
+            {
+                return null;
+            }
+
+            try
+            {
+                if (Native.Object.GetType(objHandle) != Native.ObjectTypes.Tree)
+                {
+                    return null;
+                }
+
+                ulong entryCount = Native.Tree.GetEntryCount(objHandle).ToUInt64();
+                List<string> entryShas = new List<string>((int)entryCount);
+                for (ulong i = 0; i < entryCount; ++i)
+                {
+                    IntPtr entryHandle = Native.Tree.GetEntryByIndex(objHandle, new UIntPtr(i));
+                    if (Native.Tree.GetEntryType(entryHandle) != Native.ObjectTypes.Commit)
+                    {
+                        entryShas.Add(Native.IntPtrToGitOid(Native.Tree.GetEntryId(entryHandle)).ToString());
+                    }
+                }
+
+                return entryShas.ToArray();
+            }
+            finally
+            {
+                Native.Object.Free(objHandle);
+            }
+        }
+
         public virtual bool ObjectExists(string sha)
         {
             IntPtr objHandle;
@@ -288,6 +357,30 @@ namespace GVFS.Common.Git
                 /// <returns>A handle to an oid owned by LibGit2</returns>
                 [DllImport(Git2DllName, EntryPoint = "git_commit_tree_id")]
                 public static extern IntPtr GetTreeId(IntPtr commitHandle);
+
+                [DllImport(Git2DllName, EntryPoint = "git_commit_parentcount")]
+                public static extern uint GetParentCount(IntPtr commitHandle);
+
+                /// <returns>A handle to an oid owned by LibGit2</returns>
+                [DllImport(Git2DllName, EntryPoint = "git_commit_parent_id")]
+                public static extern IntPtr GetParentId(IntPtr commitHandle, uint n);
+            }
+
+            public static class Tree
+            {
+                [DllImport(Git2DllName, EntryPoint = "git_tree_entrycount")]
+                public static extern UIntPtr GetEntryCount(IntPtr treeHandle);
+
+                /// <returns>A handle to a tree entry owned by the tree</returns>
+                [DllImport(Git2DllName, EntryPoint = "git_tree_entry_byindex")]
+                public static extern IntPtr GetEntryByIndex(IntPtr treeHandle, UIntPtr index);
+
+                /// <returns>A handle to an oid owned by LibGit2</returns>
+                [DllImport(Git2DllName, EntryPoint = "git_tree_entry_id")]
+                public static extern IntPtr GetEntryId(IntPtr entryHandle);
+
+                [DllImport(Git2DllName, EntryPoint = "git_tree_entry_type")]
+                public static extern ObjectTypes GetEntryType(IntPtr entryHandle);
             }
 
             public static class Blob
@@ -0,0 +1,496 @@
+﻿using GVFS.Common.Tracing;
+using Microsoft.Diagnostics.Tracing;
+using System;
+using System.Collections.Concurrent;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Linq;
+using System.Threading;
+
+namespace GVFS.Common.Git
+{
+    /// <summary>
+    /// Watches the objects that git asks the mount for (through GVFS.ReadObjectHook) and, once those requests look
+    /// like a walk of a tree's entries or of a commit's ancestors, downloads the objects that git is likely to ask
+    /// for next using batched requests.
+    /// </summary>
+    /// <remarks>
+    /// Speculative downloads have their own budget (bytes per second), are issued one batch at a time, and wait
+    /// while several demand downloads are in flight, so that they do not delay the objects that git is waiting for.
+    /// A batch that is still waiting for a connection or for the server when the demand downloads start is cancelled,
+    /// and its objects are downloaded again later.
+    /// </remarks>
+    public class SpeculativeObjectPrefetcher : IDisposable
+    {
+        private const string EtwArea = nameof(SpeculativeObjectPrefetcher);
+
+        private const int MaxBatchSize = 64;
+        private const int MaxQueuedObjects = 4096;
+        private const int MaxTrackedTrees = 64;
+        private const int MaxPredictedObjects = 16384;
+        private const int MaxDemandDownloadsBeforeYielding = 4;
+
+        // The size of a batch is limited to the budget divided by the average size of the objects downloaded so
+        // far (and by this estimate until the first batch has been downloaded)
+        private const long InitialBytesPerObjectEstimate = 8 * 1024;
+
+        // Number of a tree's entries that git must ask for before the rest of the tree is downloaded
+        private const int EntryRequestsBeforeTreePrefetch = 2;
+
+        // Number of consecutive parent commits that git must ask for before ancestors are downloaded, and
+        // how many generations ahead of the last commit that git asked for to download
+        private const int CommitRequestsBeforeAncestorPrefetch = 2;
+        private const int AncestorPrefetchDepth = 16;
+
+        private static readonly TimeSpan YieldInterval = TimeSpan.FromMilliseconds(20);
+
+        private readonly ITracer tracer;
+        private readonly GitRepo repo;
+        private readonly GVFSGitObjects gitObjects;
+        private readonly long bytesPerSecond;
+
+        private readonly BlockingCollection<string> completedDemandRequests = new BlockingCollection<string>();
+        private readonly CancellationTokenSource stopping = new CancellationTokenSource();
+
+        private readonly object batchCancellationLock = new object();
+
+        // Every object that has been queued for speculative download.  Demand requests for these objects are
+        // counted as predicted.
+        private readonly ConcurrentDictionary<string, bool> predictedObjects = new ConcurrentDictionary<string, bool>(StringComparer.OrdinalIgnoreCase);
+
+        // The remaining fields are only used by the thread that calls ProcessPendingWork
+        private readonly Dictionary<string, TreeWalk> treeWalksByEntry = new Dictionary<string, TreeWalk>(StringComparer.OrdinalIgnoreCase);
+        private readonly Queue<TreeWalk> trackedTrees = new Queue<TreeWalk>();
+        private readonly Stopwatch budgetTimer = Stopwatch.StartNew();
+        private Queue<PredictedObject> speculativeQueue = new Queue<PredictedObject>();
+        private HashSet<string> commitWalkNextShas = new HashSet<string>(StringComparer.OrdinalIgnoreCase);
+        private int commitWalkLength;
+        private double budgetBytes;
+        private TimeSpan budgetUpdateTime;
+
+        private int activeDemandDownloads;
+        private long predictedDemandRequests;
+        private long unpredictedDemandRequests;
+        private long speculativeBatches;
+        private long speculativeObjectsQueued;
+        private long speculativeObjectsDownloaded;
+        private long speculativeBytesDownloaded;
+        private long speculativeObjectsCancelled;
+        private long speculativeObjectsFailed;
+        private long speculativeObjectsAlreadyLocal;
+        private long speculativeObjectsDropped;
+
+        // Cancels the batch that is being downloaded (if any) when the demand downloads start.  Guarded by
+        // batchCancellationLock.
+        private CancellationTokenSource batchCancellation;
+
+        private Thread workerThread;
+
+        public SpeculativeObjectPrefetcher(ITracer tracer, GitRepo repo, GVFSGitObjects gitObjects, long bytesPerSecond)
+        {
+            this.tracer = tracer;
+            this.repo = repo;
+            this.gitObjects = gitObjects;
+            this.bytesPerSecond = bytesPerSecond;
+            this.budgetBytes = bytesPerSecond;
+        }
+
+        private enum PredictedObjectKind
+        {
+            Unknown,
+            Commit,
+        }
+
+        public void Start()
+        {
+            this.workerThread = new Thread(this.ProcessPendingWorkUntilStopped);
+            this.workerThread.IsBackground = true;
+            this.workerThread.Name = EtwArea;
+            this.workerThread.Start();
+        }
+
+        public void Stop()
+        {
+            this.stopping.Cancel();
+            this.completedDemandRequests.CompleteAdding();
+            this.workerThread?.Join();
+            this.workerThread = null;
+        }
+
+        /// <summary>
+        /// Called when a demand request (i.e. one that git is waiting for) for objectSha starts downloading
+        /// </summary>
+        public void OnDemandDownloadStarted(string objectSha)
+        {
+            if (Interlocked.Increment(ref this.activeDemandDownloads) >= MaxDemandDownloadsBeforeYielding)
+            {
+                lock (this.batchCancellationLock)
+                {
+                    this.batchCancellation?.Cancel();
+                }
+            }
+
+            if (this.predictedObjects.ContainsKey(objectSha))
+            {
+                Interlocked.Increment(ref this.predictedDemandRequests);
+            }
+            else
+            {
+                Interlocked.Increment(ref this.unpredictedDemandRequests);
+            }
+        }
+
+        public void OnDemandDownloadCompleted(string objectSha, bool succeeded)
+        {
+            Interlocked.Decrement(ref this.activeDemandDownloads);
+            if (succeeded && !this.completedDemandRequests.IsAddingCompleted)
+            {
+                try
+                {
+                    this.completedDemandRequests.Add(objectSha);
+                }
+                catch (InvalidOperationException)
+                {
+                    // Stop was called after the IsAddingCompleted check
+                }
+            }
+        }
+
+        /// <summary>
+        /// Hit rates and download counts for telemetry.  PredictedDemandRequests counts the demand requests for
+        /// objects that had already been predicted (but not yet downloaded), and so a high ratio of
+        /// PredictedDemandRequests to UnpredictedDemandRequests means that the predictions are good but the
+        /// budget is too small for them to arrive in time.
+        /// </summary>
+        public EventMetadata GetStatistics()
+        {
+            EventMetadata metadata = new EventMetadata();
+            metadata.Add("Area", EtwArea);
+            metadata.Add("BytesPerSecond", this.bytesPerSecond);
+            metadata.Add("PredictedDemandRequests", Interlocked.Read(ref this.predictedDemandRequests));
+            metadata.Add("UnpredictedDemandRequests", Interlocked.Read(ref this.unpredictedDemandRequests));
+            metadata.Add("SpeculativeBatches", Interlocked.Read(ref this.speculativeBatches));
+            metadata.Add("SpeculativeObjectsQueued", Interlocked.Read(ref this.speculativeObjectsQueued));
+            metadata.Add("SpeculativeObjectsDownloaded", Interlocked.Read(ref this.speculativeObjectsDownloaded));
+            metadata.Add("SpeculativeBytesDownloaded", Interlocked.Read(ref this.speculativeBytesDownloaded));
+            metadata.Add("SpeculativeObjectsCancelled", Interlocked.Read(ref this.speculativeObjectsCancelled));
+            metadata.Add("SpeculativeObjectsFailed", Interlocked.Read(ref this.speculativeObjectsFailed));
+            metadata.Add("SpeculativeObjectsAlreadyLocal", Interlocked.Read(ref this.speculativeObjectsAlreadyLocal));
+            metadata.Add("SpeculativeObjectsDropped", Interlocked.Read(ref this.speculativeObjectsDropped));
+            return metadata;
+        }
+
+        /// <summary>
+        /// Analyzes the demand requests that have completed since the last call, and then downloads the next batch
+        /// of predicted objects if the budget allows.
+        /// </summary>
+        /// <returns>True if a batch was downloaded (or was cancelled by demand downloads)</returns>
+        /// <remarks>Called repeatedly by the thread created in Start (and directly by unit tests)</remarks>
+        public bool ProcessPendingWork()
+        {
+            string objectSha;
+            while (this.completedDemandRequests.TryTake(out objectSha))
+            {
+                this.AnalyzeDemandRequest(objectSha);
+            }
+
+            if (this.speculativeQueue.Count == 0 ||
+                Volatile.Read(ref this.activeDemandDownloads) >= MaxDemandDownloadsBeforeYielding)
+            {
+                return false;
+            }
+
+            // A batch can overspend the budget (the size of the objects is not known until they are downloaded), in
+            // which case no more batches are downloaded until the budget has refilled
+            this.RefillBudget();
+            if (this.budgetBytes <= 0)
+            {
+                return false;
+            }
+
+            List<PredictedObject> batch = new List<PredictedObject>();
+            int maxBatchSize = this.GetMaxBatchSize();
+            while (this.speculativeQueue.Count > 0 && batch.Count < maxBatchSize)
+            {
+                PredictedObject predicted = this.speculativeQueue.Dequeue();
+                if (this.repo.ObjectExists(predicted.Sha))
+                {
+                    Interlocked.Increment(ref this.speculativeObjectsAlreadyLocal);
+                }
+                else
+                {
+                    batch.Add(predicted);
+                }
+            }
+
+            if (batch.Count == 0)
+            {
+                return false;
+            }
+
+            this.DownloadBatch(batch);
+            return true;
+        }
+
+        public void Dispose()
+        {
+            this.Stop();
+            this.completedDemandRequests.Dispose();
+            this.stopping.Dispose();
+        }
+
+        private void ProcessPendingWorkUntilStopped()
+        {
+            try
+            {
+                while (!this.stopping.IsCancellationRequested)
+                {
+                    if (this.ProcessPendingWork())
+                    {
+                        continue;
+                    }
+
+                    // Nothing could be downloaded, so wait for more demand requests (or, if objects are queued, for the
+                    // budget to refill and demand downloads to finish)
+                    string objectSha;
+                    int timeoutMs = this.speculativeQueue.Count == 0 ? Timeout.Infinite : (int)YieldInterval.TotalMilliseconds;
+                    if (this.completedDemandRequests.TryTake(out objectSha, timeoutMs, this.stopping.Token))
+                    {
+                        this.AnalyzeDemandRequest(objectSha);
+                    }
+                }
+            }
+            catch (OperationCanceledException)
+            {
+            }
+            catch (Exception e)
+            {
+                EventMetadata metadata = new EventMetadata();
+                metadata.Add("Area", EtwArea);
+                metadata.Add("Exception", e.ToString());
+                this.tracer.RelatedError(metadata, nameof(this.ProcessPendingWorkUntilStopped) + ": Unhandled exception, speculative prefetching stopped");
+            }
+        }
+
+        private void RefillBudget()
+        {
+            TimeSpan now = this.budgetTimer.Elapsed;
+            this.budgetBytes = Math.Min(
+                this.bytesPerSecond,
+                this.budgetBytes + ((now - this.budgetUpdateTime).TotalSeconds * this.bytesPerSecond));
+            this.budgetUpdateTime = now;
+        }
+
+        private int GetMaxBatchSize()
+        {
+            long objectsDownloaded = Interlocked.Read(ref this.speculativeObjectsDownloaded);
+            double bytesPerObject = objectsDownloaded == 0 ?
+                InitialBytesPerObjectEstimate :
+                Math.Max(1, (double)Interlocked.Read(ref this.speculativeBytesDownloaded) / objectsDownloaded);
+
+            return (int)Math.Max(1, Math.Min(MaxBatchSize, this.budgetBytes / bytesPerObject));
+        }
+
+        private void AnalyzeDemandRequest(string objectSha)
+        {
+            // Sibling requests: git is reading the entries of a tree that it has already read
+            TreeWalk treeWalk;
+            if (this.treeWalksByEntry.TryGetValue(objectSha, out treeWalk))
+            {
+                treeWalk.RequestedEntries++;
+                if (treeWalk.RequestedEntries == EntryRequestsBeforeTreePrefetch)
+                {
+                    foreach (string entrySha in treeWalk.EntryShas)
+                    {
+                        this.QueuePrediction(new PredictedObject(entrySha, PredictedObjectKind.Unknown, depth: 0));
+                    }
+                }
+            }
+
+            string[] treeEntryShas = this.repo.GetTreeEntryShas(objectSha);
+            if (treeEntryShas != null)
+            {
+                this.TrackTree(treeEntryShas);
+                return;
+            }
+
+            // Commit walk: git is reading the parents of the commits that it has already read
+            string[] parentShas = this.repo.GetCommitParentShas(objectSha);
+            if (parentShas != null)
+            {
+                this.commitWalkLength = this.commitWalkNextShas.Contains(objectSha) ? this.commitWalkLength + 1 : 1;
+                this.commitWalkNextShas = new HashSet<string>(parentShas, StringComparer.OrdinalIgnoreCase);
+                if (this.commitWalkLength >= CommitRequestsBeforeAncestorPrefetch)
+                {
+                    foreach (string parentSha in parentShas)
+                    {
+                        this.QueuePrediction(new PredictedObject(parentSha, PredictedObjectKind.Commit, depth: 1));
+                    }
+                }
+            }
+        }
+
+        private void TrackTree(string[] entryShas)
+        {
+            if (entryShas.Length < EntryRequestsBeforeTreePrefetch)
+            {
+                return;
+            }
+
+            TreeWalk treeWalk = new TreeWalk(entryShas);
+            foreach (string entrySha in entryShas)
+            {
+                this.treeWalksByEntry[entrySha] = treeWalk;
+            }
+
+            this.trackedTrees.Enqueue(treeWalk);
+            if (this.trackedTrees.Count > MaxTrackedTrees)
+            {
+                TreeWalk oldest = this.trackedTrees.Dequeue();
+                foreach (string entrySha in oldest.EntryShas)
+                {
+                    TreeWalk current;
+                    if (this.treeWalksByEntry.TryGetValue(entrySha, out current) && current == oldest)
+                    {
+                        this.treeWalksByEntry.Remove(entrySha);
+                    }
+                }
+            }
+        }
+
+        private void QueuePrediction(PredictedObject predicted)
+        {
+            if (this.predictedObjects.ContainsKey(predicted.Sha))
+            {
+                return;
+            }
+
+            if (this.speculativeQueue.Count >= MaxQueuedObjects)
+            {
+                Interlocked.Increment(ref this.speculativeObjectsDropped);
+                return;
+            }
+
+            if (this.predictedObjects.Count >= MaxPredictedObjects)
+            {
+                this.predictedObjects.Clear();
+            }
+
+            this.predictedObjects[predicted.Sha] = true;
+            this.speculativeQueue.Enqueue(predicted);
+            Interlocked.Increment(ref this.speculativeObjectsQueued);
+        }
+
+        private void DownloadBatch(List<PredictedObject> batch)
+        {
+            Interlocked.Increment(ref this.speculativeBatches);
+            Dictionary<string, GitObjects.DownloadAndSaveObjectResult> results;
+            long bytesDownloaded;
+            using (CancellationTokenSource cancellation = CancellationTokenSource.CreateLinkedTokenSource(this.stopping.Token))
+            {
+                lock (this.batchCancellationLock)
+                {
+                    this.batchCancellation = cancellation;
+                }
+
+                try
+                {
+                    // Demand downloads might have started since ProcessPendingWork checked for them
+                    if (Volatile.Read(ref this.activeDemandDownloads) >= MaxDemandDownloadsBeforeYielding)
+                    {
+                        cancellation.Cancel();
+                    }
+
+                    results = this.gitObjects.TryDownloadAndSaveObjects(
+                        batch.Select(predicted => predicted.Sha),
+                        GVFSGitObjects.RequestSource.SpeculativePrefetch,
+                        cancellation.Token,
+                        out bytesDownloaded);
+                }
+                catch (OperationCanceledException) when (!this.stopping.IsCancellationRequested)
+                {
+                    // Put the batch back at the front of the queue.  Any objects that were saved before the batch was
+                    // cancelled are skipped (as already local) when it is dequeued again.
+                    Interlocked.Add(ref this.speculativeObjectsCancelled, batch.Count);
+                    this.speculativeQueue = new Queue<PredictedObject>(batch.Concat(this.speculativeQueue));
+                    return;
+                }
+                finally
+                {
+                    lock (this.batchCancellationLock)
+                    {
+                        this.batchCancellation = null;
+                    }
+                }
+            }
+
+            this.budgetBytes -= bytesDownloaded;
+            Interlocked.Add(ref this.speculativeBytesDownloaded, bytesDownloaded);
+
+            foreach (PredictedObject predicted in batch)
+            {
+                GitObjects.DownloadAndSaveObjectResult result;
+                if (!results.TryGetValue(predicted.Sha, out result) || result != GitObjects.DownloadAndSaveObjectResult.Success)
+                {
+                    Interlocked.Increment(ref this.speculativeObjectsFailed);
+                    continue;
+                }
+
+                Interlocked.Increment(ref this.speculativeObjectsDownloaded);
+                if (predicted.Kind == PredictedObjectKind.Commit)
+                {
+                    // Keep the commit walk going through the downloaded ancestors
+                    string[] parentShas = this.repo.GetCommitParentShas(predicted.Sha);
+                    if (parentShas != null)
+                    {
+                        this.commitWalkNextShas.UnionWith(parentShas);
+                        if (predicted.Depth < AncestorPrefetchDepth)
+                        {
+                            foreach (string parentSha in parentShas)
+                            {
+                                this.QueuePrediction(new PredictedObject(parentSha, PredictedObjectKind.Commit, predicted.Depth + 1));
+                            }
+                        }
+                    }
+                }
+                else
+                {
+                    // git will read downloaded subtrees itself, so watch for requests for their entries too
+                    string[] treeEntryShas = this.repo.GetTreeEntryShas(predicted.Sha);
+                    if (treeEntryShas != null)
+                    {
+                        this.TrackTree(treeEntryShas);
+                    }
+                }
+            }
+        }
+
+        private class PredictedObject
+        {
+            public PredictedObject(string sha, PredictedObjectKind kind, int depth)
+            {
+                this.Sha = sha;
+                this.Kind = kind;
+                this.Depth = depth;
+            }
+
+            public string Sha { get; }
+
+            public PredictedObjectKind Kind { get; }
+
+            public int Depth { get; }
+        }
+
+        private class TreeWalk
+        {
+            public TreeWalk(string[] entryShas)
+            {
+                this.EntryShas = entryShas;
+            }
+
+            public string[] EntryShas { get; }
+
+            public int RequestedEntries { get; set; }
+        }
+    }
+}
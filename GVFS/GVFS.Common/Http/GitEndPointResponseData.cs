@@ -1,4 +1,5 @@
 ﻿using GVFS.Common.Git;
+using GVFS.Common.NetworkStreams;
 using System;
 using System.Collections.Generic;
 using System.IO;
@@ -49,6 +50,21 @@ namespace GVFS.Common.Http
 
         public GitObjectContentType ContentType { get; }
 
+        /// <summary>
+        /// Wraps Stream so that the number of bytes read from it can be counted.
+        /// </summary>
+        public CountingStream CountBytesRead()
+        {
+            if (this.Stream == null)
+            {
+                throw new RetryableException("Stream is null (this could be a result of network flakiness), retrying.");
+            }
+
+            CountingStream countingStream = new CountingStream(this.Stream);
+            this.Stream = countingStream;
+            return countingStream;
+        }
+
         /// <summary>
         /// Reads the underlying stream until it ends returning all content as a string.
         /// </summary>
@@ -161,7 +161,8 @@ namespace GVFS.Common.Http
             Func<IEnumerable<string>> objectIdGenerator,
             Func<int, GitEndPointResponseData, RetryWrapper<GitObjectTaskResult>.CallbackResult> onSuccess,
             Action<RetryWrapper<GitObjectTaskResult>.ErrorEventArgs> onFailure,
-            bool preferBatchedLooseObjects)
+            bool preferBatchedLooseObjects,
+            CancellationToken cancellationToken)
         {
             // We pass the query generator in as a function because we don't want the consumer to know about JSON or network retry logic,
             // but we still want the consumer to be able to change the query on each retry if we fail during their onSuccess handler.
@@ -172,7 +173,7 @@ namespace GVFS.Common.Http
                 onFailure,
                 HttpMethod.Post,
                 new Uri(this.CacheServer.ObjectsEndpointUrl),
-                CancellationToken.None,
+                cancellationToken,
                 () => this.ObjectIdsJsonGenerator(requestId, objectIdGenerator),
                 preferBatchedLooseObjects ? CustomLooseObjectsHeader : null);
         }
@@ -228,6 +228,30 @@ namespace GVFS.Common.NamedPipes
             }
         }
 
+        public static class RunHook
+        {
+            // Message Format
+            //     CommandLine|<Base64>
+            //     CurrentDirectory|<Base64>
+            //     Environment|<Base64>
+            //     StandardHandles|<Output>,<Error>
+            //     Run
+            //
+            //     Sent by GitHooksLoader to a GVFS.Hooks standby host, with one Environment message for each NAME=VALUE
+            //     pair.  Strings are Base64 encoded UTF-8, and the handles are the loader's handle values.  The host
+            //     replies StartedResult once it has taken on the loader's state, or FailedResult if it cannot (in which
+            //     case the loader runs the hook itself).
+            public const string CommandLineHeader = "CommandLine";
+            public const string CurrentDirectoryHeader = "CurrentDirectory";
+            public const string EnvironmentHeader = "Environment";
+            public const string StandardHandlesHeader = "StandardHandles";
+            public const string RunHeader = "Run";
+            public const string StartedResult = "Started";
+            public const string FailedResult = "Failed";
+
+            public const char HandleSeparator = ',';
+        }
+
         public class LockRequest
         {
             public LockRequest(string messageBody)
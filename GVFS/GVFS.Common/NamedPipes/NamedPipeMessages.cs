@@ -71,11 +71,18 @@ namespace GVFS.Common.NamedPipes
         public static class DownloadObject
         {
             public const string DownloadRequest = "DLO";
+            public const string LocalObjectStatsRequest = "DLOS";
+            public const string TaggedDownloadRequest = "DLOT";
+            public const string TaggedContentRequest = "DLOC";
             public const string SuccessResult = "S";
             public const string DownloadFailed = "F";
             public const string InvalidSHAResult = "InvalidSHA";
             public const string MountNotReadyResult = "MountNotReady";
 
+            // Loose objects larger than this are written to disk before the TaggedContentResponse is sent, rather than
+            // being returned in it
+            public const int MaxContentResponseLength = 1024 * 1024;
+
             public class Request
             {
                 public Request(Message message)
@@ -105,6 +112,106 @@ namespace GVFS.Common.NamedPipes
                     return new Message(this.Result, null);
                 }
             }
+
+            public class TaggedRequest
+            {
+                // Message Format
+                //     DLOT|<Tag>|<SHA>
+                //     DLOC|<Tag>|<SHA>
+                //
+                //     Tag is chosen by the client and is returned in the matching TaggedResponse (or TaggedContentResponse
+                //     for DLOC), which allows the client to have several requests outstanding on a single connection
+                public TaggedRequest(Message message)
+                {
+                    string[] parts = (message.Body ?? string.Empty).Split(new[] { MessageSeparator }, count: 2);
+                    this.Tag = parts[0];
+                    this.RequestSha = parts.Length > 1 ? parts[1] : string.Empty;
+                }
+
+                public string Tag { get; }
+
+                public string RequestSha { get; }
+            }
+
+            public class TaggedResponse
+            {
+                // Message Format
+                //     <Tag>|<Result>
+                //
+                //     Requests that arrive while an earlier download is in progress are downloaded together once it
+                //     completes, and so responses are not necessarily in request order
+                public TaggedResponse(string tag, string result)
+                {
+                    this.Tag = tag;
+                    this.Result = result;
+                }
+
+                public string Tag { get; }
+
+                public string Result { get; }
+
+                public Message CreateMessage()
+                {
+                    return new Message(this.Tag, this.Result);
+                }
+            }
+
+            public class TaggedContentResponse
+            {
+                // Message Format
+                //     <Tag>|<Result>|<Content>
+                //
+                //     Content is the Base64 encoded loose object (i.e. the compressed bytes that are written to the
+                //     objects folder), and is empty unless Result is SuccessResult.  The object is written to disk
+                //     after the response has been sent.  Content is also empty when the object is larger than
+                //     MaxContentResponseLength or was downloaded together with other objects, in which case it was
+                //     written to disk before the response was sent.
+                public TaggedContentResponse(string tag, string result, byte[] looseObjectContent)
+                {
+                    this.Tag = tag;
+                    this.Result = result;
+                    this.LooseObjectContent = looseObjectContent;
+                }
+
+                public string Tag { get; }
+
+                public string Result { get; }
+
+                public byte[] LooseObjectContent { get; }
+
+                public Message CreateMessage()
+                {
+                    string content = this.LooseObjectContent == null ? string.Empty : Convert.ToBase64String(this.LooseObjectContent);
+                    return new Message(this.Tag, this.Result + MessageSeparator + content);
+                }
+            }
+
+            public class LocalObjectStats
+            {
+                // Message Format
+                //     DLOS|<LocalHits>,<LocalMisses>
+                //
+                //     Sent by GVFS.ReadObjectHook when it exits, LocalHits is the number of requested objects that
+                //     were already in a pack file and LocalMisses is the number that it had to request from GVFS
+                public LocalObjectStats(Message message)
+                {
+                    string[] counts = (message.Body ?? string.Empty).Split(',');
+                    int localHits;
+                    int localMisses;
+                    if (counts.Length == 2 && int.TryParse(counts[0], out localHits) && int.TryParse(counts[1], out localMisses))
+                    {
+                        this.LocalHits = localHits;
+                        this.LocalMisses = localMisses;
+                        this.IsValid = true;
+                    }
+                }
+
+                public bool IsValid { get; }
+
+                public int LocalHits { get; }
+
+                public int LocalMisses { get; }
+            }
         }
 
         public static class Notification
@@ -182,6 +182,7 @@ namespace GVFS.Common.NamedPipes
             private StreamReader reader;
             private StreamWriter writer;
             private Func<bool> isStopping;
+            private object writeLock = new object();
 
             public Connection(NamedPipeServerStream serverStream, Func<bool> isStopping)
             {
@@ -213,18 +214,29 @@ namespace GVFS.Common.NamedPipes
                 }
             }
 
+            /// <remarks>
+            /// Responses can be sent from multiple threads (e.g. when requests are handled asynchronously), and
+            /// a response might be sent after the client has disconnected and the connection's pipe has been disposed.
+            /// </remarks>
             public bool TrySendResponse(string message)
             {
-                try
+                lock (this.writeLock)
                 {
-                    this.writer.WriteLine(message);
-                    this.writer.Flush();
+                    try
+                    {
+                        this.writer.WriteLine(message);
+                        this.writer.Flush();
 
-                    return true;
-                }
-                catch (IOException)
-                {
-                    return false;
+                        return true;
+                    }
+                    catch (IOException)
+                    {
+                        return false;
+                    }
+                    catch (ObjectDisposedException)
+                    {
+                        return false;
+                    }
                 }
             }
 
@@ -0,0 +1,102 @@
+﻿using System;
+using System.IO;
+
+namespace GVFS.Common.NetworkStreams
+{
+    /// <summary>
+    /// Stream wrapper that counts the bytes read from another stream.
+    /// </summary>
+    public class CountingStream : Stream
+    {
+        private readonly Stream stream;
+
+        public CountingStream(Stream stream)
+        {
+            this.stream = stream;
+        }
+
+        public long BytesRead { get; private set; }
+
+        public override bool CanRead
+        {
+            get
+            {
+                return true;
+            }
+        }
+
+        public override bool CanSeek
+        {
+            get
+            {
+                return false;
+            }
+        }
+
+        public override bool CanWrite
+        {
+            get
+            {
+                return false;
+            }
+        }
+
+        public override long Length
+        {
+            get
+            {
+                return this.stream.Length;
+            }
+        }
+
+        public override long Position
+        {
+            get
+            {
+                return this.BytesRead;
+            }
+
+            set
+            {
+                throw new NotSupportedException();
+            }
+        }
+
+        public override int Read(byte[] buffer, int offset, int count)
+        {
+            int bytesRead = this.stream.Read(buffer, offset, count);
+            this.BytesRead += bytesRead;
+            return bytesRead;
+        }
+
+        public override long Seek(long offset, SeekOrigin origin)
+        {
+            throw new NotSupportedException();
+        }
+
+        public override void Flush()
+        {
+            throw new NotSupportedException();
+        }
+
+        public override void SetLength(long value)
+        {
+            throw new NotSupportedException();
+        }
+
+        public override void Write(byte[] buffer, int offset, int count)
+        {
+            throw new NotSupportedException();
+        }
+
+        protected override void Dispose(bool disposing)
+        {
+            if (disposing)
+            {
+                this.stream.Dispose();
+            }
+
+            base.Dispose(disposing);
+        }
+    }
+}
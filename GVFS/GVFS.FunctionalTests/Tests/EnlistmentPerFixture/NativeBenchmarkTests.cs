@@ -0,0 +1,28 @@
+﻿using GVFS.Tests.Should;
+using NUnit.Framework;
+using System.IO;
+using System.Runtime.InteropServices;
+
+namespace GVFS.FunctionalTests.Tests.EnlistmentPerFixture
+{
+    // Runs the GVFS.NativeTests benchmark against a fresh mount, where none of the files have been opened yet.  The
+    // results go to the enlistment's logs, which gvfs diagnose collects.
+    [TestFixture]
+    [Category(Categories.FullSuiteOnly)]
+    public class NativeBenchmarkTests : TestsWithEnlistmentPerFixture
+    {
+        private const int MaxThreads = 16;
+        private const int OperationsPerThreadCount = 20;
+
+        [TestCase]
+        public void Native_GVFlt_Benchmark()
+        {
+            string resultsPath = Path.Combine(this.Enlistment.GVFSLogsRoot, "nativebenchmark.json");
+            GVFlt_Benchmark(this.Enlistment.RepoRoot, resultsPath, MaxThreads, OperationsPerThreadCount).ShouldEqual(true);
+            File.ReadAllText(resultsPath).ShouldContain("\"phase\":\"hydration\",\"threads\":" + MaxThreads + ",\"operations\":" + OperationsPerThreadCount + ",\"errors\":0");
+        }
+
+        [DllImport("GVFS.NativeTests.dll")]
+        private static extern bool GVFlt_Benchmark(string virtualRootPath, string resultsPath, int maxThreads, int operations);
+    }
+}
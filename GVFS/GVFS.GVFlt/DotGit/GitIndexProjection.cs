@@ -14,6 +14,7 @@ using System.ComponentModel;
 using System.Diagnostics;
 using System.IO;
 using System.Linq;
+using System.Runtime.ExceptionServices;
 using System.Text;
 using System.Threading;
 using System.Threading.Tasks;
@@ -24,17 +25,35 @@ namespace GVFS.GVFlt.DotGit
     {
         public const string ProjectionIndexBackupName = "GVFS_projection";
 
-        private const ushort ExtendedBit = 0x4000;
-        private const ushort SkipWorktreeBit = 0x4000;
-        private const int MaxPathBufferSize = 4096;
         private const int IndexFileStreamBufferSize = 4096 * 10;
 
+        private const string UpdatedProjectionIndexBackupExtension = ".new";
+
+        // The projection saved at unmount (see SaveProjectionSnapshot), which can be loaded much faster than the index
+        // can be parsed
+        private const string ProjectionSnapshotName = "GVFS_projection_snapshot";
+        private const string NewProjectionSnapshotExtension = ".new";
+
+        // The SHA-1 checksum at the end of every git index
+        private const int IndexChecksumLength = 20;
+
+        // When more than this percentage of the index's entries have changed, rebuilding the projection is faster than
+        // updating it (each change is inserted into its folder's sorted range of children on its own)
+        private const int MaxIncrementalUpdateChangePercent = 10;
+
         private const UpdateType FolderPlaceholderDeleteFlags = UpdateType.AllowDirtyMetadata | UpdateType.AllowReadOnly | UpdateType.AllowTombstone;
         private const UpdateType FilePlaceholderUpdateFlags = UpdateType.AllowDirtyMetadata | UpdateType.AllowReadOnly;
 
         private const string EtwArea = "GitIndexProjection";
 
         private const int ExternalLockReleaseTimeoutMs = 50;
+
+        // Populating the sizes of a folder's children takes one of these locks (chosen by the folder's index), so that
+        // only one thread downloads the sizes
+        private const int FolderSizesLockCount = 64;
+
+        private const int InvalidFolderIndex = -1;
+
         private static readonly DateTime UnixEpoch = new DateTime(1970, 1, 1, 0, 0, 0, DateTimeKind.Utc);
 
         private char[] gitPathSeparatorCharArray = new char[] { GVFSConstants.GitPathSeparator };
@@ -44,16 +63,22 @@ namespace GVFS.GVFlt.DotGit
         private IVirtualizationInstance gvflt;
         private SparseCheckout sparseCheckout;
 
-        private FileOrFolderData rootFolderData;
-        
-        // Cache of folder paths (in Windows format) to folder data
-        private ConcurrentDictionary<string, FileOrFolderData> projectionFolderCache;
+        // The projection that callbacks read, which is a snapshot that is never changed once it is published (other than
+        // the sizes and offsets that are found for its files).  Rebuilding or updating the projection publishes a new
+        // snapshot in its place (see PublishProjection), and so callbacks never wait for the projection to change.
+        // Callbacks that are still reading the previous snapshot finish with it, and the garbage collector frees it once
+        // none of them reference it.
+        private volatile ProjectionTree projectionTree;
+        private object[] folderSizesLocks;
+
+        // The progress of the parse at mount, which callbacks wait on for the folders that they need (rather than for the
+        // whole projection).  null once the projection has been published.
+        private volatile ProjectionParseProgress parseProgress;
 
         private BlobSizes blobSizes;
         private PlaceholderListDatabase placeholderList;
         private GVFSGitObjects gitObjects;
         private ReliableBackgroundOperations backgroundQueue;
-        private ReaderWriterLockSlim projectionReadWriteLock;
         private ManualResetEventSlim projectionParseComplete;
         private ManualResetEventSlim externalLockReleaseRequested;
 
@@ -72,12 +97,14 @@ namespace GVFS.GVFlt.DotGit
         private ConcurrentHashSet<string> updatePlaceholderFailures;
         private ConcurrentHashSet<string> deletePlaceholderFailures;
 
-        // lastUpdateTime is used by GitIndexProjection to know if offsets in rootFolderData (and projectionFolderCache) are still valid.  Each time
+        // lastUpdateTime is used by GitIndexProjection to know if offsets in the projection are still valid.  Each time
         // the offsets are reparsed, lastUpdateTime is increased by one.  When GitIndexProjection looks up an offset it
         // will only treat that offset as valid if its LastUpdateTime matches this.lastUpdateTime
         private uint lastUpdateTime;
 
         private string projectionIndexBackupPath;
+        private string updatedProjectionIndexBackupPath;
+        private string projectionSnapshotPath;
         private string indexPath;
 
         private FileStream indexFileStream;
@@ -102,11 +129,18 @@ namespace GVFS.GVFlt.DotGit
             this.repoMetadata = repoMetadata;
             this.gvflt = gvflt;
 
-            this.projectionReadWriteLock = new ReaderWriterLockSlim();
+            this.folderSizesLocks = new object[FolderSizesLockCount];
+            for (int i = 0; i < this.folderSizesLocks.Length; ++i)
+            {
+                this.folderSizesLocks[i] = new object();
+            }
+
             this.projectionParseComplete = new ManualResetEventSlim(initialState: false);
             this.externalLockReleaseRequested = new ManualResetEventSlim(initialState: false);
             this.wakeUpIndexParsingThread = new AutoResetEvent(initialState: false);
             this.projectionIndexBackupPath = Path.Combine(this.context.Enlistment.DotGVFSRoot, ProjectionIndexBackupName);
+            this.updatedProjectionIndexBackupPath = this.projectionIndexBackupPath + UpdatedProjectionIndexBackupExtension;
+            this.projectionSnapshotPath = Path.Combine(this.context.Enlistment.DotGVFSRoot, ProjectionSnapshotName);
             this.indexPath = Path.Combine(this.context.Enlistment.WorkingDirectoryRoot, GVFSConstants.DotGit.Index);
             this.placeholderList = placeholderList;
             this.sparseCheckout = sparseCheckout;
@@ -159,6 +193,161 @@ namespace GVFS.GVFlt.DotGit
             }
         }
 
+        /// <summary>
+        /// Compares the projected entries of two indexes (see <see cref="EnumerateProjectedEntries"/>), and adds an
+        /// IndexEntryChange to changes for each path whose projection is different in currentIndex
+        /// </summary>
+        /// <returns>false if more than maxChanges paths changed, and true otherwise</returns>
+        public static bool TryGetProjectedEntryChanges(
+            GitIndexReader previousIndex,
+            GitIndexReader currentIndex,
+            int maxChanges,
+            List<IndexEntryChange> changes)
+        {
+            using (IEnumerator<GitIndexEntry> previousEntries = EnumerateProjectedEntries(previousIndex).GetEnumerator())
+            using (IEnumerator<GitIndexEntry> currentEntries = EnumerateProjectedEntries(currentIndex).GetEnumerator())
+            {
+                bool hasPreviousEntry = previousEntries.MoveNext();
+                bool hasCurrentEntry = currentEntries.MoveNext();
+                while (hasPreviousEntry || hasCurrentEntry)
+                {
+                    // Index entries are sorted by path, and so a path that is only in one of the indexes comes before
+                    // the next entry of the other index
+                    int comparison;
+                    if (!hasPreviousEntry)
+                    {
+                        comparison = 1;
+                    }
+                    else if (!hasCurrentEntry)
+                    {
+                        comparison = -1;
+                    }
+                    else
+                    {
+                        comparison = ComparePaths(previousEntries.Current, currentEntries.Current);
+                    }
+
+                    if (comparison < 0)
+                    {
+                        changes.Add(new IndexEntryChange(previousEntries.Current.GetPath()));
+                        hasPreviousEntry = previousEntries.MoveNext();
+                    }
+                    else if (comparison > 0)
+                    {
+                        changes.Add(new IndexEntryChange(currentEntries.Current));
+                        hasCurrentEntry = currentEntries.MoveNext();
+                    }
+                    else
+                    {
+                        if (!ShasAreEqual(previousEntries.Current.Sha, currentEntries.Current.Sha))
+                        {
+                            changes.Add(new IndexEntryChange(currentEntries.Current));
+                        }
+
+                        hasPreviousEntry = previousEntries.MoveNext();
+                        hasCurrentEntry = currentEntries.MoveNext();
+                    }
+
+                    if (changes.Count > maxChanges)
+                    {
+                        return false;
+                    }
+                }
+            }
+
+            return true;
+        }
+
+        /// <summary>
+        /// Makes the changes found by TryGetProjectedEntryChanges to tree (a clone of the projection, see
+        /// ProjectionTree.Clone), and adds them to projectionChanges
+        /// </summary>
+        /// <returns>
+        /// false if a change cannot be made in the same way that RebuildProjection would make it (in which case tree must
+        /// be discarded)
+        /// </returns>
+        /// <remarks>
+        /// Names are checked against the case of the names in the projection, but a path that is in the index in two
+        /// cases (which git cannot check out on Windows) is not looked for when the other one is removed
+        /// </remarks>
+        public static bool TryApplyProjectedEntryChanges(ProjectionTree tree, List<IndexEntryChange> changes, ProjectionChanges projectionChanges)
+        {
+            // The clone shares the entries of the projection that it was cloned from, and so folders are walked with
+            // PrepareToChangeChild, which copies only the folders on the path to a change
+            // Remove files first, so that a file can take the place of a folder that is no longer projected (or a folder
+            // the place of a file)
+            foreach (IndexEntryChange change in changes.Where(change => !change.IsProjected))
+            {
+                // folders[i] is the folder that contains pathParts[i]
+                string[] pathParts = change.GitPath.Split(GVFSConstants.GitPathSeparator);
+                int[] folders = new int[pathParts.Length];
+                folders[0] = ProjectionTree.RootIndex;
+                for (int i = 0; i < pathParts.Length; ++i)
+                {
+                    bool isFolder = i < pathParts.Length - 1;
+                    int childIndex;
+                    if (!tree.TryGetChild(folders[i], pathParts[i], out childIndex) || 
+                        !tree.NameEquals(childIndex, pathParts[i]) || 
+                        tree.IsFolder(childIndex) != isFolder)
+                    {
+                        return false;
+                    }
+
+                    if (isFolder)
+                    {
+                        folders[i + 1] = tree.PrepareToChangeChild(folders[i], childIndex);
+                    }
+                    else
+                    {
+                        tree.RemoveChild(folders[i], childIndex);
+                    }
+                }
+
+                // RebuildProjection does not create empty folders
+                for (int i = pathParts.Length - 1; i > 0 && tree.GetChildCount(folders[i]) == 0; --i)
+                {
+                    tree.RemoveChild(folders[i - 1], folders[i]);
+                }
+
+                projectionChanges.AddFile(change.GitPath);
+            }
+
+            foreach (IndexEntryChange change in changes.Where(change => change.IsProjected))
+            {
+                string[] pathParts = change.GitPath.Split(GVFSConstants.GitPathSeparator);
+                int parentIndex = ProjectionTree.RootIndex;
+                for (int i = 0; i < pathParts.Length - 1; ++i)
+                {
+                    int childIndex;
+                    if (!tree.TryGetChild(parentIndex, pathParts[i], out childIndex))
+                    {
+                        parentIndex = tree.AddFolder(parentIndex, pathParts[i]);
+                    }
+                    else if (tree.NameEquals(childIndex, pathParts[i]) && tree.IsFolder(childIndex))
+                    {
+                        parentIndex = tree.PrepareToChangeChild(parentIndex, childIndex);
+                    }
+                    else
+                    {
+                        return false;
+                    }
+                }
+
+                string fileName = pathParts[pathParts.Length - 1];
+                int fileIndex;
+                if (tree.TryGetChild(parentIndex, fileName, out fileIndex) && 
+                    (!tree.NameEquals(fileIndex, fileName) || tree.IsFolder(fileIndex)))
+                {
+                    return false;
+                }
+
+                tree.SetFile(parentIndex, fileName, change.Sha, change.Offset);
+                projectionChanges.AddFile(change.GitPath);
+            }
+
+            return true;
+        }
+
         /// <summary>
         /// Force the index file to be parsed and a new projection collection to be built.  
         /// This method should only be used to measure index parsing performance.
@@ -220,33 +409,47 @@ namespace GVFS.GVFlt.DotGit
 
             this.backgroundQueue = backgroundQueue;
 
-            this.projectionReadWriteLock.EnterWriteLock();
-            try
+            this.projectionInvalid = this.repoMetadata.GetProjectionInvalid();
+
+            bool projectingIndexBackup = this.context.FileSystem.FileExists(this.projectionIndexBackupPath) && !this.projectionInvalid;
+            if (!projectingIndexBackup)
             {
-                this.projectionInvalid = this.repoMetadata.GetProjectionInvalid();
+                this.context.FileSystem.CopyFile(this.indexPath, this.projectionIndexBackupPath, overwrite: true);
+            }
 
-                if (!this.context.FileSystem.FileExists(this.projectionIndexBackupPath) || this.projectionInvalid)
+            // Callbacks can arrive while the projection is being built, and they are served from each folder as soon as
+            // it has been parsed
+            ProjectionParseProgress parseProgress = new ProjectionParseProgress();
+            this.parseProgress = parseProgress;
+            try
+            {
+                // The snapshot saved at the last unmount can be used if it was built from the same index as the backup
+                if (!this.TryLoadProjectionSnapshot())
                 {
-                    this.CopyIndexFileAndBuildProjection();
-                }
-                else
-                {                    
                     this.BuildProjection();
-
-                    // Set offsetsInvalid to true because we're projecting something other than the current index
-                    // (and so whatever offsets were just loaded into the projection are no longer up-to-date)
-                    this.offsetsInvalid = true;
                 }
             }
             finally
             {
-                this.projectionReadWriteLock.ExitWriteLock();
+                this.parseProgress = null;
+                parseProgress.Complete();
+
+                EventMetadata metadata = CreateEventMetadata();
+                parseProgress.AddStatsToTelemetry(metadata);
+                this.context.Tracer.RelatedEvent(EventLevel.Informational, "ProjectionParseWaits", metadata, Keywords.Telemetry);
+            }
+
+            if (projectingIndexBackup)
+            {
+                // Set offsetsInvalid to true because we're projecting something other than the current index
+                // (and so whatever offsets were just loaded into the projection are no longer up-to-date)
+                this.offsetsInvalid = true;
             }
 
             this.ClearUpdatePlaceholderErrors();
             if (this.repoMetadata.GetPlaceholdersNeedUpdate())
             {
-                this.UpdatePlaceholders();
+                this.UpdatePlaceholders(projectionChanges: null);
             }
 
             // If somehow something invalidated the projection while we were initializing, the parsing thread will
@@ -264,6 +467,7 @@ namespace GVFS.GVFlt.DotGit
             this.isStopping = true;
             this.wakeUpIndexParsingThread.Set();
             this.indexParsingThread.Wait();
+            this.SaveProjectionSnapshot();
         }
 
         public NamedPipeMessages.ReleaseLock.Response TryReleaseExternalLock(int pid)
@@ -319,19 +523,9 @@ namespace GVFS.GVFlt.DotGit
 
             this.projectionParseComplete.Reset();
 
-            try
-            {
-                // Because the projection is now invalid, attempt to delete the projection file.  If this delete fails
-                // replacing the projection will be handled by the parsing thread
-                this.context.FileSystem.DeleteFile(this.projectionIndexBackupPath);
-            }
-            catch (Exception e)
-            {
-                EventMetadata metadata = CreateEventMetadata(e);
-                metadata.Add(TracingConstants.MessageKey.InfoMessage, nameof(this.InvalidateProjection) + ": Failed to delete GVFS_Projection file");
-                this.context.Tracer.RelatedEvent(EventLevel.Informational, nameof(this.InvalidateProjection) + "_FailedToDeleteProjection", metadata);
-            }
-
+            // The projection file is kept (rather than deleted) so that the parsing thread can compare it with the new
+            // index and update only what changed.  If GVFS is restarted before then, Initialize sees that the projection
+            // is invalid in the repo metadata and builds a new one from the index.
             this.SetProjectionAndPlaceholdersAndOffsetsAsInvalid();
             this.wakeUpIndexParsingThread.Set();
         }
@@ -382,35 +576,18 @@ namespace GVFS.GVFlt.DotGit
         {
             projectedItems = null;
 
-            this.projectionReadWriteLock.EnterReadLock();
-
-            try
+            ProjectionTree tree;
+            int folderIndex;
+            if (this.TryGetFolderIndex(folderPath, folderPath.Length, out tree, out folderIndex))
             {
-                FileOrFolderData folderData;
-                if (this.TryGetOrAddFolderDataFromCache(folderPath, out folderData))
+                if (tree.ChildrenHaveSizes(folderIndex))
                 {
-                    if (folderData.ChildrenHaveSizes)
-                    {
-                        List<GVFltFileInfo> childItems = new List<GVFltFileInfo>(folderData.ChildEntries.Count);
-                        foreach (KeyValuePair<string, FileOrFolderData> childEntry in folderData.ChildEntries)
-                        {
-                            childItems.Add(new GVFltFileInfo(
-                                childEntry.Key,
-                                childEntry.Value.IsFolder ? 0 : childEntry.Value.Size,
-                                childEntry.Value.IsFolder));
-                        }
-
-                        projectedItems = childItems;
-                        return true;
-                    }
+                    projectedItems = this.GetChildItems(tree, folderIndex);
+                    return true;
                 }
-
-                return false;
-            }
-            finally
-            {
-                this.projectionReadWriteLock.ExitReadLock();
             }
+
+            return false;
         }
 
         public virtual IEnumerable<GVFltFileInfo> GetProjectedItems(
@@ -418,52 +595,33 @@ namespace GVFS.GVFlt.DotGit
             BlobSizes.BlobSizesConnection blobSizesConnection, 
             string folderPath)
         {
-            this.projectionReadWriteLock.EnterReadLock();
-
-            try
-            {
-                FileOrFolderData folderData;
-                if (this.TryGetOrAddFolderDataFromCache(folderPath, out folderData))
-                {
-                    folderData.FolderOnly_PopulateSizes(
-                        this.context.Tracer, 
-                        this.gitObjects, 
-                        blobSizesConnection, 
-                        availableSizes: null, 
-                        cancellationToken: cancellationToken);
-                    List<GVFltFileInfo> childItems = new List<GVFltFileInfo>(folderData.ChildEntries.Count);
-                    foreach (KeyValuePair<string, FileOrFolderData> childEntry in folderData.ChildEntries)
-                    {
-                        childItems.Add(new GVFltFileInfo(
-                            childEntry.Key,
-                            childEntry.Value.IsFolder ? 0 : childEntry.Value.Size,
-                            childEntry.Value.IsFolder));
-                    }
-
-                    return childItems;
-                }
-
-                return new List<GVFltFileInfo>();
-            }
-            finally
+            ProjectionTree tree;
+            int folderIndex;
+            if (this.TryGetFolderIndex(folderPath, folderPath.Length, out tree, out folderIndex))
             {
-                this.projectionReadWriteLock.ExitReadLock();
+                this.PopulateSizes(
+                    tree,
+                    folderIndex, 
+                    blobSizesConnection, 
+                    availableSizes: null, 
+                    cancellationToken: cancellationToken);
+                return this.GetChildItems(tree, folderIndex);
             }
+
+            return new List<GVFltFileInfo>();
         }
 
         public virtual bool IsPathProjected(string virtualPath, out string fileName, out bool isFolder)
         {
             isFolder = false;
-            string parentKey;
-            this.GetChildNameAndParentKey(virtualPath, out fileName, out parentKey);
-            FileOrFolderData data = this.GetProjectedFileOrFolderData(
-                blobSizesConnection: null, 
-                childName: fileName, 
-                parentKey: parentKey);
-
-            if (data != null)
-            {
-                isFolder = data.IsFolder;
+            fileName = null;
+            ProjectionTree tree;
+            int parentIndex;
+            int childIndex;
+            if (this.TryGetFileOrFolderIndex(virtualPath, out tree, out parentIndex, out childIndex))
+            {
+                fileName = virtualPath.Substring(virtualPath.LastIndexOf(GVFSConstants.PathSeparator) + 1);
+                isFolder = tree.IsFolder(childIndex);
                 return true;
             }
 
@@ -478,28 +636,23 @@ namespace GVFS.GVFlt.DotGit
             out string sha)
         {
             sha = string.Empty;
-            string childName;
-            string parentKey;
-            this.GetChildNameAndParentKey(virtualPath, out childName, out parentKey);
-            parentFolderPath = parentKey;
-            string gitCasedChildName;
-            FileOrFolderData data = this.GetProjectedFileOrFolderData(
+            parentFolderPath = virtualPath.Substring(0, Math.Max(virtualPath.LastIndexOf(GVFSConstants.PathSeparator), 0));
+            GVFltFileInfo fileInfo;
+            Sha1Id fileSha;
+            if (this.TryGetProjectedFileOrFolder(
                 cancellationToken,
                 blobSizesConnection,
                 availableSizes: null,
-                childName: childName, 
-                parentKey: parentKey, 
-                gitCasedChildName: out gitCasedChildName);
-
-            if (data != null)
+                virtualPath: virtualPath, 
+                fileInfo: out fileInfo,
+                sha: out fileSha))
             {
-                if (data.IsFolder)
+                if (!fileInfo.IsFolder)
                 {
-                    return new GVFltFileInfo(gitCasedChildName, size: 0, isFolder: true);
+                    sha = fileSha.ToString();
                 }
 
-                sha = data.ConvertShaToString();
-                return new GVFltFileInfo(gitCasedChildName, data.Size, isFolder: false);
+                return fileInfo;
             }
 
             return null;
@@ -726,12 +879,6 @@ namespace GVFS.GVFlt.DotGit
         {
             if (disposing)
             {
-                if (this.projectionReadWriteLock != null)
-                {
-                    this.projectionReadWriteLock.Dispose();
-                    this.projectionReadWriteLock = null;
-                }
-
                 if (this.projectionParseComplete != null)
                 {
                     this.projectionParseComplete.Dispose();
@@ -785,46 +932,6 @@ namespace GVFS.GVFlt.DotGit
             parentKey = virtualPath.Substring(0, separatorIndex);
         }
 
-        private static int ReadReplaceLength(Stream stream)
-        {
-            int headerByte = stream.ReadByte();
-            int offset = headerByte & 0x7f;
-
-            // Terminate the loop when the high bit is no longer set.
-            for (int i = 0; (headerByte & 0x80) != 0; i++)
-            {
-                headerByte = stream.ReadByte();
-                if (headerByte < 0)
-                {
-                    throw new EndOfStreamException("Unexpected end of stream while reading git index.");
-                }
-
-                offset += 1;
-                offset = (offset << 7) + (headerByte & 0x7f);
-            }
-
-            return offset;
-        }
-
-        private static uint ReadUInt32(byte[] buffer, Stream stream)
-        {
-            buffer[3] = (byte)stream.ReadByte();
-            buffer[2] = (byte)stream.ReadByte();
-            buffer[1] = (byte)stream.ReadByte();
-            buffer[0] = (byte)stream.ReadByte();
-
-            return BitConverter.ToUInt32(buffer, 0);
-        }
-
-        private static ushort ReadUInt16(byte[] buffer, Stream stream)
-        {
-            buffer[1] = (byte)stream.ReadByte();
-            buffer[0] = (byte)stream.ReadByte();
-
-            // (ushort)BitConverter.ToInt16 avoids the running the duplicated checks in ToUInt16
-            return (ushort)BitConverter.ToInt16(buffer, 0);
-        }
-
         private static uint ToUnixNanosecondFraction(DateTime datetime)
         {
             if (datetime > UnixEpoch)
@@ -884,509 +991,711 @@ namespace GVFS.GVFlt.DotGit
                 throw new ArgumentNullException("projection", "projection cannot be null for actions other than IndexAction.ValidateIndex");
             }
 
-            byte[] buffer = new byte[40];
-            indexFileStream.Position = 0;
-
-            indexFileStream.Read(buffer, 0, 4);
-            if (buffer[0] != 'D' ||
-                buffer[1] != 'I' ||
-                buffer[2] != 'R' ||
-                buffer[3] != 'C')
-            {
-                throw new InvalidDataException("Incorrect magic signature for index: " + string.Join(string.Empty, buffer.Take(4).Select(c => (char)c)));
-            }
-
-            uint indexVersion = ReadUInt32(buffer, indexFileStream);
-            if (indexVersion != 4)
-            {
-                throw new InvalidDataException("Unsupported index version: " + indexVersion);
-            }
-
-            uint entryCount = ReadUInt32(buffer, indexFileStream);
-
-            if (action == IndexAction.RebuildProjection)
+            using (GitIndexReader indexReader = new GitIndexReader(indexFileStream))
             {
-                projection.projectionFolderCache = new ConcurrentDictionary<string, FileOrFolderData>(StringComparer.OrdinalIgnoreCase);
-                projection.rootFolderData = new FileOrFolderData();
-            }
+                if (indexReader.Version != 4)
+                {
+                    throw new InvalidDataException("Unsupported index version: " + indexReader.Version);
+                }
 
-            FileOrFolderData lastParent = null;
+                // Actions that only read the index and update the tree can work on the blocks of an index with an
+                // Index Entry Offset Table in parallel.  Validating the sparse-checkout file updates it in index order.
+                if (action == IndexAction.RebuildProjection || action == IndexAction.UpdateOffsets)
+                {
+                    List<GitIndexEntryBlock> entryBlocks = indexReader.GetEntryBlocks();
+                    if (entryBlocks.Count > 1 && Environment.ProcessorCount > 1)
+                    {
+                        projection.PerformIndexActionInParallel(indexReader, entryBlocks, action);
+                        return CallbackResult.Success;
+                    }
+                }
 
-            int previousPathLength = 0;
-            byte[] pathBuffer = new byte[MaxPathBufferSize];
-            GitPathSplitter pathSplitter = new GitPathSplitter();
+                ProjectionTree.Builder treeBuilder = null;
+                if (action == IndexAction.RebuildProjection)
+                {
+                    treeBuilder = new ProjectionTree.Builder(projection.context.Tracer, (int)indexReader.EntryCount);
 
-            byte[] sha = new byte[20];
+                    ProjectionParseProgress parseProgress = projection.parseProgress;
+                    if (parseProgress != null)
+                    {
+                        parseProgress.Start(blockCount: 1);
+                        treeBuilder.FolderAdded = (blockTree, folderPath, folderIndex, isParsedPast) =>
+                            parseProgress.AddFolder(0, blockTree, folderPath, folderIndex, isParsedPast);
+                    }
+                }
 
-            for (int i = 0; i < entryCount; i++)
-            {
-                long entryOffset = indexFileStream.Position;
-                indexFileStream.Read(buffer, 0, 40);
-                indexFileStream.Read(sha, 0, 20);
+                ProjectionTree tree = projection?.projectionTree;
+                int lastParentIndex = InvalidFolderIndex;
+                int lastParentPathLength = 0;
+                CallbackResult result = CallbackResult.Success;
 
-                ushort flags = ReadUInt16(buffer, indexFileStream);
-                MergeStage mergeStage = (MergeStage)((flags >> 12) & 3);
-                bool isExtended = (flags & ExtendedBit) == ExtendedBit;
-                int pathLength = (ushort)(flags & 0xFFF);
+                indexReader.ForEachEntry(
+                    entry =>
+                    {
+                        result = PerformIndexActionForEntry(projection, treeBuilder, tree, entry, action, ref lastParentIndex, ref lastParentPathLength);
+                        return result == CallbackResult.Success;
+                    });
 
-                bool skipWorktree = false;
-                if (isExtended)
+                if (treeBuilder != null)
                 {
-                    ushort extendedFlags = ReadUInt16(buffer, indexFileStream);
-                    skipWorktree = (extendedFlags & SkipWorktreeBit) == SkipWorktreeBit;
+                    projection.PublishProjection(treeBuilder.Finish());
                 }
 
-                int replaceLength = ReadReplaceLength(indexFileStream);
-                int replaceIndex = previousPathLength - replaceLength;
-                int bytesToRead = pathLength - replaceIndex + 1;
-                indexFileStream.Read(pathBuffer, replaceIndex, bytesToRead);
-                previousPathLength = pathLength;
+                return result;
+            }
+        }
 
-                switch (action)
-                {
-                    case IndexAction.RebuildProjection:
-                        if (skipWorktree)
-                        {
-                            pathSplitter.Parse(pathBuffer, pathLength, replaceIndex);
-                            projection.AddItem(pathSplitter, sha, entryOffset, ref lastParent);
-                        }
-                        else if (mergeStage == MergeStage.Yours)
-                        {
-                            pathSplitter.Parse(pathBuffer, pathLength, replaceIndex);
-                            projection.AddItem(pathSplitter, sha, FileOrFolderData.InvalidOffset, ref lastParent);
-                        }
-                        else
-                        {
-                            pathSplitter.ClearLastParent();
-                        }
+        /// <param name="treeBuilder">The builder that RebuildProjection adds entries to</param>
+        /// <param name="tree">The projection whose offsets UpdateOffsets updates</param>
+        /// <param name="lastParentIndex">
+        /// The folder that UpdateOffsets found the last entry in, or InvalidFolderIndex (see <see cref="UpdateFileOffset"/>)
+        /// </param>
+        private static CallbackResult PerformIndexActionForEntry(
+            GitIndexProjection projection,
+            ProjectionTree.Builder treeBuilder,
+            ProjectionTree tree,
+            GitIndexEntry entry,
+            IndexAction action,
+            ref int lastParentIndex,
+            ref int lastParentPathLength)
+        {
+            switch (action)
+            {
+                case IndexAction.RebuildProjection:
+                    if (entry.SkipWorktree)
+                    {
+                        treeBuilder.AddFile(entry.PathBuffer, entry.PathLength, entry.Sha, entry.Offset);
+                    }
+                    else if ((MergeStage)entry.MergeStage == MergeStage.Yours)
+                    {
+                        treeBuilder.AddFile(entry.PathBuffer, entry.PathLength, entry.Sha, ProjectionTree.InvalidOffset);
+                    }
 
-                        break;
+                    break;
 
-                    case IndexAction.UpdateOffsets:
-                        if (skipWorktree)
-                        {
-                            pathSplitter.Parse(pathBuffer, pathLength, replaceIndex);
-                            projection.UpdateFileOffset(pathSplitter, entryOffset, ref lastParent);
-                        }
-                        else
-                        {
-                            pathSplitter.ClearLastParent();
-                        }
+                case IndexAction.UpdateOffsets:
+                    if (entry.SkipWorktree)
+                    {
+                        projection.UpdateFileOffset(tree, entry, ref lastParentIndex, ref lastParentPathLength);
+                    }
+                    else
+                    {
+                        lastParentIndex = InvalidFolderIndex;
+                    }
 
-                        break;
+                    break;
 
-                    case IndexAction.ValidateSparseCheckout:
-                        if (!skipWorktree)
-                        {
-                            // A git command (e.g. 'git reset --mixed') may have cleared a file's skip worktree bit without
-                            // updating the sparse-checkout file.  Ensure this file is in the sparse-checkout file
-                            pathSplitter.Parse(pathBuffer, pathLength, replaceIndex);
-                            CallbackResult updateSparseCheckoutResult = projection.sparseCheckout.AddFileEntryFromIndex(pathSplitter.GetFullPath());
-                            if (updateSparseCheckoutResult != CallbackResult.Success)
-                            {
-                                return updateSparseCheckoutResult;
-                            }
-                        }
-                        else
+                case IndexAction.ValidateSparseCheckout:
+                    if (!entry.SkipWorktree)
+                    {
+                        // A git command (e.g. 'git reset --mixed') may have cleared a file's skip worktree bit without
+                        // updating the sparse-checkout file.  Ensure this file is in the sparse-checkout file
+                        CallbackResult updateSparseCheckoutResult = projection.sparseCheckout.AddFileEntryFromIndex(entry.GetPath());
+                        if (updateSparseCheckoutResult != CallbackResult.Success)
                         {
-                            pathSplitter.ClearLastParent();
+                            return updateSparseCheckoutResult;
                         }
+                    }
 
-                        break;
+                    break;
 
-                    case IndexAction.UpdateOffsetsAndValidateSparseCheckout:
-                        pathSplitter.Parse(pathBuffer, pathLength, replaceIndex);
-                        if (skipWorktree)
-                        {
-                            projection.UpdateFileOffset(pathSplitter, entryOffset, ref lastParent);
-                        }
-                        else
+                case IndexAction.UpdateOffsetsAndValidateSparseCheckout:
+                    if (entry.SkipWorktree)
+                    {
+                        projection.UpdateFileOffset(tree, entry, ref lastParentIndex, ref lastParentPathLength);
+                    }
+                    else
+                    {
+                        lastParentIndex = InvalidFolderIndex;
+                        CallbackResult updateSparseCheckoutResult = projection.sparseCheckout.AddFileEntryFromIndex(entry.GetPath());
+                        if (updateSparseCheckoutResult != CallbackResult.Success)
                         {
-                            CallbackResult updateSparseCheckoutResult = projection.sparseCheckout.AddFileEntryFromIndex(pathSplitter.GetFullPath());
-                            if (updateSparseCheckoutResult != CallbackResult.Success)
-                            {
-                                return updateSparseCheckoutResult;
-                            }
+                            return updateSparseCheckoutResult;
                         }
+                    }
 
-                        break;
+                    break;
 
-                    case IndexAction.ValidateIndex:
-                        if ((pathLength <= 0) || (pathBuffer[0] == 0))
-                        {
-                            throw new InvalidDataException("Zero-length path found in index");
-                        }
+                case IndexAction.ValidateIndex:
+                    if (entry.PathLength <= 0)
+                    {
+                        throw new InvalidDataException("Zero-length path found in index");
+                    }
 
-                        break;
+                    break;
 
-                    default:
-                        throw new ArgumentOutOfRangeException(nameof(action));
-                }
+                default:
+                    throw new ArgumentOutOfRangeException(nameof(action));
             }
 
             return CallbackResult.Success;
         }
 
-        private bool TryGetSha(string childName, string parentKey, out string sha)
+        /// <summary>
+        /// The entries that RebuildProjection adds to the projection: skip-worktree entries, and the "yours" side of
+        /// merge conflicts.  As with RebuildProjection, only the first of these is used when a path is in the index
+        /// more than once.
+        /// </summary>
+        private static IEnumerable<GitIndexEntry> EnumerateProjectedEntries(GitIndexReader indexReader)
         {
-            sha = string.Empty;
-            FileOrFolderData data = this.GetProjectedFileOrFolderData(
-                blobSizesConnection: null, 
-                childName: childName, 
-                parentKey: parentKey);
-
-            if (data != null && !data.IsFolder)
+            int previousPathLength = -1;
+            bool pathIsProjected = false;
+            foreach (GitIndexEntry entry in indexReader.EnumerateEntries())
             {
-                sha = data.ConvertShaToString();
-                return true;
-            }
-
-            return false;
-        }
+                // An entry for the same path as the entry before it shares all of that entry's path
+                if (entry.ReplaceIndex != entry.PathLength || entry.PathLength != previousPathLength)
+                {
+                    pathIsProjected = false;
+                }
 
-        private void SetProjectionInvalid(bool isInvalid)
-        {
-            this.projectionInvalid = isInvalid;
-            this.repoMetadata.SetProjectionInvalid(isInvalid);
+                previousPathLength = entry.PathLength;
+                if (!pathIsProjected && (entry.SkipWorktree || (MergeStage)entry.MergeStage == MergeStage.Yours))
+                {
+                    pathIsProjected = true;
+                    yield return entry;
+                }
+            }
         }
 
-        private void SetProjectionAndPlaceholdersAndOffsetsAsInvalid()
+        /// <summary>
+        /// Compares the paths of two index entries in the order that git sorts them
+        /// </summary>
+        private static int ComparePaths(GitIndexEntry first, GitIndexEntry second)
         {
-            this.projectionInvalid = true;
-            this.repoMetadata.SetProjectionInvalidAndPlaceholdersNeedUpdate();
+            int length = Math.Min(first.PathLength, second.PathLength);
+            for (int i = 0; i < length; ++i)
+            {
+                if (first.PathBuffer[i] != second.PathBuffer[i])
+                {
+                    return first.PathBuffer[i] - second.PathBuffer[i];
+                }
+            }
 
-            this.offsetsInvalid = true;
+            return first.PathLength - second.PathLength;
         }
 
-        private void AddItem(GitPathSplitter pathSplitter, byte[] shaBytes, long offset, ref FileOrFolderData lastParent)
+        private static bool ShasAreEqual(byte[] first, byte[] second)
         {
-            if (pathSplitter.HasSameParentAsLastEntry)
+            for (int i = 0; i < first.Length; ++i)
             {
-                FileOrFolderData newFileData = new FileOrFolderData(shaBytes, offset);
-                lastParent.AddChild(this.context.Tracer, pathSplitter.GetChildName(), newFileData);
-            }
-            else
-            {
-                if (pathSplitter.NumParts == 1)
-                {
-                    lastParent = this.rootFolderData;
-                    FileOrFolderData newFileData = new FileOrFolderData(shaBytes, offset);                    
-                    lastParent.AddChild(this.context.Tracer, pathSplitter.GetChildName(), newFileData);
-                }
-                else
+                if (first[i] != second[i])
                 {
-                    FileOrFolderData newFileData = new FileOrFolderData(shaBytes, offset);
-                    lastParent = this.AddFileToTree(pathSplitter, newFileData);
+                    return false;
                 }
             }
+
+            return true;
         }
 
-        private void UpdateFileOffset(GitPathSplitter pathSplitter, long offset, ref FileOrFolderData lastParent)
+        private static byte[] ReadIndexChecksum(string indexPath)
         {
-            if (pathSplitter.HasSameParentAsLastEntry)
-            {
-                lastParent.UpdateChildOffset(
-                    this.context.Tracer,
-                    pathSplitter.GetChildName(),
-                    offset,
-                    this.lastUpdateTime);
-            }
-            else
+            using (FileStream indexStream = new FileStream(indexPath, FileMode.Open, FileAccess.Read, FileShare.Read))
             {
-                if (pathSplitter.NumParts == 1)
+                if (indexStream.Length < IndexChecksumLength)
                 {
-                    lastParent = this.rootFolderData;
-                    lastParent.UpdateChildOffset(this.context.Tracer, pathSplitter.GetChildName(), offset, this.lastUpdateTime);
+                    throw new EndOfStreamException("Unexpected end of stream while reading git index checksum.");
                 }
-                else
-                {
-                    if (this.TryGetParentFolderDataFromTree(pathSplitter, fileOrFolderData: out lastParent))
-                    {
-                        lastParent.UpdateChildOffset(this.context.Tracer, pathSplitter.GetChildName(), offset, this.lastUpdateTime);
-                    }
-                    else
-                    {
-                        // TODO 1083624: Improve GVFS's detection of this scenario
 
-                        EventMetadata metadata = CreateEventMetadata();
-                        metadata.Add("gitPath", pathSplitter.GetFullPath());
-                        metadata.Add("parentKey", pathSplitter.GetParentPath());
-                        metadata.Add("offset", offset);
-                        this.context.Tracer.RelatedWarning(metadata, "UpdateFileOffset: Failed to find parentKey", Keywords.Telemetry);
-                    }
+                byte[] checksum = new byte[IndexChecksumLength];
+                indexStream.Position = indexStream.Length - IndexChecksumLength;
+                if (indexStream.Read(checksum, 0, IndexChecksumLength) != IndexChecksumLength)
+                {
+                    throw new EndOfStreamException("Unexpected end of stream while reading git index checksum.");
                 }
+
+                return checksum;
             }
         }
 
-        private string GetParentKey(string gitPath, out int pathSeparatorIndex)
+        private bool TryGetSha(string virtualPath, out string sha)
         {
-            string parentKey = string.Empty;
-            pathSeparatorIndex = gitPath.LastIndexOf(GVFSConstants.GitPathSeparator);
-            if (pathSeparatorIndex >= 0)
+            sha = string.Empty;
+            ProjectionTree tree;
+            int parentIndex;
+            int fileIndex;
+            if (this.TryGetFileOrFolderIndex(virtualPath, out tree, out parentIndex, out fileIndex) &&
+                !tree.IsFolder(fileIndex))
             {
-                parentKey = gitPath.Substring(0, pathSeparatorIndex);
+                sha = tree.GetSha(fileIndex).ToString();
+                return true;
             }
 
-            return parentKey;
+            return false;
         }
 
-        private string GetChildName(string gitPath, int pathSeparatorIndex)
+        private void SetProjectionInvalid(bool isInvalid)
         {
-            if (pathSeparatorIndex < 0)
-            {
-                return gitPath;
-            }
+            this.projectionInvalid = isInvalid;
+            this.repoMetadata.SetProjectionInvalid(isInvalid);
+        }
 
-            return gitPath.Substring(pathSeparatorIndex + 1);
+        private void SetProjectionAndPlaceholdersAndOffsetsAsInvalid()
+        {
+            this.projectionInvalid = true;
+            this.repoMetadata.SetProjectionInvalidAndPlaceholdersNeedUpdate();
+
+            this.offsetsInvalid = true;
         }
 
-        private bool TryGetIndexPathOffset(string virtualPath, out long offset)
+        /// <summary>
+        /// Updates the offset of the file for entry in tree
+        /// </summary>
+        /// <param name="lastParentIndex">
+        /// The folder that the previous entry was found in, or InvalidFolderIndex if the previous entry was not.  When the
+        /// entry is in the same folder, the folder does not need to be found again.
+        /// </param>
+        /// <param name="lastParentPathLength">The length of the path (including the final '/') of lastParentIndex</param>
+        private void UpdateFileOffset(ProjectionTree tree, GitIndexEntry entry, ref int lastParentIndex, ref int lastParentPathLength)
         {
-            FileOrFolderData parentFolderData;
-            string childName;
-            string parentKey;
-            this.GetChildNameAndParentKey(virtualPath, out childName, out parentKey);
-            if (!this.TryGetOrAddFolderDataFromCache(parentKey, out parentFolderData))
+            byte[] path = entry.PathBuffer;
+            int parentPathLength = entry.PathLength;
+            while (parentPathLength > 0 && path[parentPathLength - 1] != GVFSConstants.GitPathSeparator)
             {
-                offset = FileOrFolderData.InvalidOffset;
-                return false;
+                --parentPathLength;
             }
 
-            FileOrFolderData fileData;
-            if (parentFolderData.ChildEntries.TryGetValue(childName, out fileData))
+            bool hasSameParentAsLastEntry =
+                lastParentIndex != InvalidFolderIndex &&
+                parentPathLength == lastParentPathLength &&
+                entry.ReplaceIndex >= parentPathLength;
+
+            if (!hasSameParentAsLastEntry)
             {
-                if (!fileData.IsFolder && fileData.LastUpdateTime == this.lastUpdateTime && fileData.Offset >= 0)
+                lastParentPathLength = parentPathLength;
+                if (!tree.TryGetFolder(path, Math.Max(parentPathLength - 1, 0), out lastParentIndex))
                 {
-                    offset = fileData.Offset;
-                    return true;
+                    // TODO 1083624: Improve GVFS's detection of this scenario
+
+                    lastParentIndex = InvalidFolderIndex;
+
+                    EventMetadata metadata = CreateEventMetadata();
+                    metadata.Add("gitPath", entry.GetPath());
+                    metadata.Add("parentKey", Encoding.UTF8.GetString(path, 0, Math.Max(parentPathLength - 1, 0)));
+                    metadata.Add("offset", entry.Offset);
+                    this.context.Tracer.RelatedWarning(metadata, "UpdateFileOffset: Failed to find parentKey", Keywords.Telemetry);
+                    return;
                 }
             }
 
-            offset = FileOrFolderData.InvalidOffset;
-            return false;
+            int fileIndex;
+            if (!tree.TryGetChild(lastParentIndex, path, parentPathLength, entry.PathLength - parentPathLength, out fileIndex))
+            {
+                EventMetadata metadata = CreateEventMetadata();
+                metadata.Add("childName", Encoding.UTF8.GetString(path, parentPathLength, entry.PathLength - parentPathLength));
+                metadata.Add("offset", entry.Offset);
+                this.context.Tracer.RelatedWarning(metadata, "UpdateChildOffset: Failed to find childName in ChildEntries", Keywords.Telemetry);
+            }
+            else if (tree.IsFolder(fileIndex))
+            {
+                EventMetadata metadata = CreateEventMetadata();
+                metadata.Add("offset", entry.Offset);
+                metadata.Add("updateTime", this.lastUpdateTime);
+                this.context.Tracer.RelatedWarning(metadata, "SetOffset: Skipping update of file offset, this entry is a folder");
+            }
+            else
+            {
+                tree.SetOffset(fileIndex, entry.Offset, this.lastUpdateTime);
+            }
         }
 
         /// <summary>
-        /// Add a FileOrFolderData to the tree
+        /// Makes tree the projection that callbacks read (see projectionTree)
         /// </summary>
-        /// <param name="pathSplitter">GitPathSplitter created using child's path</param>
-        /// <param name="childData">FileOrFolderData to add to the tree</param>
-        /// <returns>The FileOrFolderData for childData's parent</returns>
-        /// <remarks>This method will create and add any intermediate FileOrFolderDatas that are
-        /// required but not already in the tree.  For example, if the tree was completely empty
-        /// and AddFileToTree was called for the path \A\B\C.txt:
-        /// 
-        ///    pathParts -> { "A", "B", "C.txt"}
-        /// 
-        ///    AddFileToTree would create new FileOrFolderData entries in the tree for "A" and "B"
-        ///    and return the FileOrFolderData entry for "B"
-        /// </remarks>
-        private FileOrFolderData AddFileToTree(GitPathSplitter pathSplitter, FileOrFolderData childData)
-        {            
-            FileOrFolderData parentFolder = this.rootFolderData;
-            FileOrFolderData childEntry = null;
-            for (int pathIndex = 0; pathIndex < pathSplitter.NumParts - 1; ++pathIndex)
-            {
-                if (!parentFolder.IsFolder)
-                {
-                    string parentFolderName = pathIndex > 0 ? pathSplitter.PathParts[pathIndex - 1] : "<root>";
-                    string gitPath = pathSplitter.GetFullPath();
-
-                    EventMetadata metadata = CreateEventMetadata();
-                    metadata.Add("gitPath", gitPath);
-                    metadata.Add("parentFolder", parentFolderName);
-                    this.context.Tracer.RelatedError(metadata, "AddFileToTree: Found a file where a folder was expected");
-
-                    throw new InvalidDataException("Found a file (" + parentFolderName + ") where a folder was expected: " + gitPath);
-                }
+        private void PublishProjection(ProjectionTree tree)
+        {
+            tree.BuildChildTable();
+            this.projectionTree = tree;
+        }
 
-                if (!parentFolder.ChildEntries.TryGetValue(pathSplitter.PathParts[pathIndex], out childEntry))
+        private bool TryGetIndexPathOffset(string virtualPath, out long offset)
+        {
+            ProjectionTree tree;
+            int parentIndex;
+            int fileIndex;
+            if (this.TryGetFileOrFolderIndex(virtualPath, out tree, out parentIndex, out fileIndex))
+            {
+                if (!tree.IsFolder(fileIndex) && 
+                    tree.GetLastUpdateTime(fileIndex) == this.lastUpdateTime && 
+                    tree.GetOffset(fileIndex) >= 0)
                 {
-                    childEntry = new FileOrFolderData();
-                    parentFolder.AddChild(this.context.Tracer, pathSplitter.PathParts[pathIndex], childEntry);
+                    offset = tree.GetOffset(fileIndex);
+                    return true;
                 }
-                
-                parentFolder = childEntry;
             }
 
-            parentFolder.AddChild(this.context.Tracer, pathSplitter.PathParts[pathSplitter.NumParts - 1], childData);
-
-            return parentFolder;
+            offset = ProjectionTree.InvalidOffset;
+            return false;
         }
-        
-        private FileOrFolderData GetProjectedFileOrFolderData(
-            CancellationToken cancellationToken,
-            BlobSizes.BlobSizesConnection blobSizesConnection,
-            Dictionary<string, long> availableSizes,
-            string childName, 
-            string parentKey, 
-            out string gitCasedChildName)
+
+        /// <summary>
+        /// Performs RebuildProjection or UpdateOffsets with each block of entries in entryBlocks on its own thread
+        /// </summary>
+        /// <remarks>
+        /// For RebuildProjection, each block is added to a tree of its own, and the trees are then merged in index
+        /// order.  Only the folders that span the end of one block and the start of the next need merging, the rest
+        /// are copied into the projection as they are.  UpdateOffsets only updates the offsets of files that are
+        /// already in the tree, and each file is in only one block.
+        /// </remarks>
+        private void PerformIndexActionInParallel(GitIndexReader indexReader, List<GitIndexEntryBlock> entryBlocks, IndexAction action)
         {
-            this.projectionReadWriteLock.EnterReadLock();
+            ProjectionTree tree = this.projectionTree;
+            ProjectionTree[] blockTrees = new ProjectionTree[entryBlocks.Count];
+            ProjectionParseProgress parseProgress = action == IndexAction.RebuildProjection ? this.parseProgress : null;
+            if (parseProgress != null)
+            {
+                parseProgress.Start(entryBlocks.Count);
+            }
+
             try
             {
-                FileOrFolderData parentFolderData;
-                if (this.TryGetOrAddFolderDataFromCache(parentKey, out parentFolderData))
-                {
-                    int childIndex = parentFolderData.ChildEntries.IndexOfKey(childName);                    
-                    if (childIndex >= 0)
+                Parallel.For(
+                    0,
+                    entryBlocks.Count,
+                    blockIndex =>
                     {
-                        gitCasedChildName = parentFolderData.ChildEntries.Keys[childIndex];
-                        FileOrFolderData childData = parentFolderData.ChildEntries.Values[childIndex];
-
-                        if (blobSizesConnection != null && !childData.IsFolder && !childData.IsSizeSet())
+                        ProjectionTree.Builder treeBuilder = null;
+                        if (action == IndexAction.RebuildProjection)
                         {
-                            string sha;
-                            if (!childData.FileOnly_TryPopulateSizeLocally(this.context.Tracer, this.gitObjects, blobSizesConnection, availableSizes, out sha))
+                            treeBuilder = new ProjectionTree.Builder(this.context.Tracer, (int)entryBlocks[blockIndex].EntryCount);
+                            if (parseProgress != null)
                             {
-                                Stopwatch queryTime = Stopwatch.StartNew();
-                                parentFolderData.FolderOnly_PopulateSizes(this.context.Tracer, this.gitObjects, blobSizesConnection, availableSizes, cancellationToken);
-                                this.context.Repository.GVFSLock.Stats.RecordSizeQuery(queryTime.ElapsedMilliseconds);
+                                treeBuilder.FolderAdded = (blockTree, folderPath, folderIndex, isParsedPast) =>
+                                    parseProgress.AddFolder(blockIndex, blockTree, folderPath, folderIndex, isParsedPast);
                             }
                         }
 
-                        return childData;
-                    }
-                }
+                        int lastParentIndex = InvalidFolderIndex;
+                        int lastParentPathLength = 0;
+
+                        indexReader.ForEachEntry(
+                            entryBlocks[blockIndex],
+                            entry =>
+                            {
+                                PerformIndexActionForEntry(this, treeBuilder, tree, entry, action, ref lastParentIndex, ref lastParentPathLength);
+                                return true;
+                            });
 
-                gitCasedChildName = string.Empty;
-                return null;
+                        if (treeBuilder != null)
+                        {
+                            blockTrees[blockIndex] = treeBuilder.Finish();
+                            parseProgress?.FinishBlock(blockIndex);
+                        }
+                    });
             }
-            finally
+            catch (AggregateException e)
+            {
+                // Callers handle a corrupt index the same way whether or not it was parsed in parallel
+                ExceptionDispatchInfo.Capture(e.Flatten().InnerException).Throw();
+            }
+
+            if (action == IndexAction.RebuildProjection)
             {
-                this.projectionReadWriteLock.ExitReadLock();
+                this.PublishProjection(ProjectionTree.Builder.Merge(this.context.Tracer, blockTrees));
             }
         }
 
         /// <summary>
-        /// Get the FileOrFolderData for the specified child name and parent key.
+        /// Finds the file or folder at virtualPath, and gets what callers need to know about it from a single snapshot
+        /// of the projection
         /// </summary>
         /// <param name="blobSizesConnection">
-        /// BlobSizesConnection used to lookup the size for the FileOrFolderData.  If null, size will not be populated.
+        /// BlobSizesConnection used to lookup the size of the file.  If null, size will not be populated.
         /// </param>
-        /// <param name="childName">Child name (i.e. file name)</param>
-        /// <param name="parentKey">Parent key (parent folder path)</param>
-        /// <returns>FileOrFolderData for the specified childName and parentKey or null if no FileOrFolderData exists for them in the projection</returns>
-        /// <remarks><see cref="GetChildNameAndParentKey"/> can be used for getting child name and parent key from a file path</remarks>
-        private FileOrFolderData GetProjectedFileOrFolderData(
-            BlobSizes.BlobSizesConnection blobSizesConnection, 
-            string childName, 
-            string parentKey)
+        /// <param name="fileInfo">Out: The name (as cased in the projection), size and whether it is a folder</param>
+        /// <param name="sha">Out: The SHA of the file, when it is a file</param>
+        /// <returns>true if virtualPath is in the projection, and false otherwise</returns>
+        private bool TryGetProjectedFileOrFolder(
+            CancellationToken cancellationToken,
+            BlobSizes.BlobSizesConnection blobSizesConnection,
+            Dictionary<string, long> availableSizes,
+            string virtualPath, 
+            out GVFltFileInfo fileInfo,
+            out Sha1Id sha)
         {
-            string casedChildName;
-            return this.GetProjectedFileOrFolderData(
-                CancellationToken.None,
-                blobSizesConnection,
-                availableSizes: null, 
-                childName: childName, 
-                parentKey: parentKey, 
-                gitCasedChildName: out casedChildName);
+            ProjectionTree tree;
+            int parentIndex;
+            int childIndex;
+            if (this.TryGetFileOrFolderIndex(virtualPath, out tree, out parentIndex, out childIndex))
+            {
+                if (tree.IsFolder(childIndex))
+                {
+                    fileInfo = new GVFltFileInfo(tree.GetName(childIndex), size: 0, isFolder: true);
+                    sha = default(Sha1Id);
+                    return true;
+                }
+
+                if (blobSizesConnection != null && !tree.IsSizeSet(childIndex))
+                {
+                    string missingSha;
+                    if (!this.TryPopulateSizeLocally(tree, childIndex, blobSizesConnection, availableSizes, out missingSha))
+                    {
+                        Stopwatch queryTime = Stopwatch.StartNew();
+                        this.PopulateSizes(tree, parentIndex, blobSizesConnection, availableSizes, cancellationToken);
+                        this.context.Repository.GVFSLock.Stats.RecordSizeQuery(queryTime.ElapsedMilliseconds);
+                    }
+                }
+
+                fileInfo = new GVFltFileInfo(tree.GetName(childIndex), tree.GetSize(childIndex), isFolder: false);
+                sha = tree.GetSha(childIndex);
+                return true;
+            }
+
+            fileInfo = null;
+            sha = default(Sha1Id);
+            return false;
         }
 
         /// <summary>
-        /// Try to get the FileOrFolderData for the specified folder path from the projectionFolderCache
-        /// cache.  If the  folder is not already in projectionFolderCache, search for it in the tree and
-        /// then add it to projectionData
-        /// </summary>        
+        /// Finds the file or folder at virtualPath, and the folder that contains it
+        /// </summary>
+        /// <param name="tree">Out: The projection (or the part of it that has been parsed) that the indexes are in</param>
+        /// <remarks>
+        /// Callbacks look up paths with this, and so it walks virtualPath in place rather than splitting it into
+        /// substrings
+        /// </remarks>
+        private bool TryGetFileOrFolderIndex(string virtualPath, out ProjectionTree tree, out int parentIndex, out int childIndex)
+        {
+            int separatorIndex = virtualPath.LastIndexOf(GVFSConstants.PathSeparator);
+            int childStart = separatorIndex + 1;
+            if (this.TryGetFolderIndex(virtualPath, Math.Max(separatorIndex, 0), out tree, out parentIndex) &&
+                tree.TryGetChild(parentIndex, virtualPath, childStart, virtualPath.Length - childStart, out childIndex))
+            {
+                return true;
+            }
+
+            childIndex = -1;
+            return false;
+        }
+
+        /// <summary>
+        /// Finds the folder whose virtual path is folderPath[0] through folderPath[length - 1]
+        /// </summary>
+        /// <param name="tree">Out: The projection (or the part of it that has been parsed) that folderIndex is in</param>
         /// <returns>True if the folder could be found, and false otherwise</returns>
-        private bool TryGetOrAddFolderDataFromCache(
-            string folderPath, 
-            out FileOrFolderData folderData)
+        /// <remarks>
+        /// While the projection is being built at mount, this waits until the folder has been parsed rather than until
+        /// the whole projection has been built
+        /// </remarks>
+        private bool TryGetFolderIndex(string folderPath, int length, out ProjectionTree tree, out int folderIndex)
         {
-            if (!this.projectionFolderCache.TryGetValue(folderPath, out folderData))
+            ProjectionParseProgress parseProgress = this.parseProgress;
+            if (parseProgress != null && parseProgress.TryWaitForFolder(folderPath, length, out tree, out folderIndex))
             {
-                string[] pathParts = folderPath.Split(new char[] { GVFSConstants.PathSeparator }, StringSplitOptions.RemoveEmptyEntries);
-                if (!this.TryGetFileOrFolderDataFromTree(pathParts, fileOrFolderData: out folderData))
-                {
-                    folderPath = null;
-                    return false;
-                }
+                return tree != null;
+            }
 
-                if (folderData.IsFolder)
-                {
-                    this.projectionFolderCache.TryAdd(folderPath, folderData);
-                }
-                else
-                {
-                    EventMetadata metadata = CreateEventMetadata();
-                    metadata.Add("folderPath", folderPath);
-                    this.context.Tracer.RelatedWarning(metadata, "GitIndexProjection_TryGetOrAddFolderDataFromCacheFoundFile: Found a file when expecting a folder");
+            // The projection is null if it could not be built at mount
+            tree = this.projectionTree;
+            folderIndex = ProjectionTree.RootIndex;
+            if (tree == null || !tree.TryGetPath(folderPath, length, GVFSConstants.PathSeparator, out folderIndex))
+            {
+                return false;
+            }
 
-                    folderPath = null;
-                    return false;
-                }
+            if (!tree.IsFolder(folderIndex))
+            {
+                EventMetadata metadata = CreateEventMetadata();
+                metadata.Add("folderPath", folderPath.Substring(0, length));
+                this.context.Tracer.RelatedWarning(metadata, "GitIndexProjection_TryGetOrAddFolderDataFromCacheFoundFile: Found a file when expecting a folder");
+
+                return false;
             }
 
             return true;
         }
 
+        private List<GVFltFileInfo> GetChildItems(ProjectionTree tree, int folderIndex)
+        {
+            int firstChild = tree.GetFirstChild(folderIndex);
+            int childCount = tree.GetChildCount(folderIndex);
+            List<GVFltFileInfo> childItems = new List<GVFltFileInfo>(childCount);
+            for (int childIndex = firstChild; childIndex < firstChild + childCount; ++childIndex)
+            {
+                bool isFolder = tree.IsFolder(childIndex);
+                childItems.Add(new GVFltFileInfo(
+                    tree.GetName(childIndex),
+                    isFolder ? 0 : tree.GetSize(childIndex),
+                    isFolder));
+            }
+
+            return childItems;
+        }
+
         /// <summary>
-        /// Finds the FileOrFolderData for the parent of the path provided.
+        /// Populates the sizes of the files in a folder, downloading any that are not available locally
         /// </summary>
-        /// <param name="pathSplitter">Path splitter with child path components</param>
-        /// <param name="fileOrFolderData">Out: FileOrFolderData for childPathParts's parent</param>
-        /// <returns>True if the parent could be found in the tree, and false otherwise</returns>
-        /// <remarks>This method does not check if childPathParts is in the tree, it only looks up its parent.
-        /// If childPathParts is empty (i.e. the root folder), the root folder will be returned.</remarks>
-        private bool TryGetParentFolderDataFromTree(GitPathSplitter pathSplitter, out FileOrFolderData fileOrFolderData)
-        {
-            fileOrFolderData = null;
-            FileOrFolderData parentFolder;
-            if (this.TryGetFileOrFolderDataFromTree(pathSplitter.PathParts, pathSplitter.NumParts - 1, out parentFolder))
-            {
-                if (parentFolder.IsFolder)
+        private void PopulateSizes(
+            ProjectionTree tree,
+            int folderIndex,
+            BlobSizes.BlobSizesConnection blobSizesConnection,
+            Dictionary<string, long> availableSizes,
+            CancellationToken cancellationToken)
+        {
+            if (tree.ChildrenHaveSizes(folderIndex))
+            {
+                return;
+            }
+
+            HashSet<string> missingShas;
+            List<FileMissingSize> childrenMissingSizes;
+            this.PopulateSizesLocally(tree, folderIndex, blobSizesConnection, availableSizes, out missingShas, out childrenMissingSizes);
+
+            lock (this.folderSizesLocks[folderIndex % this.folderSizesLocks.Length])
+            {
+                // Check ChildrenHaveSizes again in case another 
+                // thread has already done the work of setting the sizes
+                if (tree.ChildrenHaveSizes(folderIndex))
                 {
-                    fileOrFolderData = parentFolder;
+                    return;
+                }
+
+                this.PopulateSizesFromRemote(
+                    tree,
+                    folderIndex,
+                    blobSizesConnection,
+                    missingShas,
+                    childrenMissingSizes,
+                    cancellationToken);
+            }
+        }
+
+        private bool TryPopulateSizeLocally(
+            ProjectionTree tree,
+            int fileIndex,
+            BlobSizes.BlobSizesConnection blobSizesConnection,
+            Dictionary<string, long> availableSizes,
+            out string missingSha)
+        {
+            missingSha = null;
+            long blobLength = 0;
+
+            Sha1Id sha1Id = tree.GetSha(fileIndex);
+            string shaString = null;
+
+            if (availableSizes != null)
+            {
+                shaString = sha1Id.ToString();
+                if (availableSizes.TryGetValue(shaString, out blobLength))
+                {
+                    tree.SetSize(fileIndex, blobLength);
                     return true;
                 }
             }
 
+            try
+            {
+                if (blobSizesConnection.TryGetSize(sha1Id, out blobLength))
+                {
+                    tree.SetSize(fileIndex, blobLength);
+                    return true;
+                }
+            }
+            catch (BlobSizesException e)
+            {
+                EventMetadata metadata = CreateEventMetadata(e);
+                missingSha = sha1Id.ToString();
+                metadata.Add(nameof(missingSha), missingSha);
+                this.context.Tracer.RelatedWarning(metadata, $"{nameof(this.TryPopulateSizeLocally)}: Exception while trying to get file size", Keywords.Telemetry);
+            }
+
+            if (missingSha == null)
+            {
+                missingSha = (shaString == null) ? sha1Id.ToString() : shaString;
+            }
+
+            if (this.gitObjects.TryGetBlobSizeLocally(missingSha, out blobLength))
+            {
+                tree.SetSize(fileIndex, blobLength);
+
+                // There is no flush for this value because it's already local, so there's little loss if it doesn't get persisted
+                // But it's faster to wait for some remote call to batch this value into a different flush
+                blobSizesConnection.BlobSizesDatabase.AddSize(sha1Id, blobLength);
+                return true;
+            }
+
             return false;
         }
 
         /// <summary>
-        /// Finds the FileOrFolderData for the path provided
+        /// Populates the sizes of the files in a folder using locally available data
         /// </summary>
-        /// <param name="pathParts">Path to desired entry</param>
-        /// <param name="fileOrFolderData">Out: FileOrFolderData for pathParts</param>
-        /// <returns>True if the path could be found in the tree, and false otherwise</returns>
-        /// <remarks>If the root folder is desired, the pathParts should be an empty array</remarks>
-        private bool TryGetFileOrFolderDataFromTree(string[] pathParts, out FileOrFolderData fileOrFolderData)
+        private void PopulateSizesLocally(
+            ProjectionTree tree,
+            int folderIndex,
+            BlobSizes.BlobSizesConnection blobSizesConnection,
+            Dictionary<string, long> availableSizes,
+            out HashSet<string> missingShas,
+            out List<FileMissingSize> childrenMissingSizes)
         {
-            return this.TryGetFileOrFolderDataFromTree(pathParts, pathParts.Length, out fileOrFolderData);
+            if (tree.ChildrenHaveSizes(folderIndex))
+            {
+                missingShas = null;
+                childrenMissingSizes = null;
+                return;
+            }
+
+            missingShas = new HashSet<string>();
+            childrenMissingSizes = new List<FileMissingSize>();
+            int firstChild = tree.GetFirstChild(folderIndex);
+            int childCount = tree.GetChildCount(folderIndex);
+            for (int childIndex = firstChild; childIndex < firstChild + childCount; ++childIndex)
+            {
+                if (!tree.IsFolder(childIndex) && !tree.IsSizeSet(childIndex))
+                {
+                    string sha;
+                    if (!this.TryPopulateSizeLocally(tree, childIndex, blobSizesConnection, availableSizes, out sha))
+                    {
+                        childrenMissingSizes.Add(new FileMissingSize(childIndex, sha));
+                        missingShas.Add(sha);
+                    }
+                }
+            }
+
+            if (childrenMissingSizes.Count == 0)
+            {
+                tree.SetChildrenHaveSizes(folderIndex);
+            }
         }
 
         /// <summary>
-        /// Finds the FileOrFolderData at the specified depth of the path provided.  If depth == pathParts.Length
-        /// TryGetFileOrFolderDataFromTree will find the FileOrFolderData specified in pathParts.  If 
-        /// depth is less than pathParts.Length, then TryGetFileOrFolderDataFromTree will return an ancestor folder of
-        /// childPathParts.
+        /// Populate sizes using size data from the remote
         /// </summary>
-        /// <param name="pathParts">Path</param>
-        /// <param name="depth">Desired path depth, if depth is > pathParts.Length, pathParts.Length will be used</param>
-        /// <param name="fileOrFolderData">Out: FileOrFolderData for pathParts at the specified depth.  For example,
-        /// if pathParts were { "A", "B", "C" } and depth was 2, FileOrFolderData for "B" would be returned.</param>
-        /// <returns>True if the specified path\depth could be found in the tree, and false otherwise</returns>
-        private bool TryGetFileOrFolderDataFromTree(string[] pathParts, int depth, out FileOrFolderData fileOrFolderData)
-        {
-            fileOrFolderData = null;
-            depth = Math.Min(depth, pathParts.Length);
-            FileOrFolderData currentEntry = this.rootFolderData;
-            for (int pathIndex = 0; pathIndex < depth; ++pathIndex)
-            {
-                if (!currentEntry.IsFolder)
+        /// <param name="missingShas">Set of object shas whose sizes should be downloaded from the remote.  This set should contains all the distinct SHAs from
+        /// in childrenMissingSizes.  PopulateSizesLocally can be used to generate this set</param>
+        /// <param name="childrenMissingSizes">List of child entries whose sizes should be downloaded from the remote.  PopulateSizesLocally
+        /// can be used to generate this list</param>
+        private void PopulateSizesFromRemote(
+            ProjectionTree tree,
+            int folderIndex,
+            BlobSizes.BlobSizesConnection blobSizesConnection,
+            HashSet<string> missingShas,
+            List<FileMissingSize> childrenMissingSizes,
+            CancellationToken cancellationToken)
+        {
+            if (childrenMissingSizes != null && childrenMissingSizes.Count > 0)
+            {
+                Dictionary<string, long> objectLengths = this.gitObjects.GetFileSizes(missingShas, cancellationToken).ToDictionary(s => s.Id, s => s.Size, StringComparer.OrdinalIgnoreCase);
+                foreach (FileMissingSize childNeedingSize in childrenMissingSizes)
                 {
-                    return false;
+                    long blobLength = 0;
+                    if (objectLengths.TryGetValue(childNeedingSize.Sha, out blobLength))
+                    {
+                        tree.SetSize(childNeedingSize.FileIndex, blobLength);
+                        blobSizesConnection.BlobSizesDatabase.AddSize(tree.GetSha(childNeedingSize.FileIndex), blobLength);
+                    }
+                    else
+                    {
+                        EventMetadata metadata = CreateEventMetadata();
+                        metadata.Add("SHA", childNeedingSize.Sha);
+                        this.context.Tracer.RelatedError(metadata, "PopulateMissingSizesFromRemote: Failed to download size for child entry", Keywords.Network);
+                        throw new SizesUnavailableException("Failed to download size for " + childNeedingSize.Sha);
+                    }
                 }
 
-                if (!currentEntry.ChildEntries.TryGetValue(pathParts[pathIndex], out currentEntry))
-                {
-                    return false;
-                }
+                blobSizesConnection.BlobSizesDatabase.Flush();
             }
 
-            fileOrFolderData = currentEntry;
-            return fileOrFolderData != null;
+            tree.SetChildrenHaveSizes(folderIndex);
         }
 
         private void ParseIndexThreadMain()
@@ -1410,53 +1719,58 @@ namespace GVFS.GVFlt.DotGit
                         }
                     }
 
-                    this.projectionReadWriteLock.EnterWriteLock();
-
                     // Record if the projection needed to be updated to ensure that placeholders and the negative cache
                     // are only updated when required (i.e. only updated when the projection was updated) 
                     bool updatedProjection = this.projectionInvalid;
 
-                    try
+                    // What changed, when the projection could be updated rather than rebuilt, so that only the placeholders
+                    // for those files and folders need updating.  null when the projection was rebuilt.
+                    ProjectionChanges projectionChanges = new ProjectionChanges();
+
+                    while (this.projectionInvalid)
                     {
-                        while (this.projectionInvalid)
+                        try
                         {
-                            try
+                            // If the update fails part way through (or throws), the projection must be rebuilt
+                            ProjectionChanges changesSoFar = projectionChanges;
+                            projectionChanges = null;
+                            if (changesSoFar != null && this.TryCopyIndexFileAndUpdateProjection(changesSoFar))
+                            {
+                                projectionChanges = changesSoFar;
+                            }
+                            else
                             {
                                 this.lastUpdateTime = 0;
                                 this.CopyIndexFileAndBuildProjection();
                             }
-                            catch (Win32Exception e)
-                            {
-                                this.SetProjectionAndPlaceholdersAndOffsetsAsInvalid();
+                        }
+                        catch (Win32Exception e)
+                        {
+                            this.SetProjectionAndPlaceholdersAndOffsetsAsInvalid();
 
-                                EventMetadata metadata = CreateEventMetadata(e);
-                                this.context.Tracer.RelatedWarning(metadata, "Win32Exception when reparsing index for projection");
-                            }
-                            catch (IOException e)
-                            {
-                                this.SetProjectionAndPlaceholdersAndOffsetsAsInvalid();
+                            EventMetadata metadata = CreateEventMetadata(e);
+                            this.context.Tracer.RelatedWarning(metadata, "Win32Exception when reparsing index for projection");
+                        }
+                        catch (IOException e)
+                        {
+                            this.SetProjectionAndPlaceholdersAndOffsetsAsInvalid();
 
-                                EventMetadata metadata = CreateEventMetadata(e);
-                                this.context.Tracer.RelatedWarning(metadata, "IOException when reparsing index for projection");
-                            }
-                            catch (UnauthorizedAccessException e)
-                            {
-                                this.SetProjectionAndPlaceholdersAndOffsetsAsInvalid();
+                            EventMetadata metadata = CreateEventMetadata(e);
+                            this.context.Tracer.RelatedWarning(metadata, "IOException when reparsing index for projection");
+                        }
+                        catch (UnauthorizedAccessException e)
+                        {
+                            this.SetProjectionAndPlaceholdersAndOffsetsAsInvalid();
 
-                                EventMetadata metadata = CreateEventMetadata(e);
-                                this.context.Tracer.RelatedWarning(metadata, "UnauthorizedAccessException when reparsing index for projection");
-                            }
+                            EventMetadata metadata = CreateEventMetadata(e);
+                            this.context.Tracer.RelatedWarning(metadata, "UnauthorizedAccessException when reparsing index for projection");
+                        }
 
-                            if (this.isStopping)
-                            {
-                                return;
-                            }
+                        if (this.isStopping)
+                        {
+                            return;
                         }
                     }
-                    finally
-                    {
-                        this.projectionReadWriteLock.ExitWriteLock();
-                    }
 
                     if (this.isStopping)
                     {
@@ -1471,7 +1785,7 @@ namespace GVFS.GVFlt.DotGit
                     if (updatedProjection)
                     {
                         this.ClearGvFltNegativePathCache();
-                        this.UpdatePlaceholders();
+                        this.UpdatePlaceholders(projectionChanges);
                     }
 
                     this.projectionParseComplete.Set();
@@ -1513,19 +1827,40 @@ namespace GVFS.GVFlt.DotGit
             this.deletePlaceholderFailures = new ConcurrentHashSet<string>();
         }
 
-        private void UpdatePlaceholders()
+        /// <param name="projectionChanges">
+        /// The files and folders whose projection has changed, or null to check every placeholder.  Placeholders for
+        /// other files and folders are left as they are.
+        /// </param>
+        private void UpdatePlaceholders(ProjectionChanges projectionChanges)
         {
             this.ClearUpdatePlaceholderErrors();
 
             List<PlaceholderListDatabase.PlaceholderData> placeholderListCopy = this.placeholderList.GetAllEntries();
             EventMetadata metadata = new EventMetadata();
             metadata.Add("Count", placeholderListCopy.Count);
+            metadata.Add("Incremental", projectionChanges != null);
             using (ITracer activity = this.context.Tracer.StartActivity("UpdatePlaceholders", EventLevel.Informational, metadata))
             {
                 ConcurrentHashSet<string> folderPlaceholdersToKeep = new ConcurrentHashSet<string>();
                 ConcurrentBag<PlaceholderListDatabase.PlaceholderData> updatedPlaceholderList = new ConcurrentBag<PlaceholderListDatabase.PlaceholderData>();
+
+                List<PlaceholderListDatabase.PlaceholderData> filePlaceholdersToUpdate = new List<PlaceholderListDatabase.PlaceholderData>();
+                foreach (PlaceholderListDatabase.PlaceholderData placeholder in placeholderListCopy.Where(x => !x.IsFolder))
+                {
+                    if (projectionChanges == null || projectionChanges.FilePaths.Contains(placeholder.Path))
+                    {
+                        filePlaceholdersToUpdate.Add(placeholder);
+                    }
+                    else
+                    {
+                        updatedPlaceholderList.Add(placeholder);
+                        this.GetChildNameAndParentKey(placeholder.Path, out string _, out string parentKey);
+                        this.AddParentFoldersToListToKeep(parentKey, folderPlaceholdersToKeep);
+                    }
+                }
+
                 this.ProcessListOnThreads(
-                    placeholderListCopy.Where(x => !x.IsFolder).ToList(),
+                    filePlaceholdersToUpdate,
                     (placeholderBatch, start, end, blobSizesConnection, availableSizes) => 
                         this.BatchPopulateMissingSizesFromRemote(blobSizesConnection, placeholderBatch, start, end, availableSizes),
                     (placeholder, blobSizesConnection, availableSizes) => 
@@ -1537,7 +1872,14 @@ namespace GVFS.GVFlt.DotGit
                 // so that we don't try to delete a folder placeholder that has file placeholders and just fails
                 foreach (PlaceholderListDatabase.PlaceholderData folderPlaceholder in placeholderListCopy.Where(x => x.IsFolder).OrderByDescending(x => x.Path))
                 {
-                    this.TryRemoveFolderPlaceholder(folderPlaceholder, updatedPlaceholderList, folderPlaceholdersToKeep);
+                    if (projectionChanges == null || projectionChanges.FolderPaths.Contains(folderPlaceholder.Path))
+                    {
+                        this.TryRemoveFolderPlaceholder(folderPlaceholder, updatedPlaceholderList, folderPlaceholdersToKeep);
+                    }
+                    else
+                    {
+                        updatedPlaceholderList.Add(folderPlaceholder);
+                    }
                 }
 
                 this.placeholderList.WriteAllEntriesAndFlush(updatedPlaceholderList);
@@ -1683,12 +2025,8 @@ namespace GVFS.GVFlt.DotGit
 
         private string GetNewProjectedShaForPlaceholder(string path)
         {
-            string childName;
-            string parentKey;
-            this.GetChildNameAndParentKey(path, out childName, out parentKey);
-
             string projectedSha;
-            if (this.TryGetSha(childName, parentKey, out projectedSha))
+            if (this.TryGetSha(path, out projectedSha))
             {
                 return projectedSha;
             }
@@ -1739,12 +2077,10 @@ namespace GVFS.GVFlt.DotGit
             ConcurrentHashSet<string> folderPlaceholdersToKeep,
             Dictionary<string, long> availableSizes)
         {
-            string childName;
-            string parentKey;
-            this.GetChildNameAndParentKey(placeholder.Path, out childName, out parentKey);
+            this.GetChildNameAndParentKey(placeholder.Path, out string _, out string parentKey);
 
             string projectedSha;
-            if (!this.TryGetSha(childName, parentKey, out projectedSha))
+            if (!this.TryGetSha(placeholder.Path, out projectedSha))
             {
                 UpdateFailureCause failureReason = UpdateFailureCause.NoFailure;
                 HResult result = this.gvflt.DeleteFile(placeholder.Path, FilePlaceholderUpdateFlags, ref failureReason);
@@ -1761,7 +2097,7 @@ namespace GVFS.GVFlt.DotGit
 
                     try
                     {
-                        FileOrFolderData data = this.GetProjectedFileOrFolderData(CancellationToken.None, blobSizesConnection, availableSizes, childName, parentKey, out string _);
+                        this.TryGetProjectedFileOrFolder(CancellationToken.None, blobSizesConnection, availableSizes, placeholder.Path, out GVFltFileInfo fileInfo, out Sha1Id _);
                         result = this.gvflt.UpdatePlaceholderIfNeeded(
                             placeholder.Path,
                             creationTime: now,
@@ -1769,7 +2105,7 @@ namespace GVFS.GVFlt.DotGit
                             lastWriteTime: now,
                             changeTime: now,
                             fileAttributes: (uint)NativeMethods.FileAttributes.FILE_ATTRIBUTE_ARCHIVE,
-                            endOfFile: data.Size,
+                            endOfFile: fileInfo.Size,
                             contentId: GVFltCallbacks.ConvertShaToContentId(projectedSha),
                             providerId: GVFltCallbacks.GetPlaceholderVersionId(),
                             updateFlags: FilePlaceholderUpdateFlags,
@@ -1899,7 +2235,12 @@ namespace GVFS.GVFlt.DotGit
             string folder = parentKey;
             while (!string.IsNullOrEmpty(folder))
             {
-                folderPlaceholdersToKeep.Add(folder);
+                // Whoever added folder is also adding its parents
+                if (!folderPlaceholdersToKeep.Add(folder))
+                {
+                    break;
+                }
+
                 this.GetChildNameAndParentKey(folder, out string _, out string parentFolder);
                 folder = parentFolder;
             }
@@ -1970,485 +2311,275 @@ namespace GVFS.GVFlt.DotGit
                     }
                 }
 
-                TimeSpan duration = tracer.Stop(null);
+                EventMetadata metadata = CreateEventMetadata();
+                metadata.Add("ProjectedEntries", this.projectionTree.Count);
+                metadata.Add("ProjectionBytes", this.projectionTree.AllocatedBytes);
+                TimeSpan duration = tracer.Stop(metadata);
                 this.context.Repository.GVFSLock.Stats.RecordParseGitIndex((long)duration.TotalMilliseconds);
             }
         }
 
-        private void ParseIndexAndBuildProjection(FileStream indexFileStream)
+        /// <summary>
+        /// Publishes the projection in the snapshot that SaveProjectionSnapshot wrote, if it was built from the same index
+        /// as the projection index backup
+        /// </summary>
+        /// <returns>
+        /// false if there is no snapshot that can be used (in which case the projection must be built from the index)
+        /// </returns>
+        private bool TryLoadProjectionSnapshot()
         {
-            CallbackResult result = PerformIndexAction(this, indexFileStream, IndexAction.RebuildProjection);
-
-            if (result != CallbackResult.Success)
+            if (!this.context.FileSystem.FileExists(this.projectionSnapshotPath))
             {
-                // RebuildProjection should always result in CallbackResult.Success (or a thrown exception)
-                throw new InvalidOperationException("ParseIndexAndBuildProjection: PerformIndexAction failed to rebuild projection");
+                return false;
             }
-        }
 
-        public class SizesUnavailableException : Exception
-        {
-            public SizesUnavailableException(string message)
-                : base(message)
+            using (ITracer activity = this.context.Tracer.StartActivity("LoadProjectionSnapshot", EventLevel.Informational))
             {
-            }
-        }
-
-        private class GitPathSplitter
-        {
-            private const int MaxParts = MaxPathBufferSize / 2;
-            private const byte PathSeparatorCode = 0x2F;
+                EventMetadata metadata = CreateEventMetadata();
+                ProjectionTree tree;
+                string error;
+                try
+                {
+                    if (!ProjectionTree.TryReadSnapshot(this.projectionSnapshotPath, ReadIndexChecksum(this.projectionIndexBackupPath), out tree, out error))
+                    {
+                        metadata.Add(TracingConstants.MessageKey.InfoMessage, "Unable to use the projection snapshot, building the projection from the index: " + error);
+                        activity.RelatedEvent(EventLevel.Informational, "LoadProjectionSnapshot_CannotUseSnapshot", metadata);
+                        return false;
+                    }
+                }
+                catch (Exception e)
+                {
+                    // The projection can always be built from the index instead
+                    EventMetadata errorMetadata = CreateEventMetadata(e);
+                    this.context.Tracer.RelatedWarning(errorMetadata, "LoadProjectionSnapshot: Exception thrown while reading the projection snapshot");
+                    return false;
+                }
 
-            private int previousFinalSeparatorIndex = int.MaxValue;
+                this.SetProjectionInvalid(false);
 
-            private char[] stringConversionBuffer = new char[MaxPathBufferSize];
+                // The snapshot does not have the offsets of the files in the index
+                this.offsetsInvalid = true;
 
-            public GitPathSplitter()
-            {
-                this.PathParts = new string[MaxParts];
-            }
+                this.PublishProjection(tree);
 
-            public string[] PathParts
-            {
-                get; private set;
+                metadata.Add("ProjectedEntries", tree.Count);
+                metadata.Add("ProjectionBytes", tree.AllocatedBytes);
+                activity.Stop(metadata);
             }
 
-            public int NumParts
-            {
-                get; private set;
-            }
+            return true;
+        }
 
-            public bool HasSameParentAsLastEntry
+        /// <summary>
+        /// Writes the projection to a snapshot (keyed by the checksum of the projection index backup that it was built
+        /// from), so that the next mount can load it rather than parsing the index
+        /// </summary>
+        private void SaveProjectionSnapshot()
+        {
+            ProjectionTree tree = this.projectionTree;
+            if (tree == null || this.projectionInvalid)
             {
-                get; private set;
+                return;
             }
 
-            public void Parse(byte[] pathBuffer, int pathLength, int replaceIndex)
+            using (ITracer activity = this.context.Tracer.StartActivity("SaveProjectionSnapshot", EventLevel.Informational))
             {
-                pathBuffer[pathLength] = 0;
-                int currentPartStartIndex = 0;
-                int startIndex = 0;
-
-                if (this.previousFinalSeparatorIndex < replaceIndex &&
-                    !this.RangeContains(pathBuffer, replaceIndex, pathLength, PathSeparatorCode))
+                string newSnapshotPath = this.projectionSnapshotPath + NewProjectionSnapshotExtension;
+                try
                 {
-                    // Only need to parse the last part, because the rest of the string is unchanged
-                    startIndex = this.previousFinalSeparatorIndex + 1;
-                    currentPartStartIndex = startIndex;
-
-                    this.NumParts--;
-
-                    this.HasSameParentAsLastEntry = true;
+                    tree.WriteSnapshot(newSnapshotPath, ReadIndexChecksum(this.projectionIndexBackupPath));
+                    this.context.FileSystem.MoveAndOverwriteFile(newSnapshotPath, this.projectionSnapshotPath);
                 }
-                else
+                catch (Exception e)
                 {
-                    this.NumParts = 0;
-                    this.ClearLastParent();
+                    EventMetadata errorMetadata = CreateEventMetadata(e);
+                    this.context.Tracer.RelatedWarning(errorMetadata, "SaveProjectionSnapshot: Unable to write the projection snapshot");
+                    this.context.FileSystem.TryDeleteFile(newSnapshotPath);
+                    return;
                 }
 
-                int partIndex = this.NumParts;
-
-                for (int i = startIndex; i < pathLength + 1; i++)
-                {
-                    if (pathBuffer[i] == PathSeparatorCode ||
-                        pathBuffer[i] == 0)
-                    {
-                        this.PathParts[partIndex] = this.UTF8ToString(pathBuffer, currentPartStartIndex, i - currentPartStartIndex);
-
-                        partIndex++;
-                        currentPartStartIndex = i + 1;
-
-                        this.NumParts++;
-
-                        if (pathBuffer[i] == PathSeparatorCode)
-                        {
-                            this.previousFinalSeparatorIndex = i;
-                        }
-                    }
-                }
+                EventMetadata metadata = CreateEventMetadata();
+                metadata.Add("ProjectedEntries", tree.Count);
+                activity.Stop(metadata);
             }
+        }
 
-            public void ClearLastParent()
-            {
-                this.previousFinalSeparatorIndex = int.MaxValue;
-                this.HasSameParentAsLastEntry = false;
-            }
+        private void ParseIndexAndBuildProjection(FileStream indexFileStream)
+        {
+            CallbackResult result = PerformIndexAction(this, indexFileStream, IndexAction.RebuildProjection);
 
-            public string GetChildName()
+            if (result != CallbackResult.Success)
             {
-                return this.PathParts[this.NumParts - 1];
+                // RebuildProjection should always result in CallbackResult.Success (or a thrown exception)
+                throw new InvalidOperationException("ParseIndexAndBuildProjection: PerformIndexAction failed to rebuild projection");
             }
+        }
 
-            public string GetFullPath()
+        /// <summary>
+        /// Updates the projection for the paths whose projection changed between the index it was built from (the
+        /// projection index backup) and the current index, and then replaces the backup with the current index
+        /// </summary>
+        /// <param name="projectionChanges">The files and folders that were changed are added to projectionChanges</param>
+        /// <returns>
+        /// false if the projection must be rebuilt instead, because there is no backup, too much has changed, or a
+        /// change cannot be made to the projection in the same way that rebuilding it would.  The projection is not
+        /// changed when false is returned.
+        /// </returns>
+        private bool TryCopyIndexFileAndUpdateProjection(ProjectionChanges projectionChanges)
+        {
+            if (!this.context.FileSystem.FileExists(this.projectionIndexBackupPath))
             {
-                return string.Join(GVFSConstants.GitPathSeparatorString, this.PathParts.Take(this.NumParts));
+                return false;
             }
 
-            public string GetParentPath()
-            {
-                if (this.NumParts > 1)
-                {
-                    return string.Join(GVFSConstants.GitPathSeparatorString, this.PathParts.Take(this.NumParts - 1));
-                }
+            this.SetProjectionInvalid(false);
 
-                return string.Empty;
-            }
+            // The offsets of entries after the first change are no longer correct
+            this.offsetsInvalid = true;
 
-            private bool RangeContains(byte[] buffer, int startIndex, int endIndex, byte value)
+            using (ITracer activity = this.context.Tracer.StartActivity("UpdateProjection", EventLevel.Informational))
             {
-                for (int i = startIndex; i < endIndex + 1; i++)
+                this.context.FileSystem.CopyFile(this.indexPath, this.updatedProjectionIndexBackupPath, overwrite: true);
+
+                List<IndexEntryChange> changes = new List<IndexEntryChange>();
+                EventMetadata metadata = CreateEventMetadata();
+                using (FileStream previousIndexStream = new FileStream(this.projectionIndexBackupPath, FileMode.Open, FileAccess.Read, FileShare.Read, IndexFileStreamBufferSize))
+                using (FileStream currentIndexStream = new FileStream(this.updatedProjectionIndexBackupPath, FileMode.Open, FileAccess.Read, FileShare.Read, IndexFileStreamBufferSize))
+                using (GitIndexReader previousIndex = new GitIndexReader(previousIndexStream))
+                using (GitIndexReader currentIndex = new GitIndexReader(currentIndexStream))
                 {
-                    if (buffer[i] == value)
+                    // RebuildProjection reports the unsupported index version
+                    if (previousIndex.Version != 4 || currentIndex.Version != 4)
                     {
-                        return true;
+                        return false;
+                    }
+
+                    int maxChanges = (int)(currentIndex.EntryCount * MaxIncrementalUpdateChangePercent / 100);
+                    if (!TryGetProjectedEntryChanges(previousIndex, currentIndex, maxChanges, changes))
+                    {
+                        metadata.Add(TracingConstants.MessageKey.InfoMessage, "Too many changes to update the projection, rebuilding it");
+                        activity.RelatedEvent(EventLevel.Informational, "UpdateProjection_TooManyChanges", metadata);
+                        return false;
                     }
                 }
 
-                return false;
-            }
+                metadata.Add("ChangedEntries", changes.Count);
 
-            private string UTF8ToString(byte[] buffer, int startIndex, int length)
-            {
-                for (int i = startIndex; i < startIndex + length; i++)
+                // Callbacks keep reading the current projection while its clone is changed.  Each change leaves the old
+                // children of a folder behind in the clone, and once most of it is unused the projection is rebuilt
+                // (which is still much less often than the index changes).
+                ProjectionTree tree = this.projectionTree.Clone();
+                if (!TryApplyProjectedEntryChanges(tree, changes, projectionChanges) || tree.UnusedEntryCount > tree.Count)
                 {
-                    if ((buffer[i] & (1 << 7)) == 0)
-                    {
-                        this.stringConversionBuffer[i - startIndex] = (char)buffer[i];
-                    }
-                    else
-                    {
-                        // The string has non-ASCII characters in it, fall back to full parsing
-                        return Encoding.UTF8.GetString(buffer, startIndex, length);
-                    }
+                    metadata.Add(TracingConstants.MessageKey.InfoMessage, "Unable to apply changes to the projection, rebuilding it");
+                    activity.RelatedEvent(EventLevel.Informational, "UpdateProjection_CannotApplyChanges", metadata);
+                    return false;
                 }
 
-                return new string(this.stringConversionBuffer, 0, length);
+                this.PublishProjection(tree);
+                this.context.FileSystem.MoveAndOverwriteFile(this.updatedProjectionIndexBackupPath, this.projectionIndexBackupPath);
+
+                TimeSpan duration = activity.Stop(metadata);
+                this.context.Repository.GVFSLock.Stats.RecordParseGitIndex((long)duration.TotalMilliseconds);
             }
+
+            return true;
         }
 
-        // Wrapper for FileOrFolderData that allows for caching string SHAs
-        private class FileMissingSize
+        public class SizesUnavailableException : Exception
         {
-            public FileMissingSize(FileOrFolderData fileOrFolderData, string sha)
+            public SizesUnavailableException(string message)
+                : base(message)
             {
-                this.Data = fileOrFolderData;
-                this.Sha = sha;
             }
+        }
 
-            public FileOrFolderData Data { get; }
-
-            public string Sha { get; }
-        }        
-
-        private class FileOrFolderData
+        /// <summary>
+        /// A change to the projection of a path, found by comparing two indexes
+        /// </summary>
+        public class IndexEntryChange
         {
-            public const long InvalidOffset = -1;
-
-            // Special values that can be stored in Size
-            // Use the Size field rather than additional fields to save on memory
-            private const long MinValidSize = 0;
-            private const long InvalidSize = -1;
-
-            private ulong shaBytes1through8;
-            private ulong shaBytes9Through16;
-            private uint shaBytes17Through20;
-
             /// <summary>
-            /// Create a FileOrFolderData for a folder
+            /// Creates a change that projects entry's file at its path
             /// </summary>
-            public FileOrFolderData()
+            public IndexEntryChange(GitIndexEntry entry)
             {
-                this.Size = FolderSizeMagicNumbers.ChildSizesNotSet;
-                this.ChildEntries = new SortedList<string, FileOrFolderData>(StringComparer.OrdinalIgnoreCase);
-                this.Offset = InvalidOffset;
+                this.GitPath = entry.GetPath();
+                this.IsProjected = true;
+
+                ulong shaBytes1through8;
+                ulong shaBytes9Through16;
+                uint shaBytes17Through20;
+                Sha1Id.ShaBufferToParts(entry.Sha, out shaBytes1through8, out shaBytes9Through16, out shaBytes17Through20);
+                this.Sha = new Sha1Id(shaBytes1through8, shaBytes9Through16, shaBytes17Through20);
+                this.Offset = entry.SkipWorktree ? entry.Offset : ProjectionTree.InvalidOffset;
             }
 
             /// <summary>
-            /// Create a FileOrFolderData for a file
+            /// Creates a change that stops projecting gitPath
             /// </summary>
-            public FileOrFolderData(byte[] shaBytes, long offset)    
+            public IndexEntryChange(string gitPath)
             {
-                this.Size = InvalidSize;
-                this.Offset = offset;
-                this.LastUpdateTime = 0;
-
-                Sha1Id.ShaBufferToParts(shaBytes, out this.shaBytes1through8, out this.shaBytes9Through16, out this.shaBytes17Through20);
+                this.GitPath = gitPath;
+                this.IsProjected = false;
             }
 
-            public bool IsFolder
-            {
-                get { return this.Size <= FolderSizeMagicNumbers.MaxSizeForFolderIndication; }
-            }
+            public string GitPath { get; }
 
-            public bool ChildrenHaveSizes
-            {
-                get
-                {
-                    return this.Size == FolderSizeMagicNumbers.ChildSizesSet;
-                }
-            }
-
-            public long Size { get; private set; }
-            public long Offset { get; private set; }
-            public uint LastUpdateTime { get; private set; }
+            /// <summary>
+            /// true if there is a file to project at GitPath, or false if GitPath is no longer projected
+            /// </summary>
+            public bool IsProjected { get; }
 
-            public SortedList<string, FileOrFolderData> ChildEntries { get; private set; }            
+            public Sha1Id Sha { get; }
 
-            public bool IsSizeSet()
-            {
-                return this.Size >= MinValidSize;
-            }
+            public long Offset { get; }
+        }
 
-            public string ConvertShaToString()
+        /// <summary>
+        /// The files whose projection was changed by incremental updates of the projection, and the folders that
+        /// contain them, as virtual paths (the same as the paths in the placeholder list)
+        /// </summary>
+        public class ProjectionChanges
+        {
+            public ProjectionChanges()
             {
-                return new Sha1Id(this.shaBytes1through8, this.shaBytes9Through16, this.shaBytes17Through20).ToString();
+                this.FilePaths = new HashSet<string>(StringComparer.OrdinalIgnoreCase);
+                this.FolderPaths = new HashSet<string>(StringComparer.OrdinalIgnoreCase);
             }
 
-            public void AddChild(ITracer tracer, string childName, FileOrFolderData data)
-            {
-                try
-                {
-                    this.ChildEntries.Add(childName, data);
-                }
-                catch (ArgumentException e)
-                {
-                    EventMetadata metadata = this.CreateEventMetadata(e);
-                    metadata.Add("childName", childName);
-                    tracer.RelatedWarning(metadata, "AddChild: Skipping addition of child, entry already exists in collection");
-                }
-            }
+            public HashSet<string> FilePaths { get; }
 
-            public void UpdateChildOffset(ITracer tracer, string childName, long offset, uint updateTime)
-            {
-                if (this.IsFolder)
-                {
-                    FileOrFolderData childData;
-                    if (this.ChildEntries.TryGetValue(childName, out childData))
-                    {
-                        childData.SetOffset(tracer, offset, updateTime);
-                    }
-                    else
-                    {
-                        EventMetadata metadata = this.CreateEventMetadata();
-                        metadata.Add("childName", childName);
-                        metadata.Add("offset", offset);
-                        tracer.RelatedWarning(metadata, "UpdateChildOffset: Failed to find childName in ChildEntries", Keywords.Telemetry);
-                    }
-                }
-                else
-                {
-                    EventMetadata metadata = this.CreateEventMetadata();
-                    metadata.Add("childName", childName);
-                    metadata.Add("offset", offset);
-                    tracer.RelatedWarning(metadata, "UpdateChildOffset: Skipping update of child, this FileOrFolderData is a file");
-                }
-            }
+            public HashSet<string> FolderPaths { get; }
 
-            public void FolderOnly_PopulateSizes(
-                ITracer tracer,                
-                GVFSGitObjects gitObjects,
-                BlobSizes.BlobSizesConnection blobSizesConnection,
-                Dictionary<string, long> availableSizes,
-                CancellationToken cancellationToken)
+            public void AddFile(string gitPath)
             {
-                if (this.ChildrenHaveSizes)
-                {
-                    return;
-                }
-
-                HashSet<string> missingShas;
-                List<FileMissingSize> childrenMissingSizes;
-                this.FolderOnly_PopulateSizesLocally(tracer, gitObjects, blobSizesConnection, availableSizes, out missingShas, out childrenMissingSizes);
+                string virtualPath = gitPath.Replace(GVFSConstants.GitPathSeparator, GVFSConstants.PathSeparator);
+                this.FilePaths.Add(virtualPath);
 
-                lock (this)
+                int separatorIndex = virtualPath.LastIndexOf(GVFSConstants.PathSeparator);
+                while (separatorIndex > 0 && this.FolderPaths.Add(virtualPath.Substring(0, separatorIndex)))
                 {
-                    // Check ChildrenHaveSizes again in case another 
-                    // thread has already done the work of setting the sizes
-                    if (this.ChildrenHaveSizes)
-                    {
-                        return;
-                    }
-                    
-                    this.PopulateSizesFromRemote(
-                        tracer,
-                        gitObjects,
-                        blobSizesConnection,
-                        missingShas,
-                        childrenMissingSizes,
-                        cancellationToken);
+                    separatorIndex = virtualPath.LastIndexOf(GVFSConstants.PathSeparator, separatorIndex - 1);
                 }
             }
+        }
 
-            public bool FileOnly_TryPopulateSizeLocally(
-                ITracer tracer,
-                GVFSGitObjects gitObjects,
-                BlobSizes.BlobSizesConnection blobSizesConnection,
-                Dictionary<string, long> availableSizes,
-                out string missingSha)
+        // A file whose size is not available locally, and its SHA as a string
+        private class FileMissingSize
+        {
+            public FileMissingSize(int fileIndex, string sha)
             {
-                missingSha = null;
-                long blobLength = 0;
-
-                Sha1Id sha1Id = new Sha1Id(this.shaBytes1through8, this.shaBytes9Through16, this.shaBytes17Through20);
-                string shaString = null;
-
-                if (availableSizes != null)
-                {
-                    shaString = this.ConvertShaToString();
-                    if (availableSizes.TryGetValue(shaString, out blobLength))
-                    {
-                        this.Size = blobLength;
-                        return true;
-                    }
-                }
-
-                try
-                {
-                    if (blobSizesConnection.TryGetSize(sha1Id, out blobLength))
-                    {
-                        this.Size = blobLength;
-                        return true;
-                    }
-                }
-                catch (BlobSizesException e)
-                {
-                    EventMetadata metadata = this.CreateEventMetadata(e);
-                    missingSha = this.ConvertShaToString();
-                    metadata.Add(nameof(missingSha), missingSha);
-                    tracer.RelatedWarning(metadata, $"{nameof(this.FileOnly_TryPopulateSizeLocally)}: Exception while trying to get file size", Keywords.Telemetry);
-                }
-
-                if (missingSha == null)
-                {
-                    missingSha = (shaString == null) ? this.ConvertShaToString() : shaString;
-                }
-                
-                if (gitObjects.TryGetBlobSizeLocally(missingSha, out blobLength))
-                {
-                    this.Size = blobLength;
-
-                    // There is no flush for this value because it's already local, so there's little loss if it doesn't get persisted
-                    // But it's faster to wait for some remote call to batch this value into a different flush
-                    blobSizesConnection.BlobSizesDatabase.AddSize(sha1Id, blobLength);
-                    return true;
-                }
-
-                return false;
-            }
-
-            /// <summary>
-            /// Populates the sizes of child entries in the folder using locally available data
-            /// </summary>
-            private void FolderOnly_PopulateSizesLocally(
-                ITracer tracer,
-                GVFSGitObjects gitObjects,
-                BlobSizes.BlobSizesConnection blobSizesConnection,
-                Dictionary<string, long> availableSizes,
-                out HashSet<string> missingShas,
-                out List<FileMissingSize> childrenMissingSizes)
-            {
-                if (this.ChildrenHaveSizes)
-                {
-                    missingShas = null;
-                    childrenMissingSizes = null;
-                    return;
-                }
-                
-                missingShas = new HashSet<string>();
-                childrenMissingSizes = new List<FileMissingSize>();
-                foreach (KeyValuePair<string, FileOrFolderData> childEntry in this.ChildEntries)
-                {
-                    if (!childEntry.Value.IsFolder && !childEntry.Value.IsSizeSet())
-                    {
-                        string sha;
-                        if (!childEntry.Value.FileOnly_TryPopulateSizeLocally(tracer, gitObjects, blobSizesConnection, availableSizes, out sha))
-                        {
-                            childrenMissingSizes.Add(new FileMissingSize(childEntry.Value, sha));
-                            missingShas.Add(sha);
-                        }
-                    }
-                }
-
-                if (childrenMissingSizes.Count == 0)
-                {
-                    this.Size = FolderSizeMagicNumbers.ChildSizesSet;
-                }
+                this.FileIndex = fileIndex;
+                this.Sha = sha;
             }
 
             /// <summary>
-            /// Populate sizes using size data from the remote
+            /// The file's index in the projection tree
             /// </summary>
-            /// <param name="missingShas">Set of object shas whose sizes should be downloaded from the remote.  This set should contains all the distinct SHAs from
-            /// in childrenMissingSizes.  PopulateSizesLocally can be used to generate this set</param>
-            /// <param name="childrenMissingSizes">List of child entries whose sizes should be downloaded from the remote.  PopulateSizesLocally
-            /// can be used to generate this list</param>
-            private void PopulateSizesFromRemote(
-                ITracer tracer,
-                GVFSGitObjects gitObjects,
-                BlobSizes.BlobSizesConnection blobSizesConnection,
-                HashSet<string> missingShas,
-                List<FileMissingSize> childrenMissingSizes,
-                CancellationToken cancellationToken)
-            {
-                if (childrenMissingSizes != null && childrenMissingSizes.Count > 0)
-                {
-                    Dictionary<string, long> objectLengths = gitObjects.GetFileSizes(missingShas, cancellationToken).ToDictionary(s => s.Id, s => s.Size, StringComparer.OrdinalIgnoreCase);
-                    foreach (FileMissingSize childNeedingSize in childrenMissingSizes)
-                    {
-                        long blobLength = 0;
-                        if (objectLengths.TryGetValue(childNeedingSize.Sha, out blobLength))
-                        {
-                            childNeedingSize.Data.Size = blobLength;
-                            blobSizesConnection.BlobSizesDatabase.AddSize(
-                                new Sha1Id(childNeedingSize.Data.shaBytes1through8, childNeedingSize.Data.shaBytes9Through16, childNeedingSize.Data.shaBytes17Through20), 
-                                blobLength);
-                        }
-                        else
-                        {
-                            EventMetadata metadata = this.CreateEventMetadata();
-                            metadata.Add("SHA", childNeedingSize.Sha);
-                            tracer.RelatedError(metadata, "PopulateMissingSizesFromRemote: Failed to download size for child entry", Keywords.Network);
-                            throw new SizesUnavailableException("Failed to download size for " + childNeedingSize.Sha);
-                        }
-                    }
-
-                    blobSizesConnection.BlobSizesDatabase.Flush();
-                }
+            public int FileIndex { get; }
 
-                this.Size = FolderSizeMagicNumbers.ChildSizesSet;
-            }
-
-            private void SetOffset(ITracer tracer, long offset, uint updateTime)
-            {
-                if (this.IsFolder)
-                {
-                    EventMetadata metadata = this.CreateEventMetadata();
-                    metadata.Add("offset", offset);
-                    metadata.Add("updateTime", updateTime);
-                    tracer.RelatedWarning(metadata, "SetOffset: Skipping update of file offset, this FileOrFolderData is a folder");
-                }
-                else
-                {
-                    this.Offset = offset;
-                    this.LastUpdateTime = updateTime;
-                }
-            }
-
-            private EventMetadata CreateEventMetadata(Exception e = null)
-            {
-                EventMetadata metadata = GitIndexProjection.CreateEventMetadata(e);
-                return metadata;
-            }
-
-            // Special values that can be stored in Size to indicate that the FileOrFolderData is a folder, and to indicate that
-            // folder's state
-            // Use the Size field rather than additional fields to save on memory
-            private static class FolderSizeMagicNumbers
-            {
-                public const long MaxSizeForFolderIndication = -2; // All values less than or equal to MaxSizeForFolderIndication indicate a folder
-                public const long ChildSizesNotSet = -2;           // Size of -2 indicates that FileOrFolderData is a folder whose children do not have their sizes
-                public const long ChildSizesSet = -3;              // Size of -3 indicates that FileOrFolderData is a folder whose children do have their sizes
-            }
+            public string Sha { get; }
         }
     }
 }
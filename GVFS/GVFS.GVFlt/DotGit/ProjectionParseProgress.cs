@@ -0,0 +1,334 @@
+﻿using GVFS.Common;
+using GVFS.Common.Tracing;
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Threading;
+
+namespace GVFS.GVFlt.DotGit
+{
+    /// <summary>
+    /// How far the parse of the index at mount has got, so that callbacks for folders that have already been parsed
+    /// can be served before the parse finishes.  The parse adds each folder (see
+    /// <see cref="ProjectionTree.Builder.FolderAdded"/>) once all of its children are known, and callbacks wait (see
+    /// <see cref="TryWaitForFolder"/>) until the index has been parsed past every path that could be in the folder that
+    /// they need.
+    /// </summary>
+    /// <remarks>
+    /// The index is sorted by the bytes of each path, and so it has been parsed past a folder once a folder that sorts
+    /// after it (and is not in it) has been added.  The projection ignores case, and so the last path that could be in
+    /// a folder is found from the lower case of the folder's path ('a' sorts after 'A').  A folder that is in the index
+    /// with more than one case is only merged when its parent is added, and so callbacks for it wait for the whole
+    /// parse, as do callbacks for the root folder and for paths with non-ASCII characters.
+    ///
+    /// When the index is parsed in blocks on separate threads, only the first block that has not finished moves the
+    /// parse forward, and the folders that a block adds when it finishes could have more children in the next block.
+    /// </remarks>
+    public class ProjectionParseProgress
+    {
+        private readonly object progressLock = new object();
+
+        // Keyed by virtual path.  Folders that cannot be served until the parse finishes have a null Tree.
+        private Dictionary<string, ParsedFolder> folders;
+
+        // The git path of the last folder that each block was parsed past, and of the last folder that the whole index
+        // was parsed past (from the first block that has not finished)
+        private string[] blockParsedThroughPaths;
+        private bool[] finishedBlocks;
+        private int firstUnfinishedBlock;
+        private string parsedThroughPath;
+        private bool isComplete;
+
+        // The last path that could be in the folder that each waiting callback needs (see GetLastPathInFolder)
+        private List<string> waitingForPaths;
+
+        private int folderLookups;
+        private int lookupsThatWaited;
+        private int lookupsThatWaitedForFullParse;
+        private long waitTimeMs;
+        private long maxWaitTimeMs;
+
+        public ProjectionParseProgress()
+        {
+            this.folders = new Dictionary<string, ParsedFolder>(StringComparer.OrdinalIgnoreCase);
+            this.waitingForPaths = new List<string>();
+            this.Start(blockCount: 1);
+        }
+
+        /// <summary>
+        /// Starts tracking a parse of the index in blockCount blocks (see AddFolder and FinishBlock)
+        /// </summary>
+        public void Start(int blockCount)
+        {
+            lock (this.progressLock)
+            {
+                this.blockParsedThroughPaths = new string[blockCount];
+                this.finishedBlocks = new bool[blockCount];
+                this.firstUnfinishedBlock = 0;
+                this.parsedThroughPath = null;
+                this.folders.Clear();
+            }
+        }
+
+        /// <summary>
+        /// Adds a folder that callbacks can be served from
+        /// </summary>
+        /// <param name="blockIndex">The block of the index that the folder was parsed from</param>
+        /// <param name="tree">The tree that the block is being built in</param>
+        /// <param name="folderPath">The folder's git path</param>
+        /// <param name="folderIndex">The index of the folder in tree</param>
+        /// <param name="isParsedPast">
+        /// true if a path after the folder has been parsed, and false if the block ended (in which case the folder could
+        /// have more children in the next block)
+        /// </param>
+        public void AddFolder(int blockIndex, ProjectionTree tree, string folderPath, int folderIndex, bool isParsedPast)
+        {
+            string virtualPath = folderPath.Replace(GVFSConstants.GitPathSeparator, GVFSConstants.PathSeparator);
+            lock (this.progressLock)
+            {
+                if (this.folders.ContainsKey(virtualPath) || !isParsedPast)
+                {
+                    this.folders[virtualPath] = new ParsedFolder(null, folderIndex);
+                }
+                else
+                {
+                    this.folders.Add(virtualPath, new ParsedFolder(tree, folderIndex));
+                }
+
+                if (isParsedPast)
+                {
+                    this.blockParsedThroughPaths[blockIndex] = folderPath;
+                    if (blockIndex == this.firstUnfinishedBlock)
+                    {
+                        this.SetParsedThroughPath(folderPath);
+                    }
+                }
+            }
+        }
+
+        /// <summary>
+        /// Records that every entry in a block of the index has been parsed (and its folders added)
+        /// </summary>
+        public void FinishBlock(int blockIndex)
+        {
+            lock (this.progressLock)
+            {
+                this.finishedBlocks[blockIndex] = true;
+                while (this.firstUnfinishedBlock < this.finishedBlocks.Length && this.finishedBlocks[this.firstUnfinishedBlock])
+                {
+                    ++this.firstUnfinishedBlock;
+                    if (this.firstUnfinishedBlock < this.finishedBlocks.Length && this.blockParsedThroughPaths[this.firstUnfinishedBlock] != null)
+                    {
+                        this.SetParsedThroughPath(this.blockParsedThroughPaths[this.firstUnfinishedBlock]);
+                    }
+                }
+            }
+        }
+
+        /// <summary>
+        /// Records that the parse has finished (or failed), and wakes every waiting callback
+        /// </summary>
+        /// <remarks>The complete projection must be published before Complete is called</remarks>
+        public void Complete()
+        {
+            lock (this.progressLock)
+            {
+                this.isComplete = true;
+                this.folders.Clear();
+                Monitor.PulseAll(this.progressLock);
+            }
+        }
+
+        /// <summary>
+        /// Waits until the folder whose virtual path is folderPath[0] through folderPath[length - 1] has been parsed, or
+        /// until the parse has finished
+        /// </summary>
+        /// <returns>
+        /// true if the folder has been parsed, in which case tree and folderIndex are the folder (or tree is null if the
+        /// folder is not in the projection), and false if the caller must use the complete projection instead
+        /// </returns>
+        public bool TryWaitForFolder(string folderPath, int length, out ProjectionTree tree, out int folderIndex)
+        {
+            tree = null;
+            folderIndex = ProjectionTree.RootIndex;
+
+            string lastPathInFolder = GetLastPathInFolder(folderPath, length);
+            Stopwatch waitTime = null;
+            lock (this.progressLock)
+            {
+                ++this.folderLookups;
+                while (!this.isComplete)
+                {
+                    if (lastPathInFolder != null && IsParsedPast(this.parsedThroughPath, lastPathInFolder))
+                    {
+                        ParsedFolder folder;
+                        if (!this.folders.TryGetValue(folderPath.Substring(0, length), out folder))
+                        {
+                            // Every path that could be in the folder has been parsed, and none were
+                            this.RecordWait(waitTime, waitedForFullParse: false);
+                            return true;
+                        }
+
+                        if (folder.Tree != null)
+                        {
+                            tree = folder.Tree;
+                            folderIndex = folder.Index;
+                            this.RecordWait(waitTime, waitedForFullParse: false);
+                            return true;
+                        }
+
+                        // The folder could still be merged with a folder that has the same name
+                        lastPathInFolder = null;
+                    }
+
+                    if (waitTime == null)
+                    {
+                        waitTime = Stopwatch.StartNew();
+                    }
+
+                    if (lastPathInFolder != null)
+                    {
+                        this.waitingForPaths.Add(lastPathInFolder);
+                        Monitor.Wait(this.progressLock);
+                        this.waitingForPaths.Remove(lastPathInFolder);
+                    }
+                    else
+                    {
+                        Monitor.Wait(this.progressLock);
+                    }
+                }
+
+                this.RecordWait(waitTime, waitedForFullParse: waitTime != null);
+                return false;
+            }
+        }
+
+        public void AddStatsToTelemetry(EventMetadata metadata)
+        {
+            lock (this.progressLock)
+            {
+                metadata.Add("FolderLookups", this.folderLookups);
+                metadata.Add("LookupsThatWaited", this.lookupsThatWaited);
+                metadata.Add("LookupsThatWaitedForFullParse", this.lookupsThatWaitedForFullParse);
+                metadata.Add("WaitTimeMS", this.waitTimeMs);
+                metadata.Add("MaxWaitTimeMS", this.maxWaitTimeMs);
+            }
+        }
+
+        /// <summary>
+        /// Returns the git path, in lower case, of the folder whose virtual path is folderPath[0] through
+        /// folderPath[length - 1].  No path in the folder (with any case) sorts after this path followed by '/'.
+        /// </summary>
+        /// <returns>null if the folder cannot be served until the parse finishes</returns>
+        private static string GetLastPathInFolder(string folderPath, int length)
+        {
+            if (length == 0 ||
+                folderPath[0] == GVFSConstants.PathSeparator ||
+                folderPath[length - 1] == GVFSConstants.PathSeparator)
+            {
+                return null;
+            }
+
+            char[] lastPath = new char[length];
+            for (int i = 0; i < length; ++i)
+            {
+                char c = folderPath[i];
+                if (c >= 0x80 || (c == GVFSConstants.PathSeparator && folderPath[i - 1] == GVFSConstants.PathSeparator))
+                {
+                    return null;
+                }
+
+                if (c == GVFSConstants.PathSeparator)
+                {
+                    c = GVFSConstants.GitPathSeparator;
+                }
+                else if (c >= 'A' && c <= 'Z')
+                {
+                    c = (char)(c + ('a' - 'A'));
+                }
+
+                lastPath[i] = c;
+            }
+
+            return new string(lastPath);
+        }
+
+        /// <summary>
+        /// Returns true if every path in lastPathInFolder sorts before, or is in, parsedThroughPath (every path in which
+        /// has been parsed)
+        /// </summary>
+        /// <remarks>
+        /// lastPathInFolder is ASCII, and so comparing UTF-16 characters finds the same order as comparing UTF8 bytes
+        /// </remarks>
+        private static bool IsParsedPast(string parsedThroughPath, string lastPathInFolder)
+        {
+            if (parsedThroughPath == null)
+            {
+                return false;
+            }
+
+            // Compare the paths with a '/' after each, so that a folder is in another if its path starts with the other's
+            for (int i = 0; i <= lastPathInFolder.Length; ++i)
+            {
+                char last = i < lastPathInFolder.Length ? lastPathInFolder[i] : GVFSConstants.GitPathSeparator;
+                if (i == parsedThroughPath.Length)
+                {
+                    // lastPathInFolder is in parsedThroughPath if it has a '/' here
+                    return last == GVFSConstants.GitPathSeparator;
+                }
+
+                if (parsedThroughPath[i] != last)
+                {
+                    return parsedThroughPath[i] > last;
+                }
+            }
+
+            // parsedThroughPath is in lastPathInFolder, which could have more paths after it
+            return false;
+        }
+
+        private void SetParsedThroughPath(string folderPath)
+        {
+            this.parsedThroughPath = folderPath;
+            foreach (string waitingForPath in this.waitingForPaths)
+            {
+                if (IsParsedPast(folderPath, waitingForPath))
+                {
+                    Monitor.PulseAll(this.progressLock);
+                    break;
+                }
+            }
+        }
+
+        private void RecordWait(Stopwatch waitTime, bool waitedForFullParse)
+        {
+            if (waitTime == null)
+            {
+                return;
+            }
+
+            long waitTimeMs = waitTime.ElapsedMilliseconds;
+            ++this.lookupsThatWaited;
+            if (waitedForFullParse)
+            {
+                ++this.lookupsThatWaitedForFullParse;
+            }
+
+            this.waitTimeMs += waitTimeMs;
+            this.maxWaitTimeMs = Math.Max(this.maxWaitTimeMs, waitTimeMs);
+        }
+
+        private struct ParsedFolder
+        {
+            public ParsedFolder(ProjectionTree tree, int index)
+            {
+                this.Tree = tree;
+                this.Index = index;
+            }
+
+            public ProjectionTree Tree { get; }
+
+            public int Index { get; }
+        }
+    }
+}
@@ -0,0 +1,1541 @@
+﻿using GVFS.Common.Git;
+using GVFS.Common.Tracing;
+using System;
+using System.Collections.Generic;
+using System.IO;
+using System.IO.MemoryMappedFiles;
+using System.Runtime.InteropServices;
+using System.Text;
+
+namespace GVFS.GVFlt.DotGit
+{
+    /// <summary>
+    /// The files and folders that GitIndexProjection projects, stored in two large arrays rather than as an object
+    /// (and a name string) per file.  Every file and folder is a fixed-size entry in one array, with its name in a
+    /// shared pool of UTF8 bytes, and the children of a folder are a contiguous range of entries sorted by name
+    /// (ignoring case, as SortedList with StringComparer.OrdinalIgnoreCase did).
+    /// </summary>
+    /// <remarks>
+    /// Files and folders are referred to by the index of their entry, and RootIndex is the root folder.  Adding a
+    /// child to a folder moves the folder's children to the end of the array, and so indexes are only valid until
+    /// the tree is next changed.  The entries that are left behind are not reused (see <see cref="UnusedEntryCount"/>).
+    ///
+    /// Once the tree is built, <see cref="BuildChildTable"/> adds a hash table of every file and folder keyed by where
+    /// its parent's children start and the case-folded hash of its name, so that looking up a child is one or two
+    /// probes of the table rather than a binary search of its folder's children.  The table is kept up to date as the
+    /// tree is changed.
+    ///
+    /// <see cref="Clone"/> shares the arrays (and the child table) with the copy, which only copies the ranges of
+    /// children that it changes, and so changing a few files in a clone costs about as much as changing them in place.
+    ///
+    /// The arrays (and the child table) can be written to a snapshot file with <see cref="WriteSnapshot"/>, and read back
+    /// with <see cref="TryReadSnapshot"/> in a fraction of the time that it takes to parse the index again.
+    /// </remarks>
+    public class ProjectionTree
+    {
+        public const int RootIndex = 0;
+        public const long InvalidOffset = -1;
+
+        private const int MinEntriesCapacity = 16;
+        private const int MinNamesCapacity = 256;
+        private const int EstimatedNameLength = 16;
+        private const byte PathSeparatorCode = 0x2F;
+
+        private const long MinValidSize = 0;
+        private const long InvalidSize = -1;
+
+        private const int MinChildTableCapacity = 16;
+        private const int EmptyChildTableSlot = 0;
+
+        // Changing the tree adds to the child table (which BuildChildTable leaves at most half full) until it is three
+        // quarters full, and then drops it so that BuildChildTable builds a bigger one
+        private const int MaxChildTableLoadPercent = 75;
+        private const uint FnvOffsetBasis = 2166136261;
+        private const uint FnvPrime = 16777619;
+
+        // Snapshot files start with the signature ("GVPT"), the version, the size of an entry, the checksum of the index
+        // that the tree was built from, and the lengths of the entries, names and child table (which then follow)
+        private const uint SnapshotSignature = 0x54505647;
+        private const int SnapshotVersion = 2;
+        private const int IndexChecksumLength = 20;
+        private const int SnapshotHeaderLength = (3 * sizeof(int)) + IndexChecksumLength + (4 * sizeof(int));
+
+        private Entry[] entries;
+        private int entriesLength;
+        private byte[] names;
+        private int namesLength;
+        private int count;
+
+        // The index of the root's entry, which a clone moves the first time that it changes the root (see Clone).
+        // RootIndex always refers to the root, and no other entry is ever at index 0.
+        private int rootIndex;
+
+        // Entries before sharedEntriesLength are shared with the tree that this tree was cloned from, and so are
+        // never changed (other than their sizes and offsets).  0 when this tree has its own entries.
+        private int sharedEntriesLength;
+
+        // true once the tree has been cloned, after which it cannot be changed (see Clone)
+        private bool hasBeenCloned;
+
+        // The index of every entry in the tree (other than the root, and so 0 is an empty slot), see BuildChildTable.
+        // Entries that have been moved or removed can still have slots, which lookups skip.  null when the table has
+        // not been built, or became too full to add to.
+        private int[] childTable;
+        private int childTableCount;
+
+        // true until the Builder that is building the tree finishes.  Callbacks can read the folders of a tree that is
+        // being built (see Builder.FolderAdded), but sizes that they set can be lost when the entries are reallocated,
+        // and so the tree does not record which folders have the sizes of their children until it is built.
+        private volatile bool isBeingBuilt;
+
+        private ProjectionTree(int entriesCapacity, int namesCapacity)
+        {
+            this.entries = new Entry[Math.Max(entriesCapacity, MinEntriesCapacity)];
+            this.names = new byte[Math.Max(namesCapacity, MinNamesCapacity)];
+
+            Entry root = new Entry();
+            root.Size = FolderSizeMagicNumbers.ChildSizesNotSet;
+            this.AppendEntry(root);
+        }
+
+        /// <summary>
+        /// The number of files and folders in the tree, not counting the root folder
+        /// </summary>
+        public int Count
+        {
+            get { return this.count; }
+        }
+
+        /// <summary>
+        /// Entries that are no longer part of the tree, because their folder's children were moved or they were removed
+        /// </summary>
+        public int UnusedEntryCount
+        {
+            get { return this.entriesLength - this.count - 1; }
+        }
+
+        /// <summary>
+        /// The number of bytes allocated for the tree's entries, names and child table
+        /// </summary>
+        public long AllocatedBytes
+        {
+            get
+            {
+                long childTableBytes = this.childTable == null ? 0 : (long)this.childTable.Length * sizeof(int);
+                return ((long)this.entries.Length * Marshal.SizeOf(typeof(Entry))) + this.names.Length + childTableBytes;
+            }
+        }
+
+        /// <summary>
+        /// Reads the tree in the snapshot file at path, if it was written by WriteSnapshot for the index whose checksum
+        /// is indexChecksum
+        /// </summary>
+        /// <returns>
+        /// false (with the reason in error) if the snapshot is for a different index, was written by a different version
+        /// of GVFS, or is not a valid tree
+        /// </returns>
+        /// <remarks>
+        /// The offsets of files are not kept, as they are only valid until the index is next parsed, and none of the
+        /// folders are marked as having their children's sizes (see <see cref="Clone"/>).
+        /// </remarks>
+        public static bool TryReadSnapshot(string path, byte[] indexChecksum, out ProjectionTree tree, out string error)
+        {
+            tree = null;
+            using (FileStream snapshotStream = new FileStream(path, FileMode.Open, FileAccess.Read, FileShare.Read))
+            {
+                if (snapshotStream.Length < SnapshotHeaderLength)
+                {
+                    error = "Snapshot is too short (" + snapshotStream.Length + " bytes)";
+                    return false;
+                }
+
+                using (MemoryMappedFile snapshotMapping = MemoryMappedFile.CreateFromFile(
+                    snapshotStream,
+                    mapName: null,
+                    capacity: 0,
+                    access: MemoryMappedFileAccess.Read,
+                    memoryMappedFileSecurity: null,
+                    inheritability: HandleInheritability.None,
+                    leaveOpen: true))
+                using (MemoryMappedViewAccessor snapshotView = snapshotMapping.CreateViewAccessor(0, snapshotStream.Length, MemoryMappedFileAccess.Read))
+                {
+                    long position = 0;
+                    uint signature = snapshotView.ReadUInt32(position);
+                    int version = snapshotView.ReadInt32(position + sizeof(uint));
+                    int entrySize = snapshotView.ReadInt32(position + sizeof(uint) + sizeof(int));
+                    position += 3 * sizeof(int);
+                    if (signature != SnapshotSignature || version != SnapshotVersion || entrySize != Marshal.SizeOf(typeof(Entry)))
+                    {
+                        error = "Unsupported snapshot version: " + version;
+                        return false;
+                    }
+
+                    byte[] snapshotIndexChecksum = new byte[IndexChecksumLength];
+                    snapshotView.ReadArray(position, snapshotIndexChecksum, 0, IndexChecksumLength);
+                    position += IndexChecksumLength;
+                    for (int i = 0; i < IndexChecksumLength; ++i)
+                    {
+                        if (snapshotIndexChecksum[i] != indexChecksum[i])
+                        {
+                            error = "Snapshot is for a different index";
+                            return false;
+                        }
+                    }
+
+                    int entriesLength = snapshotView.ReadInt32(position);
+                    int namesLength = snapshotView.ReadInt32(position + sizeof(int));
+                    int count = snapshotView.ReadInt32(position + (2 * sizeof(int)));
+                    int childTableLength = snapshotView.ReadInt32(position + (3 * sizeof(int)));
+                    position += 4 * sizeof(int);
+                    long expectedLength = position + ((long)entriesLength * entrySize) + namesLength + ((long)childTableLength * sizeof(int));
+                    if (entriesLength < 1 || namesLength < 0 || count < 0 || count >= entriesLength || childTableLength < 0 || expectedLength != snapshotStream.Length)
+                    {
+                        error = "Snapshot is " + snapshotStream.Length + " bytes, which does not match its header";
+                        return false;
+                    }
+
+                    tree = new ProjectionTree(entriesLength, namesLength);
+                    snapshotView.ReadArray(position, tree.entries, 0, entriesLength);
+                    position += (long)entriesLength * entrySize;
+                    if (namesLength > 0)
+                    {
+                        snapshotView.ReadArray(position, tree.names, 0, namesLength);
+                        position += namesLength;
+                    }
+
+                    tree.entriesLength = entriesLength;
+                    tree.namesLength = namesLength;
+                    tree.count = count;
+
+                    if (childTableLength > 0)
+                    {
+                        tree.childTable = new int[childTableLength];
+                        snapshotView.ReadArray(position, tree.childTable, 0, childTableLength);
+                    }
+                }
+            }
+
+            if (!tree.TryValidateSnapshot(out error))
+            {
+                tree = null;
+                return false;
+            }
+
+            error = null;
+            return true;
+        }
+
+        public bool IsFolder(int index)
+        {
+            return this.entries[this.GetEntryIndex(index)].Size <= FolderSizeMagicNumbers.MaxSizeForFolderIndication;
+        }
+
+        public int GetFirstChild(int folderIndex)
+        {
+            return this.entries[this.GetEntryIndex(folderIndex)].FirstChild;
+        }
+
+        public int GetChildCount(int folderIndex)
+        {
+            return this.entries[this.GetEntryIndex(folderIndex)].ChildCount;
+        }
+
+        public string GetName(int index)
+        {
+            index = this.GetEntryIndex(index);
+            return Encoding.UTF8.GetString(this.names, this.entries[index].NameOffset, this.entries[index].NameLength);
+        }
+
+        public bool NameEquals(int index, string name)
+        {
+            return string.Equals(this.GetName(index), name, StringComparison.Ordinal);
+        }
+
+        public Sha1Id GetSha(int fileIndex)
+        {
+            return this.entries[fileIndex].Sha;
+        }
+
+        /// <summary>
+        /// The file's size, which is only valid when IsSizeSet is true
+        /// </summary>
+        public long GetSize(int fileIndex)
+        {
+            return this.entries[fileIndex].Size;
+        }
+
+        public bool IsSizeSet(int fileIndex)
+        {
+            return this.entries[fileIndex].Size >= MinValidSize;
+        }
+
+        public void SetSize(int fileIndex, long size)
+        {
+            this.entries[fileIndex].Size = size;
+        }
+
+        public bool ChildrenHaveSizes(int folderIndex)
+        {
+            return !this.isBeingBuilt && this.entries[this.GetEntryIndex(folderIndex)].Size == FolderSizeMagicNumbers.ChildSizesSet;
+        }
+
+        public void SetChildrenHaveSizes(int folderIndex)
+        {
+            if (!this.isBeingBuilt)
+            {
+                this.entries[this.GetEntryIndex(folderIndex)].Size = FolderSizeMagicNumbers.ChildSizesSet;
+            }
+        }
+
+        public long GetOffset(int fileIndex)
+        {
+            return this.entries[fileIndex].Offset;
+        }
+
+        public uint GetLastUpdateTime(int fileIndex)
+        {
+            return this.entries[fileIndex].LastUpdateTime;
+        }
+
+        public void SetOffset(int fileIndex, long offset, uint updateTime)
+        {
+            this.entries[fileIndex].Offset = offset;
+            this.entries[fileIndex].LastUpdateTime = updateTime;
+        }
+
+        /// <summary>
+        /// Finds the child of folderIndex named name (ignoring case)
+        /// </summary>
+        public bool TryGetChild(int folderIndex, string name, out int childIndex)
+        {
+            return this.TryGetChild(folderIndex, name, 0, name.Length, out childIndex);
+        }
+
+        /// <summary>
+        /// Finds the child of folderIndex named name[start] through name[start + length - 1] (ignoring case)
+        /// </summary>
+        public bool TryGetChild(int folderIndex, string name, int start, int length, out int childIndex)
+        {
+            folderIndex = this.GetEntryIndex(folderIndex);
+            if (this.childTable != null)
+            {
+                return this.TryGetChildFromTable(folderIndex, name, start, length, GetFoldedHash(name, start, length), out childIndex);
+            }
+
+            childIndex = this.BinarySearchChildren(folderIndex, name, start, length);
+            return childIndex >= 0;
+        }
+
+        /// <summary>
+        /// Finds the child of folderIndex whose UTF8 name is name[start] through name[start + length - 1] (ignoring case)
+        /// </summary>
+        public bool TryGetChild(int folderIndex, byte[] name, int start, int length, out int childIndex)
+        {
+            folderIndex = this.GetEntryIndex(folderIndex);
+            uint hash;
+            if (this.childTable != null && TryGetFoldedHash(name, start, length, out hash))
+            {
+                return this.TryGetChildFromTable(folderIndex, name, start, length, hash, out childIndex);
+            }
+
+            childIndex = this.BinarySearchChildren(folderIndex, name, start, length);
+            return childIndex >= 0;
+        }
+
+        /// <summary>
+        /// Finds the file or folder whose path is path[0] through path[length - 1], where the names in the path are
+        /// separated by separator.  Empty names (from repeated separators) are skipped.
+        /// </summary>
+        /// <remarks>The path is walked in place, and so nothing is allocated for the lookup</remarks>
+        public bool TryGetPath(string path, int length, char separator, out int index)
+        {
+            index = RootIndex;
+            int nameStart = 0;
+            while (nameStart < length)
+            {
+                int nameEnd = path.IndexOf(separator, nameStart, length - nameStart);
+                if (nameEnd < 0)
+                {
+                    nameEnd = length;
+                }
+
+                if (nameEnd > nameStart)
+                {
+                    if (!this.IsFolder(index) || !this.TryGetChild(index, path, nameStart, nameEnd - nameStart, out index))
+                    {
+                        return false;
+                    }
+                }
+
+                nameStart = nameEnd + 1;
+            }
+
+            return true;
+        }
+
+        /// <summary>
+        /// Finds the folder whose UTF8 git path is path[0] through path[length - 1]
+        /// </summary>
+        public bool TryGetFolder(byte[] path, int length, out int folderIndex)
+        {
+            folderIndex = RootIndex;
+            int nameStart = 0;
+            while (nameStart < length)
+            {
+                int nameEnd = nameStart;
+                while (nameEnd < length && path[nameEnd] != PathSeparatorCode)
+                {
+                    ++nameEnd;
+                }
+
+                if (!this.TryGetChild(folderIndex, path, nameStart, nameEnd - nameStart, out folderIndex) || !this.IsFolder(folderIndex))
+                {
+                    return false;
+                }
+
+                nameStart = nameEnd + 1;
+            }
+
+            return true;
+        }
+
+        /// <summary>
+        /// Adds an empty folder to parentIndex
+        /// </summary>
+        /// <returns>The index of the new folder</returns>
+        /// <remarks>
+        /// There must not already be a child named name.  In a clone, parentIndex must be RootIndex or a folder returned
+        /// by <see cref="PrepareToChangeChild"/> or AddFolder (as for SetFile and RemoveChild).
+        /// </remarks>
+        public int AddFolder(int parentIndex, string name)
+        {
+            Entry folder = new Entry();
+            folder.Size = FolderSizeMagicNumbers.ChildSizesNotSet;
+            return this.InsertChild(this.GetFolderToChange(parentIndex), name, folder);
+        }
+
+        /// <summary>
+        /// Adds a file to parentIndex, or replaces the file that is already there
+        /// </summary>
+        /// <returns>The index of the file</returns>
+        public int SetFile(int parentIndex, string name, Sha1Id sha, long offset)
+        {
+            parentIndex = this.GetFolderToChange(parentIndex);
+
+            // The file does not have its size yet
+            this.entries[parentIndex].Size = FolderSizeMagicNumbers.ChildSizesNotSet;
+
+            int fileIndex;
+            if (this.TryGetChild(parentIndex, name, out fileIndex))
+            {
+                fileIndex = this.CopySharedChildren(parentIndex, fileIndex);
+                this.entries[fileIndex].Size = InvalidSize;
+                this.entries[fileIndex].Sha = sha;
+                this.entries[fileIndex].Offset = offset;
+                this.entries[fileIndex].LastUpdateTime = 0;
+                return fileIndex;
+            }
+
+            return this.InsertChild(parentIndex, name, CreateFileEntry(sha, offset));
+        }
+
+        /// <summary>
+        /// Removes a child from its parent folder.  Anything in the child (when it is a folder) is also removed.
+        /// </summary>
+        public void RemoveChild(int parentIndex, int childIndex)
+        {
+            parentIndex = this.GetFolderToChange(parentIndex);
+            childIndex = this.CopySharedChildren(parentIndex, childIndex);
+            this.count -= this.CountEntries(childIndex);
+
+            int end = this.entries[parentIndex].FirstChild + this.entries[parentIndex].ChildCount;
+            Array.Copy(this.entries, childIndex + 1, this.entries, childIndex, end - childIndex - 1);
+            this.entries[parentIndex].ChildCount -= 1;
+            this.AddToChildTable(parentIndex, childIndex, end - 1);
+        }
+
+        /// <summary>
+        /// Makes a child of folderIndex one that can be changed (or have its children changed) without changing the tree
+        /// that this tree was cloned from
+        /// </summary>
+        /// <param name="folderIndex">RootIndex, or a folder returned by PrepareToChangeChild or AddFolder</param>
+        /// <returns>The index of the child, which is different when the children of folderIndex had to be copied</returns>
+        public int PrepareToChangeChild(int folderIndex, int childIndex)
+        {
+            return this.CopySharedChildren(this.GetFolderToChange(folderIndex), childIndex);
+        }
+
+        /// <summary>
+        /// Returns a copy of the tree that can be changed while other threads are still reading this one.  This tree
+        /// cannot be changed once it has been cloned.
+        /// </summary>
+        /// <remarks>
+        /// The copy shares this tree's entries, names and child table.  It adds its entries and names after this tree's,
+        /// and copies the children of a folder to the end of the entries before it changes them (and so the folder's
+        /// parent's children, and so on up to the root).  The entries that the trees share are the same files and
+        /// folders in both, and so sizes and offsets that are set in one are valid in the other.  A folder's entry is
+        /// always copied before its children, and so a folder is only copied as having its children's sizes when the
+        /// sizes were set before they were copied.
+        ///
+        /// Only the most recent clone of a tree can share it, as a clone that is discarded may have added entries, names
+        /// and child table slots after this tree's.  Cloning the tree again copies all of it, and none of the folders in
+        /// that copy are marked as having their children's sizes (other threads could have set a folder's children's
+        /// sizes after they were copied, but marked the folder before it was copied).
+        /// </remarks>
+        public ProjectionTree Clone()
+        {
+            ProjectionTree clone = (ProjectionTree)this.MemberwiseClone();
+            clone.hasBeenCloned = false;
+            if (this.hasBeenCloned)
+            {
+                clone.entries = (Entry[])this.entries.Clone();
+                clone.names = (byte[])this.names.Clone();
+                clone.childTable = null;
+                clone.sharedEntriesLength = 0;
+                clone.ClearChildSizesSet(clone.entriesLength);
+            }
+            else
+            {
+                clone.sharedEntriesLength = this.entriesLength;
+            }
+
+            this.hasBeenCloned = true;
+            return clone;
+        }
+
+        /// <summary>
+        /// Builds the hash table that TryGetChild uses to find children (unless the tree already has one), which is kept
+        /// up to date as the tree is changed
+        /// </summary>
+        /// <remarks>
+        /// The table is keyed by the index of the first child of an entry's parent (which, unlike the parent's index, does
+        /// not change when the parent is moved) and the hash of its name folded the same way that OrdinalIgnoreCase folds
+        /// it (ToUpperInvariant of each character).  It is at most half full when it is built, and so a lookup rarely
+        /// needs more than one or two probes.
+        /// </remarks>
+        public void BuildChildTable()
+        {
+            if (this.childTable != null)
+            {
+                return;
+            }
+
+            int capacity = MinChildTableCapacity;
+            while (capacity < this.count * 2)
+            {
+                capacity *= 2;
+            }
+
+            int[] table = new int[capacity];
+            Stack<int> foldersToAdd = new Stack<int>();
+            foldersToAdd.Push(this.rootIndex);
+            while (foldersToAdd.Count > 0)
+            {
+                int folderIndex = foldersToAdd.Pop();
+                int firstChild = this.entries[folderIndex].FirstChild;
+                int childCount = this.entries[folderIndex].ChildCount;
+                for (int childIndex = firstChild; childIndex < firstChild + childCount; ++childIndex)
+                {
+                    this.AddToChildTable(table, firstChild, childIndex);
+                    if (this.IsFolder(childIndex))
+                    {
+                        foldersToAdd.Push(childIndex);
+                    }
+                }
+            }
+
+            this.childTable = table;
+            this.childTableCount = this.count;
+        }
+
+        /// <summary>
+        /// Writes the tree (and its child table, if it has one) to a snapshot file at path, which TryReadSnapshot reads
+        /// when given the same indexChecksum
+        /// </summary>
+        /// <param name="indexChecksum">The checksum at the end of the index that the tree was built from</param>
+        /// <remarks>
+        /// Other threads can be setting sizes and offsets while the tree is written, which is safe because TryReadSnapshot
+        /// does not keep the offsets or which folders have their children's sizes.  The root is always written as the
+        /// first entry.  The child table is not written once the tree has been cloned, as it can then have slots for the
+        /// clone's entries (and TryReadSnapshot would not read it).
+        /// </remarks>
+        public void WriteSnapshot(string path, byte[] indexChecksum)
+        {
+            int[] table = this.hasBeenCloned ? null : this.childTable;
+            int childTableLength = table == null ? 0 : table.Length;
+            int entrySize = Marshal.SizeOf(typeof(Entry));
+            long snapshotLength = SnapshotHeaderLength + ((long)this.entriesLength * entrySize) + this.namesLength + ((long)childTableLength * sizeof(int));
+
+            using (MemoryMappedFile snapshotMapping = MemoryMappedFile.CreateFromFile(path, FileMode.Create, mapName: null, capacity: snapshotLength, access: MemoryMappedFileAccess.ReadWrite))
+            using (MemoryMappedViewAccessor snapshotView = snapshotMapping.CreateViewAccessor(0, snapshotLength, MemoryMappedFileAccess.ReadWrite))
+            {
+                long position = 0;
+                snapshotView.Write(position, SnapshotSignature);
+                snapshotView.Write(position + sizeof(uint), SnapshotVersion);
+                snapshotView.Write(position + sizeof(uint) + sizeof(int), entrySize);
+                position += 3 * sizeof(int);
+                snapshotView.WriteArray(position, indexChecksum, 0, IndexChecksumLength);
+                position += IndexChecksumLength;
+                snapshotView.Write(position, this.entriesLength);
+                snapshotView.Write(position + sizeof(int), this.namesLength);
+                snapshotView.Write(position + (2 * sizeof(int)), this.count);
+                snapshotView.Write(position + (3 * sizeof(int)), childTableLength);
+                position += 4 * sizeof(int);
+
+                snapshotView.WriteArray(position, this.entries, 0, this.entriesLength);
+                snapshotView.Write(position, ref this.entries[this.rootIndex]);
+                position += (long)this.entriesLength * entrySize;
+                if (this.namesLength > 0)
+                {
+                    snapshotView.WriteArray(position, this.names, 0, this.namesLength);
+                    position += this.namesLength;
+                }
+
+                if (table != null)
+                {
+                    snapshotView.WriteArray(position, table, 0, table.Length);
+                }
+
+                snapshotView.Flush();
+            }
+        }
+
+        private static Entry CreateFileEntry(Sha1Id sha, long offset)
+        {
+            Entry file = new Entry();
+            file.Size = InvalidSize;
+            file.Sha = sha;
+            file.Offset = offset;
+            return file;
+        }
+
+        private static Sha1Id ToSha1Id(byte[] shaBytes)
+        {
+            ulong shaBytes1through8;
+            ulong shaBytes9Through16;
+            uint shaBytes17Through20;
+            Sha1Id.ShaBufferToParts(shaBytes, out shaBytes1through8, out shaBytes9Through16, out shaBytes17Through20);
+            return new Sha1Id(shaBytes1through8, shaBytes9Through16, shaBytes17Through20);
+        }
+
+        private static bool IsFolder(Entry entry)
+        {
+            return entry.Size <= FolderSizeMagicNumbers.MaxSizeForFolderIndication;
+        }
+
+        private static byte ToUpperAscii(byte value)
+        {
+            return value >= 'a' && value <= 'z' ? (byte)(value - ('a' - 'A')) : value;
+        }
+
+        private static int GetChildTableSlot(int[] table, int parentFirstChild, uint nameHash)
+        {
+            uint key = nameHash ^ ((uint)parentFirstChild * 0x9E3779B1);
+            key ^= key >> 15;
+            key *= 0x85EBCA6B;
+            key ^= key >> 13;
+            return (int)(key & (uint)(table.Length - 1));
+        }
+
+        /// <summary>
+        /// Hashes name[start] through name[start + length - 1] after folding its case (see <see cref="BuildChildTable"/>)
+        /// </summary>
+        private static uint GetFoldedHash(string name, int start, int length)
+        {
+            uint hash = FnvOffsetBasis;
+            for (int i = start; i < start + length; ++i)
+            {
+                char value = name[i];
+                char folded = value < 0x80 ? (char)ToUpperAscii((byte)value) : char.ToUpperInvariant(value);
+                hash = (hash ^ folded) * FnvPrime;
+            }
+
+            return hash;
+        }
+
+        /// <summary>
+        /// Hashes the UTF8 name name[start] through name[start + length - 1] in the same way as the string overload,
+        /// when the name is ASCII
+        /// </summary>
+        /// <returns>false if the name has non-ASCII characters</returns>
+        private static bool TryGetFoldedHash(byte[] name, int start, int length, out uint hash)
+        {
+            hash = FnvOffsetBasis;
+            for (int i = start; i < start + length; ++i)
+            {
+                byte value = name[i];
+                if (value >= 0x80)
+                {
+                    return false;
+                }
+
+                hash = (hash ^ ToUpperAscii(value)) * FnvPrime;
+            }
+
+            return true;
+        }
+
+        /// <summary>
+        /// Compares two UTF8 names in the same order as StringComparer.OrdinalIgnoreCase compares them as strings
+        /// </summary>
+        private static int CompareNames(byte[] first, int firstStart, int firstLength, byte[] second, int secondStart, int secondLength)
+        {
+            int length = Math.Min(firstLength, secondLength);
+            for (int i = 0; i < length; ++i)
+            {
+                byte firstByte = first[firstStart + i];
+                byte secondByte = second[secondStart + i];
+                if (firstByte != secondByte)
+                {
+                    if (firstByte >= 0x80 || secondByte >= 0x80)
+                    {
+                        return string.Compare(
+                            Encoding.UTF8.GetString(first, firstStart, firstLength),
+                            Encoding.UTF8.GetString(second, secondStart, secondLength),
+                            StringComparison.OrdinalIgnoreCase);
+                    }
+
+                    int comparison = ToUpperAscii(firstByte) - ToUpperAscii(secondByte);
+                    if (comparison != 0)
+                    {
+                        return comparison;
+                    }
+                }
+            }
+
+            return firstLength - secondLength;
+        }
+
+        /// <summary>
+        /// Compares name[start] through name[start + length - 1] with the name of an entry, in the same order as
+        /// StringComparer.OrdinalIgnoreCase
+        /// </summary>
+        private int CompareName(string name, int start, int length, int index)
+        {
+            byte[] names = this.names;
+            int nameOffset = this.entries[index].NameOffset;
+            int nameLength = this.entries[index].NameLength;
+            int commonLength = Math.Min(length, nameLength);
+            for (int i = 0; i < commonLength; ++i)
+            {
+                char nameChar = name[start + i];
+                byte entryByte = names[nameOffset + i];
+                if (nameChar >= 0x80 || entryByte >= 0x80)
+                {
+                    string entryName = this.GetName(index);
+                    int comparison = string.Compare(name, start, entryName, 0, Math.Min(length, entryName.Length), StringComparison.OrdinalIgnoreCase);
+                    return comparison != 0 ? comparison : length - entryName.Length;
+                }
+
+                if (nameChar != entryByte)
+                {
+                    int comparison = ToUpperAscii((byte)nameChar) - ToUpperAscii(entryByte);
+                    if (comparison != 0)
+                    {
+                        return comparison;
+                    }
+                }
+            }
+
+            return length - nameLength;
+        }
+
+        private uint GetFoldedHash(int index)
+        {
+            uint hash;
+            if (TryGetFoldedHash(this.names, this.entries[index].NameOffset, this.entries[index].NameLength, out hash))
+            {
+                return hash;
+            }
+
+            string name = this.GetName(index);
+            return GetFoldedHash(name, 0, name.Length);
+        }
+
+        private bool TryGetChildFromTable(int folderIndex, string name, int start, int length, uint nameHash, out int childIndex)
+        {
+            int[] table = this.childTable;
+            uint firstChild = (uint)this.entries[folderIndex].FirstChild;
+            uint childCount = (uint)this.entries[folderIndex].ChildCount;
+            for (int slot = GetChildTableSlot(table, (int)firstChild, nameHash); table[slot] != EmptyChildTableSlot; slot = (slot + 1) & (table.Length - 1))
+            {
+                // Entries in other folders (or that have been moved since they were added) are skipped without reading them
+                childIndex = table[slot];
+                if ((uint)childIndex - firstChild < childCount && this.CompareName(name, start, length, childIndex) == 0)
+                {
+                    return true;
+                }
+            }
+
+            childIndex = -1;
+            return false;
+        }
+
+        private bool TryGetChildFromTable(int folderIndex, byte[] name, int start, int length, uint nameHash, out int childIndex)
+        {
+            int[] table = this.childTable;
+            uint firstChild = (uint)this.entries[folderIndex].FirstChild;
+            uint childCount = (uint)this.entries[folderIndex].ChildCount;
+            for (int slot = GetChildTableSlot(table, (int)firstChild, nameHash); table[slot] != EmptyChildTableSlot; slot = (slot + 1) & (table.Length - 1))
+            {
+                childIndex = table[slot];
+                if ((uint)childIndex - firstChild < childCount &&
+                    CompareNames(name, start, length, this.names, this.entries[childIndex].NameOffset, this.entries[childIndex].NameLength) == 0)
+                {
+                    return true;
+                }
+            }
+
+            childIndex = -1;
+            return false;
+        }
+
+        /// <summary>
+        /// Returns the index of the child of folderIndex named name[start] through name[start + length - 1], or the
+        /// bitwise complement of the index it would be inserted at
+        /// </summary>
+        private int BinarySearchChildren(int folderIndex, string name, int start, int length)
+        {
+            int low = this.entries[folderIndex].FirstChild;
+            int high = low + this.entries[folderIndex].ChildCount - 1;
+            while (low <= high)
+            {
+                int middle = low + ((high - low) / 2);
+                int comparison = this.CompareName(name, start, length, middle);
+                if (comparison == 0)
+                {
+                    return middle;
+                }
+
+                if (comparison < 0)
+                {
+                    high = middle - 1;
+                }
+                else
+                {
+                    low = middle + 1;
+                }
+            }
+
+            return ~low;
+        }
+
+        /// <summary>
+        /// Returns the index of the child of folderIndex whose UTF8 name is name[start] through name[start + length - 1],
+        /// or the bitwise complement of the index it would be inserted at
+        /// </summary>
+        private int BinarySearchChildren(int folderIndex, byte[] name, int start, int length)
+        {
+            int low = this.entries[folderIndex].FirstChild;
+            int high = low + this.entries[folderIndex].ChildCount - 1;
+            while (low <= high)
+            {
+                int middle = low + ((high - low) / 2);
+                int comparison = CompareNames(name, start, length, this.names, this.entries[middle].NameOffset, this.entries[middle].NameLength);
+                if (comparison == 0)
+                {
+                    return middle;
+                }
+
+                if (comparison < 0)
+                {
+                    high = middle - 1;
+                }
+                else
+                {
+                    low = middle + 1;
+                }
+            }
+
+            return ~low;
+        }
+
+        private int CompareNames(Entry first, Entry second)
+        {
+            return CompareNames(this.names, first.NameOffset, first.NameLength, this.names, second.NameOffset, second.NameLength);
+        }
+
+        private int InsertChild(int parentIndex, string name, Entry child)
+        {
+            byte[] nameBytes = Encoding.UTF8.GetBytes(name);
+            child.NameOffset = this.AppendName(nameBytes, 0, nameBytes.Length);
+            child.NameLength = nameBytes.Length;
+
+            int insertIndex = this.BinarySearchChildren(parentIndex, name, 0, name.Length);
+            if (insertIndex >= 0)
+            {
+                throw new ArgumentException("The folder already has a child named " + name, nameof(name));
+            }
+
+            insertIndex = ~insertIndex;
+            int firstChild = this.entries[parentIndex].FirstChild;
+            int childCount = this.entries[parentIndex].ChildCount;
+            this.count += 1;
+
+            // The folder's children must be contiguous.  If they are the last entries (and are not shared with the tree
+            // that this tree was cloned from) the new child can be inserted where it is, otherwise they are moved to the
+            // end of the entries with the new child.
+            if (childCount > 0 && firstChild + childCount == this.entriesLength && firstChild >= this.sharedEntriesLength)
+            {
+                this.EnsureEntriesCapacity(this.entriesLength + 1);
+                Array.Copy(this.entries, insertIndex, this.entries, insertIndex + 1, firstChild + childCount - insertIndex);
+                this.entries[insertIndex] = child;
+                this.entriesLength += 1;
+                this.entries[parentIndex].ChildCount = childCount + 1;
+                this.AddToChildTable(parentIndex, insertIndex, firstChild + childCount + 1);
+                return insertIndex;
+            }
+
+            this.EnsureEntriesCapacity(this.entriesLength + childCount + 1);
+            int newFirstChild = this.entriesLength;
+            int newChildIndex = newFirstChild + insertIndex - firstChild;
+            Array.Copy(this.entries, firstChild, this.entries, newFirstChild, insertIndex - firstChild);
+            this.entries[newChildIndex] = child;
+            Array.Copy(this.entries, insertIndex, this.entries, newChildIndex + 1, firstChild + childCount - insertIndex);
+            this.entriesLength += childCount + 1;
+
+            this.entries[parentIndex].FirstChild = newFirstChild;
+            this.entries[parentIndex].ChildCount = childCount + 1;
+            this.AddToChildTable(parentIndex, newFirstChild, newFirstChild + childCount + 1);
+            return newChildIndex;
+        }
+
+        /// <summary>
+        /// Returns the index of the entry that index refers to, which is only different for RootIndex
+        /// </summary>
+        private int GetEntryIndex(int index)
+        {
+            return index == RootIndex ? this.rootIndex : index;
+        }
+
+        /// <summary>
+        /// Returns the index of the entry that folderIndex refers to, after moving the root (if it is the root) to an
+        /// entry that is not shared with the tree that this tree was cloned from
+        /// </summary>
+        private int GetFolderToChange(int folderIndex)
+        {
+            if (this.hasBeenCloned)
+            {
+                throw new InvalidOperationException("The tree cannot be changed once it has been cloned");
+            }
+
+            if (folderIndex == RootIndex)
+            {
+                if (this.rootIndex < this.sharedEntriesLength)
+                {
+                    this.rootIndex = this.AppendEntry(this.entries[this.rootIndex]);
+                }
+
+                return this.rootIndex;
+            }
+
+            if (folderIndex < this.sharedEntriesLength)
+            {
+                throw new ArgumentException("The folder is shared with the tree that this tree was cloned from", nameof(folderIndex));
+            }
+
+            return folderIndex;
+        }
+
+        /// <summary>
+        /// Copies the children of folderIndex to the end of the entries, if they are shared with the tree that this tree
+        /// was cloned from
+        /// </summary>
+        /// <returns>The index that childIndex (one of the children) has once they have been copied</returns>
+        private int CopySharedChildren(int folderIndex, int childIndex)
+        {
+            int firstChild = this.entries[folderIndex].FirstChild;
+            int childCount = this.entries[folderIndex].ChildCount;
+            if (firstChild >= this.sharedEntriesLength)
+            {
+                return childIndex;
+            }
+
+            // Making room can give the tree its own copy of the entries, which then no longer need to be copied
+            this.EnsureEntriesCapacity(this.entriesLength + childCount);
+            if (firstChild >= this.sharedEntriesLength)
+            {
+                return childIndex;
+            }
+
+            int newFirstChild = this.entriesLength;
+            Array.Copy(this.entries, firstChild, this.entries, newFirstChild, childCount);
+            this.entriesLength += childCount;
+            this.entries[folderIndex].FirstChild = newFirstChild;
+            this.AddToChildTable(folderIndex, newFirstChild, newFirstChild + childCount);
+            return newFirstChild + childIndex - firstChild;
+        }
+
+        /// <summary>
+        /// Adds the children of folderIndex from start to (but not including) end to the child table, after they have been
+        /// added or moved
+        /// </summary>
+        private void AddToChildTable(int folderIndex, int start, int end)
+        {
+            int[] table = this.childTable;
+            if (table == null)
+            {
+                return;
+            }
+
+            if ((long)(this.childTableCount + end - start) * 100 > (long)table.Length * MaxChildTableLoadPercent)
+            {
+                this.childTable = null;
+                return;
+            }
+
+            int firstChild = this.entries[folderIndex].FirstChild;
+            for (int childIndex = start; childIndex < end; ++childIndex)
+            {
+                this.AddToChildTable(table, firstChild, childIndex);
+            }
+
+            this.childTableCount += end - start;
+        }
+
+        private void AddToChildTable(int[] table, int parentFirstChild, int childIndex)
+        {
+            // The slot is only written once the entry has been, so another tree that shares the table (see Clone) never
+            // finds an entry that is not there yet
+            int slot = GetChildTableSlot(table, parentFirstChild, this.GetFoldedHash(childIndex));
+            while (table[slot] != EmptyChildTableSlot)
+            {
+                slot = (slot + 1) & (table.Length - 1);
+            }
+
+            table[slot] = childIndex;
+        }
+
+        private void ClearChildSizesSet(int length)
+        {
+            for (int i = 0; i < length; ++i)
+            {
+                if (this.entries[i].Size == FolderSizeMagicNumbers.ChildSizesSet)
+                {
+                    this.entries[i].Size = FolderSizeMagicNumbers.ChildSizesNotSet;
+                }
+            }
+        }
+
+        /// <summary>
+        /// The number of entries in the tree at index (the entry and, for a folder, everything in it)
+        /// </summary>
+        private int CountEntries(int index)
+        {
+            int entryCount = 0;
+            Stack<int> entriesToCount = new Stack<int>();
+            entriesToCount.Push(index);
+            while (entriesToCount.Count > 0)
+            {
+                Entry entry = this.entries[entriesToCount.Pop()];
+                entryCount += 1;
+                if (IsFolder(entry))
+                {
+                    for (int i = entry.FirstChild; i < entry.FirstChild + entry.ChildCount; ++i)
+                    {
+                        entriesToCount.Push(i);
+                    }
+                }
+            }
+
+            return entryCount;
+        }
+
+        /// <summary>
+        /// Checks that a tree read from a snapshot can be used safely: every name and range of children is within the
+        /// arrays, every entry other than the root has one parent, and the child table only holds valid indexes.  Offsets
+        /// and the folders' ChildSizesSet are cleared at the same time.
+        /// </summary>
+        private bool TryValidateSnapshot(out string error)
+        {
+            for (int i = 0; i < this.entriesLength; ++i)
+            {
+                Entry entry = this.entries[i];
+                if (entry.NameOffset < 0 || entry.NameLength < 0 || entry.NameOffset > this.namesLength - entry.NameLength)
+                {
+                    error = "Snapshot entry " + i + " has an invalid name";
+                    return false;
+                }
+
+                if (IsFolder(entry))
+                {
+                    if (entry.Size < FolderSizeMagicNumbers.ChildSizesSet ||
+                        entry.FirstChild < 0 ||
+                        entry.ChildCount < 0 ||
+                        entry.FirstChild > this.entriesLength - entry.ChildCount)
+                    {
+                        error = "Snapshot folder " + i + " has invalid children";
+                        return false;
+                    }
+
+                    this.entries[i].Size = FolderSizeMagicNumbers.ChildSizesNotSet;
+                }
+                else
+                {
+                    this.entries[i].Offset = InvalidOffset;
+                    this.entries[i].LastUpdateTime = 0;
+                }
+            }
+
+            if (!this.IsFolder(RootIndex))
+            {
+                error = "Snapshot root is not a folder";
+                return false;
+            }
+
+            // Counting the entries under the root (and stopping if there are more than there could be) also finds
+            // folders that are their own ancestor
+            int entryCount = 0;
+            Stack<int> foldersToCount = new Stack<int>();
+            foldersToCount.Push(RootIndex);
+            while (foldersToCount.Count > 0 && entryCount <= this.count)
+            {
+                int folderIndex = foldersToCount.Pop();
+                int firstChild = this.entries[folderIndex].FirstChild;
+                int childCount = this.entries[folderIndex].ChildCount;
+                entryCount += childCount;
+                for (int childIndex = firstChild; childIndex < firstChild + childCount; ++childIndex)
+                {
+                    if (this.IsFolder(childIndex))
+                    {
+                        foldersToCount.Push(childIndex);
+                    }
+                }
+            }
+
+            if (entryCount != this.count)
+            {
+                error = "Snapshot has " + entryCount + " entries under its root, rather than " + this.count;
+                return false;
+            }
+
+            if (this.childTable != null)
+            {
+                int[] table = this.childTable;
+                if (table.Length < MinChildTableCapacity || (table.Length & (table.Length - 1)) != 0)
+                {
+                    error = "Snapshot child table has an invalid length: " + table.Length;
+                    return false;
+                }
+
+                int usedSlots = 0;
+                for (int slot = 0; slot < table.Length; ++slot)
+                {
+                    if (table[slot] < 0 || table[slot] >= this.entriesLength)
+                    {
+                        error = "Snapshot child table slot " + slot + " is invalid";
+                        return false;
+                    }
+
+                    if (table[slot] != EmptyChildTableSlot)
+                    {
+                        ++usedSlots;
+                    }
+                }
+
+                // Lookups stop at the first empty slot, and so there must be enough of them
+                if ((long)usedSlots * 100 > (long)table.Length * MaxChildTableLoadPercent)
+                {
+                    error = "Snapshot child table is too full: " + usedSlots + " of " + table.Length + " slots are used";
+                    return false;
+                }
+
+                this.childTableCount = usedSlots;
+            }
+
+            error = null;
+            return true;
+        }
+
+        private int AppendEntry(Entry entry)
+        {
+            this.EnsureEntriesCapacity(this.entriesLength + 1);
+            this.entries[this.entriesLength] = entry;
+            return this.entriesLength++;
+        }
+
+        private int AppendName(byte[] buffer, int start, int length)
+        {
+            if (this.namesLength + length > this.names.Length)
+            {
+                Array.Resize(ref this.names, Math.Max(this.names.Length * 2, this.namesLength + length));
+            }
+
+            Buffer.BlockCopy(buffer, start, this.names, this.namesLength, length);
+            this.namesLength += length;
+            return this.namesLength - length;
+        }
+
+        private void EnsureEntriesCapacity(int capacity)
+        {
+            if (capacity > this.entries.Length)
+            {
+                Array.Resize(ref this.entries, Math.Max(this.entries.Length * 2, capacity));
+
+                // The tree now has its own copy of the entries that it shared, but other threads could have set a
+                // folder's children's sizes after they were copied and marked the folder before it was (see Clone)
+                if (this.sharedEntriesLength > 0)
+                {
+                    this.ClearChildSizesSet(this.sharedEntriesLength);
+                    this.sharedEntriesLength = 0;
+                }
+            }
+        }
+
+        /// <summary>
+        /// Builds a ProjectionTree from git paths in index order
+        /// </summary>
+        /// <remarks>
+        /// Index order keeps everything in a folder together, and so a folder's children are known once a path
+        /// outside of the folder is added.  The children are then sorted and added to the tree as one range.  As
+        /// SortedList did, only the first of any children with the same name (ignoring case) is kept, except that
+        /// folders with the same name are merged.
+        /// </remarks>
+        public class Builder
+        {
+            private ITracer tracer;
+            private ProjectionTree tree;
+
+            // The folders that the last path added is in.  openFolders[0] is the root folder, and openFolderPathLengths[i]
+            // is the length of the path of openFolders[i] (including its final '/').
+            private List<List<Entry>> openFolders;
+            private List<int> openFolderPathLengths;
+            private byte[] openFolderPath;
+
+            public Builder(ITracer tracer, int estimatedEntryCount)
+            {
+                this.tracer = tracer;
+
+                // The folders are not in the index, and so allow for a folder for every eight files
+                this.tree = new ProjectionTree(
+                    estimatedEntryCount + (estimatedEntryCount / 8) + 1,
+                    estimatedEntryCount * EstimatedNameLength);
+                this.tree.isBeingBuilt = true;
+
+                this.openFolders = new List<List<Entry>>();
+                this.openFolders.Add(new List<Entry>());
+                this.openFolderPathLengths = new List<int>();
+                this.openFolderPathLengths.Add(0);
+                this.openFolderPath = new byte[GitIndexEntry.MaxPathBufferSize];
+            }
+
+            /// <summary>
+            /// Called when a folder has all of its children
+            /// </summary>
+            /// <param name="tree">The tree that is being built</param>
+            /// <param name="folderPath">The folder's git path</param>
+            /// <param name="folderIndex">
+            /// The index in tree of a copy of the folder, which the Builder does not change.  The folder's children are
+            /// not changed either (unless the folder is merged with a folder that has the same name).
+            /// </param>
+            /// <param name="isParsedPast">
+            /// true if the folder was added because a path after it was added, and false if it was added by Finish
+            /// </param>
+            public delegate void OnFolderAdded(ProjectionTree tree, string folderPath, int folderIndex, bool isParsedPast);
+
+            /// <summary>
+            /// Called, if set, as each folder is added, so that the folder can be used while the rest of the tree is built
+            /// </summary>
+            public OnFolderAdded FolderAdded { get; set; }
+
+            private int OpenFolderDepth
+            {
+                get { return this.openFolderPathLengths.Count - 1; }
+            }
+
+            /// <summary>
+            /// Builds one ProjectionTree from trees that were built from consecutive parts of the index (in order)
+            /// </summary>
+            public static ProjectionTree Merge(ITracer tracer, IList<ProjectionTree> trees)
+            {
+                int entryCount = 0;
+                int namesLength = 0;
+                foreach (ProjectionTree tree in trees)
+                {
+                    entryCount += tree.entriesLength;
+                    namesLength += tree.namesLength;
+                }
+
+                Builder builder = new Builder(tracer, estimatedEntryCount: 0);
+                ProjectionTree mergedTree = builder.tree;
+                mergedTree.EnsureEntriesCapacity(entryCount + 1);
+                mergedTree.names = new byte[Math.Max(namesLength, MinNamesCapacity)];
+
+                foreach (ProjectionTree tree in trees)
+                {
+                    int entriesStart = mergedTree.entriesLength;
+                    int namesStart = mergedTree.namesLength;
+                    Array.Copy(tree.entries, 0, mergedTree.entries, entriesStart, tree.entriesLength);
+                    Buffer.BlockCopy(tree.names, 0, mergedTree.names, namesStart, tree.namesLength);
+                    mergedTree.entriesLength += tree.entriesLength;
+                    mergedTree.namesLength += tree.namesLength;
+
+                    for (int i = entriesStart; i < mergedTree.entriesLength; ++i)
+                    {
+                        mergedTree.entries[i].NameOffset += namesStart;
+                        if (mergedTree.IsFolder(i))
+                        {
+                            mergedTree.entries[i].FirstChild += entriesStart;
+
+                            // Callbacks can still be setting the sizes in trees that were used while they were built
+                            mergedTree.entries[i].Size = FolderSizeMagicNumbers.ChildSizesNotSet;
+                        }
+                    }
+
+                    // The folders at the end of one tree and the start of the next are merged by Finish
+                    Entry root = mergedTree.entries[entriesStart + tree.rootIndex];
+                    for (int i = root.FirstChild; i < root.FirstChild + root.ChildCount; ++i)
+                    {
+                        builder.openFolders[0].Add(mergedTree.entries[i]);
+                    }
+                }
+
+                return builder.Finish();
+            }
+
+            /// <summary>
+            /// Adds a file to the tree, and any folders that it is in that are not already in the tree
+            /// </summary>
+            /// <param name="path">The file's UTF8 git path (with '/' separators)</param>
+            /// <param name="pathLength">The length of the path in path</param>
+            /// <param name="sha">The file's SHA-1</param>
+            /// <param name="offset">The offset of the file's index entry</param>
+            public void AddFile(byte[] path, int pathLength, byte[] sha, long offset)
+            {
+                // Close the folders that path is not in
+                int commonLength = 0;
+                int openFolderPathLength = this.openFolderPathLengths[this.OpenFolderDepth];
+                int maxCommonLength = Math.Min(pathLength, openFolderPathLength);
+                while (commonLength < maxCommonLength && path[commonLength] == this.openFolderPath[commonLength])
+                {
+                    ++commonLength;
+                }
+
+                while (this.openFolderPathLengths[this.OpenFolderDepth] > commonLength)
+                {
+                    this.CloseFolder(isParsedPast: true);
+                }
+
+                // Open the folders that path is in that are not already open
+                int nameStart = this.openFolderPathLengths[this.OpenFolderDepth];
+                for (int i = nameStart; i < pathLength; ++i)
+                {
+                    if (path[i] == PathSeparatorCode)
+                    {
+                        Entry folder = new Entry();
+                        folder.Size = FolderSizeMagicNumbers.ChildSizesNotSet;
+                        this.AddChild(folder, path, nameStart, i - nameStart);
+
+                        Buffer.BlockCopy(path, nameStart, this.openFolderPath, nameStart, i + 1 - nameStart);
+                        this.openFolderPathLengths.Add(i + 1);
+                        if (this.openFolders.Count <= this.OpenFolderDepth)
+                        {
+                            this.openFolders.Add(new List<Entry>());
+                        }
+
+                        nameStart = i + 1;
+                    }
+                }
+
+                this.AddChild(CreateFileEntry(ToSha1Id(sha), offset), path, nameStart, pathLength - nameStart);
+            }
+
+            /// <summary>
+            /// Adds the last folders to the tree
+            /// </summary>
+            /// <returns>The tree.  The Builder cannot be used after Finish is called.</returns>
+            public ProjectionTree Finish()
+            {
+                while (this.OpenFolderDepth > 0)
+                {
+                    this.CloseFolder(isParsedPast: false);
+                }
+
+                Entry root = this.tree.entries[RootIndex];
+                this.AddChildren(this.openFolders[0], out root.FirstChild, out root.ChildCount);
+                this.tree.entries[RootIndex] = root;
+
+                ProjectionTree tree = this.tree;
+                tree.count = tree.CountEntries(RootIndex) - 1;
+                tree.isBeingBuilt = false;
+                this.tree = null;
+                return tree;
+            }
+
+            private void AddChild(Entry child, byte[] path, int nameStart, int nameLength)
+            {
+                child.NameOffset = this.tree.AppendName(path, nameStart, nameLength);
+                child.NameLength = nameLength;
+                this.openFolders[this.OpenFolderDepth].Add(child);
+            }
+
+            private void CloseFolder(bool isParsedPast)
+            {
+                List<Entry> children = this.openFolders[this.OpenFolderDepth];
+                int folderPathLength = this.openFolderPathLengths[this.OpenFolderDepth];
+                this.openFolderPathLengths.RemoveAt(this.OpenFolderDepth);
+
+                // The folder is always the last child of its parent while it is open
+                List<Entry> parentChildren = this.openFolders[this.OpenFolderDepth];
+                Entry folder = parentChildren[parentChildren.Count - 1];
+                this.AddChildren(children, out folder.FirstChild, out folder.ChildCount);
+                parentChildren[parentChildren.Count - 1] = folder;
+
+                children.Clear();
+
+                if (this.FolderAdded != null)
+                {
+                    // The entry in parentChildren is copied again when the parent is closed, and so the copy that is
+                    // used until then is one that will not move
+                    int folderIndex = this.tree.AppendEntry(folder);
+                    string folderPath = Encoding.UTF8.GetString(this.openFolderPath, 0, folderPathLength - 1);
+                    this.FolderAdded(this.tree, folderPath, folderIndex, isParsedPast);
+                }
+            }
+
+            /// <summary>
+            /// Adds children, which are in the order that they were added to their folder, to the end of the tree's
+            /// entries in sorted order
+            /// </summary>
+            private void AddChildren(List<Entry> children, out int firstChild, out int childCount)
+            {
+                ProjectionTree tree = this.tree;
+                bool isSorted = true;
+                for (int i = 1; i < children.Count && isSorted; ++i)
+                {
+                    isSorted = tree.CompareNames(children[i - 1], children[i]) < 0;
+                }
+
+                if (!isSorted)
+                {
+                    children = this.SortAndMergeChildren(children);
+                }
+
+                tree.EnsureEntriesCapacity(tree.entriesLength + children.Count);
+                children.CopyTo(tree.entries, tree.entriesLength);
+                firstChild = tree.entriesLength;
+                childCount = children.Count;
+                tree.entriesLength += children.Count;
+            }
+
+            private List<Entry> SortAndMergeChildren(List<Entry> children)
+            {
+                ProjectionTree tree = this.tree;
+
+                // Sort stably, so that the first of any children with the same name comes first
+                int[] sortOrder = new int[children.Count];
+                for (int i = 0; i < sortOrder.Length; ++i)
+                {
+                    sortOrder[i] = i;
+                }
+
+                Array.Sort(
+                    sortOrder,
+                    (first, second) =>
+                    {
+                        int comparison = tree.CompareNames(children[first], children[second]);
+                        return comparison != 0 ? comparison : first - second;
+                    });
+
+                List<Entry> sortedChildren = new List<Entry>(children.Count);
+                foreach (int childIndex in sortOrder)
+                {
+                    Entry child = children[childIndex];
+                    if (sortedChildren.Count == 0 || tree.CompareNames(sortedChildren[sortedChildren.Count - 1], child) != 0)
+                    {
+                        sortedChildren.Add(child);
+                        continue;
+                    }
+
+                    Entry existingChild = sortedChildren[sortedChildren.Count - 1];
+                    if (IsFolder(existingChild) && IsFolder(child))
+                    {
+                        sortedChildren[sortedChildren.Count - 1] = this.MergeFolders(existingChild, child);
+                    }
+                    else if (IsFolder(child))
+                    {
+                        // A folder after a file with the same name would need the file to be a folder
+                        string childName = Encoding.UTF8.GetString(tree.names, child.NameOffset, child.NameLength);
+
+                        EventMetadata metadata = new EventMetadata();
+                        metadata.Add("Area", "GitIndexProjection");
+                        metadata.Add("childName", childName);
+                        this.tracer.RelatedError(metadata, "AddChildren: Found a file where a folder was expected");
+
+                        throw new InvalidDataException("Found a file (" + childName + ") where a folder was expected");
+                    }
+                    else
+                    {
+                        // Keep the first of the children, whether it is a file or a folder
+                        EventMetadata metadata = new EventMetadata();
+                        metadata.Add("Area", "GitIndexProjection");
+                        metadata.Add("childName", Encoding.UTF8.GetString(tree.names, child.NameOffset, child.NameLength));
+                        this.tracer.RelatedWarning(metadata, "AddChild: Skipping addition of child, entry already exists in collection");
+                    }
+                }
+
+                return sortedChildren;
+            }
+
+            private Entry MergeFolders(Entry folder, Entry otherFolder)
+            {
+                List<Entry> children = new List<Entry>(folder.ChildCount + otherFolder.ChildCount);
+                for (int i = folder.FirstChild; i < folder.FirstChild + folder.ChildCount; ++i)
+                {
+                    children.Add(this.tree.entries[i]);
+                }
+
+                for (int i = otherFolder.FirstChild; i < otherFolder.FirstChild + otherFolder.ChildCount; ++i)
+                {
+                    children.Add(this.tree.entries[i]);
+                }
+
+                // The children of both folders are added again, after the entries that they were in
+                this.AddChildren(children, out folder.FirstChild, out folder.ChildCount);
+                return folder;
+            }
+        }
+
+        /// <summary>
+        /// A file or folder.  Folders have no SHA, offset or update time, and so they use that space for the range of
+        /// entries that are their children.
+        /// </summary>
+        [StructLayout(LayoutKind.Explicit)]
+        private struct Entry
+        {
+            [FieldOffset(0)]
+            public int NameOffset;
+
+            [FieldOffset(4)]
+            public int NameLength;
+
+            // For files, the size of the file (or InvalidSize).  For folders, one of FolderSizeMagicNumbers.
+            [FieldOffset(8)]
+            public long Size;
+
+            [FieldOffset(16)]
+            public long Offset;
+
+            [FieldOffset(24)]
+            public Sha1Id Sha;
+
+            [FieldOffset(44)]
+            public uint LastUpdateTime;
+
+            [FieldOffset(16)]
+            public int FirstChild;
+
+            [FieldOffset(20)]
+            public int ChildCount;
+        }
+
+        // Special values that can be stored in Size to indicate that the entry is a folder, and to indicate that
+        // folder's state
+        private static class FolderSizeMagicNumbers
+        {
+            public const long MaxSizeForFolderIndication = -2; // All values less than or equal to MaxSizeForFolderIndication indicate a folder
+            public const long ChildSizesNotSet = -2;           // Size of -2 indicates that the entry is a folder whose children do not have their sizes
+            public const long ChildSizesSet = -3;              // Size of -3 indicates that the entry is a folder whose children do have their sizes
+        }
+    }
+}
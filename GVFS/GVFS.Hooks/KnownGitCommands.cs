@@ -4,6 +4,7 @@ namespace GVFS.Hooks
 {
     internal static class KnownGitCommands
     {
+        // GitHooksLoader/GVFSHooks.cpp has a copy of this list
         private static HashSet<string> knownCommands = new HashSet<string>()
         {
             "add",
@@ -30,6 +30,11 @@ namespace GVFS.Hooks
         {
             try
             {
+                if (args.Length > 0 && args[0] == GVFSConstants.StandbyHooks.StandbyArg)
+                {
+                    args = StandbyHost.WaitForHookRequest(args);
+                }
+
                 if (args.Length < 2)
                 {
                     ExitWithError("Usage: gvfs.hooks.exe --git-pid=<pid> <hook> <git verb> [<other arguments>]");
@@ -98,6 +103,7 @@ namespace GVFS.Hooks
             Environment.Exit(1);
         }
 
+        // GitHooksLoader/GVFSHooks.cpp makes the same checks before handling pre-command in-process
         private static void CheckForLegalCommands(string[] args)
         {
             string command = GetGitCommand(args);
@@ -388,7 +394,7 @@ namespace GVFS.Hooks
 
             switch (gitCommand)
             {
-                // Keep these alphabetically sorted
+                // Keep these alphabetically sorted, and in sync with NoLockGitCommands in GitHooksLoader/GVFSHooks.cpp
                 case "blame":
                 case "branch":
                 case "cat-file":
@@ -0,0 +1,495 @@
+﻿using GVFS.Common;
+using GVFS.Common.NamedPipes;
+using System;
+using System.Collections;
+using System.Collections.Generic;
+using System.ComponentModel;
+using System.Diagnostics;
+using System.IO;
+using System.IO.Pipes;
+using System.Reflection;
+using System.Runtime.CompilerServices;
+using System.Runtime.InteropServices;
+using System.Security.Principal;
+using System.Text;
+using System.Threading;
+
+namespace GVFS.Hooks
+{
+    /// <summary>
+    /// A GVFS.Hooks process that is already loaded and waiting for GitHooksLoader to hand it a hook, which
+    /// saves git commands from paying for a process launch and .NET startup on every hook.
+    /// </summary>
+    /// <remarks>
+    /// A standby host runs a single hook.  Once GitHooksLoader has sent its command line, environment, working
+    /// directory and standard handles, the host starts its replacement, takes on the loader's state, and then runs
+    /// the hook exactly as it would have if the loader had launched it.  The loader waits on the host process for
+    /// the hook's exit code, and launches GVFS.Hooks itself when no standby host is waiting.
+    ///
+    /// Nothing may use Console before the host has taken on the loader's state, as Console binds to the standard
+    /// handles the first time that it is used.
+    ///
+    /// The hosts are started by GVFS.Mount, serve only its enlistment (which is part of the pipe name), and exit when
+    /// the mount process exits unless they are already running a hook.
+    ///
+    /// Whoever connects to a host decides what it runs, with the host's token.  Hosts therefore never run elevated
+    /// (an elevated mount does not start them), and their pipe only accepts the same user at the same or a higher
+    /// integrity level.
+    /// </remarks>
+    public static class StandbyHost
+    {
+        // Only the user running the host may connect, and a mandatory label stops processes running below medium
+        // integrity (e.g. sandboxed processes) from writing to the pipe
+        private const string PipeSecurityDescriptorFormat = "D:P(A;;FA;;;{0})S:(ML;;NW;;;ME)";
+
+        private const int StdInputHandle = -10;
+        private const int StdOutputHandle = -11;
+        private const int StdErrorHandle = -12;
+
+        private const uint ProcessDupHandle = 0x0040;
+        private const uint DuplicateSameAccess = 0x0002;
+        private const uint HandleFlagInherit = 0x0001;
+
+        // Values of hostState
+        private const int WaitingState = 0;
+        private const int RunningHookState = 1;
+        private const int ExitingState = 2;
+
+        private static readonly Type[] HookTypes = { typeof(Program), typeof(GVFSLock), typeof(NamedPipeClient), typeof(ProcessHelper), typeof(Paths), typeof(ConsoleHelper) };
+
+        private static int hostState = WaitingState;
+
+        /// <summary>
+        /// Waits for GitHooksLoader to hand over a hook, and returns the arguments to run it with.  Exits the process
+        /// if there are already enough standby hosts waiting, or when the mount that started the host exits.
+        /// </summary>
+        /// <param name="standbyArgs">
+        /// The host's own arguments, see <see cref="GVFSConstants.StandbyHooks.StandbyArg"/>
+        /// </param>
+        public static string[] WaitForHookRequest(string[] standbyArgs)
+        {
+            // Don't hold on to the directory that we happened to be started in
+            Environment.CurrentDirectory = ProcessHelper.GetCurrentProcessLocation();
+
+            if (ProcessHelper.IsAdminElevated())
+            {
+                // GVFS.Mount does not start hosts when it is elevated, but a host must never hand its elevation to
+                // the unelevated processes that can connect to it
+                Environment.Exit(0);
+                return null;
+            }
+
+            int mountProcessId;
+            Process mountProcess = null;
+            if (standbyArgs.Length != 3 || !int.TryParse(standbyArgs[1], out mountProcessId))
+            {
+                Environment.Exit(0);
+                return null;
+            }
+
+            try
+            {
+                mountProcess = Process.GetProcessById(mountProcessId);
+            }
+            catch (ArgumentException)
+            {
+                // The mount has already exited
+                Environment.Exit(0);
+            }
+
+            string enlistmentRoot = standbyArgs[2];
+            NamedPipeServerStream pipe = null;
+            try
+            {
+                pipe = new NamedPipeServerStream(
+                    GetPipeName(enlistmentRoot),
+                    PipeDirection.InOut,
+                    GVFSConstants.StandbyHooks.MaxStandbyHosts,
+                    PipeTransmissionMode.Byte,
+                    PipeOptions.None,
+                    0, // default inBufferSize
+                    0, // default outBufferSize
+                    CreatePipeSecurity(),
+                    HandleInheritability.None);
+            }
+            catch (IOException)
+            {
+                // Every pipe instance is taken, i.e. there are already MaxStandbyHosts hosts waiting
+                Environment.Exit(0);
+            }
+
+            ExitWhenMountExits(mountProcess);
+            PrepareHookMethods();
+
+            HookRequest request = null;
+            using (pipe)
+            {
+                while (request == null)
+                {
+                    pipe.WaitForConnection();
+                    request = TryAcceptRequest(pipe);
+                    if (request == null)
+                    {
+                        pipe.Disconnect();
+                    }
+                }
+            }
+
+            // Replace ourselves before taking on the loader's environment, working directory and handles, none of
+            // which the new host should inherit
+            StartNewHost(mountProcessId, enlistmentRoot);
+
+            return TakeOnRequest(request);
+        }
+
+        private static void StartNewHost(int mountProcessId, string enlistmentRoot)
+        {
+            string standbyArgs = string.Format("{0} {1} \"{2}\"", GVFSConstants.StandbyHooks.StandbyArg, mountProcessId, enlistmentRoot);
+            ProcessHelper.StartBackgroundProcess(Assembly.GetExecutingAssembly().Location, standbyArgs, createWindow: false);
+        }
+
+        private static string GetPipeName(string enlistmentRoot)
+        {
+            // GitHooksLoader builds the same name from the enlistment that it is installed in, the name of the hook
+            // application, and the user's SID
+            return
+                Paths.GetNamedPipeName(enlistmentRoot) + "." +
+                Path.GetFileNameWithoutExtension(Assembly.GetExecutingAssembly().Location) + ".Standby." +
+                WindowsIdentity.GetCurrent().User.Value;
+        }
+
+        private static void ExitWhenMountExits(Process mountProcess)
+        {
+            Thread watcher = new Thread(() =>
+            {
+                mountProcess.WaitForExit();
+
+                // A host that has already taken a hook finishes running it
+                if (Interlocked.CompareExchange(ref hostState, ExitingState, WaitingState) == WaitingState)
+                {
+                    Environment.Exit(0);
+                }
+            });
+
+            watcher.IsBackground = true;
+            watcher.Start();
+        }
+
+        private static PipeSecurity CreatePipeSecurity()
+        {
+            PipeSecurity security = new PipeSecurity();
+            security.SetSecurityDescriptorSddlForm(string.Format(PipeSecurityDescriptorFormat, WindowsIdentity.GetCurrent().User.Value));
+            return security;
+        }
+
+        private static void PrepareHookMethods()
+        {
+            // JIT compiling the hook's code is most of the time that it takes GVFS.Hooks to start
+            foreach (Type type in HookTypes)
+            {
+                foreach (MethodInfo method in type.GetMethods(BindingFlags.Public | BindingFlags.NonPublic | BindingFlags.Static | BindingFlags.Instance | BindingFlags.DeclaredOnly))
+                {
+                    if (!method.IsAbstract && !method.ContainsGenericParameters)
+                    {
+                        RuntimeHelpers.PrepareMethod(method.MethodHandle);
+                    }
+                }
+            }
+        }
+
+        private static HookRequest TryAcceptRequest(NamedPipeServerStream pipe)
+        {
+            StreamReader reader = new StreamReader(pipe, new UTF8Encoding(false), false, 4096, leaveOpen: true);
+            StreamWriter writer = new StreamWriter(pipe, new UTF8Encoding(false), 1024, leaveOpen: true);
+
+            HookRequest request = null;
+            try
+            {
+                request = HookRequest.Read(reader);
+                if (request == null || !TryDuplicateClientHandles(pipe, request))
+                {
+                    request = null;
+                }
+                else if (!Directory.Exists(request.CurrentDirectory) ||
+                    Interlocked.CompareExchange(ref hostState, RunningHookState, WaitingState) != WaitingState)
+                {
+                    // The loader runs the hook itself when the host cannot, including when the host is exiting
+                    request.CloseHandles();
+                    request = null;
+                }
+
+                writer.WriteLine(request != null ? NamedPipeMessages.RunHook.StartedResult : NamedPipeMessages.RunHook.FailedResult);
+                writer.Flush();
+                return request;
+            }
+            catch (IOException)
+            {
+                // The loader has gone, and will run the hook itself.  Our copies of its handles must not be left open,
+                // as they could stop whoever is reading git's output from ever seeing it end.
+                if (request != null && request.HasDuplicatedHandles)
+                {
+                    request.CloseHandles();
+                }
+
+                return null;
+            }
+        }
+
+        private static bool TryDuplicateClientHandles(NamedPipeServerStream pipe, HookRequest request)
+        {
+            // The handles are duplicated from the loader rather than by it so that we can decide when they become
+            // inheritable.  This fails if the loader is elevated and we are not, and the loader then runs the hook
+            // itself with its own elevation.
+            uint clientProcessId;
+            if (!GetNamedPipeClientProcessId(pipe.SafePipeHandle.DangerousGetHandle(), out clientProcessId))
+            {
+                return false;
+            }
+
+            IntPtr clientProcess = OpenProcess(ProcessDupHandle, false, clientProcessId);
+            if (clientProcess == IntPtr.Zero)
+            {
+                return false;
+            }
+
+            try
+            {
+                IntPtr outputHandle;
+                IntPtr errorHandle;
+                if (!TryDuplicateHandle(clientProcess, request.OutputHandle, out outputHandle))
+                {
+                    return false;
+                }
+
+                if (!TryDuplicateHandle(clientProcess, request.ErrorHandle, out errorHandle))
+                {
+                    CloseHandle(outputHandle);
+                    return false;
+                }
+
+                request.OutputHandle = outputHandle;
+                request.ErrorHandle = errorHandle;
+                request.HasDuplicatedHandles = true;
+                return true;
+            }
+            finally
+            {
+                CloseHandle(clientProcess);
+            }
+        }
+
+        private static bool TryDuplicateHandle(IntPtr clientProcess, IntPtr clientHandle, out IntPtr handle)
+        {
+            handle = IntPtr.Zero;
+            if (clientHandle == IntPtr.Zero)
+            {
+                // The loader has no handle for this stream, and so neither will the hook
+                return true;
+            }
+
+            return DuplicateHandle(clientProcess, clientHandle, GetCurrentProcess(), out handle, 0, false, DuplicateSameAccess);
+        }
+
+        private static string[] TakeOnRequest(HookRequest request)
+        {
+            // The hook's own child processes (e.g. 'gvfs prefetch') inherit these
+            foreach (IntPtr handle in new[] { request.OutputHandle, request.ErrorHandle })
+            {
+                if (handle != IntPtr.Zero)
+                {
+                    SetHandleInformation(handle, HandleFlagInherit, HandleFlagInherit);
+                }
+            }
+
+            // GitHooksLoader starts hooks without standard input
+            SetStdHandle(StdInputHandle, IntPtr.Zero);
+            SetStdHandle(StdOutputHandle, request.OutputHandle);
+            SetStdHandle(StdErrorHandle, request.ErrorHandle);
+
+            foreach (DictionaryEntry variable in Environment.GetEnvironmentVariables())
+            {
+                string name = (string)variable.Key;
+                if (!request.EnvironmentVariables.ContainsKey(name))
+                {
+                    Environment.SetEnvironmentVariable(name, null);
+                }
+            }
+
+            foreach (KeyValuePair<string, string> variable in request.EnvironmentVariables)
+            {
+                Environment.SetEnvironmentVariable(variable.Key, variable.Value);
+            }
+
+            Environment.CurrentDirectory = request.CurrentDirectory;
+
+            return GetArguments(request.CommandLine);
+        }
+
+        private static string[] GetArguments(string commandLine)
+        {
+            int count;
+            IntPtr argv = CommandLineToArgvW(commandLine, out count);
+            if (argv == IntPtr.Zero)
+            {
+                throw new Win32Exception(Marshal.GetLastWin32Error());
+            }
+
+            try
+            {
+                // As with Main's args, the application name is not included
+                string[] args = new string[Math.Max(count - 1, 0)];
+                for (int i = 1; i < count; ++i)
+                {
+                    args[i - 1] = Marshal.PtrToStringUni(Marshal.ReadIntPtr(argv, i * IntPtr.Size));
+                }
+
+                return args;
+            }
+            finally
+            {
+                LocalFree(argv);
+            }
+        }
+
+        [DllImport("kernel32.dll", SetLastError = true)]
+        private static extern bool GetNamedPipeClientProcessId(IntPtr pipe, out uint clientProcessId);
+
+        [DllImport("kernel32.dll", SetLastError = true)]
+        private static extern IntPtr OpenProcess(uint desiredAccess, bool inheritHandle, uint processId);
+
+        [DllImport("kernel32.dll")]
+        private static extern IntPtr GetCurrentProcess();
+
+        [DllImport("kernel32.dll", SetLastError = true)]
+        private static extern bool DuplicateHandle(
+            IntPtr sourceProcess,
+            IntPtr sourceHandle,
+            IntPtr targetProcess,
+            out IntPtr targetHandle,
+            uint desiredAccess,
+            bool inheritHandle,
+            uint options);
+
+        [DllImport("kernel32.dll", SetLastError = true)]
+        private static extern bool SetHandleInformation(IntPtr handle, uint mask, uint flags);
+
+        [DllImport("kernel32.dll", SetLastError = true)]
+        private static extern bool SetStdHandle(int stdHandle, IntPtr handle);
+
+        [DllImport("kernel32.dll")]
+        private static extern bool CloseHandle(IntPtr handle);
+
+        [DllImport("kernel32.dll")]
+        private static extern IntPtr LocalFree(IntPtr memory);
+
+        [DllImport("shell32.dll", SetLastError = true, CharSet = CharSet.Unicode)]
+        private static extern IntPtr CommandLineToArgvW(string commandLine, out int count);
+
+        private class HookRequest
+        {
+            private HookRequest()
+            {
+                this.EnvironmentVariables = new Dictionary<string, string>(StringComparer.OrdinalIgnoreCase);
+            }
+
+            public string CommandLine { get; private set; }
+
+            public string CurrentDirectory { get; private set; }
+
+            public Dictionary<string, string> EnvironmentVariables { get; }
+
+            public IntPtr OutputHandle { get; set; }
+
+            public IntPtr ErrorHandle { get; set; }
+
+            public bool HasDuplicatedHandles { get; set; }
+
+            /// <summary>
+            /// Reads a request from GitHooksLoader, see NamedPipeMessages.RunHook.
+            /// </summary>
+            /// <returns>The request, or null if it is incomplete or invalid</returns>
+            public static HookRequest Read(StreamReader reader)
+            {
+                HookRequest request = new HookRequest();
+                bool hasHandles = false;
+
+                try
+                {
+                    for (string line = reader.ReadLine(); line != null; line = reader.ReadLine())
+                    {
+                        NamedPipeMessages.Message message = NamedPipeMessages.Message.FromString(line);
+                        switch (message.Header)
+                        {
+                            case NamedPipeMessages.RunHook.CommandLineHeader:
+                                request.CommandLine = Decode(message.Body);
+                                break;
+
+                            case NamedPipeMessages.RunHook.CurrentDirectoryHeader:
+                                request.CurrentDirectory = Decode(message.Body);
+                                break;
+
+                            case NamedPipeMessages.RunHook.EnvironmentHeader:
+                                string variable = Decode(message.Body);
+                                int separatorIndex = variable.IndexOf('=');
+                                if (separatorIndex <= 0)
+                                {
+                                    return null;
+                                }
+
+                                request.EnvironmentVariables[variable.Substring(0, separatorIndex)] = variable.Substring(separatorIndex + 1);
+                                break;
+
+                            case NamedPipeMessages.RunHook.StandardHandlesHeader:
+                                string[] handles = (message.Body ?? string.Empty).Split(NamedPipeMessages.RunHook.HandleSeparator);
+                                ulong outputHandle;
+                                ulong errorHandle;
+                                if (handles.Length != 2 ||
+                                    !ulong.TryParse(handles[0], out outputHandle) ||
+                                    !ulong.TryParse(handles[1], out errorHandle))
+                                {
+                                    return null;
+                                }
+
+                                request.OutputHandle = new IntPtr((long)outputHandle);
+                                request.ErrorHandle = new IntPtr((long)errorHandle);
+                                hasHandles = true;
+                                break;
+
+                            case NamedPipeMessages.RunHook.RunHeader:
+                                if (request.CommandLine == null || request.CurrentDirectory == null || !hasHandles)
+                                {
+                                    return null;
+                                }
+
+                                return request;
+
+                            default:
+                                return null;
+                        }
+                    }
+                }
+                catch (FormatException)
+                {
+                }
+
+                return null;
+            }
+
+            public void CloseHandles()
+            {
+                foreach (IntPtr handle in new[] { this.OutputHandle, this.ErrorHandle })
+                {
+                    if (handle != IntPtr.Zero)
+                    {
+                        CloseHandle(handle);
+                    }
+                }
+            }
+
+            private static string Decode(string body)
+            {
+                return Encoding.UTF8.GetString(Convert.FromBase64String(body ?? string.Empty));
+            }
+        }
+    }
+}
@@ -10,10 +10,15 @@ using Microsoft.Win32;
 using Microsoft.Win32.SafeHandles;
 using System;
 using System.Collections.Generic;
+using System.ComponentModel;
 using System.Diagnostics;
 using System.IO;
+using System.Linq;
 using System.Reflection;
+using System.Runtime.CompilerServices;
+using System.Text;
 using System.Threading;
+using System.Threading.Tasks;
 
 namespace GVFS.Mount
 {
@@ -34,12 +39,16 @@ namespace GVFS.Mount
 
         private GVFSContext context;
         private GVFSGitObjects gitObjects;
+        private SpeculativeObjectPrefetcher speculativePrefetcher;
 
         private MountState currentState;
         private HeartbeatThread heartbeat;
         private ManualResetEvent unmountEvent;
 
         private List<SafeFileHandle> folderLockHandles;
+
+        // The tagged download requests that each connection has outstanding
+        private ConditionalWeakTable<NamedPipeServer.Connection, TaggedDownloadQueue> taggedDownloadQueues;
         
         public InProcessMount(ITracer tracer, GVFSEnlistment enlistment, CacheServerInfo cacheServer, RetryConfig retryConfig, bool showDebugWindow)
         {
@@ -49,6 +58,7 @@ namespace GVFS.Mount
             this.enlistment = enlistment;
             this.showDebugWindow = showDebugWindow;
             this.unmountEvent = new ManualResetEvent(false);
+            this.taggedDownloadQueues = new ConditionalWeakTable<NamedPipeServer.Connection, TaggedDownloadQueue>();
         }
 
         private enum MountState
@@ -114,6 +124,7 @@ namespace GVFS.Mount
 
                 this.ValidateMountPoints();
                 this.UpdateHooks();
+                this.StartHookStandbyHosts();
                 this.SetVisualStudioRegistryKey();
 
                 this.MountAndStartWorkingDirectoryCallbacks(this.cacheServer);
@@ -223,6 +234,102 @@ namespace GVFS.Mount
                     this.FailMountAndExit("Error copying " + GVFSConstants.DotGit.Hooks.ReadObjectName + " to enlistment. " + ConsoleHelper.GetGVFSLogMessage(this.enlistment.EnlistmentRoot));
                 }
             }
+
+            this.UpdateReadObjectHookEnlistmentCache();
+        }
+
+        /// <summary>
+        /// Record the enlistment root next to the read-object hook so that the hook does not
+        /// need to walk up from the current directory looking for .gvfs every time git starts it.
+        /// </summary>
+        /// <remarks>
+        /// File format (see EnlistmentCacheHeader in GVFS.ReadObjectHook):
+        ///     UInt32 version
+        ///     UInt32 enlistment root length (in characters)
+        ///     Enlistment root (UTF-16) followed by a null terminator
+        /// </remarks>
+        private void UpdateReadObjectHookEnlistmentCache()
+        {
+            const uint EnlistmentCacheVersion = 1;
+
+            string cachePath = Path.Combine(this.enlistment.WorkingDirectoryRoot, GVFSConstants.DotGit.Hooks.ReadObjectEnlistmentCachePath);
+            byte[] contents;
+            using (MemoryStream stream = new MemoryStream())
+            using (BinaryWriter writer = new BinaryWriter(stream, Encoding.Unicode))
+            {
+                writer.Write(EnlistmentCacheVersion);
+                writer.Write((uint)this.enlistment.EnlistmentRoot.Length);
+                writer.Write(Encoding.Unicode.GetBytes(this.enlistment.EnlistmentRoot + '\0'));
+                writer.Flush();
+                contents = stream.ToArray();
+            }
+
+            try
+            {
+                if (File.Exists(cachePath) && File.ReadAllBytes(cachePath).SequenceEqual(contents))
+                {
+                    return;
+                }
+
+                File.WriteAllBytes(cachePath, contents);
+            }
+            catch (Exception e)
+            {
+                // The hook falls back to searching for the enlistment root when the cache is missing or stale
+                EventMetadata metadata = new EventMetadata();
+                metadata.Add("Area", "Mount");
+                metadata.Add("cachePath", cachePath);
+                metadata.Add("Exception", e.ToString());
+                this.tracer.RelatedWarning(metadata, "Failed to update " + GVFSConstants.DotGit.Hooks.ReadObjectName + " enlistment cache");
+            }
+        }
+
+        private void StartHookStandbyHosts()
+        {
+            // Setting gvfs.hook-standby-hosts to true keeps GVFS.Hooks processes waiting for GitHooksLoader to hand
+            // them the pre-command and post-command hooks.  The hosts replace themselves as they are used, and any
+            // beyond GVFSConstants.StandbyHooks.MaxStandbyHosts exit immediately.  They only serve this enlistment,
+            // and exit when this process does (i.e. once it has unmounted).
+            GitProcess git = new GitProcess(this.enlistment);
+            string value;
+            bool enabled;
+            if (!git.TryGetFromConfig(GVFSConstants.GitConfig.HookStandbyHosts, forceOutsideEnlistment: false, value: out value) ||
+                !bool.TryParse(value?.Trim(), out enabled) ||
+                !enabled)
+            {
+                return;
+            }
+
+            if (ProcessHelper.IsAdminElevated())
+            {
+                // The hosts would inherit our elevated token, and then run whatever hook any of the user's
+                // unelevated processes asked them to
+                this.tracer.RelatedInfo("Not starting hook standby hosts because the mount is elevated");
+                return;
+            }
+
+            string hooksPath = Path.Combine(ProcessHelper.GetCurrentProcessLocation(), GVFSConstants.GVFSHooksExecutableName);
+            string standbyArgs = string.Format(
+                "{0} {1} \"{2}\"",
+                GVFSConstants.StandbyHooks.StandbyArg,
+                Process.GetCurrentProcess().Id,
+                this.enlistment.EnlistmentRoot);
+            try
+            {
+                for (int i = 0; i < GVFSConstants.StandbyHooks.MaxStandbyHosts; ++i)
+                {
+                    ProcessHelper.StartBackgroundProcess(hooksPath, standbyArgs, createWindow: false);
+                }
+            }
+            catch (Win32Exception e)
+            {
+                // Hooks still run without standby hosts, GitHooksLoader just has to start them itself
+                EventMetadata metadata = new EventMetadata();
+                metadata.Add("Area", "Mount");
+                metadata.Add("hooksPath", hooksPath);
+                metadata.Add("Exception", e.ToString());
+                this.tracer.RelatedWarning(metadata, "Failed to start hook standby hosts");
+            }
         }
 
         private void SetVisualStudioRegistryKey()
@@ -316,6 +423,18 @@ namespace GVFS.Mount
                     this.HandleDownloadObjectRequest(message, connection);
                     break;
 
+                case NamedPipeMessages.DownloadObject.TaggedDownloadRequest:
+                    this.HandleTaggedDownloadObjectRequest(message, connection, returnContent: false);
+                    break;
+
+                case NamedPipeMessages.DownloadObject.TaggedContentRequest:
+                    this.HandleTaggedDownloadObjectRequest(message, connection, returnContent: true);
+                    break;
+
+                case NamedPipeMessages.DownloadObject.LocalObjectStatsRequest:
+                    this.HandleLocalObjectStatsRequest(message, connection);
+                    break;
+
                 default:
                     EventMetadata metadata = new EventMetadata();
                     metadata.Add("Area", "Mount");
@@ -399,43 +518,275 @@ namespace GVFS.Mount
 
         private void HandleDownloadObjectRequest(NamedPipeMessages.Message message, NamedPipeServer.Connection connection)
         {
-            NamedPipeMessages.DownloadObject.Response response;
-
             NamedPipeMessages.DownloadObject.Request request = new NamedPipeMessages.DownloadObject.Request(message);
-            string objectSha = request.RequestSha;
-            if (request == null)
+            NamedPipeMessages.DownloadObject.Response response = new NamedPipeMessages.DownloadObject.Response(this.DownloadObjectForNamedPipeRequest(request.RequestSha));
+            connection.TrySendResponse(response.CreateMessage());
+        }
+
+        private void HandleTaggedDownloadObjectRequest(NamedPipeMessages.Message message, NamedPipeServer.Connection connection, bool returnContent)
+        {
+            NamedPipeMessages.DownloadObject.TaggedRequest request = new NamedPipeMessages.DownloadObject.TaggedRequest(message);
+
+            // Download the objects on a thread pool thread so that the connection can go on to read the client's other
+            // outstanding requests.  Requests that arrive while a download is in progress are queued, and downloaded
+            // together once it completes.  The client matches the responses to its requests using the tag.
+            TaggedDownloadQueue queue = this.taggedDownloadQueues.GetOrCreateValue(connection);
+            if (queue.TryAddAndStartDownloading(new TaggedDownload(request, returnContent)))
             {
-                response = new NamedPipeMessages.DownloadObject.Response(NamedPipeMessages.UnknownRequest);
+                Task.Run(() => this.DownloadQueuedTaggedObjects(queue, connection));
             }
-            else if (this.currentState != MountState.Ready)
+        }
+
+        private void DownloadQueuedTaggedObjects(TaggedDownloadQueue queue, NamedPipeServer.Connection connection)
+        {
+            List<TaggedDownload> downloads;
+            while (queue.TryTakeAllOrStopDownloading(out downloads))
             {
-                response = new NamedPipeMessages.DownloadObject.Response(NamedPipeMessages.DownloadObject.MountNotReadyResult);
+                if (downloads.Count == 1)
+                {
+                    this.DownloadTaggedObject(downloads[0], connection);
+                }
+                else
+                {
+                    this.DownloadTaggedObjects(downloads, connection);
+                }
             }
-            else
+        }
+
+        private void DownloadTaggedObject(TaggedDownload download, NamedPipeServer.Connection connection)
+        {
+            string result;
+            byte[] looseObjectContent = null;
+            try
             {
-                if (!SHA1Util.IsValidShaFormat(objectSha))
+                result = this.DownloadObjectForNamedPipeRequest(download.Request.RequestSha, download.ReturnContent, out looseObjectContent);
+            }
+            catch (Exception e)
+            {
+                this.LogTaggedDownloadException(download.Request.RequestSha, e);
+                result = NamedPipeMessages.DownloadObject.DownloadFailed;
+            }
+
+            this.SendTaggedResponse(download, result, looseObjectContent, connection);
+        }
+
+        private void DownloadTaggedObjects(List<TaggedDownload> downloads, NamedPipeServer.Connection connection)
+        {
+            Dictionary<string, string> results;
+            try
+            {
+                results = this.DownloadObjectsForNamedPipeRequest(downloads.Select(download => download.Request.RequestSha));
+            }
+            catch (Exception e)
+            {
+                this.LogTaggedDownloadException(string.Join(",", downloads.Select(download => download.Request.RequestSha)), e);
+                results = new Dictionary<string, string>();
+            }
+
+            // The objects are written to disk before TryDownloadAndSaveObjects returns, and so content responses have no
+            // content and the client reads the object from disk
+            foreach (TaggedDownload download in downloads)
+            {
+                string result;
+                if (!results.TryGetValue(download.Request.RequestSha, out result))
                 {
-                    response = new NamedPipeMessages.DownloadObject.Response(NamedPipeMessages.DownloadObject.InvalidSHAResult);
+                    result = NamedPipeMessages.DownloadObject.DownloadFailed;
                 }
-                else
+
+                this.SendTaggedResponse(download, result, looseObjectContent: null, connection: connection);
+            }
+        }
+
+        private void SendTaggedResponse(TaggedDownload download, string result, byte[] looseObjectContent, NamedPipeServer.Connection connection)
+        {
+            if (download.ReturnContent)
+            {
+                connection.TrySendResponse(new NamedPipeMessages.DownloadObject.TaggedContentResponse(download.Request.Tag, result, looseObjectContent).CreateMessage());
+            }
+            else
+            {
+                connection.TrySendResponse(new NamedPipeMessages.DownloadObject.TaggedResponse(download.Request.Tag, result).CreateMessage());
+            }
+        }
+
+        private void LogTaggedDownloadException(string objectShas, Exception e)
+        {
+            EventMetadata metadata = new EventMetadata();
+            metadata.Add("Area", "Mount");
+            metadata.Add("sha", objectShas);
+            metadata.Add("Exception", e.ToString());
+            this.tracer.RelatedError(metadata, nameof(this.HandleTaggedDownloadObjectRequest) + ": Unhandled exception while downloading object");
+        }
+
+        private string DownloadObjectForNamedPipeRequest(string objectSha)
+        {
+            byte[] looseObjectContent;
+            return this.DownloadObjectForNamedPipeRequest(objectSha, returnContent: false, looseObjectContent: out looseObjectContent);
+        }
+
+        private string DownloadObjectForNamedPipeRequest(string objectSha, bool returnContent, out byte[] looseObjectContent)
+        {
+            // When returnContent is true, looseObjectContent is set to the downloaded object, which is written
+            // to disk in the background rather than before the response is sent.  Objects larger than
+            // MaxContentResponseLength are written to disk first, and looseObjectContent is null.
+            looseObjectContent = null;
+            if (this.currentState != MountState.Ready)
+            {
+                return NamedPipeMessages.DownloadObject.MountNotReadyResult;
+            }
+
+            if (!SHA1Util.IsValidShaFormat(objectSha))
+            {
+                return NamedPipeMessages.DownloadObject.InvalidSHAResult;
+            }
+
+            Stopwatch downloadTime = Stopwatch.StartNew();
+            GitObjects.DownloadAndSaveObjectResult downloadResult = GitObjects.DownloadAndSaveObjectResult.Error;
+            Task looseObjectSaved = null;
+            this.speculativePrefetcher?.OnDemandDownloadStarted(objectSha);
+            try
+            {
+                if (returnContent)
                 {
-                    Stopwatch downloadTime = Stopwatch.StartNew();
-                    if (this.gitObjects.TryDownloadAndSaveObject(objectSha, GVFSGitObjects.RequestSource.NamedPipeMessage) == GitObjects.DownloadAndSaveObjectResult.Success)
-                    {
-                        response = new NamedPipeMessages.DownloadObject.Response(NamedPipeMessages.DownloadObject.SuccessResult);
-                    }
-                    else
+                    downloadResult = this.gitObjects.TryDownloadObjectContent(
+                        objectSha,
+                        GVFSGitObjects.RequestSource.NamedPipeMessage,
+                        out looseObjectContent,
+                        out looseObjectSaved);
+
+                    if (looseObjectContent != null && looseObjectContent.Length > NamedPipeMessages.DownloadObject.MaxContentResponseLength)
                     {
-                        response = new NamedPipeMessages.DownloadObject.Response(NamedPipeMessages.DownloadObject.DownloadFailed);
+                        // Rather than buffering a large object in the response, have the client read it from disk
+                        looseObjectSaved.Wait();
+                        looseObjectContent = null;
                     }
+                }
+                else
+                {
+                    downloadResult = this.gitObjects.TryDownloadAndSaveObject(objectSha, GVFSGitObjects.RequestSource.NamedPipeMessage);
+                }
+            }
+            finally
+            {
+                // The prefetcher reads completed objects from disk, and so it is only told once the object has been written
+                bool succeeded = downloadResult == GitObjects.DownloadAndSaveObjectResult.Success;
+                if (looseObjectSaved != null && !looseObjectSaved.IsCompleted)
+                {
+                    looseObjectSaved.ContinueWith(unused => this.speculativePrefetcher?.OnDemandDownloadCompleted(objectSha, succeeded));
+                }
+                else
+                {
+                    this.speculativePrefetcher?.OnDemandDownloadCompleted(objectSha, succeeded);
+                }
+            }
 
-                    bool isBlob;
-                    this.context.Repository.TryGetIsBlob(objectSha, out isBlob);
-                    this.context.Repository.GVFSLock.Stats.RecordObjectDownload(isBlob, downloadTime.ElapsedMilliseconds);
+            string result;
+            if (downloadResult == GitObjects.DownloadAndSaveObjectResult.Success)
+            {
+                result = NamedPipeMessages.DownloadObject.SuccessResult;
+            }
+            else
+            {
+                result = NamedPipeMessages.DownloadObject.DownloadFailed;
+                looseObjectContent = null;
+            }
+
+            bool isBlob;
+            if (looseObjectContent != null)
+            {
+                isBlob = GVFSGitObjects.IsLooseObjectBlob(looseObjectContent);
+            }
+            else
+            {
+                this.context.Repository.TryGetIsBlob(objectSha, out isBlob);
+            }
+
+            this.context.Repository.GVFSLock.Stats.RecordObjectDownload(isBlob, downloadTime.ElapsedMilliseconds);
+
+            return result;
+        }
+
+        /// <summary>
+        /// Downloads objectShas in a single request
+        /// </summary>
+        /// <returns>The result for each of objectShas (keyed ignoring case)</returns>
+        private Dictionary<string, string> DownloadObjectsForNamedPipeRequest(IEnumerable<string> objectShas)
+        {
+            Dictionary<string, string> results = new Dictionary<string, string>(StringComparer.OrdinalIgnoreCase);
+            List<string> validShas = new List<string>();
+            foreach (string objectSha in objectShas)
+            {
+                if (this.currentState != MountState.Ready)
+                {
+                    results[objectSha] = NamedPipeMessages.DownloadObject.MountNotReadyResult;
+                }
+                else if (!SHA1Util.IsValidShaFormat(objectSha))
+                {
+                    results[objectSha] = NamedPipeMessages.DownloadObject.InvalidSHAResult;
+                }
+                else
+                {
+                    validShas.Add(objectSha);
                 }
             }
 
-            connection.TrySendResponse(response.CreateMessage());
+            if (validShas.Count == 0)
+            {
+                return results;
+            }
+
+            Stopwatch downloadTime = Stopwatch.StartNew();
+            Dictionary<string, GitObjects.DownloadAndSaveObjectResult> downloadResults = null;
+            foreach (string objectSha in validShas)
+            {
+                this.speculativePrefetcher?.OnDemandDownloadStarted(objectSha);
+            }
+
+            try
+            {
+                downloadResults = this.gitObjects.TryDownloadAndSaveObjects(validShas, GVFSGitObjects.RequestSource.NamedPipeMessage);
+            }
+            finally
+            {
+                foreach (string objectSha in validShas)
+                {
+                    GitObjects.DownloadAndSaveObjectResult downloadResult;
+                    bool succeeded = downloadResults != null &&
+                        downloadResults.TryGetValue(objectSha, out downloadResult) &&
+                        downloadResult == GitObjects.DownloadAndSaveObjectResult.Success;
+                    this.speculativePrefetcher?.OnDemandDownloadCompleted(objectSha, succeeded);
+                }
+            }
+
+            long downloadTimeMs = downloadTime.ElapsedMilliseconds;
+            foreach (KeyValuePair<string, GitObjects.DownloadAndSaveObjectResult> downloadResult in downloadResults)
+            {
+                results[downloadResult.Key] = downloadResult.Value == GitObjects.DownloadAndSaveObjectResult.Success ?
+                    NamedPipeMessages.DownloadObject.SuccessResult :
+                    NamedPipeMessages.DownloadObject.DownloadFailed;
+            }
+
+            // The objects share a single request, so attribute an equal share of its time to each of them
+            long perObjectTimeMs = downloadResults.Count > 0 ? downloadTimeMs / downloadResults.Count : 0;
+            foreach (string objectSha in downloadResults.Keys)
+            {
+                bool isBlob;
+                this.context.Repository.TryGetIsBlob(objectSha, out isBlob);
+                this.context.Repository.GVFSLock.Stats.RecordObjectDownload(isBlob, perObjectTimeMs);
+            }
+
+            return results;
+        }
+
+        private void HandleLocalObjectStatsRequest(NamedPipeMessages.Message message, NamedPipeServer.Connection connection)
+        {
+            NamedPipeMessages.DownloadObject.LocalObjectStats stats = new NamedPipeMessages.DownloadObject.LocalObjectStats(message);
+            if (stats.IsValid)
+            {
+                this.context.Repository.GVFSLock.Stats.RecordReadObjectHookLocalObjects(stats.LocalHits, stats.LocalMisses);
+            }
+
+            connection.TrySendResponse(NamedPipeMessages.DownloadObject.SuccessResult);
         }
 
         private void HandleGetStatusRequest(NamedPipeServer.Connection connection)
@@ -564,10 +915,34 @@ namespace GVFS.Mount
 
             this.AcquireFolderLocks();
 
+            long speculativePrefetchBytesPerSecond = this.GetSpeculativePrefetchBytesPerSecond();
+            if (speculativePrefetchBytesPerSecond > 0)
+            {
+                this.speculativePrefetcher = new SpeculativeObjectPrefetcher(this.tracer, this.context.Repository, this.gitObjects, speculativePrefetchBytesPerSecond);
+                this.speculativePrefetcher.Start();
+            }
+
             this.heartbeat = new HeartbeatThread(this.tracer, this.gvfltCallbacks);
             this.heartbeat.Start();
         }
 
+        private long GetSpeculativePrefetchBytesPerSecond()
+        {
+            // Speculative prefetching is off unless gvfs.speculative-prefetch-bytes-per-second is set to a budget
+            // greater than 0
+            GitProcess git = new GitProcess(this.enlistment);
+            string value;
+            long bytesPerSecond;
+            if (git.TryGetFromConfig(GVFSConstants.GitConfig.SpeculativePrefetchBytesPerSecond, forceOutsideEnlistment: false, value: out value) &&
+                long.TryParse(value?.Trim(), out bytesPerSecond) &&
+                bytesPerSecond >= 0)
+            {
+                return bytesPerSecond;
+            }
+
+            return 0;
+        }
+
         private void UnmountAndStopWorkingDirectoryCallbacks()
         {
             this.ReleaseFolderLocks();
@@ -578,6 +953,13 @@ namespace GVFS.Mount
                 this.heartbeat = null;
             }
 
+            if (this.speculativePrefetcher != null)
+            {
+                this.speculativePrefetcher.Dispose();
+                this.tracer.RelatedEvent(EventLevel.Informational, "SpeculativePrefetchStatistics", this.speculativePrefetcher.GetStatistics(), Keywords.Telemetry);
+                this.speculativePrefetcher = null;
+            }
+
             if (this.gvfltCallbacks != null)
             {
                 this.gvfltCallbacks.Stop();
@@ -585,5 +967,63 @@ namespace GVFS.Mount
                 this.gvfltCallbacks = null;
             }
         }
+
+        private class TaggedDownload
+        {
+            public TaggedDownload(NamedPipeMessages.DownloadObject.TaggedRequest request, bool returnContent)
+            {
+                this.Request = request;
+                this.ReturnContent = returnContent;
+            }
+
+            public NamedPipeMessages.DownloadObject.TaggedRequest Request { get; }
+
+            public bool ReturnContent { get; }
+        }
+
+        private class TaggedDownloadQueue
+        {
+            private readonly object queueLock = new object();
+            private List<TaggedDownload> queuedDownloads = new List<TaggedDownload>();
+            private bool isDownloading;
+
+            /// <summary>
+            /// Queues download, and returns true if the caller must start downloading the queue
+            /// </summary>
+            public bool TryAddAndStartDownloading(TaggedDownload download)
+            {
+                lock (this.queueLock)
+                {
+                    this.queuedDownloads.Add(download);
+                    if (this.isDownloading)
+                    {
+                        return false;
+                    }
+
+                    this.isDownloading = true;
+                    return true;
+                }
+            }
+
+            /// <summary>
+            /// Takes every queued download, or returns false (and stops downloading) if the queue is empty
+            /// </summary>
+            public bool TryTakeAllOrStopDownloading(out List<TaggedDownload> downloads)
+            {
+                lock (this.queueLock)
+                {
+                    if (this.queuedDownloads.Count == 0)
+                    {
+                        this.isDownloading = false;
+                        downloads = null;
+                        return false;
+                    }
+
+                    downloads = this.queuedDownloads;
+                    this.queuedDownloads = new List<TaggedDownload>();
+                    return true;
+                }
+            }
+        }
     }
 }
\ No newline at end of file
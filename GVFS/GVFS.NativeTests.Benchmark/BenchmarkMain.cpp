@@ -0,0 +1,121 @@
+// GVFS.NativeTests.Benchmark
+//
+// Runs the GVFS.NativeTests benchmark (see GVFS.NativeTests/include/Benchmark.h) against MockBackend, an in-process
+// stand-in for ProjFS and GVFS.Mount, and writes the results as JSON.  This is for working on the benchmark itself
+// without the filter driver: the numbers come from the costs given below, not from GVFS.  GVFlt_Benchmark in
+// GVFS.NativeTests runs the same benchmark against a GVFS mount.
+//
+// Usage: GVFS.NativeTests.Benchmark [--threads <max threads>] [--operations <count>] [--placeholder-us <us>]
+//                                   [--hydration-us <us>] [--hydration-concurrency <count>] [--output <file>]
+
+#include "Benchmark.h"
+#include "MockBackend.h"
+#include <fstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace
+{
+    const size_t FilesPerFolder = 256;
+
+    int Usage(const char* program)
+    {
+        fprintf(
+            stderr,
+            "Usage: %s [--threads <max threads>] [--operations <count>] [--placeholder-us <us>]\n"
+            "       [--hydration-us <us>] [--hydration-concurrency <count>] [--output <file>]\n",
+            program);
+        return 1;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    BenchmarkOptions options;
+    MockBackendOptions backendOptions;
+    const char* outputPath = nullptr;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (i + 1 >= argc)
+        {
+            return Usage(argv[0]);
+        }
+
+        const char* name = argv[i];
+        const char* value = argv[++i];
+        if (strcmp(name, "--threads") == 0)
+        {
+            options.maxThreads = atoi(value);
+        }
+        else if (strcmp(name, "--operations") == 0)
+        {
+            options.operations = strtoul(value, nullptr, 10);
+        }
+        else if (strcmp(name, "--placeholder-us") == 0)
+        {
+            backendOptions.placeholderCostUs = atoi(value);
+        }
+        else if (strcmp(name, "--hydration-us") == 0)
+        {
+            backendOptions.hydrationCostUs = atoi(value);
+        }
+        else if (strcmp(name, "--hydration-concurrency") == 0)
+        {
+            backendOptions.hydrationConcurrency = atoi(value);
+        }
+        else if (strcmp(name, "--output") == 0)
+        {
+            outputPath = value;
+        }
+        else
+        {
+            return Usage(argv[0]);
+        }
+    }
+
+    if (options.maxThreads < 1 ||
+        options.operations == 0 ||
+        backendOptions.placeholderCostUs < 0 ||
+        backendOptions.hydrationCostUs < 0 ||
+        backendOptions.hydrationConcurrency < 1)
+    {
+        return Usage(argv[0]);
+    }
+
+    // Enough files for every phase at every thread count to open files that nothing has opened before
+    size_t threadCountCount = 0;
+    for (int threadCount = 1; threadCount <= options.maxThreads && threadCount <= 64; threadCount *= 2)
+    {
+        ++threadCountCount;
+    }
+
+    size_t filesNeeded = 2 * options.operations * threadCountCount;
+    backendOptions.filesPerFolder = FilesPerFolder;
+    backendOptions.folders = (filesNeeded + FilesPerFolder - 1) / FilesPerFolder;
+
+    MockBackend backend(backendOptions);
+    std::string json;
+    std::string error;
+    if (!RunBenchmark(backend, options, json, error))
+    {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+
+    if (outputPath == nullptr)
+    {
+        fputs(json.c_str(), stdout);
+        return 0;
+    }
+
+    std::ofstream output(outputPath, std::ios::binary);
+    output << json;
+    if (!output)
+    {
+        fprintf(stderr, "Unable to write '%s'\n", outputPath);
+        return 1;
+    }
+
+    return 0;
+}
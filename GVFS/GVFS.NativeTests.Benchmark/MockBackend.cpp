@@ -0,0 +1,153 @@
+#include "MockBackend.h"
+#include <chrono>
+#include <functional>
+#include <thread>
+
+MockBackend::MockBackend(const MockBackendOptions& backendOptions)
+    : options(backendOptions),
+      runningHydrations(0)
+{
+    for (size_t folderIndex = 0; folderIndex < backendOptions.folders; ++folderIndex)
+    {
+        std::string folderName = "folder" + std::to_string(folderIndex) + "/";
+        std::vector<std::string>& entries = this->folderEntries[folderName];
+        this->folderNames.push_back(folderName);
+
+        for (size_t fileIndex = 0; fileIndex < backendOptions.filesPerFolder; ++fileIndex)
+        {
+            std::string fileName = "file" + std::to_string(fileIndex) + ".txt";
+            entries.push_back(fileName);
+
+            std::unique_ptr<MockFile> file(new MockFile());
+            file->state = Virtual;
+            this->filesByPath[folderName + fileName] = file.get();
+            this->files.push_back(std::move(file));
+        }
+    }
+}
+
+std::string MockBackend::GetName() const
+{
+    return "mock";
+}
+
+bool MockBackend::FindFiles(size_t maxFiles, std::vector<std::string>& foundFiles, std::vector<std::string>& folders)
+{
+    for (const std::string& folderName : this->folderNames)
+    {
+        if (foundFiles.size() >= maxFiles)
+        {
+            break;
+        }
+
+        folders.push_back(folderName);
+        for (const std::string& fileName : this->folderEntries[folderName])
+        {
+            if (foundFiles.size() < maxFiles)
+            {
+                foundFiles.push_back(folderName + fileName);
+            }
+        }
+    }
+
+    return true;
+}
+
+bool MockBackend::OpenForRead(const std::string& path)
+{
+    MockFile* file = this->FindFile(path);
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    if (file->state == Virtual)
+    {
+        this->CreatePlaceholder(*file);
+    }
+
+    return true;
+}
+
+bool MockBackend::ReadFileAsString(const std::string& path)
+{
+    MockFile* file = this->FindFile(path);
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    if (file->state != Hydrated)
+    {
+        this->CreatePlaceholder(*file);
+        this->Hydrate(*file);
+    }
+
+    // Once hydrated, the contents are never changed
+    std::string contents = file->contents;
+    return !contents.empty();
+}
+
+bool MockBackend::EnumDirectory(const std::string& folder, size_t& entryCount)
+{
+    std::unordered_map<std::string, std::vector<std::string>>::const_iterator entries = this->folderEntries.find(folder);
+    if (entries == this->folderEntries.end())
+    {
+        return false;
+    }
+
+    // GVFS.Mount returns a copy of the projected folder's entries
+    std::vector<std::string> enumeration(entries->second);
+    entryCount = enumeration.size();
+    return true;
+}
+
+MockBackend::MockFile* MockBackend::FindFile(const std::string& path)
+{
+    std::unordered_map<std::string, MockFile*>::const_iterator file = this->filesByPath.find(path);
+    return file == this->filesByPath.end() ? nullptr : file->second;
+}
+
+void MockBackend::CreatePlaceholder(MockFile& file)
+{
+    std::lock_guard<std::mutex> fileLock(this->GetFileLock(file));
+    if (file.state == Virtual)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(this->options.placeholderCostUs));
+        file.state = Placeholder;
+    }
+}
+
+void MockBackend::Hydrate(MockFile& file)
+{
+    std::lock_guard<std::mutex> fileLock(this->GetFileLock(file));
+    if (file.state == Hydrated)
+    {
+        return;
+    }
+
+    {
+        std::unique_lock<std::mutex> hydrationSlot(this->hydrationLock);
+        this->hydrationSlotAvailable.wait(
+            hydrationSlot,
+            [this]() { return this->runningHydrations < this->options.hydrationConcurrency; });
+        ++this->runningHydrations;
+    }
+
+    std::this_thread::sleep_for(std::chrono::microseconds(this->options.hydrationCostUs));
+    file.contents.assign(256, 'x');
+    file.state = Hydrated;
+
+    {
+        std::lock_guard<std::mutex> hydrationSlot(this->hydrationLock);
+        --this->runningHydrations;
+    }
+
+    this->hydrationSlotAvailable.notify_one();
+}
+
+std::mutex& MockBackend::GetFileLock(const MockFile& file)
+{
+    size_t lockCount = sizeof(this->fileLocks) / sizeof(this->fileLocks[0]);
+    return this->fileLocks[std::hash<const MockFile*>()(&file) % lockCount];
+}
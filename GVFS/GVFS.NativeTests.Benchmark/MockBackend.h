@@ -0,0 +1,70 @@
+#pragma once
+
+#include "Benchmark.h"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+struct MockBackendOptions
+{
+    size_t folders = 64;
+    size_t filesPerFolder = 256;
+
+    // How long GVFS.Mount takes to answer ProjFS when a file is first opened (GetPlaceholderInfo, which looks the path
+    // up in the projection), and when it is first read (GetFileStream, which reads the blob from the object cache)
+    int placeholderCostUs = 20;
+    int hydrationCostUs = 200;
+
+    // How many files GVFS.Mount hydrates at once, with the rest waiting their turn
+    int hydrationConcurrency = 8;
+};
+
+// Stands in for ProjFS and GVFS.Mount, so that the benchmark harness and its reports can be worked on without the
+// filter driver.  Files start out virtual, the first open makes a file a placeholder, and the first read hydrates it,
+// each of which waits for as long as the callback to GVFS.Mount would take.  Two threads that open the same virtual
+// file at once share the one callback, as they do with ProjFS.
+class MockBackend : public BenchmarkBackend
+{
+public:
+    explicit MockBackend(const MockBackendOptions& backendOptions);
+
+    virtual std::string GetName() const override;
+    virtual bool FindFiles(size_t maxFiles, std::vector<std::string>& files, std::vector<std::string>& folders) override;
+    virtual bool OpenForRead(const std::string& path) override;
+    virtual bool ReadFileAsString(const std::string& path) override;
+    virtual bool EnumDirectory(const std::string& folder, size_t& entryCount) override;
+
+private:
+    enum FileState
+    {
+        Virtual,
+        Placeholder,
+        Hydrated,
+    };
+
+    struct MockFile
+    {
+        std::atomic<int> state;
+        std::string contents;
+    };
+
+    MockFile* FindFile(const std::string& path);
+    void CreatePlaceholder(MockFile& file);
+    void Hydrate(MockFile& file);
+    std::mutex& GetFileLock(const MockFile& file);
+
+    MockBackendOptions options;
+    std::vector<std::string> folderNames;
+    std::unordered_map<std::string, std::vector<std::string>> folderEntries;
+    std::vector<std::unique_ptr<MockFile>> files;
+    std::unordered_map<std::string, MockFile*> filesByPath;
+
+    // Callbacks for a file are made while holding its lock (one of these, picked by the file's address)
+    std::mutex fileLocks[256];
+
+    std::mutex hydrationLock;
+    std::condition_variable hydrationSlotAvailable;
+    int runningHydrations;
+};
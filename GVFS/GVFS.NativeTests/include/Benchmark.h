@@ -0,0 +1,47 @@
+#pragma once
+
+// Times the file system operations that GVFS virtualizes, from 1 up to 64 threads at once.  This only uses the C++
+// standard library, so that it can be built without the filter driver: GVFlt_Benchmark runs it against a GVFS mount
+// (using TestHelpers.h), and GVFS.NativeTests.Benchmark runs it against an in-process mock of GVFS.
+
+#include <string>
+#include <vector>
+
+// The operations that are timed.  Each one returns false if it failed, and is called from many threads at once.
+class BenchmarkBackend
+{
+public:
+    virtual ~BenchmarkBackend()
+    {
+    }
+
+    // A short name for the results, e.g. "gvfs"
+    virtual std::string GetName() const = 0;
+
+    // Lists up to maxFiles files (and every folder that was enumerated to find them), without opening the files
+    virtual bool FindFiles(size_t maxFiles, std::vector<std::string>& files, std::vector<std::string>& folders) = 0;
+
+    virtual bool OpenForRead(const std::string& path) = 0;
+    virtual bool ReadFileAsString(const std::string& path) = 0;
+    virtual bool EnumDirectory(const std::string& folder, size_t& entryCount) = 0;
+};
+
+struct BenchmarkOptions
+{
+    // Each phase is run with 1, 2, 4, ... threads, up to maxThreads
+    int maxThreads = 64;
+
+    // The operations that each phase runs at each thread count, shared out between the threads
+    size_t operations = 1000;
+};
+
+// Runs these phases at each thread count, and writes the results to json:
+//
+//   placeholderCreation   open files that have never been opened, so that GVFS creates a placeholder for each
+//   hydration             read files that have never been opened, so that GVFS also provides their contents
+//   warmOpen              open files that have already been read
+//   enumeration           enumerate folders that have already been enumerated once
+//
+// Each phase uses files that no earlier phase has touched, and so the backend needs at least
+// 2 * operations * (the number of thread counts) files that are still virtual.
+bool RunBenchmark(BenchmarkBackend& backend, const BenchmarkOptions& options, std::string& json, std::string& error);
@@ -0,0 +1,9 @@
+#pragma once
+
+extern "C"
+{
+    // Times placeholder creation, hydration, warm opens and enumeration under virtualRootPath at 1 up to maxThreads
+    // threads (see Benchmark.h), and writes the results to resultsPath as JSON.  virtualRootPath must have at least
+    // 2 * operations * (the number of thread counts) files that have not been opened since it was mounted.
+    NATIVE_TESTS_EXPORT bool GVFlt_Benchmark(const char* virtualRootPath, const char* resultsPath, int maxThreads, int operations);
+}
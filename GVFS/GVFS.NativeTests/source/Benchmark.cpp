@@ -0,0 +1,258 @@
+// Not built with the precompiled header, as GVFS.NativeTests.Benchmark also builds this file on Linux
+#include "Benchmark.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <random>
+#include <stdio.h>
+#include <thread>
+
+struct PhaseResult
+{
+    std::string phase;
+    int threads = 0;
+    size_t errors = 0;
+    size_t entries = 0;
+    double seconds = 0;
+    std::vector<double> latenciesUs;
+};
+
+// Runs operation(0) to operation(operationCount - 1), shared out between threadCount threads that all start together.
+// operation returns false if it failed, and sets entries to the number of entries it returned (when enumerating).
+static PhaseResult RunPhase(
+    const char* phase,
+    int threadCount,
+    size_t operationCount,
+    const std::function<bool(size_t, size_t&)>& operation)
+{
+    PhaseResult result;
+    result.phase = phase;
+    result.threads = threadCount;
+
+    std::atomic<size_t> nextOperation(0);
+    std::atomic<size_t> errors(0);
+    std::atomic<size_t> entries(0);
+    std::vector<std::vector<double>> threadLatencies(threadCount);
+
+    std::promise<void> mainThreadReadyPromise;
+    std::shared_future<void> mainThreadReadyFuture(mainThreadReadyPromise.get_future());
+    std::vector<std::promise<void>> threadReadyPromises(threadCount);
+    std::vector<std::thread> threads;
+
+    for (int i = 0; i < threadCount; ++i)
+    {
+        threads.emplace_back([&, i, mainThreadReadyFuture]()
+        {
+            std::vector<double>& latencies = threadLatencies[i];
+            latencies.reserve(operationCount / static_cast<size_t>(threadCount) + 1);
+
+            // Notify the main thread that our thread is ready, and wait for it to ask us to start
+            threadReadyPromises[i].set_value();
+            mainThreadReadyFuture.wait();
+
+            for (size_t index = nextOperation++; index < operationCount; index = nextOperation++)
+            {
+                size_t operationEntries = 0;
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                bool succeeded = operation(index, operationEntries);
+                std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+                latencies.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+                entries += operationEntries;
+                if (!succeeded)
+                {
+                    ++errors;
+                }
+            }
+        });
+    }
+
+    for (std::promise<void>& promise : threadReadyPromises)
+    {
+        promise.get_future().wait();
+    }
+
+    std::chrono::steady_clock::time_point phaseStart = std::chrono::steady_clock::now();
+    mainThreadReadyPromise.set_value();
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - phaseStart).count();
+    result.errors = errors;
+    result.entries = entries;
+    for (const std::vector<double>& latencies : threadLatencies)
+    {
+        result.latenciesUs.insert(result.latenciesUs.end(), latencies.begin(), latencies.end());
+    }
+
+    std::sort(result.latenciesUs.begin(), result.latenciesUs.end());
+    return result;
+}
+
+static double Percentile(const std::vector<double>& sortedValues, double percentile)
+{
+    // Nearest rank
+    if (sortedValues.empty())
+    {
+        return 0;
+    }
+
+    size_t rank = static_cast<size_t>(percentile / 100.0 * static_cast<double>(sortedValues.size()) + 0.999999);
+    return sortedValues[std::min(std::max<size_t>(rank, 1), sortedValues.size()) - 1];
+}
+
+static void AppendJsonString(std::string& json, const std::string& value)
+{
+    json += '"';
+    for (char c : value)
+    {
+        if (c == '"' || c == '\\')
+        {
+            json += '\\';
+            json += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned int>(c));
+            json += escaped;
+        }
+        else
+        {
+            json += c;
+        }
+    }
+
+    json += '"';
+}
+
+static void AppendJsonNumber(std::string& json, const char* name, double value)
+{
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), ",\"%s\":%.3f", name, value);
+    json += buffer;
+}
+
+static void AppendPhaseResult(std::string& json, const PhaseResult& result)
+{
+    // e.g. {"phase":"hydration","threads":8,"operations":1000,"errors":0,"seconds":0.412,"operationsPerSecond":2427.184,
+    //       "latencyUs":{"p50":...,"p90":...,"p99":...,"p999":...,"max":...,"mean":...}}
+    double operationCount = static_cast<double>(result.latenciesUs.size());
+    json += "{\"phase\":";
+    AppendJsonString(json, result.phase);
+    json += ",\"threads\":" + std::to_string(result.threads);
+    json += ",\"operations\":" + std::to_string(result.latenciesUs.size());
+    json += ",\"errors\":" + std::to_string(result.errors);
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), ",\"seconds\":%.6f", result.seconds);
+    json += buffer;
+    AppendJsonNumber(json, "operationsPerSecond", result.seconds > 0 ? operationCount / result.seconds : 0);
+    if (result.phase == "enumeration")
+    {
+        json += ",\"entries\":" + std::to_string(result.entries);
+        AppendJsonNumber(json, "entriesPerSecond", result.seconds > 0 ? static_cast<double>(result.entries) / result.seconds : 0);
+    }
+
+    double totalUs = 0;
+    for (double latencyUs : result.latenciesUs)
+    {
+        totalUs += latencyUs;
+    }
+
+    json += ",\"latencyUs\":{";
+    snprintf(buffer, sizeof(buffer), "\"p50\":%.3f", Percentile(result.latenciesUs, 50));
+    json += buffer;
+    AppendJsonNumber(json, "p90", Percentile(result.latenciesUs, 90));
+    AppendJsonNumber(json, "p99", Percentile(result.latenciesUs, 99));
+    AppendJsonNumber(json, "p999", Percentile(result.latenciesUs, 99.9));
+    AppendJsonNumber(json, "max", result.latenciesUs.empty() ? 0 : result.latenciesUs.back());
+    AppendJsonNumber(json, "mean", result.latenciesUs.empty() ? 0 : totalUs / operationCount);
+    json += "}}";
+}
+
+bool RunBenchmark(BenchmarkBackend& backend, const BenchmarkOptions& options, std::string& json, std::string& error)
+{
+    std::vector<int> threadCounts;
+    for (int threadCount = 1; threadCount <= std::min(options.maxThreads, 64); threadCount *= 2)
+    {
+        threadCounts.push_back(threadCount);
+    }
+
+    if (threadCounts.empty() || options.operations == 0)
+    {
+        error = "maxThreads and operations must be at least 1";
+        return false;
+    }
+
+    std::vector<std::string> files;
+    std::vector<std::string> folders;
+    size_t filesNeeded = 2 * options.operations * threadCounts.size();
+    if (!backend.FindFiles(filesNeeded, files, folders))
+    {
+        error = "Unable to find the files to run the benchmark with";
+        return false;
+    }
+
+    if (files.size() < filesNeeded || folders.empty())
+    {
+        error = "Found " + std::to_string(files.size()) + " files, and the benchmark needs " + std::to_string(filesNeeded);
+        return false;
+    }
+
+    // Spread each phase's files across the folders rather than working through one folder at a time
+    std::mt19937 random(20180601);
+    std::shuffle(files.begin(), files.end(), random);
+
+    size_t nextUnopenedFile = 0;
+    std::vector<std::string> readFiles;
+    std::vector<PhaseResult> results;
+    for (int threadCount : threadCounts)
+    {
+        const std::string* unopenedFiles = &files[nextUnopenedFile];
+        nextUnopenedFile += options.operations;
+        results.push_back(RunPhase(
+            "placeholderCreation",
+            threadCount,
+            options.operations,
+            [&](size_t index, size_t&) { return backend.OpenForRead(unopenedFiles[index]); }));
+
+        unopenedFiles = &files[nextUnopenedFile];
+        nextUnopenedFile += options.operations;
+        results.push_back(RunPhase(
+            "hydration",
+            threadCount,
+            options.operations,
+            [&](size_t index, size_t&) { return backend.ReadFileAsString(unopenedFiles[index]); }));
+
+        readFiles.insert(readFiles.end(), unopenedFiles, unopenedFiles + options.operations);
+        results.push_back(RunPhase(
+            "warmOpen",
+            threadCount,
+            options.operations,
+            [&](size_t index, size_t&) { return backend.OpenForRead(readFiles[index % readFiles.size()]); }));
+
+        results.push_back(RunPhase(
+            "enumeration",
+            threadCount,
+            options.operations,
+            [&](size_t index, size_t& entryCount) { return backend.EnumDirectory(folders[index % folders.size()], entryCount); }));
+    }
+
+    json = "{\"backend\":";
+    AppendJsonString(json, backend.GetName());
+    json += ",\"files\":" + std::to_string(files.size());
+    json += ",\"folders\":" + std::to_string(folders.size());
+    json += ",\"results\":[";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        json += i == 0 ? "\n" : ",\n";
+        AppendPhaseResult(json, results[i]);
+    }
+
+    json += "\n]}\n";
+    return true;
+}
@@ -0,0 +1,142 @@
+#include "stdafx.h"
+#include "GVFlt_Benchmark.h"
+#include "Benchmark.h"
+#include "TestException.h"
+#include "TestHelpers.h"
+#include "Should.h"
+#include <fstream>
+
+namespace
+{
+    // Runs the benchmark's operations against a GVFS mount.  The helpers in TestHelpers.h throw a TestException when
+    // an operation fails, which the benchmark counts as an error.
+    class GVFSBenchmarkBackend : public BenchmarkBackend
+    {
+    public:
+        explicit GVFSBenchmarkBackend(const std::string& rootPath)
+            : virtualRootPath(rootPath)
+        {
+            if (this->virtualRootPath.empty() || this->virtualRootPath.back() != '\\')
+            {
+                this->virtualRootPath += '\\';
+            }
+        }
+
+        virtual std::string GetName() const override
+        {
+            return "gvfs";
+        }
+
+        virtual bool FindFiles(size_t maxFiles, std::vector<std::string>& files, std::vector<std::string>& folders) override
+        {
+            // Breadth first, so that the files come from many folders.  Enumerating a folder does not create
+            // placeholders for the files in it, and so they are still virtual.
+            std::list<std::string> foldersToEnumerate;
+            foldersToEnumerate.push_back(this->virtualRootPath);
+            while (!foldersToEnumerate.empty() && files.size() < maxFiles)
+            {
+                std::string folder = foldersToEnumerate.front();
+                foldersToEnumerate.pop_front();
+
+                std::vector<FileInfo> entries;
+                try
+                {
+                    entries = TestHelpers::EnumDirectory(folder);
+                }
+                catch (TestException&)
+                {
+                    return false;
+                }
+
+                folders.push_back(folder);
+                for (const FileInfo& entry : entries)
+                {
+                    // .git is not virtualized
+                    if (entry.Name == "." || entry.Name == ".." || entry.Name == ".git")
+                    {
+                        continue;
+                    }
+
+                    if (!entry.IsFile)
+                    {
+                        foldersToEnumerate.push_back(folder + entry.Name + "\\");
+                    }
+                    else if (files.size() < maxFiles)
+                    {
+                        files.push_back(folder + entry.Name);
+                    }
+                }
+            }
+
+            return true;
+        }
+
+        virtual bool OpenForRead(const std::string& path) override
+        {
+            try
+            {
+                TestHelpers::OpenForRead(path);
+                return true;
+            }
+            catch (TestException&)
+            {
+                return false;
+            }
+        }
+
+        virtual bool ReadFileAsString(const std::string& path) override
+        {
+            try
+            {
+                TestHelpers::ReadFileAsString(path);
+                return true;
+            }
+            catch (TestException&)
+            {
+                return false;
+            }
+        }
+
+        virtual bool EnumDirectory(const std::string& folder, size_t& entryCount) override
+        {
+            try
+            {
+                entryCount = TestHelpers::EnumDirectory(folder).size();
+                return true;
+            }
+            catch (TestException&)
+            {
+                return false;
+            }
+        }
+
+    private:
+        std::string virtualRootPath;
+    };
+}
+
+bool GVFlt_Benchmark(const char* virtualRootPath, const char* resultsPath, int maxThreads, int operations)
+{
+    if (maxThreads < 1 || operations < 1)
+    {
+        printf("\nGVFlt_Benchmark: maxThreads and operations must be at least 1");
+        return false;
+    }
+
+    BenchmarkOptions options;
+    options.maxThreads = maxThreads;
+    options.operations = static_cast<size_t>(operations);
+
+    GVFSBenchmarkBackend backend(virtualRootPath);
+    std::string json;
+    std::string error;
+    if (!RunBenchmark(backend, options, json, error))
+    {
+        printf("\nGVFlt_Benchmark: %s", error.c_str());
+        return false;
+    }
+
+    std::ofstream results(resultsPath, std::ios::binary);
+    results << json;
+    return static_cast<bool>(results);
+}
@@ -0,0 +1,134 @@
+﻿using GVFS.Common.Git;
+using System;
+using System.IO;
+
+namespace GVFS.PerfProfiling
+{
+    class GitIndexReaderProfiler
+    {
+        private const int StreamBufferSize = 4096 * 10;
+
+        private readonly string indexPath;
+
+        public GitIndexReaderProfiler(string indexPath)
+        {
+            this.indexPath = indexPath;
+        }
+
+        /// <summary>
+        /// Decode every entry the way GitIndexProjection and FastFetch did before GitIndexReader (a buffered
+        /// FileStream read a field at a time), as a baseline for the GitIndexReader timings
+        /// </summary>
+        public int ReadEntriesFromStream()
+        {
+            using (FileStream indexStream = new FileStream(this.indexPath, FileMode.Open, FileAccess.Read, FileShare.Read, StreamBufferSize))
+            {
+                byte[] buffer = new byte[40];
+                byte[] sha = new byte[20];
+                byte[] pathBuffer = new byte[GitIndexEntry.MaxPathBufferSize];
+
+                indexStream.Position = 8;
+                uint entryCount = ReadUInt32(buffer, indexStream);
+
+                int skipWorktreeEntries = 0;
+                int previousPathLength = 0;
+                for (int i = 0; i < entryCount; i++)
+                {
+                    indexStream.Read(buffer, 0, 40);
+                    indexStream.Read(sha, 0, 20);
+
+                    ushort flags = ReadUInt16(buffer, indexStream);
+                    int pathLength = flags & 0xFFF;
+                    if ((flags & 0x4000) == 0x4000)
+                    {
+                        ushort extendedFlags = ReadUInt16(buffer, indexStream);
+                        if ((extendedFlags & 0x4000) == 0x4000)
+                        {
+                            skipWorktreeEntries++;
+                        }
+                    }
+
+                    int replaceIndex = previousPathLength - ReadReplaceLength(indexStream);
+                    indexStream.Read(pathBuffer, replaceIndex, pathLength - replaceIndex + 1);
+                    previousPathLength = pathLength;
+                }
+
+                return skipWorktreeEntries;
+            }
+        }
+
+        public int ReadEntries()
+        {
+            int skipWorktreeEntries = 0;
+            this.ForEachEntry(
+                entry =>
+                {
+                    if (entry.SkipWorktree)
+                    {
+                        skipWorktreeEntries++;
+                    }
+
+                    return true;
+                });
+
+            return skipWorktreeEntries;
+        }
+
+        /// <summary>
+        /// Decode every entry and also convert its path and SHA, as FastFetch and projection rebuilds do
+        /// </summary>
+        public long ReadEntriesAndPaths()
+        {
+            long pathCharacters = 0;
+            this.ForEachEntry(
+                entry =>
+                {
+                    pathCharacters += entry.GetPath().Length + entry.Sha[0];
+                    return true;
+                });
+
+            return pathCharacters;
+        }
+
+        private static int ReadReplaceLength(Stream stream)
+        {
+            int headerByte = stream.ReadByte();
+            int offset = headerByte & 0x7f;
+            while ((headerByte & 0x80) != 0)
+            {
+                headerByte = stream.ReadByte();
+                offset += 1;
+                offset = (offset << 7) + (headerByte & 0x7f);
+            }
+
+            return offset;
+        }
+
+        private static uint ReadUInt32(byte[] buffer, Stream stream)
+        {
+            buffer[3] = (byte)stream.ReadByte();
+            buffer[2] = (byte)stream.ReadByte();
+            buffer[1] = (byte)stream.ReadByte();
+            buffer[0] = (byte)stream.ReadByte();
+
+            return BitConverter.ToUInt32(buffer, 0);
+        }
+
+        private static ushort ReadUInt16(byte[] buffer, Stream stream)
+        {
+            buffer[1] = (byte)stream.ReadByte();
+            buffer[0] = (byte)stream.ReadByte();
+
+            return (ushort)BitConverter.ToInt16(buffer, 0);
+        }
+
+        private void ForEachEntry(Func<GitIndexEntry, bool> visitEntry)
+        {
+            using (FileStream indexStream = new FileStream(this.indexPath, FileMode.Open, FileAccess.Read, FileShare.Read))
+            using (GitIndexReader indexReader = new GitIndexReader(indexStream))
+            {
+                indexReader.ForEachEntry(visitEntry);
+            }
+        }
+    }
+}
@@ -10,12 +10,27 @@ namespace GVFS.PerfProfiling
 {
     class Program
     {
+        // Folders below src that the read-object hook is run in (git runs it in the folder that git was run in)
+        private static readonly int[] ReadObjectHookDepths = new int[] { 0, 2, 8, 32 };
+
         static void Main(string[] args)
         {
             ProfilingEnvironment environment = new ProfilingEnvironment(@"M:\OS");
+            string indexPath = Path.Combine(environment.Enlistment.WorkingDirectoryRoot, GVFSConstants.DotGit.Index);
+
+            GitIndexReaderProfiler indexReaderProfiler = new GitIndexReaderProfiler(indexPath);
+            TimeIt(
+                "Index Read (FileStream, baseline)",
+                () => indexReaderProfiler.ReadEntriesFromStream());
+            TimeIt(
+                "Index Read (GitIndexReader)",
+                () => indexReaderProfiler.ReadEntries());
+            TimeIt(
+                "Index Read (GitIndexReader, with paths and SHAs)",
+                () => indexReaderProfiler.ReadEntriesAndPaths());
             TimeIt(
                 "Validate Index",
-                () => GitIndexProjection.ReadIndex(Path.Combine(environment.Enlistment.WorkingDirectoryRoot, GVFSConstants.DotGit.Index)));
+                () => GitIndexProjection.ReadIndex(indexPath));
             TimeIt(
                 "Index Parse (new projection)", 
                 () => environment.GVFltCallbacks.GitIndexProjectionProfiler.ForceRebuildProjection());
@@ -25,10 +40,55 @@ namespace GVFS.PerfProfiling
             TimeIt(
                 "Index Parse (validate sparse checkout)", 
                 () => environment.GVFltCallbacks.GitIndexProjectionProfiler.ForceValidateSparseCheckout());
+
+            ProjectionLookupProfiler lookupProfiler = new ProjectionLookupProfiler(environment.Context.Tracer, indexPath);
+            foreach (bool deep in new[] { false, true })
+            {
+                string paths = deep ? "deep paths" : "shallow paths";
+                int pathCount = deep ? lookupProfiler.DeepPathCount : lookupProfiler.ShallowPathCount;
+                TimeLookups(
+                    "Projection Lookup (split path, baseline, " + paths + ")",
+                    pathCount,
+                    () => lookupProfiler.LookUpBySplitting(deep));
+                TimeLookups(
+                    "Projection Lookup (binary search, " + paths + ")",
+                    pathCount,
+                    () => lookupProfiler.LookUp(deep, useChildTable: false));
+                TimeLookups(
+                    "Projection Lookup (child table, " + paths + ")",
+                    pathCount,
+                    () => lookupProfiler.LookUp(deep, useChildTable: true));
+            }
+
+            ReadObjectHookProfiler readObjectHookProfiler = new ReadObjectHookProfiler(environment.Enlistment);
+            List<string> hookStartupByDepth = new List<string>();
+            try
+            {
+                foreach (int depth in ReadObjectHookDepths)
+                {
+                    double searchMilliseconds = TimeIt(
+                        "Read-object hook startup (search for enlistment root, depth " + depth + ")",
+                        () => readObjectHookProfiler.RunHook(useEnlistmentCache: false, depth: depth));
+                    double cacheMilliseconds = TimeIt(
+                        "Read-object hook startup (enlistment cache, depth " + depth + ")",
+                        () => readObjectHookProfiler.RunHook(useEnlistmentCache: true, depth: depth));
+                    hookStartupByDepth.Add(string.Format("{0,5} {1,12:F2} {2,12:F2}", depth, searchMilliseconds, cacheMilliseconds));
+                }
+            }
+            finally
+            {
+                readObjectHookProfiler.DeleteWorkingDirectories();
+            }
+
+            Console.WriteLine("Read-object hook startup (average ms) by depth below src");
+            Console.WriteLine("{0,5} {1,12} {2,12}", "Depth", "Search", "Cache");
+            hookStartupByDepth.ForEach(Console.WriteLine);
+            Console.WriteLine();
+
             Console.WriteLine("Press Enter to exit");
         }
 
-        private static void TimeIt(string name, Action action)
+        private static double TimeIt(string name, Action action)
         {
             List<TimeSpan> times = new List<TimeSpan>();
 
@@ -42,7 +102,16 @@ namespace GVFS.PerfProfiling
                 Console.WriteLine(stopwatch.Elapsed.TotalMilliseconds);
             }
 
-            Console.WriteLine("Average Time - " + name + times.Select(timespan => timespan.TotalMilliseconds).Average());
+            double averageMilliseconds = times.Select(timespan => timespan.TotalMilliseconds).Average();
+            Console.WriteLine("Average Time - " + name + averageMilliseconds);
+            Console.WriteLine();
+            return averageMilliseconds;
+        }
+
+        private static void TimeLookups(string name, int lookupCount, Action lookUp)
+        {
+            double averageMilliseconds = TimeIt(name, lookUp);
+            Console.WriteLine("Lookups/sec - " + name + (lookupCount * 1000 / averageMilliseconds));
             Console.WriteLine();
         }
     }
@@ -0,0 +1,136 @@
+﻿using GVFS.Common;
+using GVFS.Common.Git;
+using GVFS.Common.Tracing;
+using GVFS.GVFlt.DotGit;
+using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Linq;
+
+namespace GVFS.PerfProfiling
+{
+    class ProjectionLookupProfiler
+    {
+        private const int MaxPathsPerSet = 100000;
+        private const int ShallowPathMaxDepth = 2;
+        private const int DeepPathMinDepth = 6;
+
+        private readonly ProjectionTree tree;
+        private readonly ProjectionTree tableTree;
+        private readonly string[] shallowPaths;
+        private readonly string[] deepPaths;
+
+        public ProjectionLookupProfiler(ITracer tracer, string indexPath)
+        {
+            this.tree = BuildTree(tracer, indexPath);
+            this.tableTree = BuildTree(tracer, indexPath);
+            this.tableTree.BuildChildTable();
+
+            List<string> shallowPaths = new List<string>();
+            List<string> deepPaths = new List<string>();
+            using (FileStream indexStream = new FileStream(indexPath, FileMode.Open, FileAccess.Read, FileShare.Read))
+            using (GitIndexReader indexReader = new GitIndexReader(indexStream))
+            {
+                indexReader.ForEachEntry(
+                    entry =>
+                    {
+                        if (entry.SkipWorktree)
+                        {
+                            // Callbacks are given virtual paths, which may not match the case of the index
+                            string virtualPath = entry.GetPath().Replace(GVFSConstants.GitPathSeparator, GVFSConstants.PathSeparator).ToUpperInvariant();
+                            int depth = virtualPath.Count(c => c == GVFSConstants.PathSeparator) + 1;
+                            if (depth <= ShallowPathMaxDepth && shallowPaths.Count < MaxPathsPerSet)
+                            {
+                                shallowPaths.Add(virtualPath);
+                            }
+                            else if (depth >= DeepPathMinDepth && deepPaths.Count < MaxPathsPerSet)
+                            {
+                                deepPaths.Add(virtualPath);
+                            }
+                        }
+
+                        return true;
+                    });
+            }
+
+            this.shallowPaths = shallowPaths.ToArray();
+            this.deepPaths = deepPaths.ToArray();
+        }
+
+        public int ShallowPathCount
+        {
+            get { return this.shallowPaths.Length; }
+        }
+
+        public int DeepPathCount
+        {
+            get { return this.deepPaths.Length; }
+        }
+
+        /// <summary>
+        /// Look up every path the way callbacks did before the child table (splitting the path and searching each
+        /// folder's children), as a baseline for the LookUp timings
+        /// </summary>
+        public int LookUpBySplitting(bool deep)
+        {
+            int found = 0;
+            foreach (string path in deep ? this.deepPaths : this.shallowPaths)
+            {
+                int index = ProjectionTree.RootIndex;
+                bool pathFound = true;
+                foreach (string name in path.Split(GVFSConstants.PathSeparator))
+                {
+                    if (!this.tree.TryGetChild(index, name, out index))
+                    {
+                        pathFound = false;
+                        break;
+                    }
+                }
+
+                if (pathFound)
+                {
+                    found++;
+                }
+            }
+
+            return found;
+        }
+
+        public int LookUp(bool deep, bool useChildTable)
+        {
+            ProjectionTree lookupTree = useChildTable ? this.tableTree : this.tree;
+            int found = 0;
+            foreach (string path in deep ? this.deepPaths : this.shallowPaths)
+            {
+                int index;
+                if (lookupTree.TryGetPath(path, path.Length, GVFSConstants.PathSeparator, out index))
+                {
+                    found++;
+                }
+            }
+
+            return found;
+        }
+
+        private static ProjectionTree BuildTree(ITracer tracer, string indexPath)
+        {
+            using (FileStream indexStream = new FileStream(indexPath, FileMode.Open, FileAccess.Read, FileShare.Read))
+            using (GitIndexReader indexReader = new GitIndexReader(indexStream))
+            {
+                ProjectionTree.Builder builder = new ProjectionTree.Builder(tracer, (int)indexReader.EntryCount);
+                indexReader.ForEachEntry(
+                    entry =>
+                    {
+                        if (entry.SkipWorktree)
+                        {
+                            builder.AddFile(entry.PathBuffer, entry.PathLength, entry.Sha, entry.Offset);
+                        }
+
+                        return true;
+                    });
+
+                return builder.Finish();
+            }
+        }
+    }
+}
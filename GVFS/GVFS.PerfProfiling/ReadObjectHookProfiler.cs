@@ -0,0 +1,119 @@
+﻿using GVFS.Common;
+using System.Diagnostics;
+using System.IO;
+using System.Text;
+
+namespace GVFS.PerfProfiling
+{
+    class ReadObjectHookProfiler
+    {
+        private const string FlushPacket = "0000";
+
+        // Folders for RunHook's working directories are created (and deleted by DeleteWorkingDirectories) under here
+        private const string WorkingDirectoriesFolderName = ".readobjectprofiling";
+        private const string WorkingDirectoryFolderName = "d";
+
+        private readonly string hookPath;
+        private readonly string enlistmentCachePath;
+        private readonly string workingDirectoryRoot;
+        private readonly string workingDirectoriesRoot;
+        private readonly byte[] handshake;
+
+        public ReadObjectHookProfiler(GVFSEnlistment enlistment)
+        {
+            this.hookPath = Path.Combine(enlistment.WorkingDirectoryRoot, GVFSConstants.DotGit.Hooks.ReadObjectPath + ".exe");
+            this.enlistmentCachePath = Path.Combine(enlistment.WorkingDirectoryRoot, GVFSConstants.DotGit.Hooks.ReadObjectEnlistmentCachePath);
+            this.workingDirectoryRoot = enlistment.WorkingDirectoryRoot;
+            this.workingDirectoriesRoot = Path.Combine(enlistment.WorkingDirectoryRoot, WorkingDirectoriesFolderName);
+
+            this.handshake = Encoding.ASCII.GetBytes(
+                PacketLine("git-read-object-client") + 
+                PacketLine("version=1") + 
+                FlushPacket + 
+                PacketLine("capability=get") + 
+                FlushPacket);
+        }
+
+        /// <summary>
+        /// Run the read-object hook through the handshake and its enlistment root lookup, then
+        /// close stdin so that it exits before any objects are requested.
+        /// </summary>
+        /// <param name="depth">
+        /// How many folders below the working directory root (src) the hook is run in.  Git runs the hook in the
+        /// folder that it was run in, and without the enlistment cache the hook walks up from there to the enlistment
+        /// root, so its startup cost grows with depth.
+        /// </param>
+        public void RunHook(bool useEnlistmentCache, int depth)
+        {
+            string workingDirectory = this.GetWorkingDirectory(depth);
+            string hiddenCachePath = this.enlistmentCachePath + ".profiling";
+            bool cacheHidden = false;
+            if (!useEnlistmentCache && File.Exists(this.enlistmentCachePath))
+            {
+                File.Move(this.enlistmentCachePath, hiddenCachePath);
+                cacheHidden = true;
+            }
+
+            try
+            {
+                ProcessStartInfo startInfo = new ProcessStartInfo(this.hookPath);
+                startInfo.WorkingDirectory = workingDirectory;
+                startInfo.UseShellExecute = false;
+                startInfo.RedirectStandardInput = true;
+                startInfo.RedirectStandardOutput = true;
+                startInfo.RedirectStandardError = true;
+                startInfo.CreateNoWindow = true;
+
+                using (Process hook = Process.Start(startInfo))
+                {
+                    hook.StandardInput.BaseStream.Write(this.handshake, 0, this.handshake.Length);
+                    hook.StandardInput.Close();
+                    hook.StandardOutput.ReadToEnd();
+                    hook.WaitForExit();
+                }
+            }
+            finally
+            {
+                if (cacheHidden)
+                {
+                    File.Move(hiddenCachePath, this.enlistmentCachePath);
+                }
+            }
+        }
+
+        public void DeleteWorkingDirectories()
+        {
+            if (Directory.Exists(this.workingDirectoriesRoot))
+            {
+                Directory.Delete(this.workingDirectoriesRoot, recursive: true);
+            }
+        }
+
+        private static string PacketLine(string line)
+        {
+            // Length includes the 4 byte header and the trailing newline
+            return (line.Length + 5).ToString("x4") + line + "\n";
+        }
+
+        /// <summary>
+        /// Returns (and creates) a folder depth folders below src.  The folders are new and empty, so git does not see
+        /// them, and creating them does not hydrate any of the enlistment's projected folders.
+        /// </summary>
+        private string GetWorkingDirectory(int depth)
+        {
+            if (depth == 0)
+            {
+                return this.workingDirectoryRoot;
+            }
+
+            StringBuilder workingDirectory = new StringBuilder(this.workingDirectoriesRoot);
+            for (int i = 1; i < depth; ++i)
+            {
+                workingDirectory.Append(Path.DirectorySeparatorChar).Append(WorkingDirectoryFolderName);
+            }
+
+            Directory.CreateDirectory(workingDirectory.ToString());
+            return workingDirectory.ToString();
+        }
+    }
+}
@@ -0,0 +1,261 @@
+// GVFS.ReadObjectHook.Benchmark
+//
+// Pushes a million pkt-lines (counting flush packets) through the read-object hook's buffered pkt-line
+// engine (packet.cpp) and through the stdio based implementation it replaced, and reports the time taken
+// by each.
+//
+// The stream mirrors what the hook sees in practice: git sends "command=get", "sha1=<sha>" and a
+// flush packet for every object, and the hook answers each one with "status=success" and a flush.
+
+#include "stdafx.h"
+#include "packet.h"
+#include <chrono>
+
+#define SHA1_LENGTH 40
+#define PACKET_LINE_COUNT 1000000
+
+// Each get command is "command=get", "sha1=<sha>" and a flush, and each response is "status=success" and a flush
+#define PACKETS_PER_GET_COMMAND 3
+#define PACKETS_PER_RESPONSE 2
+#define GET_COMMAND_COUNT (PACKET_LINE_COUNT / PACKETS_PER_GET_COMMAND)
+#define RESPONSE_COUNT (PACKET_LINE_COUNT / PACKETS_PER_RESPONSE)
+
+static const char *RequestFileName = "packet_benchmark_requests.tmp";
+static const char *ResponseFileName = "packet_benchmark_responses.tmp";
+
+// The stdio based pkt-line implementation that GVFS.ReadObjectHook used before packet_reader and packet_writer
+namespace legacy
+{
+	static int hexval(char c)
+	{
+		if (c >= '0' && c <= '9') return c - '0';
+		if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+		if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+		return -1;
+	}
+
+	static int packet_length(const char *packetlen)
+	{
+		int len = 0;
+		for (int i = 0; i < 4; i++)
+		{
+			int val = hexval(packetlen[i]);
+			if (val < 0)
+			{
+				return -1;
+			}
+
+			len = (len << 4) | val;
+		}
+
+		return len;
+	}
+
+	static size_t packet_txt_read(char *buf, size_t count, FILE *stream)
+	{
+		char packetlen[4];
+		if (fread(packetlen, 1, 4, stream) != 4)
+		{
+			die(-1, "invalid packet length");
+		}
+
+		int len = packet_length(packetlen);
+		if (len == 0)
+		{
+			buf[0] = 0;
+			return 0;
+		}
+
+		if (len < 4 || (size_t)(len - 4) >= count)
+		{
+			die(-1, "protocol error: bad line length %d", len);
+		}
+
+		len -= 4;
+		if (fread(buf, 1, len, stream) != (size_t)len)
+		{
+			die(-1, "invalid packet");
+		}
+
+		if (len && buf[len - 1] == '\n')
+		{
+			len--;
+		}
+
+		buf[len] = 0;
+		return len;
+	}
+
+	static void packet_txt_write(const char *buf, FILE *stream)
+	{
+		static const char hexchar[] = "0123456789abcdef";
+		size_t count = strlen(buf);
+		size_t size = count + 5;
+		char packetlen[4] = { hexchar[(size >> 12) & 15], hexchar[(size >> 8) & 15], hexchar[(size >> 4) & 15], hexchar[size & 15] };
+		if (fwrite(packetlen, 1, 4, stream) != 4 ||
+			fwrite(buf, 1, count, stream) != count ||
+			fwrite("\n", 1, 1, stream) != 1)
+		{
+			die(-1, "error writing packet");
+		}
+
+		fflush(stream);
+	}
+
+	static void packet_flush(FILE *stream)
+	{
+		if (fwrite("0000", 1, 4, stream) != 4)
+		{
+			die(-1, "error writing flush packet");
+		}
+
+		fflush(stream);
+	}
+}
+
+class Timer
+{
+public:
+	Timer() : start(std::chrono::steady_clock::now())
+	{
+	}
+
+	double ElapsedMilliseconds() const
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - this->start).count();
+	}
+
+private:
+	std::chrono::steady_clock::time_point start;
+};
+
+static void Report(const char *name, double elapsedMs, int packetCount)
+{
+	printf("%-40s %10d lines %10.2f ms %12.0f lines/sec\n", name, packetCount, elapsedMs, packetCount * 1000.0 / elapsedMs);
+}
+
+static FILE *OpenFile(const char *path, const char *mode)
+{
+	FILE *file;
+	if (fopen_s(&file, path, mode) != 0)
+	{
+		die(1, "Failed to open %s\n", path);
+	}
+
+	return file;
+}
+
+static void WriteRequests()
+{
+	// Requests are written with packet_writer since the write path is measured separately
+	FILE *file = OpenFile(RequestFileName, "wb");
+	packet_writer *writer = new packet_writer;
+	packet_writer_init(writer, _fileno(file));
+
+	char sha1Line[5 + SHA1_LENGTH + 1];
+	for (int i = 0; i < GET_COMMAND_COUNT; i++)
+	{
+		_snprintf_s(sha1Line, _TRUNCATE, "sha1=%040x", i);
+		packet_txt_write("command=get", writer);
+		packet_txt_write(sha1Line, writer);
+		packet_write_flush_pkt(writer);
+	}
+
+	packet_write_buffered(writer);
+	delete writer;
+	fclose(file);
+}
+
+static double ReadRequestsLegacy()
+{
+	FILE *file = OpenFile(RequestFileName, "rb");
+	char buffer[512];
+
+	Timer timer;
+	for (int i = 0; i < GET_COMMAND_COUNT; i++)
+	{
+		legacy::packet_txt_read(buffer, sizeof(buffer), file);
+		legacy::packet_txt_read(buffer, sizeof(buffer), file);
+		if (legacy::packet_txt_read(buffer, sizeof(buffer), file))
+		{
+			die(1, "Expected flush packet\n");
+		}
+	}
+
+	double elapsedMs = timer.ElapsedMilliseconds();
+	fclose(file);
+	return elapsedMs;
+}
+
+static double ReadRequestsBuffered()
+{
+	FILE *file = OpenFile(RequestFileName, "rb");
+	packet_reader *reader = new packet_reader;
+	packet_reader_init(reader, _fileno(file));
+	const char *line;
+
+	Timer timer;
+	for (int i = 0; i < GET_COMMAND_COUNT; i++)
+	{
+		packet_txt_read_inplace(&line, reader);
+		packet_txt_read_inplace(&line, reader);
+		if (packet_txt_read_inplace(&line, reader))
+		{
+			die(1, "Expected flush packet\n");
+		}
+	}
+
+	double elapsedMs = timer.ElapsedMilliseconds();
+	delete reader;
+	fclose(file);
+	return elapsedMs;
+}
+
+static double WriteResponsesLegacy()
+{
+	FILE *file = OpenFile(ResponseFileName, "wb");
+
+	Timer timer;
+	for (int i = 0; i < RESPONSE_COUNT; i++)
+	{
+		legacy::packet_txt_write("status=success", file);
+		legacy::packet_flush(file);
+	}
+
+	double elapsedMs = timer.ElapsedMilliseconds();
+	fclose(file);
+	return elapsedMs;
+}
+
+static double WriteResponsesBuffered()
+{
+	FILE *file = OpenFile(ResponseFileName, "wb");
+	packet_writer *writer = new packet_writer;
+	packet_writer_init(writer, _fileno(file));
+
+	Timer timer;
+	for (int i = 0; i < RESPONSE_COUNT; i++)
+	{
+		packet_txt_write("status=success", writer);
+		packet_flush(writer);
+	}
+
+	double elapsedMs = timer.ElapsedMilliseconds();
+	delete writer;
+	fclose(file);
+	return elapsedMs;
+}
+
+int main()
+{
+	WriteRequests();
+
+	Report("Read requests (stdio)", ReadRequestsLegacy(), GET_COMMAND_COUNT * PACKETS_PER_GET_COMMAND);
+	Report("Read requests (packet_reader)", ReadRequestsBuffered(), GET_COMMAND_COUNT * PACKETS_PER_GET_COMMAND);
+	Report("Write responses (stdio)", WriteResponsesLegacy(), RESPONSE_COUNT * PACKETS_PER_RESPONSE);
+	Report("Write responses (packet_writer)", WriteResponsesBuffered(), RESPONSE_COUNT * PACKETS_PER_RESPONSE);
+
+	remove(RequestFileName);
+	remove(ResponseFileName);
+	return 0;
+}
@@ -0,0 +1,550 @@
+// GVFS.ReadObjectHook.ProtocolBenchmark
+//
+// Measures the whole read-object path: a synthetic git client speaks the read-object v1 protocol to
+// GVFS.ReadObjectHook, which forwards each "get" to GVFS.ReadObjectHook.StandInServer (standing in for the mount).
+// Each run reports objects/sec, per-object latency percentiles (from writing the "get" command to reading its
+// status), the CPU time spent per object, and how many downloads the stand-in server made for the objects (it
+// batches the requests that arrive while a download is in progress, as the mount does), as a single JSON object so
+// that results can be compared across builds.
+//
+// Usage: GVFS.ReadObjectHook.ProtocolBenchmark --hook <read-object> --server <stand-in server> [options]
+//
+//     --objects <count>     Number of get commands to send (default 10000)
+//     --pattern <pattern>   sequential, duplicate (SHAs repeat from a pool of 1/16th of the objects) or random
+//     --pipeline <depth>    Get commands to send before waiting for a status (default 1, like git)
+//     --delay-ms <ms>       Simulated download time in the stand-in server (default 0)
+//     --content             Negotiate the "content" capability, so that the hook returns each object's content
+//     --content-size <n>    Size of each object's content (default 256)
+//     --objects-dir <path>  Have the stand-in server write each object under path, and (like git) read each object
+//                           back from disk unless its content was returned by the hook
+//     --output <path>       Also write the JSON results to this file
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define SHA1_LENGTH 40
+
+typedef std::chrono::steady_clock Clock;
+
+struct Options
+{
+	std::string hookPath;
+	std::string serverPath;
+	std::string pattern = "sequential";
+	std::string outputPath;
+	std::string objectsDir;
+	bool content = false;
+	int contentSize = 256;
+	int objectCount = 10000;
+	int pipelineDepth = 1;
+	int delayMs = 0;
+};
+
+static void Fail(const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+	exit(1);
+}
+
+// The synthetic git side of the read-object protocol
+class GitClient
+{
+public:
+	GitClient(int input, int output)
+		: input(input), output(output)
+	{
+	}
+
+	void WritePacket(const std::string &line)
+	{
+		char header[5];
+		snprintf(header, sizeof(header), "%04x", (unsigned int)(line.length() + 5));
+		this->pending += header;
+		this->pending += line;
+		this->pending += '\n';
+	}
+
+	void WriteFlush()
+	{
+		this->pending += "0000";
+	}
+
+	void Send()
+	{
+		size_t written = 0;
+		while (written < this->pending.length())
+		{
+			ssize_t bytesWritten = write(this->output, this->pending.c_str() + written, this->pending.length() - written);
+			if (bytesWritten <= 0)
+			{
+				Fail("Failed to write to the hook (%d)\n", errno);
+			}
+
+			written += (size_t)bytesWritten;
+		}
+
+		this->pending.clear();
+	}
+
+	// Reads binary packets up to the next flush packet, returning the total size of their payloads
+	size_t ReadContent()
+	{
+		size_t contentLength = 0;
+		char buffer[65520];
+		while (1)
+		{
+			char header[5] = { 0 };
+			this->ReadExactly(header, 4);
+			unsigned int length = (unsigned int)strtoul(header, NULL, 16);
+			if (length == 0)
+			{
+				return contentLength;
+			}
+
+			if (length < 4 || length > sizeof(buffer))
+			{
+				Fail("Invalid packet length from the hook: %s\n", header);
+			}
+
+			this->ReadExactly(buffer, length - 4);
+			contentLength += length - 4;
+		}
+	}
+
+	// Returns the line without its newline, or an empty string for a flush packet
+	std::string ReadPacket()
+	{
+		char header[5] = { 0 };
+		this->ReadExactly(header, 4);
+		unsigned int length = (unsigned int)strtoul(header, NULL, 16);
+		if (length == 0)
+		{
+			return std::string();
+		}
+
+		if (length < 4)
+		{
+			Fail("Invalid packet length from the hook: %s\n", header);
+		}
+
+		std::string line(length - 4, '\0');
+		this->ReadExactly(&line[0], length - 4);
+		if (!line.empty() && line.back() == '\n')
+		{
+			line.pop_back();
+		}
+
+		return line;
+	}
+
+	void Expect(const std::string &expected)
+	{
+		std::string line = this->ReadPacket();
+		if (line != expected)
+		{
+			Fail("Expected '%s' from the hook, received '%s'\n", expected.c_str(), line.c_str());
+		}
+	}
+
+	void Close()
+	{
+		close(this->output);
+	}
+
+private:
+	void ReadExactly(char *buffer, size_t count)
+	{
+		while (count > 0)
+		{
+			ssize_t bytesRead = read(this->input, buffer, count);
+			if (bytesRead <= 0)
+			{
+				Fail("The hook closed its output (%d)\n", errno);
+			}
+
+			buffer += bytesRead;
+			count -= (size_t)bytesRead;
+		}
+	}
+
+	int input;
+	int output;
+	std::string pending;
+};
+
+static std::vector<std::string> CreateShas(const Options &options)
+{
+	std::vector<std::string> shas;
+	shas.reserve(options.objectCount);
+	std::mt19937_64 random(0x6a09e667f3bcc908ULL);
+	char sha[SHA1_LENGTH + 1];
+	if (options.pattern == "sequential")
+	{
+		for (int i = 0; i < options.objectCount; i++)
+		{
+			snprintf(sha, sizeof(sha), "%040x", i + 1);
+			shas.push_back(sha);
+		}
+	}
+	else if (options.pattern == "duplicate")
+	{
+		int poolSize = std::max(1, options.objectCount / 16);
+		std::uniform_int_distribution<int> pick(1, poolSize);
+		for (int i = 0; i < options.objectCount; i++)
+		{
+			snprintf(sha, sizeof(sha), "%040x", pick(random));
+			shas.push_back(sha);
+		}
+	}
+	else if (options.pattern == "random")
+	{
+		for (int i = 0; i < options.objectCount; i++)
+		{
+			unsigned long long high = random();
+			unsigned long long middle = random();
+			unsigned int low = (unsigned int)random();
+			snprintf(sha, sizeof(sha), "%016llx%016llx%08x", high, middle, low);
+			shas.push_back(sha);
+		}
+	}
+	else
+	{
+		Fail("Unknown pattern: %s\n", options.pattern.c_str());
+	}
+
+	return shas;
+}
+
+static pid_t Spawn(const std::vector<std::string> &arguments, int stdinFd, int stdoutFd)
+{
+	pid_t pid = fork();
+	if (pid < 0)
+	{
+		Fail("fork failed (%d)\n", errno);
+	}
+
+	if (pid == 0)
+	{
+		if (stdinFd >= 0)
+		{
+			dup2(stdinFd, 0);
+		}
+
+		if (stdoutFd >= 0)
+		{
+			dup2(stdoutFd, 1);
+		}
+
+		std::vector<char *> argv;
+		for (const std::string &argument : arguments)
+		{
+			argv.push_back(const_cast<char *>(argument.c_str()));
+		}
+
+		argv.push_back(NULL);
+		execv(argv[0], argv.data());
+		_exit(127);
+	}
+
+	return pid;
+}
+
+static bool TryReadObjectFromDisk(const std::string &objectsDir, const std::string &sha)
+{
+	std::string path = objectsDir + "/" + sha.substr(0, 2) + "/" + sha.substr(2);
+	FILE *file = fopen(path.c_str(), "rb");
+	if (file == NULL)
+	{
+		return false;
+	}
+
+	char buffer[65536];
+	size_t totalRead = 0;
+	size_t bytesRead;
+	while ((bytesRead = fread(buffer, 1, sizeof(buffer), file)) > 0)
+	{
+		totalRead += bytesRead;
+	}
+
+	fclose(file);
+	return totalRead > 0;
+}
+
+static long long GetChildrenCpuMicroseconds()
+{
+	rusage usage;
+	getrusage(RUSAGE_CHILDREN, &usage);
+	return (long long)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+static long long GetSelfCpuMicroseconds()
+{
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return (long long)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+// Reads the totals that the stand-in server prints when it is stopped, and returns its number of downloads
+static long long ReadServerDownloadRequests(int serverOutputFd)
+{
+	std::string output;
+	char buffer[256];
+	ssize_t bytesRead;
+	while ((bytesRead = read(serverOutputFd, buffer, sizeof(buffer))) > 0 || (bytesRead < 0 && errno == EINTR))
+	{
+		if (bytesRead > 0)
+		{
+			output.append(buffer, (size_t)bytesRead);
+		}
+	}
+
+	const char *key = "\"downloadRequests\":";
+	size_t position = output.find(key);
+	return position == std::string::npos ? -1 : atoll(output.c_str() + position + strlen(key));
+}
+
+static long long GetPercentile(const std::vector<long long> &sortedValues, double percentile)
+{
+	if (sortedValues.empty())
+	{
+		return 0;
+	}
+
+	size_t index = (size_t)(percentile / 100.0 * (sortedValues.size() - 1) + 0.5);
+	return sortedValues[std::min(index, sortedValues.size() - 1)];
+}
+
+static Options ParseOptions(int argc, char *argv[])
+{
+	Options options;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string option = argv[i];
+		if (option == "--content")
+		{
+			options.content = true;
+			continue;
+		}
+
+		if (i + 1 >= argc)
+		{
+			Fail("Missing value for %s\n", option.c_str());
+		}
+
+		const char *value = argv[++i];
+		if (option == "--hook") options.hookPath = value;
+		else if (option == "--server") options.serverPath = value;
+		else if (option == "--objects") options.objectCount = atoi(value);
+		else if (option == "--pattern") options.pattern = value;
+		else if (option == "--pipeline") options.pipelineDepth = std::max(1, atoi(value));
+		else if (option == "--delay-ms") options.delayMs = atoi(value);
+		else if (option == "--content-size") options.contentSize = atoi(value);
+		else if (option == "--objects-dir") options.objectsDir = value;
+		else if (option == "--output") options.outputPath = value;
+		else Fail("Unknown option: %s\n", option.c_str());
+	}
+
+	if (options.hookPath.empty() || options.serverPath.empty() || options.objectCount <= 0)
+	{
+		Fail("Usage: %s --hook <read-object> --server <stand-in server> [--objects <count>] [--pattern sequential|duplicate|random] "
+			"[--pipeline <depth>] [--delay-ms <ms>] [--content] [--content-size <bytes>] [--objects-dir <path>] [--output <path>]\n", argv[0]);
+	}
+
+	return options;
+}
+
+int main(int argc, char *argv[])
+{
+	Options options = ParseOptions(argc, argv);
+	std::vector<std::string> shas = CreateShas(options);
+
+	signal(SIGPIPE, SIG_IGN);
+
+	char socketPath[64];
+	snprintf(socketPath, sizeof(socketPath), "/tmp/gvfs-readobject-benchmark-%d.sock", (int)getpid());
+	setenv("GVFS_READOBJECT_SOCKET", socketPath, 1);
+
+	// Close-on-exec so that neither child holds the other ends open (dup2 clears the flag on stdin/stdout),
+	// otherwise the hook would never see end of file on its input
+	int serverOutput[2];
+	int hookInput[2];
+	int hookOutput[2];
+	if (pipe2(serverOutput, O_CLOEXEC) != 0 || pipe2(hookInput, O_CLOEXEC) != 0 || pipe2(hookOutput, O_CLOEXEC) != 0)
+	{
+		Fail("pipe failed (%d)\n", errno);
+	}
+
+	long long childrenCpuStart = GetChildrenCpuMicroseconds();
+	long long selfCpuStart = GetSelfCpuMicroseconds();
+
+	// The server only prints its totals, when it is stopped
+	char delay[16];
+	char contentSize[16];
+	snprintf(delay, sizeof(delay), "%d", options.delayMs);
+	snprintf(contentSize, sizeof(contentSize), "%d", options.contentSize);
+	std::vector<std::string> serverArguments = { options.serverPath, socketPath, "--delay-ms", delay, "--content-size", contentSize };
+	if (!options.objectsDir.empty())
+	{
+		serverArguments.push_back("--objects-dir");
+		serverArguments.push_back(options.objectsDir);
+	}
+
+	pid_t serverPid = Spawn(serverArguments, -1, serverOutput[1]);
+	close(serverOutput[1]);
+	while (access(socketPath, F_OK) != 0)
+	{
+		usleep(1000);
+	}
+
+	pid_t hookPid = Spawn({ options.hookPath }, hookInput[0], hookOutput[1]);
+	close(hookInput[0]);
+	close(hookOutput[1]);
+
+	GitClient git(hookOutput[0], hookInput[1]);
+	Clock::time_point start = Clock::now();
+
+	git.WritePacket("git-read-object-client");
+	git.WritePacket("version=1");
+	git.WriteFlush();
+	git.Send();
+	git.Expect("git-read-object-server");
+	git.Expect("version=1");
+	git.Expect("");
+
+	git.WritePacket("capability=get");
+	if (options.content)
+	{
+		git.WritePacket("capability=content");
+	}
+
+	git.WriteFlush();
+	git.Send();
+	git.Expect("capability=get");
+	if (options.content)
+	{
+		git.Expect("capability=content");
+	}
+
+	git.Expect("");
+
+	Clock::time_point handshakeEnd = Clock::now();
+
+	std::vector<Clock::time_point> sendTimes(shas.size());
+	std::vector<long long> latencies;
+	latencies.reserve(shas.size());
+	size_t sent = 0;
+	size_t received = 0;
+	int failures = 0;
+	while (received < shas.size())
+	{
+		while (sent < shas.size() && sent - received < (size_t)options.pipelineDepth)
+		{
+			git.WritePacket("command=get");
+			git.WritePacket("sha1=" + shas[sent]);
+			git.WriteFlush();
+			git.Send();
+			sendTimes[sent] = Clock::now();
+			sent++;
+		}
+
+		// Like git, the object is only available once its content has been received or read back from disk
+		std::string status = git.ReadPacket();
+		git.Expect("");
+		bool succeeded = status == "status=success";
+		if (succeeded)
+		{
+			size_t contentLength = options.content ? git.ReadContent() : 0;
+			if (contentLength == 0 && !options.objectsDir.empty())
+			{
+				succeeded = TryReadObjectFromDisk(options.objectsDir, shas[received]);
+			}
+		}
+
+		latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - sendTimes[received]).count());
+		if (!succeeded)
+		{
+			failures++;
+		}
+
+		received++;
+	}
+
+	Clock::time_point end = Clock::now();
+
+	git.Close();
+	int hookStatus;
+	waitpid(hookPid, &hookStatus, 0);
+	kill(serverPid, SIGTERM);
+	long long serverDownloads = ReadServerDownloadRequests(serverOutput[0]);
+	close(serverOutput[0]);
+	waitpid(serverPid, NULL, 0);
+	unlink(socketPath);
+
+	long long childrenCpu = GetChildrenCpuMicroseconds() - childrenCpuStart;
+	long long selfCpu = GetSelfCpuMicroseconds() - selfCpuStart;
+
+	std::sort(latencies.begin(), latencies.end());
+	double elapsedMs = std::chrono::duration<double, std::milli>(end - start).count();
+	double handshakeMs = std::chrono::duration<double, std::milli>(handshakeEnd - start).count();
+	double objectsElapsedSec = std::chrono::duration<double>(end - handshakeEnd).count();
+
+	char results[1024];
+	snprintf(
+		results,
+		sizeof(results),
+		"{\"pattern\":\"%s\",\"objects\":%d,\"pipeline\":%d,\"delayMs\":%d,\"content\":%s,\"contentSize\":%d,"
+		"\"failures\":%d,\"hookExitCode\":%d,\"serverDownloads\":%lld,\"objectsPerDownload\":%.2f,"
+		"\"elapsedMs\":%.3f,\"handshakeMs\":%.3f,\"objectsPerSec\":%.1f,"
+		"\"latencyUs\":{\"p50\":%lld,\"p99\":%lld,\"p999\":%lld,\"max\":%lld},"
+		"\"cpuUsPerObject\":{\"hookAndServer\":%.3f,\"client\":%.3f}}",
+		options.pattern.c_str(),
+		options.objectCount,
+		options.pipelineDepth,
+		options.delayMs,
+		options.content ? "true" : "false",
+		options.contentSize,
+		failures,
+		WIFEXITED(hookStatus) ? WEXITSTATUS(hookStatus) : -1,
+		serverDownloads,
+		serverDownloads > 0 ? (double)shas.size() / serverDownloads : 0.0,
+		elapsedMs,
+		handshakeMs,
+		objectsElapsedSec > 0 ? shas.size() / objectsElapsedSec : 0.0,
+		GetPercentile(latencies, 50),
+		GetPercentile(latencies, 99),
+		GetPercentile(latencies, 99.9),
+		latencies.back(),
+		(double)childrenCpu / shas.size(),
+		(double)selfCpu / shas.size());
+
+	printf("%s\n", results);
+	if (!options.outputPath.empty())
+	{
+		FILE *output = fopen(options.outputPath.c_str(), "w");
+		if (output == NULL)
+		{
+			Fail("Failed to open %s (%d)\n", options.outputPath.c_str(), errno);
+		}
+
+		fprintf(output, "%s\n", results);
+		fclose(output);
+	}
+
+	return (failures == 0 && WIFEXITED(hookStatus) && WEXITSTATUS(hookStatus) == 0) ? 0 : 1;
+}
@@ -0,0 +1,523 @@
+// GVFS.ReadObjectHook.StandInServer
+//
+// Stands in for GVFS.Mount so that GVFS.ReadObjectHook can be run and load tested without a GVFS enlistment.
+// It listens on a Unix domain socket and answers the download requests from NamedPipeMessages.DownloadObject
+// without downloading anything:
+//
+//     DLO|<SHA>                       ->  <Result>
+//     DLOT|<Tag>|<SHA>                ->  <Tag>|<Result>
+//     DLOC|<Tag>|<SHA>                ->  <Tag>|<Result>|<Base64 content>
+//     DLOS|<LocalHits>,<LocalMisses>  ->  S
+//
+// Like the mount (see InProcessMount.HandleTaggedDownloadObjectRequest), tagged requests that arrive while an earlier
+// "download" on the same connection is in progress are queued, and "downloaded" together (taking a single --delay-ms)
+// once it completes.  DLOC responses to a batch have no content, and the objects are written before responding.
+// When stopped, the server prints the number of objects requested, the number of downloads they took, and the
+// local hits and misses that the hook reported with DLOS.
+//
+// Usage: GVFS.ReadObjectHook.StandInServer <socket path> [--delay-ms <ms>] [--fail-prefix <prefix>]
+//            [--content-size <bytes>] [--objects-dir <path>]
+//
+//     --delay-ms      Simulated download time for each object (default 0)
+//     --fail-prefix   Objects whose SHA starts with this prefix fail to download
+//     --content-size  Size of the (made up) content of each object (default 256)
+//     --objects-dir   Write each object to <path>/<first 2 characters of SHA>/<remaining 38 characters>, as the
+//                     mount does.  Like the mount, DLO, DLOT and batched DLOC requests write the object before
+//                     responding, and a DLOC request on its own writes it after responding.
+//
+// Point GVFS.ReadObjectHook at the server by setting GVFS_READOBJECT_SOCKET to the socket path.
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define SHA1_LENGTH 40
+
+static const char *SuccessResult = "S";
+static const char *DownloadFailed = "F";
+static const char *InvalidSHAResult = "InvalidSHA";
+static const char *UnknownRequest = "UnknownRequest";
+
+static int delayMs = 0;
+static std::string failPrefix;
+static size_t contentSize = 256;
+static std::string objectsDir;
+static std::string objectContent;
+static std::string encodedObjectContent;
+static std::atomic<long long> objectsRequested(0);
+static std::atomic<long long> downloadRequests(0);
+static std::atomic<long long> localHitsReported(0);
+static std::atomic<long long> localMissesReported(0);
+
+// Set by the SIGINT/SIGTERM handler, which also shuts down listenFd so that the accept loop wakes up and exits
+static volatile sig_atomic_t stopRequested = 0;
+static int listenFd = -1;
+
+struct TaggedDownload
+{
+	std::string tag;
+	std::string sha;
+	bool returnContent;
+};
+
+// A connection from one GVFS.ReadObjectHook process.  Tagged requests are answered from a download thread, and so
+// responses are written under writeLock.
+class Connection
+{
+public:
+	explicit Connection(int socketFd)
+		: socketFd(socketFd), isDownloading(false)
+	{
+	}
+
+	~Connection()
+	{
+		close(this->socketFd);
+	}
+
+	bool ReadRequest(std::string &request)
+	{
+		while (1)
+		{
+			size_t newline = this->received.find('\n');
+			if (newline != std::string::npos)
+			{
+				request = this->received.substr(0, newline);
+				this->received.erase(0, newline + 1);
+				return true;
+			}
+
+			char buffer[4096];
+			ssize_t bytesRead = recv(this->socketFd, buffer, sizeof(buffer), 0);
+			if (bytesRead < 0 && errno == EINTR)
+			{
+				continue;
+			}
+
+			if (bytesRead <= 0)
+			{
+				return false;
+			}
+
+			this->received.append(buffer, (size_t)bytesRead);
+		}
+	}
+
+	void SendResponse(const std::string &response)
+	{
+		std::string line = response + "\n";
+		std::lock_guard<std::mutex> lock(this->writeLock);
+		size_t written = 0;
+		while (written < line.length())
+		{
+			ssize_t bytesWritten = send(this->socketFd, line.c_str() + written, line.length() - written, MSG_NOSIGNAL);
+			if (bytesWritten < 0 && errno == EINTR)
+			{
+				continue;
+			}
+
+			if (bytesWritten <= 0)
+			{
+				return;
+			}
+
+			written += (size_t)bytesWritten;
+		}
+	}
+
+	// Queues download, and returns true if the caller must start downloading the queue (see TaggedDownloadQueue in
+	// InProcessMount.cs)
+	bool TryAddAndStartDownloading(const TaggedDownload &download)
+	{
+		std::lock_guard<std::mutex> lock(this->queueLock);
+		this->queuedDownloads.push_back(download);
+		if (this->isDownloading)
+		{
+			return false;
+		}
+
+		this->isDownloading = true;
+		return true;
+	}
+
+	// Takes every queued download, or returns false (and stops downloading) if the queue is empty
+	bool TryTakeAllOrStopDownloading(std::vector<TaggedDownload> &downloads)
+	{
+		std::lock_guard<std::mutex> lock(this->queueLock);
+		if (this->queuedDownloads.empty())
+		{
+			this->isDownloading = false;
+			return false;
+		}
+
+		downloads.swap(this->queuedDownloads);
+		this->queuedDownloads.clear();
+		return true;
+	}
+
+	void SendTaggedResponse(const TaggedDownload &download, const std::string &response)
+	{
+		this->SendResponse(download.tag + "|" + response);
+	}
+
+	bool IsDownloading()
+	{
+		std::lock_guard<std::mutex> lock(this->queueLock);
+		return this->isDownloading;
+	}
+
+private:
+	int socketFd;
+	std::string received;
+	std::mutex writeLock;
+	std::mutex queueLock;
+	std::vector<TaggedDownload> queuedDownloads;
+	bool isDownloading;
+};
+
+static bool IsValidSHA(const std::string &sha)
+{
+	if (sha.length() != SHA1_LENGTH)
+	{
+		return false;
+	}
+
+	for (char c : sha)
+	{
+		if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F')))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool IsOnServer(const std::string &sha)
+{
+	return failPrefix.empty() || sha.compare(0, failPrefix.length(), failPrefix) != 0;
+}
+
+// "Downloads" objectCount objects in a single request to the server
+static void SimulateDownload(size_t objectCount)
+{
+	objectsRequested += objectCount;
+	downloadRequests++;
+	if (delayMs > 0)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(delayMs));
+	}
+}
+
+static bool DownloadObject(const std::string &sha)
+{
+	SimulateDownload(1);
+	return IsOnServer(sha);
+}
+
+static std::string EncodeBase64(const std::string &data)
+{
+	static const char *alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	std::string encoded;
+	encoded.reserve((data.length() + 2) / 3 * 4);
+	for (size_t i = 0; i < data.length(); i += 3)
+	{
+		size_t remaining = data.length() - i;
+		unsigned int triple = (unsigned char)data[i] << 16;
+		triple |= remaining > 1 ? (unsigned char)data[i + 1] << 8 : 0;
+		triple |= remaining > 2 ? (unsigned char)data[i + 2] : 0;
+		encoded += alphabet[(triple >> 18) & 63];
+		encoded += alphabet[(triple >> 12) & 63];
+		encoded += remaining > 1 ? alphabet[(triple >> 6) & 63] : '=';
+		encoded += remaining > 2 ? alphabet[triple & 63] : '=';
+	}
+
+	return encoded;
+}
+
+static void WriteObject(const std::string &sha)
+{
+	if (objectsDir.empty())
+	{
+		return;
+	}
+
+	// Write to a temp file and rename it into place, as GitObjects.WriteLooseObject does
+	std::string folder = objectsDir + "/" + sha.substr(0, 2);
+	mkdir(folder.c_str(), 0755);
+	std::string path = folder + "/" + sha.substr(2);
+	std::string tempPath = path + ".tmp";
+	FILE *file = fopen(tempPath.c_str(), "wb");
+	if (file == NULL)
+	{
+		return;
+	}
+
+	fwrite(objectContent.data(), 1, objectContent.length(), file);
+	fflush(file);
+	fsync(fileno(file));
+	fclose(file);
+	rename(tempPath.c_str(), path.c_str());
+}
+
+static std::string HandleDownloadRequest(const std::string &sha)
+{
+	if (!IsValidSHA(sha))
+	{
+		return InvalidSHAResult;
+	}
+
+	if (!DownloadObject(sha))
+	{
+		return DownloadFailed;
+	}
+
+	WriteObject(sha);
+	return SuccessResult;
+}
+
+static void DownloadTaggedObject(Connection *connection, const TaggedDownload &download)
+{
+	if (!download.returnContent)
+	{
+		connection->SendTaggedResponse(download, HandleDownloadRequest(download.sha));
+	}
+	else if (!IsValidSHA(download.sha))
+	{
+		connection->SendTaggedResponse(download, std::string(InvalidSHAResult) + "|");
+	}
+	else if (!DownloadObject(download.sha))
+	{
+		connection->SendTaggedResponse(download, std::string(DownloadFailed) + "|");
+	}
+	else
+	{
+		connection->SendTaggedResponse(download, std::string(SuccessResult) + "|" + encodedObjectContent);
+		WriteObject(download.sha);
+	}
+}
+
+static void DownloadTaggedObjects(Connection *connection, const std::vector<TaggedDownload> &downloads)
+{
+	size_t validCount = 0;
+	for (const TaggedDownload &download : downloads)
+	{
+		validCount += IsValidSHA(download.sha) ? 1 : 0;
+	}
+
+	if (validCount > 0)
+	{
+		SimulateDownload(validCount);
+	}
+
+	// The objects are written before responding, and so content responses have no content
+	for (const TaggedDownload &download : downloads)
+	{
+		std::string result;
+		if (!IsValidSHA(download.sha))
+		{
+			result = InvalidSHAResult;
+		}
+		else if (!IsOnServer(download.sha))
+		{
+			result = DownloadFailed;
+		}
+		else
+		{
+			WriteObject(download.sha);
+			result = SuccessResult;
+		}
+
+		connection->SendTaggedResponse(download, download.returnContent ? result + "|" : result);
+	}
+}
+
+static void DownloadQueuedTaggedObjects(Connection *connection)
+{
+	std::vector<TaggedDownload> downloads;
+	while (connection->TryTakeAllOrStopDownloading(downloads))
+	{
+		if (downloads.size() == 1)
+		{
+			DownloadTaggedObject(connection, downloads[0]);
+		}
+		else
+		{
+			DownloadTaggedObjects(connection, downloads);
+		}
+
+		downloads.clear();
+	}
+}
+
+static void HandleTaggedDownloadRequest(Connection *connection, const std::string &body, bool returnContent)
+{
+	size_t separator = body.find('|');
+	TaggedDownload download;
+	download.tag = body.substr(0, separator);
+	download.sha = separator == std::string::npos ? std::string() : body.substr(separator + 1);
+	download.returnContent = returnContent;
+
+	// Download on another thread so that the connection can go on to read the client's other outstanding requests
+	if (connection->TryAddAndStartDownloading(download))
+	{
+		std::thread(DownloadQueuedTaggedObjects, connection).detach();
+	}
+}
+
+static void HandleConnection(int socketFd)
+{
+	Connection connection(socketFd);
+	std::string request;
+	while (connection.ReadRequest(request))
+	{
+		size_t separator = request.find('|');
+		std::string header = request.substr(0, separator);
+		std::string body = separator == std::string::npos ? std::string() : request.substr(separator + 1);
+
+		if (header == "DLO")
+		{
+			connection.SendResponse(HandleDownloadRequest(body));
+		}
+		else if (header == "DLOT" || header == "DLOC")
+		{
+			HandleTaggedDownloadRequest(&connection, body, header == "DLOC");
+		}
+		else if (header == "DLOS")
+		{
+			long long hits = 0;
+			long long misses = 0;
+			if (sscanf(body.c_str(), "%lld,%lld", &hits, &misses) == 2)
+			{
+				localHitsReported += hits;
+				localMissesReported += misses;
+			}
+
+			connection.SendResponse(SuccessResult);
+		}
+		else
+		{
+			connection.SendResponse(UnknownRequest);
+		}
+	}
+
+	// The connection owns the socket, so wait for any tagged requests that are still being answered
+	while (connection.IsDownloading())
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+static void RequestStop(int)
+{
+	stopRequested = 1;
+	shutdown(listenFd, SHUT_RDWR);
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "Usage: %s <socket path> [--delay-ms <ms>] [--fail-prefix <prefix>] [--content-size <bytes>] [--objects-dir <path>]\n", argv[0]);
+		return 1;
+	}
+
+	const char *socketPath = argv[1];
+	for (int i = 2; i + 1 < argc; i += 2)
+	{
+		if (strcmp(argv[i], "--delay-ms") == 0)
+		{
+			delayMs = atoi(argv[i + 1]);
+		}
+		else if (strcmp(argv[i], "--fail-prefix") == 0)
+		{
+			failPrefix = argv[i + 1];
+		}
+		else if (strcmp(argv[i], "--content-size") == 0)
+		{
+			contentSize = (size_t)atol(argv[i + 1]);
+		}
+		else if (strcmp(argv[i], "--objects-dir") == 0)
+		{
+			objectsDir = argv[i + 1];
+		}
+		else
+		{
+			fprintf(stderr, "Unknown option: %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	// Every object has the same content, which only needs to be the right size
+	objectContent.resize(contentSize);
+	for (size_t i = 0; i < contentSize; i++)
+	{
+		objectContent[i] = (char)(i * 31 + 7);
+	}
+
+	encodedObjectContent = EncodeBase64(objectContent);
+
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (strlen(socketPath) >= sizeof(address.sun_path))
+	{
+		fprintf(stderr, "Socket path is too long: %s\n", socketPath);
+		return 1;
+	}
+
+	strncpy(address.sun_path, socketPath, sizeof(address.sun_path) - 1);
+	unlink(socketPath);
+
+	listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listenFd < 0 ||
+		bind(listenFd, (const sockaddr *)&address, sizeof(address)) != 0 ||
+		listen(listenFd, SOMAXCONN) != 0)
+	{
+		fprintf(stderr, "Failed to listen on %s (%d)\n", socketPath, errno);
+		return 1;
+	}
+
+	signal(SIGINT, RequestStop);
+	signal(SIGTERM, RequestStop);
+
+	while (!stopRequested)
+	{
+		int socketFd = accept(listenFd, NULL, NULL);
+		if (socketFd < 0)
+		{
+			if (stopRequested || errno == EINTR)
+			{
+				continue;
+			}
+
+			fprintf(stderr, "accept failed (%d)\n", errno);
+			return 1;
+		}
+
+		std::thread(HandleConnection, socketFd).detach();
+	}
+
+	// Print the totals when stopped, so that load tests can compare them with what the hooks reported.  Connections
+	// could still be being answered, and so exit without running static destructors.
+	printf(
+		"{\"objectsRequested\":%lld,\"downloadRequests\":%lld,\"localHitsReported\":%lld,\"localMissesReported\":%lld}\n",
+		objectsRequested.load(),
+		downloadRequests.load(),
+		localHitsReported.load(),
+		localMissesReported.load());
+	fflush(stdout);
+	_exit(0);
+}
@@ -0,0 +1,321 @@
+#include "stdafx.h"
+#include "localobjects.h"
+
+#ifdef _WIN32
+
+#include <vector>
+
+#define SHA1_LENGTH 40
+#define SHA1_BYTES 20
+#define FANOUT_ENTRIES 256
+#define PACK_IDX_SIGNATURE 0xff744f63
+#define PACK_IDX_VERSION 2
+#define PACK_IDX_HEADER_SIZE 8
+
+// A memory mapped version 2 pack index (see Documentation/technical/pack-format.txt)
+struct PackIndex
+{
+	std::wstring path;
+	HANDLE mappingHandle;
+	const unsigned char *view;
+	const UINT32 *fanout;
+	const unsigned char *shas;
+	UINT32 objectCount;
+};
+
+struct ObjectDirectory
+{
+	std::wstring path;
+	std::vector<PackIndex> packIndexes;
+	FILETIME packDirectoryLastWriteTime;
+	bool packIndexesLoaded;
+};
+
+static std::vector<ObjectDirectory> objectDirectories;
+static bool objectDirectoriesInitialized = false;
+
+static bool TryParseSHA(const char *sha1, unsigned char *shaBytes)
+{
+	for (int i = 0; i < SHA1_BYTES; i++)
+	{
+		int value = 0;
+		for (int j = 0; j < 2; j++)
+		{
+			char c = sha1[i * 2 + j];
+			int nibble;
+			if (c >= '0' && c <= '9') nibble = c - '0';
+			else if (c >= 'a' && c <= 'f') nibble = c - 'a' + 10;
+			else if (c >= 'A' && c <= 'F') nibble = c - 'A' + 10;
+			else return false;
+
+			value = (value << 4) | nibble;
+		}
+
+		shaBytes[i] = (unsigned char)value;
+	}
+
+	return true;
+}
+
+static bool IsAbsolutePath(const std::wstring &path)
+{
+	return (path.length() >= 2 && path[1] == L':') || (path.length() >= 2 && path[0] == L'\\' && path[1] == L'\\');
+}
+
+static void AddObjectDirectory(const std::wstring &path)
+{
+	ObjectDirectory directory;
+	directory.path = path;
+	directory.packIndexesLoaded = false;
+	directory.packDirectoryLastWriteTime = { 0, 0 };
+	objectDirectories.push_back(directory);
+}
+
+static void AddAlternateObjectDirectories(const std::wstring &objectsRoot)
+{
+	// Each line of info\alternates is the path of another objects folder (GVFS writes the path of
+	// the shared object cache).  Relative paths are relative to the objects folder.
+	std::wstring alternatesPath = objectsRoot + L"\\info\\alternates";
+	FILE *alternatesFile;
+	if (_wfopen_s(&alternatesFile, alternatesPath.c_str(), L"rb") != 0)
+	{
+		return;
+	}
+
+	char line[MAX_PATH * 4];
+	while (fgets(line, sizeof(line), alternatesFile) != NULL)
+	{
+		size_t length = strlen(line);
+		while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r'))
+		{
+			line[--length] = 0;
+		}
+
+		if (length == 0 || line[0] == '#')
+		{
+			continue;
+		}
+
+		wchar_t alternate[MAX_PATH];
+		if (MultiByteToWideChar(CP_UTF8, 0, line, -1, alternate, MAX_PATH) == 0)
+		{
+			continue;
+		}
+
+		std::wstring alternatePath(alternate);
+		std::replace(alternatePath.begin(), alternatePath.end(), L'/', L'\\');
+		AddObjectDirectory(IsAbsolutePath(alternatePath) ? alternatePath : objectsRoot + L"\\" + alternatePath);
+	}
+
+	fclose(alternatesFile);
+}
+
+static void InitializeObjectDirectories()
+{
+	// read-object.exe lives in .git\hooks, and so the objects folder is .git\objects
+	objectDirectoriesInitialized = true;
+
+	wchar_t modulePath[MAX_PATH];
+	DWORD modulePathLength = GetModuleFileNameW(NULL, modulePath, MAX_PATH);
+	if (modulePathLength == 0 || modulePathLength >= MAX_PATH)
+	{
+		return;
+	}
+
+	std::wstring dotGitPath(modulePath);
+	for (int i = 0; i < 2; i++)
+	{
+		size_t lastSlash = dotGitPath.find_last_of(L'\\');
+		if (lastSlash == std::wstring::npos)
+		{
+			return;
+		}
+
+		dotGitPath.resize(lastSlash);
+	}
+
+	std::wstring objectsRoot = dotGitPath + L"\\objects";
+	AddObjectDirectory(objectsRoot);
+	AddAlternateObjectDirectories(objectsRoot);
+}
+
+static bool TryMapPackIndex(const std::wstring &indexPath, PackIndex &packIndex)
+{
+	HANDLE indexHandle = CreateFileW(indexPath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (indexHandle == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	HANDLE mappingHandle = NULL;
+	const unsigned char *view = NULL;
+	if (GetFileSizeEx(indexHandle, &fileSize) &&
+		fileSize.QuadPart >= (LONGLONG)(PACK_IDX_HEADER_SIZE + FANOUT_ENTRIES * sizeof(UINT32)))
+	{
+		mappingHandle = CreateFileMappingW(indexHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mappingHandle != NULL)
+		{
+			view = (const unsigned char *)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+		}
+	}
+
+	// The mapping keeps the view alive, so the file handle is no longer needed
+	CloseHandle(indexHandle);
+
+	if (view != NULL)
+	{
+		const UINT32 *header = (const UINT32 *)view;
+		const UINT32 *fanout = header + 2;
+		UINT32 objectCount = _byteswap_ulong(fanout[FANOUT_ENTRIES - 1]);
+		if (_byteswap_ulong(header[0]) == PACK_IDX_SIGNATURE &&
+			_byteswap_ulong(header[1]) == PACK_IDX_VERSION &&
+			(ULONGLONG)fileSize.QuadPart >= PACK_IDX_HEADER_SIZE + FANOUT_ENTRIES * sizeof(UINT32) + (ULONGLONG)objectCount * SHA1_BYTES)
+		{
+			packIndex.path = indexPath;
+			packIndex.mappingHandle = mappingHandle;
+			packIndex.view = view;
+			packIndex.fanout = fanout;
+			packIndex.shas = (const unsigned char *)(fanout + FANOUT_ENTRIES);
+			packIndex.objectCount = objectCount;
+			return true;
+		}
+
+		UnmapViewOfFile(view);
+	}
+
+	if (mappingHandle != NULL)
+	{
+		CloseHandle(mappingHandle);
+	}
+
+	return false;
+}
+
+static void LoadPackIndexes(ObjectDirectory &directory)
+{
+	// Only pick up pack indexes that have not been mapped already, and skip any whose .pack is
+	// missing (git writes the .pack before the .idx, so this only skips incomplete packs)
+	std::wstring packDirectory = directory.path + L"\\pack\\";
+	WIN32_FILE_ATTRIBUTE_DATA packDirectoryAttributes;
+	if (!GetFileAttributesExW(packDirectory.c_str(), GetFileExInfoStandard, &packDirectoryAttributes))
+	{
+		directory.packIndexesLoaded = true;
+		return;
+	}
+
+	if (directory.packIndexesLoaded && CompareFileTime(&packDirectoryAttributes.ftLastWriteTime, &directory.packDirectoryLastWriteTime) == 0)
+	{
+		return;
+	}
+
+	directory.packIndexesLoaded = true;
+	directory.packDirectoryLastWriteTime = packDirectoryAttributes.ftLastWriteTime;
+
+	WIN32_FIND_DATAW findFileData;
+	HANDLE findHandle = FindFirstFileW((packDirectory + L"*.idx").c_str(), &findFileData);
+	if (findHandle == INVALID_HANDLE_VALUE)
+	{
+		return;
+	}
+
+	do
+	{
+		std::wstring indexPath = packDirectory + findFileData.cFileName;
+		bool alreadyLoaded = false;
+		for (const PackIndex &packIndex : directory.packIndexes)
+		{
+			if (_wcsicmp(packIndex.path.c_str(), indexPath.c_str()) == 0)
+			{
+				alreadyLoaded = true;
+				break;
+			}
+		}
+
+		std::wstring packPath = indexPath.substr(0, indexPath.length() - 4) + L".pack";
+		if (alreadyLoaded || GetFileAttributesW(packPath.c_str()) == INVALID_FILE_ATTRIBUTES)
+		{
+			continue;
+		}
+
+		PackIndex packIndex;
+		if (TryMapPackIndex(indexPath, packIndex))
+		{
+			directory.packIndexes.push_back(packIndex);
+		}
+	} while (FindNextFileW(findHandle, &findFileData));
+
+	FindClose(findHandle);
+}
+
+static bool PackIndexContains(const PackIndex &packIndex, const unsigned char *shaBytes)
+{
+	// The fanout table holds the number of objects whose first byte is less than or equal to each
+	// value, which bounds the binary search to the objects that share the SHA's first byte
+	UINT32 low = shaBytes[0] == 0 ? 0 : _byteswap_ulong(packIndex.fanout[shaBytes[0] - 1]);
+	UINT32 high = _byteswap_ulong(packIndex.fanout[shaBytes[0]]);
+	if (high > packIndex.objectCount)
+	{
+		return false;
+	}
+
+	while (low < high)
+	{
+		UINT32 middle = low + (high - low) / 2;
+		int comparison = memcmp(packIndex.shas + (size_t)middle * SHA1_BYTES, shaBytes, SHA1_BYTES);
+		if (comparison == 0)
+		{
+			return true;
+		}
+
+		if (comparison < 0)
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+
+	return false;
+}
+
+bool LocalObjectExists(const char *sha1)
+{
+	unsigned char shaBytes[SHA1_BYTES];
+	if (strlen(sha1) != SHA1_LENGTH || !TryParseSHA(sha1, shaBytes))
+	{
+		return false;
+	}
+
+	if (!objectDirectoriesInitialized)
+	{
+		InitializeObjectDirectories();
+	}
+
+	for (ObjectDirectory &directory : objectDirectories)
+	{
+		LoadPackIndexes(directory);
+		for (const PackIndex &packIndex : directory.packIndexes)
+		{
+			if (PackIndexContains(packIndex, shaBytes))
+			{
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+#else
+
+bool LocalObjectExists(const char *)
+{
+	// Without a GVFS enlistment (i.e. when running against GVFS.ReadObjectHook.StandInServer) there
+	// is no object store to check, so every object is requested from the server
+	return false;
+}
+
+#endif
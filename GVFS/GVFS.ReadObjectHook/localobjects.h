@@ -0,0 +1,13 @@
+#pragma once
+
+// Looks for objects that are already in a pack file, by searching the pack indexes in the .git\objects
+// folder that read-object.exe was installed next to and in its alternates (i.e. the shared object cache
+// that GVFS registers in .git\objects\info\alternates).
+//
+// git only calls read-object when it cannot find an object, but the object may have been written
+// since git last looked (e.g. by a prefetch or by another git process's read-object hook), and
+// answering those requests locally avoids a round trip to GVFS.  Only pack index hits are trusted:
+// git re-scans the pack folder after read-object succeeds, and a pack is only indexed once it has been
+// verified.  A loose object that exists may be the very object that git could not read (e.g. a
+// truncated or corrupt download), so loose objects are always requested from GVFS, which overwrites them.
+bool LocalObjectExists(const char *sha1);
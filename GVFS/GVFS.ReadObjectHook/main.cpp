@@ -7,50 +7,150 @@
 // Git and read-object.exe negoiate an interface and capabilities then git issues a "get" command for the missing SHA.
 // See Git Documentation/Technical/read-object-protocol.txt for details.
 // GVFS.ReadObjectHook decides which GVFS instance to connect to based on it's path.
+// To avoid walking the directory tree on every launch, GVFS writes the enlistment root to read-object.enlistment
+// (next to read-object.exe) when it mounts, and GVFS.ReadObjectHook uses that root whenever it contains the current
+// directory.
 // It then connects to GVFS and asks GVFS to download the requested object (to the .git\objects folder).
+// The connection goes through transport.h, which also lets the hook run against GVFS.ReadObjectHook.StandInServer
+// on platforms without a GVFS mount.
+//
+// GVFS.ReadObjectHook opens the pipe for overlapped I/O and sends each download request with a tag, so that
+// several requests can be outstanding at once.  GVFS downloads the requests that arrive while an earlier download
+// is in progress together, in a single request to the server, and answers each of them by its tag.  When git has
+// written several "get" commands before reading the responses, they are all sent to GVFS right away.  git expects
+// the responses in the order the "get" commands were sent, so each response is written as soon as it and all of the
+// responses before it are complete.
+//
+// Before asking GVFS for an object, GVFS.ReadObjectHook checks whether the object is already in a pack file
+// (see localobjects.h), and only connects to GVFS once it finds an object that is missing.  When it exits,
+// GVFS.ReadObjectHook reports how many objects were found locally and how many were sent to GVFS (DLOS).
+//
+// If git also lists the "content" capability, GVFS.ReadObjectHook asks GVFS for the object's content (DLOC rather
+// than DLOT) and forwards it to git, so that git does not have to read back the object that GVFS just downloaded.
+// GVFS writes the object to disk after it has responded.  Each "status=success" response is then followed by the
+// loose object (the compressed bytes that would be in .git\objects) as binary packets and a flush packet.  The
+// content is empty when the object was already on disk, when it is too large to send over the pipe, or when GVFS
+// downloaded it together with other objects (GVFS writes these to disk before responding), in which case git reads
+// it from disk as usual.
+//
+// Set GVFS_READOBJECT_PERFTRACE to the path of a file to record how long each phase takes (see perftrace.h).
 
 #include "stdafx.h"
 #include "packet.h"
+#include "localobjects.h"
+#include "perftrace.h"
+#include "returncode.h"
+#include "transport.h"
 
-#define MAX_PACKET_LENGTH 512
 #define SHA1_LENGTH 40
-#define MESSAGE_LENGTH (4 + SHA1_LENGTH + 1)
+#define MAX_OUTSTANDING_REQUESTS 64
+#define ENLISTMENT_CACHE_VERSION 1
+#define REQUEST_MESSAGE_LENGTH 64
+#define INPUT_POLL_INTERVAL_MS 10
+#define STATS_ACK_TIMEOUT_MS 1000
+
+#ifdef _WIN32
 
-enum ReturnCode
+// Layout of the read-object.enlistment file written by GVFS.Mount
+// (see InProcessMount.UpdateReadObjectHookEnlistmentCache)
+struct EnlistmentCacheHeader
 {
-    Success = 0,
-    InvalidArgCount = 1,
-    GetCurrentDirectoryFailure = 2,
-    NotInGVFSEnlistment = 3,
-    PipeConnectError = 4,
-    PipeConnectTimeout = 5,
-    InvalidSHA = 6,
-    PipeWriteFailed = 7,
-    PipeReadFailed = 8,
-	FailureToDownload = 9,
-	ErrorReadObjectProtocol = 10
+	UINT32 version;
+	UINT32 enlistmentRootLength; // In characters, not including the null terminator that follows the root
 };
 
-inline std::wstring GetGVFSPipeName(const char *appName)
+inline bool TryTruncateToCachedEnlistmentRoot(wchar_t *currentDirectory)
 {
-	// The pipe name is build using the path of the GVFS enlistment root.
-	// Start in the current directory and walk up the directory tree
-	// until we find a folder that contains the ".gvfs" folder
+	// If the enlistment root recorded by the mount is a prefix of currentDirectory (and the enlistment
+	// still has a .gvfs folder) truncate currentDirectory to that root and return true.  Otherwise (e.g.
+	// the enlistment has moved or the cache has not been written yet) return false so that the caller
+	// can fall back to walking the directory tree.
+	wchar_t cachePath[MAX_PATH];
+	DWORD modulePathLength = GetModuleFileNameW(NULL, cachePath, MAX_PATH);
+	if (modulePathLength == 0 || modulePathLength >= MAX_PATH)
+	{
+		return false;
+	}
 
-	const size_t dotGVFSRelativePathLength = sizeof(L"\\.gvfs") / sizeof(wchar_t);
+	wchar_t *extension = wcsrchr(cachePath, L'.');
+	if (extension == NULL || wcscpy_s(extension, MAX_PATH - (extension - cachePath), L".enlistment") != 0)
+	{
+		return false;
+	}
 
-	// TODO 640838: Support paths longer than MAX_PATH
-	wchar_t enlistmentRoot[MAX_PATH];
-	DWORD currentDirResult = GetCurrentDirectoryW(MAX_PATH - dotGVFSRelativePathLength, enlistmentRoot);
-	if (currentDirResult == 0 || currentDirResult > MAX_PATH - dotGVFSRelativePathLength)
+	HANDLE cacheHandle = CreateFileW(
+		cachePath,
+		GENERIC_READ,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		NULL,
+		OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL,
+		NULL);
+	if (cacheHandle == INVALID_HANDLE_VALUE)
 	{
-		die(ReturnCode::GetCurrentDirectoryFailure, "GetCurrentDirectory failed (%d)\n", GetLastError());
+		return false;
+	}
+
+	bool rootFound = false;
+	LARGE_INTEGER fileSize;
+	size_t cacheSize = 0;
+	HANDLE mappingHandle = NULL;
+	const void *view = NULL;
+	if (GetFileSizeEx(cacheHandle, &fileSize) &&
+		fileSize.QuadPart >= (LONGLONG)sizeof(EnlistmentCacheHeader) &&
+		fileSize.QuadPart <= (LONGLONG)(sizeof(EnlistmentCacheHeader) + MAX_PATH * sizeof(wchar_t)))
+	{
+		cacheSize = (size_t)fileSize.QuadPart;
+		mappingHandle = CreateFileMappingW(cacheHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mappingHandle != NULL)
+		{
+			view = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+		}
+	}
+
+	if (view != NULL)
+	{
+		const EnlistmentCacheHeader *header = (const EnlistmentCacheHeader *)view;
+		const wchar_t *cachedRoot = (const wchar_t *)(header + 1);
+		size_t rootLength = header->enlistmentRootLength;
+		if (header->version == ENLISTMENT_CACHE_VERSION &&
+			rootLength > 0 &&
+			sizeof(EnlistmentCacheHeader) + (rootLength + 1) * sizeof(wchar_t) <= cacheSize &&
+			rootLength + sizeof(L"\\.gvfs") / sizeof(wchar_t) <= MAX_PATH &&
+			_wcsnicmp(currentDirectory, cachedRoot, rootLength) == 0 &&
+			(currentDirectory[rootLength] == L'\\' || currentDirectory[rootLength] == 0))
+		{
+			wchar_t dotGVFSPath[MAX_PATH];
+			wcsncpy_s(dotGVFSPath, currentDirectory, rootLength);
+			wcscat_s(dotGVFSPath, L"\\.gvfs");
+			DWORD attributes = GetFileAttributesW(dotGVFSPath);
+			if (attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY))
+			{
+				currentDirectory[rootLength] = 0;
+				rootFound = true;
+			}
+		}
+
+		UnmapViewOfFile(view);
+	}
+
+	if (mappingHandle != NULL)
+	{
+		CloseHandle(mappingHandle);
 	}
 
+	CloseHandle(cacheHandle);
+	return rootFound;
+}
+
+inline void TruncateToEnlistmentRoot(const char *appName, wchar_t *enlistmentRoot)
+{
+	// Start in the current directory and walk up the directory tree
+	// until we find a folder that contains the ".gvfs" folder
 	size_t enlistmentRootLength = wcslen(enlistmentRoot);
 	if ('\\' != enlistmentRoot[enlistmentRootLength - 1])
 	{
-		wcscat_s(enlistmentRoot, L"\\");
+		wcscat_s(enlistmentRoot, MAX_PATH, L"\\");
 		enlistmentRootLength++;
 	}
 
@@ -86,117 +186,292 @@ inline std::wstring GetGVFSPipeName(const char *appName)
 	};
 
 	*(lastslash) = 0;
+}
+
+inline std::wstring GetGVFSPipeName(const char *appName)
+{
+	// The pipe name is build using the path of the GVFS enlistment root.
+	const size_t dotGVFSRelativePathLength = sizeof(L"\\.gvfs") / sizeof(wchar_t);
+
+	// TODO 640838: Support paths longer than MAX_PATH
+	wchar_t enlistmentRoot[MAX_PATH];
+	DWORD currentDirResult = GetCurrentDirectoryW(MAX_PATH - dotGVFSRelativePathLength, enlistmentRoot);
+	if (currentDirResult == 0 || currentDirResult > MAX_PATH - dotGVFSRelativePathLength)
+	{
+		die(ReturnCode::GetCurrentDirectoryFailure, "GetCurrentDirectory failed (%d)\n", GetLastError());
+	}
+
+	if (!TryTruncateToCachedEnlistmentRoot(enlistmentRoot))
+	{
+		TruncateToEnlistmentRoot(appName, enlistmentRoot);
+	}
 
 	std::wstring namedPipe(CharUpperW(enlistmentRoot));
 	std::replace(namedPipe.begin(), namedPipe.end(), L':', L'_');
 	return L"\\\\.\\pipe\\GVFS_" + namedPipe;
 }
 
-inline HANDLE CreatePipeToGVFS(const std::wstring& pipeName)
+#else
+
+inline TransportName GetGVFSPipeName(const char *appName)
 {
-	HANDLE pipeHandle;
-	while (1)
+	// There is no GVFS mount on this platform, only GVFS.ReadObjectHook.StandInServer on a Unix domain socket
+	char socketPath[1024];
+	size_t requiredCount = 0;
+	if (getenv_s(&requiredCount, socketPath, sizeof(socketPath), "GVFS_READOBJECT_SOCKET") != 0 || requiredCount <= 1)
 	{
-		pipeHandle = CreateFileW(
-			pipeName.c_str(), // pipe name 
-			GENERIC_READ |     // read and write access 
-			GENERIC_WRITE,
-			0,                 // no sharing 
-			NULL,              // default security attributes
-			OPEN_EXISTING,     // opens existing pipe 
-			0,                 // default attributes 
-			NULL);             // no template file 
+		die(
+			ReturnCode::NotInGVFSEnlistment,
+			"%s requires GVFS_READOBJECT_SOCKET to be set to the path of the server's socket\n",
+			appName);
+	}
 
-		if (pipeHandle != INVALID_HANDLE_VALUE)
-		{
-			break;
-		}
+	return TransportName(socketPath);
+}
+
+#endif
+
+// An object that git has asked for, and that has not yet been reported back to git
+struct PendingObject
+{
+	char sha1[SHA1_LENGTH + 1];
+	bool completed;
+	int result;
+	LONGLONG downloadStartTicks;
+	std::string content;
+};
+
+static TransportName gvfsPipeName;
+static unsigned int localObjectHits = 0;
+static unsigned int localObjectMisses = 0;
+static bool returnContent = false;
 
-		if (GetLastError() != ERROR_PIPE_BUSY)
+inline void ConnectToGVFS()
+{
+	// Only connect to GVFS the first time an object is missing locally
+	if (!TransportIsConnected())
+	{
+		LONGLONG connectStartTicks = PerfTraceStart();
+		TransportConnect(gvfsPipeName);
+		PerfTraceRecord(PerfTracePhase::PipeConnect, connectStartTicks);
+	}
+}
+
+void SendDownloadRequest(unsigned int tag, const char *sha1)
+{
+	// Construct tagged download request message (DLOC when git wants the object's content)
+	// Format:  "DLOT|<tag>|<40 character SHA>"
+	// Example: "DLOT|17|920C34DCDDFC8F07AC4704C8C0D087D6F2095729"
+	char message[REQUEST_MESSAGE_LENGTH];
+	int messageLength = _snprintf_s(message, _TRUNCATE, "%s|%u|%s\n", returnContent ? "DLOC" : "DLOT", tag, sha1);
+	if (messageLength < 0)
+	{
+		die(ReturnCode::InvalidSHA, "Invalid SHA: %s\n", sha1);
+	}
+
+	ConnectToGVFS();
+	if (!TransportWrite(message, (DWORD)messageLength))
+	{
+		die(ReturnCode::PipeWriteFailed, "Failed to write to pipe (%d)\n", TransportLastError());
+	}
+}
+
+bool TryParseTag(const char *begin, const char *end, unsigned int *tag)
+{
+	// The tag must be nothing but decimal digits, and must fit in an unsigned int
+	if (begin == end)
+	{
+		return false;
+	}
+
+	unsigned long long value = 0;
+	for (const char *digit = begin; digit < end; ++digit)
+	{
+		if (*digit < '0' || *digit > '9')
 		{
-			die(ReturnCode::PipeConnectError, "Could not open pipe: %ls, Error: %d\n", pipeName.c_str(), GetLastError());
+			return false;
 		}
 
-		if (!WaitNamedPipeW(pipeName.c_str(), 3000))
+		value = value * 10 + (*digit - '0');
+		if (value > UINT_MAX)
 		{
-			die(ReturnCode::PipeConnectTimeout, "Could not open pipe: %ls, Timed out.", pipeName.c_str());
+			return false;
 		}
 	}
 
-	return pipeHandle;
+	*tag = (unsigned int)value;
+	return true;
 }
 
-int DownloadSHA(HANDLE pipeHandle, const char *sha1)
+bool TryReadDownloadResponse(DWORD timeoutMs, unsigned int *tag, int *result, const char **content)
 {
-	// Construct download request message
-	// Format:  "DLO|<40 character SHA>"
-	// Example: "DLO|920C34DCDDFC8F07AC4704C8C0D087D6F2095729"
-	char message[MESSAGE_LENGTH+1];
-	if (_snprintf_s(message, _TRUNCATE, "DLO|%s\n", sha1) < 0)
+	// Response format: "<tag>|<Result>" or, for DLOC, "<tag>|<Result>|<Base64 content>"
+	// Example: "17|S"
+	// Returns false if no response arrived within timeoutMs.  *content points into the transport's buffer,
+	// and is only valid until the next read.
+	char *line;
+	int readResult = TransportReadLine(&line, timeoutMs);
+	if (readResult < 0)
 	{
-		die(ReturnCode::InvalidSHA, "First argument must be a 40 character SHA, actual value: %s\n", sha1);
+		die(ReturnCode::PipeReadFailed, "Read response from pipe failed (%d)\n", TransportLastError());
 	}
 
-	DWORD bytesWritten;
-	BOOL success = WriteFile(
-		pipeHandle,             // pipe handle 
-		message,				// message 
-		MESSAGE_LENGTH,			// message length 
-		&bytesWritten,          // bytes written 
-		NULL);                  // not overlapped 
+	if (readResult == 0)
+	{
+		return false;
+	}
 
-	if (!success || bytesWritten != MESSAGE_LENGTH)
+	char *separator = strchr(line, '|');
+	if (separator == NULL)
 	{
-		die(ReturnCode::PipeWriteFailed, "Failed to write to pipe (%d)\n", GetLastError());
+		die(ReturnCode::PipeReadFailed, "Invalid response from pipe: %s\n", line);
 	}
 
-	DWORD bytesRead;
-	do
+	if (!TryParseTag(line, separator, tag))
 	{
-		// Read from the pipe. 
-		success = ReadFile(
-			pipeHandle,			// pipe handle 
-			message,			// buffer to receive reply 
-			sizeof(message),	// size of buffer 
-			&bytesRead,         // number of bytes read 
-			NULL);              // not overlapped 
+		die(ReturnCode::PipeReadFailed, "Invalid response tag from pipe: %s\n", line);
+	}
 
-		if (!success && GetLastError() != ERROR_MORE_DATA)
+	*result = *(separator + 1) == 'S' ? ReturnCode::Success : ReturnCode::FailureToDownload;
+	const char *contentSeparator = strchr(separator + 1, '|');
+	*content = contentSeparator == NULL ? "" : contentSeparator + 1;
+	return true;
+}
+
+bool TryDecodeBase64(const char *encoded, std::string *decoded)
+{
+	static signed char values[256];
+	if (values[(unsigned char)'/'] == 0)
+	{
+		memset(values, -1, sizeof(values));
+		const char *alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+		for (int i = 0; i < 64; i++)
 		{
-			break;
+			values[(unsigned char)alphabet[i]] = (signed char)i;
 		}
-	} while (!success);  // repeat loop if ERROR_MORE_DATA 
-	if (!success)
+	}
+
+	size_t length = strlen(encoded);
+	if (length % 4 != 0)
+	{
+		return false;
+	}
+
+	decoded->clear();
+	decoded->reserve(length / 4 * 3);
+	for (size_t i = 0; i < length; i += 4)
+	{
+		int padding = (encoded[i + 3] == '=') + (encoded[i + 2] == '=');
+		if (padding > 0 && i + 4 != length)
+		{
+			return false;
+		}
+
+		int a = values[(unsigned char)encoded[i]];
+		int b = values[(unsigned char)encoded[i + 1]];
+		int c = padding > 1 ? 0 : values[(unsigned char)encoded[i + 2]];
+		int d = padding > 0 ? 0 : values[(unsigned char)encoded[i + 3]];
+		if ((a | b | c | d) < 0)
+		{
+			return false;
+		}
+
+		unsigned int triple = (a << 18) | (b << 12) | (c << 6) | d;
+		decoded->push_back((char)(triple >> 16));
+		if (padding < 2)
+		{
+			decoded->push_back((char)(triple >> 8));
+		}
+
+		if (padding < 1)
+		{
+			decoded->push_back((char)triple);
+		}
+	}
+
+	return true;
+}
+
+void ReportLocalObjectStats()
+{
+	// Called at exit, so failures are ignored rather than passed to die
+	// Format:  "DLOS|<objects found locally>,<objects requested from GVFS>"
+	if (localObjectHits == 0 && localObjectMisses == 0)
+	{
+		return;
+	}
+
+	if (!TransportIsConnected() && !TransportTryConnect(gvfsPipeName))
 	{
-		die(ReturnCode::PipeReadFailed, "Read response from pipe failed (%d)\n", GetLastError());
+		return;
 	}
 
-	return *message == 'S' ? ReturnCode::Success : ReturnCode::FailureToDownload;
+	char message[REQUEST_MESSAGE_LENGTH];
+	int messageLength = _snprintf_s(message, _TRUNCATE, "DLOS|%u,%u\n", localObjectHits, localObjectMisses);
+	char *response;
+	if (messageLength > 0 && TransportWrite(message, (DWORD)messageLength))
+	{
+		// Wait for the acknowledgement so that the mount has read the message before the pipe is closed
+		TransportReadLine(&response, STATS_ACK_TIMEOUT_MS);
+	}
+
+	TransportClose();
+}
+
+void ReadGetCommand(char *sha1)
+{
+	const char *line;
+	size_t len;
+
+	len = packet_txt_read_inplace(&line);
+	if (!packet_txt_equals(line, len, "command=get"))
+	{
+		die(ReturnCode::ErrorReadObjectProtocol, "Bad command\n");
+	}
+
+	len = packet_txt_read_inplace(&line);
+	if ((len != SHA1_LENGTH + 5) || strncmp(line, "sha1=", 5))
+	{
+		die(ReturnCode::ErrorReadObjectProtocol, "Bad sha1 in get command\n");
+	}
+
+	memcpy(sha1, line + 5, SHA1_LENGTH);
+	sha1[SHA1_LENGTH] = 0;
+
+	if (packet_txt_read_inplace(&line))
+	{
+		die(ReturnCode::ErrorReadObjectProtocol, "Bad command end\n");
+	}
 }
 
 int main(int, char *argv[])
 {
-	char packet_buffer[MAX_PACKET_LENGTH];
+	const char *line;
 	size_t len;
-	int err;
 
+	InitializePerfTrace();
+	atexit(WritePerfTrace);
+	LONGLONG handshakeStartTicks = PerfTraceStart();
+
+#ifdef _WIN32
 	// set the mode to binary so we don't get CRLF translation
 	_setmode(_fileno(stdin), _O_BINARY);
 	_setmode(_fileno(stdout), _O_BINARY);
+#endif
 
-	packet_txt_read(packet_buffer, sizeof(packet_buffer));
-	if (strcmp(packet_buffer, "git-read-object-client"))
+	len = packet_txt_read_inplace(&line);
+	if (!packet_txt_equals(line, len, "git-read-object-client"))
 	{
 		die(ReturnCode::ErrorReadObjectProtocol, "Bad welcome message\n");
 	}
 
-	packet_txt_read(packet_buffer, sizeof(packet_buffer));
-	if (strcmp(packet_buffer, "version=1"))
+	len = packet_txt_read_inplace(&line);
+	if (!packet_txt_equals(line, len, "version=1"))
 	{
 		die(ReturnCode::ErrorReadObjectProtocol, "Bad version\n");
 	}
 
-	if (packet_txt_read(packet_buffer, sizeof(packet_buffer)))
+	if (packet_txt_read_inplace(&line))
 	{
 		die(ReturnCode::ErrorReadObjectProtocol, "Bad version end\n");
 	}
@@ -205,46 +480,123 @@ int main(int, char *argv[])
 	packet_txt_write("version=1");
 	packet_flush();
 
-	packet_txt_read(packet_buffer, sizeof(packet_buffer));
-	if (strcmp(packet_buffer, "capability=get"))
+	// git lists the capabilities that it supports, and the hook replies with the ones that it will use
+	bool getCapability = false;
+	while ((len = packet_txt_read_inplace(&line)) > 0)
 	{
-		die(ReturnCode::ErrorReadObjectProtocol, "Bad capability\n");
+		if (packet_txt_equals(line, len, "capability=get"))
+		{
+			getCapability = true;
+		}
+		else if (packet_txt_equals(line, len, "capability=content"))
+		{
+			returnContent = true;
+		}
 	}
 
-	if (packet_txt_read(packet_buffer, sizeof(packet_buffer)))
+	if (!getCapability)
 	{
-		die(ReturnCode::ErrorReadObjectProtocol, "Bad capability end\n");
+		die(ReturnCode::ErrorReadObjectProtocol, "Bad capability\n");
 	}
 
 	packet_txt_write("capability=get");
-	packet_flush();
+	if (returnContent)
+	{
+		packet_txt_write("capability=content");
+	}
 
-	std::wstring pipeName(GetGVFSPipeName(argv[0]));
+	packet_flush();
+	PerfTraceRecord(PerfTracePhase::Handshake, handshakeStartTicks);
 
-	HANDLE pipeHandle = CreatePipeToGVFS(pipeName);
+	gvfsPipeName = GetGVFSPipeName(argv[0]);
+	atexit(ReportLocalObjectStats);
 
+	// pendingObjects is a ring buffer of the objects that have not been reported to git, in the order that git
+	// asked for them.  The object with tag t is stored at pendingObjects[t % MAX_OUTSTANDING_REQUESTS].
+	PendingObject pendingObjects[MAX_OUTSTANDING_REQUESTS];
+	unsigned int firstTag = 0;
+	unsigned int pendingCount = 0;
 	while (1)
 	{
-		packet_txt_read(packet_buffer, sizeof(packet_buffer));
-		if (strcmp(packet_buffer, "command=get"))
+		// Wait for the next get command if there is nothing else to do, and pick up any others that git has already sent
+		while (pendingCount < MAX_OUTSTANDING_REQUESTS && (pendingCount == 0 || packet_input_pending()))
 		{
-			die(ReturnCode::ErrorReadObjectProtocol, "Bad command\n");
+			unsigned int tag = firstTag + pendingCount;
+			PendingObject &object = pendingObjects[tag % MAX_OUTSTANDING_REQUESTS];
+			ReadGetCommand(object.sha1);
+			pendingCount++;
+
+			// Only ask GVFS for the objects that are not already in a pack file
+			object.content.clear();
+			if (LocalObjectExists(object.sha1))
+			{
+				object.completed = true;
+				object.result = ReturnCode::Success;
+				localObjectHits++;
+			}
+			else
+			{
+				object.completed = false;
+				object.downloadStartTicks = PerfTraceStart();
+				localObjectMisses++;
+				SendDownloadRequest(tag, object.sha1);
+			}
 		}
 
-		len = packet_txt_read(packet_buffer, sizeof(packet_buffer));
-		if ((len != SHA1_LENGTH + 5) || strncmp(packet_buffer, "sha1=", 5))
+		// Report every completed object that git is waiting for, in request order, with a single write
+		while (pendingCount > 0 && pendingObjects[firstTag % MAX_OUTSTANDING_REQUESTS].completed)
 		{
-			die(ReturnCode::ErrorReadObjectProtocol, "Bad sha1 in get command\n");
+			PendingObject &object = pendingObjects[firstTag % MAX_OUTSTANDING_REQUESTS];
+			packet_txt_write(object.result ? "status=error" : "status=success");
+			packet_write_flush_pkt();
+			if (returnContent && object.result == ReturnCode::Success)
+			{
+				packet_bin_write(object.content.data(), object.content.length());
+				packet_write_flush_pkt();
+			}
+
+			firstTag++;
+			pendingCount--;
 		}
 
-		if (packet_txt_read(packet_buffer, sizeof(packet_buffer)))
+		if (packet_stdout.length > 0)
 		{
-			die(ReturnCode::ErrorReadObjectProtocol, "Bad command end\n");
+			LONGLONG writeStartTicks = PerfTraceStart();
+			packet_write_buffered();
+			PerfTraceRecord(PerfTracePhase::PacketWrite, writeStartTicks);
 		}
 
-		err = DownloadSHA(pipeHandle, packet_buffer + 5);
-		packet_txt_write(err ? "status=error" : "status=success");
-		packet_flush();
+		if (pendingCount > 0)
+		{
+			// Wait for one of the outstanding downloads to complete.  If there is room for more requests, stop
+			// waiting periodically to check whether git has sent more get commands.
+			unsigned int tag;
+			int result;
+			const char *content;
+			DWORD timeoutMs = pendingCount < MAX_OUTSTANDING_REQUESTS ? INPUT_POLL_INTERVAL_MS : INFINITE;
+			if (TryReadDownloadResponse(timeoutMs, &tag, &result, &content))
+			{
+				if (tag - firstTag >= pendingCount)
+				{
+					die(ReturnCode::PipeReadFailed, "Unexpected response tag %u\n", tag);
+				}
+
+				PendingObject &object = pendingObjects[tag % MAX_OUTSTANDING_REQUESTS];
+				if (object.completed)
+				{
+					die(ReturnCode::PipeReadFailed, "Repeated response tag %u\n", tag);
+				}
+
+				if (returnContent && result == ReturnCode::Success && !TryDecodeBase64(content, &object.content))
+				{
+					die(ReturnCode::PipeReadFailed, "Invalid object content in response for tag %u\n", tag);
+				}
+
+				object.completed = true;
+				object.result = result;
+				PerfTraceRecord(PerfTracePhase::Download, object.downloadStartTicks);
+			}
+		}
 	}
 
 	// we'll never reach here as the signal to exit is having stdin closed which is handled in packet_bin_read
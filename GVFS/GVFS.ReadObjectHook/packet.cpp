@@ -1,6 +1,10 @@
 #include "stdafx.h"
 #include "packet.h"
 
+#ifndef _WIN32
+#include <poll.h>
+#endif
+
 void die(int err, const char *fmt, ...)
 {
 	va_list params;
@@ -74,91 +78,225 @@ static int packet_length(const char *packetlen)
 	return (val < 0) ? val : (val << 8) | hex2chr(packetlen + 2);
 }
 
-static size_t packet_bin_read(void *buf, size_t count, FILE *stream)
+packet_reader packet_stdin = { 0 };
+packet_writer packet_stdout = { 1 };
+
+void packet_reader_init(packet_reader *reader, int fd)
+{
+	reader->fd = fd;
+	reader->start = 0;
+	reader->end = 0;
+}
+
+void packet_writer_init(packet_writer *writer, int fd)
+{
+	writer->fd = fd;
+	writer->length = 0;
+}
+
+static size_t packet_fill(packet_reader *reader, size_t needed)
+{
+	// Ensure at least needed bytes are buffered after reader->start, compacting the
+	// buffer first if the packet would run past its end.  Returns the bytes available,
+	// which is less than needed only at end of input.
+	if (reader->start + needed > sizeof(reader->buffer))
+	{
+		memmove(reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+		reader->end -= reader->start;
+		reader->start = 0;
+	}
+
+	while (reader->end - reader->start < needed)
+	{
+		int bytes_read = _read(reader->fd, reader->buffer + reader->end, (unsigned int)(sizeof(reader->buffer) - reader->end));
+		if (bytes_read < 0)
+		{
+			die(-1, "error reading packet (%d)", errno);
+		}
+
+		if (bytes_read == 0)
+		{
+			break;
+		}
+
+		reader->end += bytes_read;
+	}
+
+	return reader->end - reader->start;
+}
+
+static size_t packet_bin_read(const char **buf, packet_reader *reader)
 {
-	char packetlen[4];
-	size_t len, ret;
+	size_t available = packet_fill(reader, 4);
 
 	/* if we timeout waiting for input, exit and git will restart us if needed */
-	size_t bytes_read = fread(packetlen, 1, 4, stream);
-	if (0 == bytes_read)
+	if (0 == available)
 	{
 		exit(0);
 	}
-	if (4 != bytes_read)
+	if (available < 4)
 	{
 		die(-1, "invalid packet length");
 	}
 
-	len = packet_length(packetlen);
+	const char *packetlen = reader->buffer + reader->start;
+	int len = packet_length(packetlen);
+	if (len < 0)
+	{
+		die(-1, "protocol error: bad line length character: %.4s", packetlen);
+	}
 	if (!len)
 	{
+		reader->start += 4;
+		*buf = reader->buffer + reader->start;
 		return 0;
 	}
-	if (len < 4)
+	if (len < 4 || len > LARGE_PACKET_MAX)
 	{
-		die(-1, "protocol error: bad line length character: %.4s", packetlen);
+		die(-1, "protocol error: bad line length %d", len);
 	}
-	len -= 4;
-	if (len >= count)
+
+	available = packet_fill(reader, len);
+	if (available < (size_t)len)
 	{
-		die(-1, "protocol error: bad line length %d", len);
+		die(-1, "invalid packet (%d bytes expected; %d bytes read)", len - 4, (int)available - 4);
 	}
-	ret = fread(buf, 1, len, stream);
-	if (ret != len)
+
+	*buf = reader->buffer + reader->start + 4;
+	reader->start += len;
+	return len - 4;
+}
+
+size_t packet_txt_read_inplace(const char **line, packet_reader *reader)
+{
+	size_t len = packet_bin_read(line, reader);
+	if (len && (*line)[len - 1] == '\n')
 	{
-		die(-1, "invalid packet (%d bytes expected; %d bytes read)", len, ret);
+		len--;
 	}
 
 	return len;
 }
 
-size_t packet_txt_read(char *buf, size_t count, FILE *stream)
+size_t packet_txt_read(char *buf, size_t count, packet_reader *reader)
 {
-	size_t len;
-	
-	len = packet_bin_read(buf, count, stream);
-	if (len && buf[len - 1] == '\n')
+	const char *line;
+	size_t len = packet_txt_read_inplace(&line, reader);
+	if (len >= count)
 	{
-		len--;
+		die(-1, "protocol error: bad line length %d", (int)len);
 	}
 
+	memcpy(buf, line, len);
 	buf[len] = 0;
 	return len;
 }
 
-void packet_txt_write(const char *buf, FILE *stream)
+bool packet_txt_equals(const char *line, size_t len, const char *expected)
+{
+	return strlen(expected) == len && memcmp(line, expected, len) == 0;
+}
+
+void packet_write_buffered(packet_writer *writer)
 {
-	char packetlen[4];
-	size_t len, count = strlen(buf);
+	size_t written = 0;
+	while (written < writer->length)
+	{
+		int len = _write(writer->fd, writer->buffer + written, (unsigned int)(writer->length - written));
+		if (len <= 0)
+		{
+			die(-1, "error writing packet (%d)", errno);
+		}
+
+		written += len;
+	}
 
-	set_packet_header(packetlen, count + 5);
-	len = fwrite(packetlen, 1, 4, stream);
-	if (len != 4)
+	writer->length = 0;
+}
+
+void packet_txt_write(const char *buf, packet_writer *writer)
+{
+	size_t count = strlen(buf);
+	size_t len = count + 5;
+	if (len > LARGE_PACKET_MAX)
 	{
-		die(-1, "error writing packet length");
+		die(-1, "protocol error: impossibly long line");
 	}
-	len = fwrite(buf, 1, count, stream);
-	if (len != count)
+
+	if (writer->length + len > sizeof(writer->buffer))
 	{
-		die(-1, "error writing packet");
+		packet_write_buffered(writer);
 	}
-	len = fwrite("\n", 1, 1, stream);
-	if (len != 1)
+
+	// Gather the header, payload and newline so that the whole line goes out in a single write
+	char *packet = writer->buffer + writer->length;
+	set_packet_header(packet, len);
+	memcpy(packet + 4, buf, count);
+	packet[len - 1] = '\n';
+	writer->length += len;
+}
+
+void packet_bin_write(const char *buf, size_t count, packet_writer *writer)
+{
+	// Split the data into the largest packets that git accepts
+	while (count > 0)
 	{
-		die(-1, "error writing packet");
+		size_t payload = count < LARGE_PACKET_MAX - 4 ? count : LARGE_PACKET_MAX - 4;
+		if (writer->length + payload + 4 > sizeof(writer->buffer))
+		{
+			packet_write_buffered(writer);
+		}
+
+		char *packet = writer->buffer + writer->length;
+		set_packet_header(packet, payload + 4);
+		memcpy(packet + 4, buf, payload);
+		writer->length += payload + 4;
+		buf += payload;
+		count -= payload;
 	}
-	fflush(stream);
 }
 
-void packet_flush(FILE *stream)
+bool packet_input_pending(packet_reader *reader)
 {
-	size_t len;
+	if (reader->end > reader->start)
+	{
+		return true;
+	}
+
+#ifdef _WIN32
+	// Only pipes can report how much input is waiting, treat anything else as having nothing pending.
+	HANDLE handle = (HANDLE)_get_osfhandle(reader->fd);
+	if (handle == INVALID_HANDLE_VALUE || GetFileType(handle) != FILE_TYPE_PIPE)
+	{
+		return false;
+	}
+
+	DWORD bytesAvailable = 0;
+	if (!PeekNamedPipe(handle, NULL, 0, NULL, &bytesAvailable, NULL))
+	{
+		return false;
+	}
+
+	return bytesAvailable > 0;
+#else
+	pollfd pollInput = { reader->fd, POLLIN, 0 };
+	return poll(&pollInput, 1, 0) > 0 && (pollInput.revents & POLLIN);
+#endif
+}
 
-	len = fwrite("0000", 1, 4, stream);
-	if (len != 4)
+void packet_write_flush_pkt(packet_writer *writer)
+{
+	if (writer->length + 4 > sizeof(writer->buffer))
 	{
-		die(-1, "error writing flush packet");
+		packet_write_buffered(writer);
 	}
-	fflush(stream);
+
+	memcpy(writer->buffer + writer->length, "0000", 4);
+	writer->length += 4;
+}
+
+void packet_flush(packet_writer *writer)
+{
+	packet_write_flush_pkt(writer);
+	packet_write_buffered(writer);
 }
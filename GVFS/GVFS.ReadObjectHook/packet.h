@@ -1,7 +1,42 @@
 #pragma once
 #include <stdio.h>
 
-size_t packet_txt_read(char *buf, size_t count, FILE *stream = stdin);
-void packet_txt_write(const char *buf, FILE *stream = stdout);
-void packet_flush(FILE *stream = stdout);
+// Largest pkt-line git will send or accept, including the 4 byte length header
+#define LARGE_PACKET_MAX 65520
+#define PACKET_BUFFER_SIZE (2 * LARGE_PACKET_MAX)
+
+// Buffered pkt-line reader.  Packets are parsed in place in buffer, so the line
+// returned by packet_txt_read_inplace is only valid until the next read.
+struct packet_reader
+{
+	int fd;
+	size_t start;
+	size_t end;
+	char buffer[PACKET_BUFFER_SIZE];
+};
+
+// Buffered pkt-line writer.  Lines are gathered into buffer and only written
+// to fd by packet_flush or packet_write_buffered (or when buffer is full).
+struct packet_writer
+{
+	int fd;
+	size_t length;
+	char buffer[PACKET_BUFFER_SIZE];
+};
+
+extern packet_reader packet_stdin;
+extern packet_writer packet_stdout;
+
+void packet_reader_init(packet_reader *reader, int fd);
+void packet_writer_init(packet_writer *writer, int fd);
+
+size_t packet_txt_read_inplace(const char **line, packet_reader *reader = &packet_stdin);
+size_t packet_txt_read(char *buf, size_t count, packet_reader *reader = &packet_stdin);
+bool packet_txt_equals(const char *line, size_t len, const char *expected);
+void packet_txt_write(const char *buf, packet_writer *writer = &packet_stdout);
+void packet_bin_write(const char *buf, size_t count, packet_writer *writer = &packet_stdout);
+void packet_write_flush_pkt(packet_writer *writer = &packet_stdout);
+void packet_write_buffered(packet_writer *writer = &packet_stdout);
+void packet_flush(packet_writer *writer = &packet_stdout);
+bool packet_input_pending(packet_reader *reader = &packet_stdin);
 void die(int err, const char *fmt, ...);
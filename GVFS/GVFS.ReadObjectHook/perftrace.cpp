@@ -0,0 +1,182 @@
+#include "stdafx.h"
+#include "perftrace.h"
+#include <atomic>
+#include <chrono>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Values below 2^SUB_BUCKET_BITS microseconds get a bucket each, and every larger power of two is split into
+// 2^(SUB_BUCKET_BITS - 1) buckets, which keeps each bucket within 12.5% of the values it holds
+#define SUB_BUCKET_BITS 4
+#define SUB_BUCKET_COUNT (1 << SUB_BUCKET_BITS)
+#define SUB_BUCKET_HALF_COUNT (SUB_BUCKET_COUNT / 2)
+#define MAX_VALUE_BITS 40
+#define BUCKET_COUNT (SUB_BUCKET_HALF_COUNT * (MAX_VALUE_BITS - SUB_BUCKET_BITS + 3))
+#define PERFTRACE_PATH_LENGTH 1024
+
+struct PhaseStats
+{
+	std::atomic<LONGLONG> count;
+	std::atomic<LONGLONG> totalMicroseconds;
+	std::atomic<LONGLONG> maxMicroseconds;
+	std::atomic<LONGLONG> buckets[BUCKET_COUNT];
+};
+
+static const char *PhaseNames[PerfTracePhaseCount] = { "Handshake", "PipeConnect", "Download", "PacketWrite" };
+
+static bool perfTraceEnabled = false;
+static char perfTracePath[PERFTRACE_PATH_LENGTH];
+static PhaseStats phaseStats[PerfTracePhaseCount];
+
+static int GetHighestBit(unsigned long long value)
+{
+#ifdef _MSC_VER
+	unsigned long highestBit;
+	_BitScanReverse64(&highestBit, value);
+	return (int)highestBit;
+#else
+	return 63 - __builtin_clzll(value);
+#endif
+}
+
+static int GetBucketIndex(unsigned long long microseconds)
+{
+	if (microseconds < SUB_BUCKET_COUNT)
+	{
+		return (int)microseconds;
+	}
+
+	int highestBit = GetHighestBit(microseconds);
+	if (highestBit > MAX_VALUE_BITS)
+	{
+		return BUCKET_COUNT - 1;
+	}
+
+	// The top SUB_BUCKET_BITS bits of the value (whose first bit is always set) select the bucket within its power of two
+	int shift = highestBit - (SUB_BUCKET_BITS - 1);
+	int subBucket = (int)(microseconds >> shift);
+	return (SUB_BUCKET_HALF_COUNT * shift) + subBucket;
+}
+
+static unsigned long long GetBucketLowerBound(int index)
+{
+	if (index < SUB_BUCKET_COUNT)
+	{
+		return (unsigned long long)index;
+	}
+
+	int shift = (index / SUB_BUCKET_HALF_COUNT) - 1;
+	unsigned long long subBucket = (unsigned long long)(index % SUB_BUCKET_HALF_COUNT) + SUB_BUCKET_HALF_COUNT;
+	return subBucket << shift;
+}
+
+static unsigned long long GetPercentile(const PhaseStats &stats, double percentile)
+{
+	LONGLONG target = (LONGLONG)(stats.count * percentile / 100.0);
+	LONGLONG seen = 0;
+	for (int i = 0; i < BUCKET_COUNT; i++)
+	{
+		seen += stats.buckets[i];
+		if (seen > target)
+		{
+			return GetBucketLowerBound(i);
+		}
+	}
+
+	return (unsigned long long)stats.maxMicroseconds;
+}
+
+void InitializePerfTrace()
+{
+	size_t pathLength = 0;
+	if (getenv_s(&pathLength, perfTracePath, sizeof(perfTracePath), "GVFS_READOBJECT_PERFTRACE") != 0 || pathLength <= 1)
+	{
+		return;
+	}
+
+	perfTraceEnabled = true;
+}
+
+LONGLONG PerfTraceStart()
+{
+	if (!perfTraceEnabled)
+	{
+		return 0;
+	}
+
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void PerfTraceRecord(PerfTracePhase phase, LONGLONG startTicks)
+{
+	if (!perfTraceEnabled)
+	{
+		return;
+	}
+
+	LONGLONG microseconds = PerfTraceStart() - startTicks;
+	if (microseconds < 0)
+	{
+		microseconds = 0;
+	}
+
+	PhaseStats &stats = phaseStats[phase];
+	stats.count.fetch_add(1, std::memory_order_relaxed);
+	stats.totalMicroseconds.fetch_add(microseconds, std::memory_order_relaxed);
+	stats.buckets[GetBucketIndex((unsigned long long)microseconds)].fetch_add(1, std::memory_order_relaxed);
+
+	LONGLONG max = stats.maxMicroseconds.load(std::memory_order_relaxed);
+	while (microseconds > max && !stats.maxMicroseconds.compare_exchange_weak(max, microseconds, std::memory_order_relaxed))
+	{
+	}
+}
+
+void WritePerfTrace()
+{
+	// Called at exit.  Appends a single JSON line, so that every read-object process can share one trace file:
+	// {"pid":1234,"phases":{"Download":{"count":2,"totalUs":900,"maxUs":600,"p50Us":592,"p90Us":592,"p99Us":592,"buckets":[[296,1],[592,1]]},...}}
+	if (!perfTraceEnabled)
+	{
+		return;
+	}
+
+	FILE *traceFile;
+	if (fopen_s(&traceFile, perfTracePath, "ab") != 0)
+	{
+		return;
+	}
+
+	fprintf(traceFile, "{\"pid\":%lu,\"phases\":{", (unsigned long)GetCurrentProcessId());
+	for (int phase = 0; phase < PerfTracePhaseCount; phase++)
+	{
+		const PhaseStats &stats = phaseStats[phase];
+		fprintf(
+			traceFile,
+			"%s\"%s\":{\"count\":%lld,\"totalUs\":%lld,\"maxUs\":%lld,\"p50Us\":%llu,\"p90Us\":%llu,\"p99Us\":%llu,\"buckets\":[",
+			phase == 0 ? "" : ",",
+			PhaseNames[phase],
+			(long long)stats.count,
+			(long long)stats.totalMicroseconds,
+			(long long)stats.maxMicroseconds,
+			GetPercentile(stats, 50),
+			GetPercentile(stats, 90),
+			GetPercentile(stats, 99));
+
+		bool firstBucket = true;
+		for (int i = 0; i < BUCKET_COUNT; i++)
+		{
+			if (stats.buckets[i] != 0)
+			{
+				fprintf(traceFile, "%s[%llu,%lld]", firstBucket ? "" : ",", GetBucketLowerBound(i), (long long)stats.buckets[i]);
+				firstBucket = false;
+			}
+		}
+
+		fprintf(traceFile, "]}");
+	}
+
+	fprintf(traceFile, "}}\n");
+	fclose(traceFile);
+}
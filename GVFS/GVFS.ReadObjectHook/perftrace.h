@@ -0,0 +1,21 @@
+#pragma once
+
+// Opt-in timing for GVFS.ReadObjectHook.  When GVFS_READOBJECT_PERFTRACE is set to a file path, the time spent
+// in each phase is recorded in a log-linear (HDR style) latency histogram, and when the hook exits a JSON line
+// with the per-phase totals and histograms is appended to that file.
+//
+// Recording only touches preallocated atomic counters, and when tracing is disabled PerfTraceStart
+// returns 0 and PerfTraceRecord returns immediately.  PerfTraceStart returns a timestamp in microseconds.
+enum PerfTracePhase
+{
+	Handshake = 0,
+	PipeConnect,
+	Download,
+	PacketWrite,
+	PerfTracePhaseCount
+};
+
+void InitializePerfTrace();
+LONGLONG PerfTraceStart();
+void PerfTraceRecord(PerfTracePhase phase, LONGLONG startTicks);
+void WritePerfTrace();
@@ -0,0 +1,65 @@
+#pragma once
+
+// Lets GVFS.ReadObjectHook build on platforms other than Windows, where it talks to
+// GVFS.ReadObjectHook.StandInServer over a Unix domain socket (see transport.h).
+// Only the parts of the Windows API and the secure CRT that the hook uses are defined here.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+typedef uint32_t DWORD;
+typedef uint32_t UINT32;
+typedef int64_t LONGLONG;
+
+#define INFINITE 0xFFFFFFFF
+#define _TRUNCATE ((size_t)-1)
+
+#define _read read
+#define _write write
+#define _fileno fileno
+
+template <size_t size>
+inline int _snprintf_s(char (&buffer)[size], size_t, const char *format, ...)
+{
+	// Like _snprintf_s with _TRUNCATE, returns -1 if the output was truncated
+	va_list args;
+	va_start(args, format);
+	int length = vsnprintf(buffer, size, format, args);
+	va_end(args);
+	return (length < 0 || (size_t)length >= size) ? -1 : length;
+}
+
+inline int getenv_s(size_t *requiredSize, char *buffer, size_t bufferSize, const char *name)
+{
+	const char *value = getenv(name);
+	size_t valueSize = value == NULL ? 0 : strlen(value) + 1;
+	*requiredSize = valueSize;
+	if (buffer == NULL || valueSize == 0)
+	{
+		return 0;
+	}
+
+	if (valueSize > bufferSize)
+	{
+		return ERANGE;
+	}
+
+	memcpy(buffer, value, valueSize);
+	return 0;
+}
+
+inline int fopen_s(FILE **file, const char *path, const char *mode)
+{
+	*file = fopen(path, mode);
+	return *file == NULL ? errno : 0;
+}
+
+inline DWORD GetCurrentProcessId()
+{
+	return (DWORD)getpid();
+}
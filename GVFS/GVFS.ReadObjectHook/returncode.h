@@ -0,0 +1,17 @@
+#pragma once
+
+// Exit codes for GVFS.ReadObjectHook, passed to die
+enum ReturnCode
+{
+    Success = 0,
+    InvalidArgCount = 1,
+    GetCurrentDirectoryFailure = 2,
+    NotInGVFSEnlistment = 3,
+    PipeConnectError = 4,
+    PipeConnectTimeout = 5,
+    InvalidSHA = 6,
+    PipeWriteFailed = 7,
+    PipeReadFailed = 8,
+	FailureToDownload = 9,
+	ErrorReadObjectProtocol = 10
+};
@@ -5,13 +5,20 @@
 
 #pragma once
 
+#ifdef _WIN32
 #include "targetver.h"
 #include <Windows.h>
-#include <stdio.h>
-#include <string>
-#include <algorithm>
 #include <locale>
 #include <codecvt>
 #include <fcntl.h>
 #include <io.h>
-#include <string.h>
\ No newline at end of file
+#else
+#include "posixcompat.h"
+#endif
+
+#include <stdio.h>
+#include <string>
+#include <algorithm>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
\ No newline at end of file
@@ -0,0 +1,330 @@
+#include "stdafx.h"
+#include "transport.h"
+#include "packet.h"
+#include "returncode.h"
+
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <chrono>
+#include <thread>
+#endif
+
+#define INITIAL_RESPONSE_BUFFER_LENGTH 4096
+#define CONNECT_TIMEOUT_MS 3000
+
+// Received bytes that have not yet been returned by TransportReadLine are kept in
+// responseBuffer[responseStart, responseEnd).  The buffer starts small and grows to fit the longest
+// response line, as responses that carry object content can be much longer than status responses.
+static char *responseBuffer = NULL;
+static DWORD responseBufferLength = 0;
+static DWORD responseStart = 0;
+static DWORD responseEnd = 0;
+
+static bool TryMakeRoomInResponseBuffer()
+{
+	if (responseStart > 0)
+	{
+		memmove(responseBuffer, responseBuffer + responseStart, responseEnd - responseStart);
+		responseEnd -= responseStart;
+		responseStart = 0;
+	}
+
+	if (responseEnd < responseBufferLength)
+	{
+		return true;
+	}
+
+	DWORD newLength = responseBufferLength == 0 ? INITIAL_RESPONSE_BUFFER_LENGTH : responseBufferLength * 2;
+	if (newLength < responseBufferLength)
+	{
+		return false;
+	}
+
+	char *newBuffer = (char *)realloc(responseBuffer, newLength);
+	if (newBuffer == NULL)
+	{
+		return false;
+	}
+
+	responseBuffer = newBuffer;
+	responseBufferLength = newLength;
+	return true;
+}
+
+#ifdef _WIN32
+
+static HANDLE pipeHandle = INVALID_HANDLE_VALUE;
+static OVERLAPPED writeOverlapped;
+static OVERLAPPED readOverlapped;
+static bool readPending = false;
+
+static HANDLE OpenPipe(const TransportName &name)
+{
+	return CreateFileW(
+		name.c_str(),      // pipe name 
+		GENERIC_READ |     // read and write access 
+		GENERIC_WRITE,
+		0,                 // no sharing 
+		NULL,              // default security attributes
+		OPEN_EXISTING,     // opens existing pipe 
+		FILE_FLAG_OVERLAPPED, // overlapped, so that a read can be pending while requests are written
+		NULL);             // no template file 
+}
+
+static bool TryCreateEvents()
+{
+	writeOverlapped.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+	readOverlapped.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+	return writeOverlapped.hEvent != NULL && readOverlapped.hEvent != NULL;
+}
+
+void TransportConnect(const TransportName &name)
+{
+	while (1)
+	{
+		pipeHandle = OpenPipe(name);
+		if (pipeHandle != INVALID_HANDLE_VALUE)
+		{
+			break;
+		}
+
+		if (GetLastError() != ERROR_PIPE_BUSY)
+		{
+			die(ReturnCode::PipeConnectError, "Could not open pipe: %ls, Error: %d\n", name.c_str(), GetLastError());
+		}
+
+		if (!WaitNamedPipeW(name.c_str(), CONNECT_TIMEOUT_MS))
+		{
+			die(ReturnCode::PipeConnectTimeout, "Could not open pipe: %ls, Timed out.", name.c_str());
+		}
+	}
+
+	if (!TryCreateEvents())
+	{
+		die(ReturnCode::PipeConnectError, "Failed to create pipe events (%d)\n", GetLastError());
+	}
+}
+
+bool TransportTryConnect(const TransportName &name)
+{
+	pipeHandle = OpenPipe(name);
+	return pipeHandle != INVALID_HANDLE_VALUE && TryCreateEvents();
+}
+
+bool TransportIsConnected()
+{
+	return pipeHandle != INVALID_HANDLE_VALUE;
+}
+
+bool TransportWrite(const char *message, DWORD messageLength)
+{
+	DWORD bytesWritten;
+	if (!WriteFile(pipeHandle, message, messageLength, NULL, &writeOverlapped) &&
+		GetLastError() != ERROR_IO_PENDING)
+	{
+		return false;
+	}
+
+	return GetOverlappedResult(pipeHandle, &writeOverlapped, &bytesWritten, TRUE) && bytesWritten == messageLength;
+}
+
+static int TransportReceive(DWORD timeoutMs)
+{
+	// Keep a single read outstanding.  responseBuffer is only compacted (or grown) when no read is pending,
+	// as the pending read writes to a fixed location in the buffer.
+	if (!readPending)
+	{
+		if (!TryMakeRoomInResponseBuffer())
+		{
+			return -1;
+		}
+
+		if (!ReadFile(pipeHandle, responseBuffer + responseEnd, responseBufferLength - responseEnd, NULL, &readOverlapped) &&
+			GetLastError() != ERROR_IO_PENDING &&
+			GetLastError() != ERROR_MORE_DATA)
+		{
+			return -1;
+		}
+
+		readPending = true;
+	}
+
+	if (WaitForSingleObject(readOverlapped.hEvent, timeoutMs) == WAIT_TIMEOUT)
+	{
+		return 0;
+	}
+
+	readPending = false;
+	DWORD bytesRead;
+	if ((!GetOverlappedResult(pipeHandle, &readOverlapped, &bytesRead, FALSE) && GetLastError() != ERROR_MORE_DATA) || bytesRead == 0)
+	{
+		return -1;
+	}
+
+	responseEnd += bytesRead;
+	return 1;
+}
+
+int TransportLastError()
+{
+	return (int)GetLastError();
+}
+
+void TransportClose()
+{
+	CloseHandle(pipeHandle);
+	pipeHandle = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+static int socketFd = -1;
+
+static bool TryOpenSocket(const TransportName &name, int *error)
+{
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (name.length() >= sizeof(address.sun_path))
+	{
+		*error = ENAMETOOLONG;
+		return false;
+	}
+
+	memcpy(address.sun_path, name.c_str(), name.length());
+	socketFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (socketFd < 0)
+	{
+		*error = errno;
+		return false;
+	}
+
+	if (connect(socketFd, (const sockaddr *)&address, sizeof(address)) != 0)
+	{
+		*error = errno;
+		close(socketFd);
+		socketFd = -1;
+		return false;
+	}
+
+	return true;
+}
+
+void TransportConnect(const TransportName &name)
+{
+	// Like WaitNamedPipe, keep retrying for a while if the server has not started listening yet
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(CONNECT_TIMEOUT_MS);
+	int error;
+	while (!TryOpenSocket(name, &error))
+	{
+		if (error != ENOENT && error != ECONNREFUSED && error != EAGAIN)
+		{
+			die(ReturnCode::PipeConnectError, "Could not open socket: %s, Error: %d\n", name.c_str(), error);
+		}
+
+		if (std::chrono::steady_clock::now() >= deadline)
+		{
+			die(ReturnCode::PipeConnectTimeout, "Could not open socket: %s, Timed out.", name.c_str());
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+}
+
+bool TransportTryConnect(const TransportName &name)
+{
+	int error;
+	return TryOpenSocket(name, &error);
+}
+
+bool TransportIsConnected()
+{
+	return socketFd >= 0;
+}
+
+bool TransportWrite(const char *message, DWORD messageLength)
+{
+	DWORD written = 0;
+	while (written < messageLength)
+	{
+		ssize_t bytesWritten = send(socketFd, message + written, messageLength - written, MSG_NOSIGNAL);
+		if (bytesWritten < 0 && errno == EINTR)
+		{
+			continue;
+		}
+
+		if (bytesWritten <= 0)
+		{
+			return false;
+		}
+
+		written += (DWORD)bytesWritten;
+	}
+
+	return true;
+}
+
+static int TransportReceive(DWORD timeoutMs)
+{
+	if (!TryMakeRoomInResponseBuffer())
+	{
+		return -1;
+	}
+
+	pollfd pollSocket = { socketFd, POLLIN, 0 };
+	int ready = poll(&pollSocket, 1, timeoutMs == INFINITE ? -1 : (int)timeoutMs);
+	if (ready == 0 || (ready < 0 && errno == EINTR))
+	{
+		return 0;
+	}
+
+	ssize_t bytesRead = ready < 0 ? -1 : recv(socketFd, responseBuffer + responseEnd, responseBufferLength - responseEnd, 0);
+	if (bytesRead <= 0)
+	{
+		return -1;
+	}
+
+	responseEnd += (DWORD)bytesRead;
+	return 1;
+}
+
+int TransportLastError()
+{
+	return errno;
+}
+
+void TransportClose()
+{
+	close(socketFd);
+	socketFd = -1;
+}
+
+#endif
+
+int TransportReadLine(char **line, DWORD timeoutMs)
+{
+	// scanned is relative to responseStart, so that it is still correct after the buffer is compacted
+	DWORD scanned = 0;
+	while (1)
+	{
+		char *start = responseBuffer + responseStart;
+		DWORD available = responseEnd - responseStart;
+		char *newline = available > scanned ? (char *)memchr(start + scanned, '\n', available - scanned) : NULL;
+		if (newline != NULL)
+		{
+			*newline = 0;
+			responseStart = (DWORD)(newline + 1 - responseBuffer);
+			*line = start;
+			return 1;
+		}
+
+		scanned = available;
+		int received = TransportReceive(timeoutMs);
+		if (received <= 0)
+		{
+			return received;
+		}
+	}
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+// The connection from GVFS.ReadObjectHook to GVFS.  On Windows this is the mount's named pipe, opened for
+// overlapped I/O so that a read can be pending while requests are written.  On other platforms there is no
+// mount, and the hook connects to GVFS.ReadObjectHook.StandInServer over a Unix domain socket instead.
+// Messages are newline terminated in both directions (see NamedPipeMessages in GVFS.Common).
+
+#ifdef _WIN32
+typedef std::wstring TransportName;
+#else
+typedef std::string TransportName;
+#endif
+
+// Connect, waiting for the server if it is busy, and die if the connection cannot be made
+void TransportConnect(const TransportName &name);
+
+// Connect without waiting, returns false on failure rather than calling die (used at exit)
+bool TransportTryConnect(const TransportName &name);
+
+bool TransportIsConnected();
+bool TransportWrite(const char *message, DWORD messageLength);
+
+// Wait up to timeoutMs for a complete response line.  On success *line points to the null terminated
+// line (without its newline), which is valid until the next call.  Returns 1 when a line was read,
+// 0 if timeoutMs elapsed first, and -1 if the connection failed.
+int TransportReadLine(char **line, DWORD timeoutMs);
+
+// The error code (GetLastError or errno) from the last failed call
+int TransportLastError();
+
+void TransportClose();
@@ -22,6 +22,35 @@ namespace GVFS.UnitTests.CommandLine
                 () => HooksInstaller.MergeHooksData(new string[] { "first", "gvfs.hooks.exe" }, Filename, GVFSConstants.DotGit.Hooks.PreCommandHookName));
         }
 
+        [TestCase]
+        [Category(CategoryConstants.ExceptionExpected)]
+        public void MergeHooksDataThrowsOnFoundGVFSHooksWithCommandFilter()
+        {
+            Assert.Throws<HooksInstaller.HooksConfigurationException>(
+                () => HooksInstaller.MergeHooksData(new string[] { "first", "gvfs.hooks.exe|status" }, Filename, GVFSConstants.DotGit.Hooks.PreCommandHookName));
+        }
+
+        [TestCase]
+        [Category(CategoryConstants.ExceptionExpected)]
+        public void MergeHooksDataThrowsOnFoundParallelGVFSHooks()
+        {
+            Assert.Throws<HooksInstaller.HooksConfigurationException>(
+                () => HooksInstaller.MergeHooksData(new string[] { "&first", "& gvfs.hooks.exe|status" }, Filename, GVFSConstants.DotGit.Hooks.PreCommandHookName));
+        }
+
+        [TestCase]
+        public void MergeHooksDataKeepsCommandFilters()
+        {
+            string result = HooksInstaller.MergeHooksData(new string[] { "first|checkout,!status" }, Filename, GVFSConstants.DotGit.Hooks.PreCommandHookName);
+            IEnumerable<string> resultLines = result
+                .Split(new char[] { '\n', '\r' }, StringSplitOptions.RemoveEmptyEntries)
+                .Where(line => !line.StartsWith("#"));
+
+            resultLines.Count().ShouldEqual(2);
+            resultLines.ElementAt(0).ShouldEqual("first|checkout,!status");
+            resultLines.ElementAt(1).ShouldEqual(GVFSConstants.GVFSHooksExecutableName);
+        }
+
         [TestCase]
         public void MergeHooksDataEmptyConfig()
         {
@@ -0,0 +1,345 @@
+﻿using GVFS.Common.Git;
+using GVFS.GVFlt.DotGit;
+using GVFS.Tests.Should;
+using GVFS.UnitTests.Mock.Common;
+using NUnit.Framework;
+using System.Collections.Generic;
+using System.IO;
+using System.Linq;
+using System.Security.Cryptography;
+using System.Text;
+
+namespace GVFS.UnitTests.GVFlt.DotGit
+{
+    [TestFixture]
+    public class GitIndexProjectionTests
+    {
+        private const ushort ExtendedBit = 0x4000;
+        private const ushort SkipWorktreeBit = 0x4000;
+        private const int MergeStageShift = 12;
+        private const int NoConflicts = 0;
+        private const int CommonAncestor = 1;
+        private const int Yours = 2;
+        private const int Theirs = 3;
+
+        private static readonly IndexEntry[] BaseIndex = new IndexEntry[]
+        {
+            new IndexEntry("A/B/file1.txt"),
+            new IndexEntry("A/B/file2.txt"),
+            new IndexEntry("A/C.txt"),
+            new IndexEntry("A/D/x"),
+            new IndexEntry("notprojected.txt", skipWorktree: false),
+            new IndexEntry("readme"),
+            new IndexEntry("z/old.txt"),
+        };
+
+        [TestCase]
+        public void AddedFilesAreProjected()
+        {
+            AssertUpdateMatchesRebuild(
+                BaseIndex,
+                Insert(BaseIndex, new IndexEntry("A/B/file3.txt"), new IndexEntry("new/folder/n.txt")),
+                "A\\B\\file3.txt",
+                "new\\folder\\n.txt");
+        }
+
+        [TestCase]
+        public void RemovedFilesAndTheFoldersTheyEmptyAreNotProjected()
+        {
+            AssertUpdateMatchesRebuild(
+                BaseIndex,
+                Remove(BaseIndex, "A/B/file1.txt", "z/old.txt"),
+                "A\\B\\file1.txt",
+                "z\\old.txt");
+        }
+
+        [TestCase]
+        public void ModifiedFilesHaveTheirNewSha()
+        {
+            AssertUpdateMatchesRebuild(
+                BaseIndex,
+                Replace(BaseIndex, new IndexEntry("A/C.txt", content: "modified")),
+                "A\\C.txt");
+        }
+
+        [TestCase]
+        public void FilesCanReplaceFoldersAndFoldersCanReplaceFiles()
+        {
+            IndexEntry[] current = Insert(
+                Remove(BaseIndex, "A/D/x", "readme"),
+                new IndexEntry("A/D"),
+                new IndexEntry("readme/inner.txt"));
+
+            AssertUpdateMatchesRebuild(BaseIndex, current, "A\\D", "A\\D\\x", "readme", "readme\\inner.txt");
+            AssertUpdateMatchesRebuild(current, BaseIndex, "A\\D", "A\\D\\x", "readme", "readme\\inner.txt");
+        }
+
+        [TestCase]
+        public void SkipWorktreeChangesWhetherFilesAreProjected()
+        {
+            IndexEntry[] current = Replace(
+                BaseIndex,
+                new IndexEntry("A/C.txt", skipWorktree: false),
+                new IndexEntry("notprojected.txt"));
+
+            AssertUpdateMatchesRebuild(BaseIndex, current, "A\\C.txt", "notprojected.txt");
+            AssertUpdateMatchesRebuild(current, BaseIndex, "A\\C.txt", "notprojected.txt");
+        }
+
+        [TestCase]
+        public void MergeConflictsProjectYourVersion()
+        {
+            IndexEntry[] conflicted = Insert(
+                Remove(BaseIndex, "A/C.txt", "readme"),
+                new IndexEntry("A/C.txt", content: "base", skipWorktree: false, stage: CommonAncestor),
+                new IndexEntry("A/C.txt", content: "yours", skipWorktree: false, stage: Yours),
+                new IndexEntry("A/C.txt", content: "theirs", skipWorktree: false, stage: Theirs),
+                new IndexEntry("readme", content: "base", skipWorktree: false, stage: CommonAncestor),
+                new IndexEntry("readme", content: "theirs", skipWorktree: false, stage: Theirs));
+
+            // readme was deleted by "yours", and so is not projected while it is in conflict
+            AssertUpdateMatchesRebuild(BaseIndex, conflicted, "A\\C.txt", "readme");
+
+            IndexEntry[] resolved = Replace(BaseIndex, new IndexEntry("A/C.txt", content: "resolved", skipWorktree: false, stage: NoConflicts));
+            AssertUpdateMatchesRebuild(conflicted, resolved, "A\\C.txt", "readme");
+        }
+
+        [TestCase]
+        public void AllKindsOfChangesCanBeMadeTogether()
+        {
+            IndexEntry[] current = new IndexEntry[]
+            {
+                new IndexEntry("A/B/file2.txt", content: "modified"),
+                new IndexEntry("A/B/file3.txt"),
+                new IndexEntry("A/C.txt", content: "yours", skipWorktree: false, stage: Yours),
+                new IndexEntry("A/C.txt", content: "theirs", skipWorktree: false, stage: Theirs),
+                new IndexEntry("A/D"),
+                new IndexEntry("notprojected.txt"),
+                new IndexEntry("readme/inner.txt"),
+                new IndexEntry("z/old.txt", skipWorktree: false),
+            };
+
+            AssertUpdateMatchesRebuild(BaseIndex, current);
+            AssertUpdateMatchesRebuild(current, BaseIndex);
+        }
+
+        [TestCase]
+        public void TooManyChangesAreNotApplied()
+        {
+            IndexEntry[] current = Insert(BaseIndex, new IndexEntry("A/B/file3.txt"), new IndexEntry("A/B/file4.txt"));
+            using (TestIndex previousIndex = new TestIndex(BaseIndex))
+            using (TestIndex currentIndex = new TestIndex(current))
+            {
+                List<GitIndexProjection.IndexEntryChange> changes = new List<GitIndexProjection.IndexEntryChange>();
+                GitIndexProjection.TryGetProjectedEntryChanges(previousIndex.Reader, currentIndex.Reader, 1, changes).ShouldBeFalse();
+            }
+        }
+
+        [TestCase]
+        public void NamesThatOnlyDifferByCaseAreNotApplied()
+        {
+            // RebuildProjection merges "a" into the folder named "A", which is left to a rebuild rather than updated
+            IndexEntry[] current = Insert(BaseIndex, new IndexEntry("a/new.txt"));
+            using (TestIndex previousIndex = new TestIndex(BaseIndex))
+            using (TestIndex currentIndex = new TestIndex(current))
+            {
+                List<GitIndexProjection.IndexEntryChange> changes = new List<GitIndexProjection.IndexEntryChange>();
+                GitIndexProjection.TryGetProjectedEntryChanges(previousIndex.Reader, currentIndex.Reader, int.MaxValue, changes).ShouldBeTrue();
+
+                ProjectionTree tree = previousIndex.BuildProjection().Clone();
+                GitIndexProjection.TryApplyProjectedEntryChanges(tree, changes, new GitIndexProjection.ProjectionChanges()).ShouldBeFalse();
+            }
+        }
+
+        /// <summary>
+        /// Checks that updating the projection of previous for the changes in current gives the same tree as building the
+        /// projection of current, and that the original projection is not changed
+        /// </summary>
+        private static void AssertUpdateMatchesRebuild(IndexEntry[] previous, IndexEntry[] current, params string[] expectedChangedFiles)
+        {
+            using (TestIndex previousIndex = new TestIndex(previous))
+            using (TestIndex currentIndex = new TestIndex(current))
+            {
+                List<GitIndexProjection.IndexEntryChange> changes = new List<GitIndexProjection.IndexEntryChange>();
+                GitIndexProjection.TryGetProjectedEntryChanges(previousIndex.Reader, currentIndex.Reader, int.MaxValue, changes).ShouldBeTrue();
+
+                ProjectionTree previousTree = previousIndex.BuildProjection();
+                string previousDescription = GetDescription(previousTree, ProjectionTree.RootIndex);
+
+                ProjectionTree updatedTree = previousTree.Clone();
+                GitIndexProjection.ProjectionChanges projectionChanges = new GitIndexProjection.ProjectionChanges();
+                GitIndexProjection.TryApplyProjectedEntryChanges(updatedTree, changes, projectionChanges).ShouldBeTrue();
+
+                GetDescription(updatedTree, ProjectionTree.RootIndex).ShouldEqual(GetDescription(currentIndex.BuildProjection(), ProjectionTree.RootIndex));
+                updatedTree.Count.ShouldEqual(currentIndex.BuildProjection().Count);
+                GetDescription(previousTree, ProjectionTree.RootIndex).ShouldEqual(previousDescription);
+
+                if (expectedChangedFiles.Length > 0)
+                {
+                    projectionChanges.FilePaths.OrderBy(path => path).ShouldMatchInOrder(expectedChangedFiles.OrderBy(path => path));
+                }
+            }
+        }
+
+        private static IndexEntry[] Insert(IndexEntry[] entries, params IndexEntry[] newEntries)
+        {
+            return entries.Concat(newEntries).OrderBy(entry => entry.PathBytes, new ByteComparer()).ThenBy(entry => entry.Stage).ToArray();
+        }
+
+        private static IndexEntry[] Remove(IndexEntry[] entries, params string[] paths)
+        {
+            return entries.Where(entry => !paths.Contains(entry.Path)).ToArray();
+        }
+
+        private static IndexEntry[] Replace(IndexEntry[] entries, params IndexEntry[] newEntries)
+        {
+            return Insert(Remove(entries, newEntries.Select(entry => entry.Path).ToArray()), newEntries);
+        }
+
+        private static string GetDescription(ProjectionTree tree, int index)
+        {
+            if (!tree.IsFolder(index))
+            {
+                return tree.GetName(index) + " " + tree.GetSha(index);
+            }
+
+            int firstChild = tree.GetFirstChild(index);
+            IEnumerable<string> children = Enumerable.Range(firstChild, tree.GetChildCount(index)).Select(child => GetDescription(tree, child));
+            return tree.GetName(index) + "(" + string.Join(", ", children) + ")";
+        }
+
+        private static void WriteUInt32(Stream stream, uint value)
+        {
+            WriteUInt16(stream, (ushort)(value >> 16));
+            WriteUInt16(stream, (ushort)value);
+        }
+
+        private static void WriteUInt16(Stream stream, ushort value)
+        {
+            stream.WriteByte((byte)(value >> 8));
+            stream.WriteByte((byte)value);
+        }
+
+        private class IndexEntry
+        {
+            public IndexEntry(string path, string content = null, bool skipWorktree = true, int stage = NoConflicts)
+            {
+                this.Path = path;
+                this.PathBytes = Encoding.UTF8.GetBytes(path);
+                this.SkipWorktree = skipWorktree;
+                this.Stage = stage;
+                using (SHA1 sha1 = SHA1.Create())
+                {
+                    this.Sha = sha1.ComputeHash(Encoding.UTF8.GetBytes(path + ":" + (content ?? string.Empty)));
+                }
+            }
+
+            public string Path { get; }
+            public byte[] PathBytes { get; }
+            public byte[] Sha { get; }
+            public bool SkipWorktree { get; }
+            public int Stage { get; }
+        }
+
+        /// <summary>
+        /// A version 3 index of entries, written to a temporary file
+        /// </summary>
+        private class TestIndex : System.IDisposable
+        {
+            private string path;
+            private FileStream stream;
+
+            public TestIndex(IndexEntry[] entries)
+            {
+                this.path = System.IO.Path.GetTempFileName();
+                File.WriteAllBytes(this.path, CreateIndex(entries));
+                this.stream = new FileStream(this.path, FileMode.Open, FileAccess.Read, FileShare.Read);
+                this.Reader = new GitIndexReader(this.stream);
+            }
+
+            public GitIndexReader Reader { get; }
+
+            /// <summary>
+            /// Builds the projection of the index in the same way that RebuildProjection does
+            /// </summary>
+            public ProjectionTree BuildProjection()
+            {
+                ProjectionTree.Builder builder = new ProjectionTree.Builder(new MockTracer(), (int)this.Reader.EntryCount);
+                foreach (GitIndexEntry entry in this.Reader.EnumerateEntries())
+                {
+                    if (entry.SkipWorktree)
+                    {
+                        builder.AddFile(entry.PathBuffer, entry.PathLength, entry.Sha, entry.Offset);
+                    }
+                    else if (entry.MergeStage == Yours)
+                    {
+                        builder.AddFile(entry.PathBuffer, entry.PathLength, entry.Sha, ProjectionTree.InvalidOffset);
+                    }
+                }
+
+                return builder.Finish();
+            }
+
+            public void Dispose()
+            {
+                this.Reader.Dispose();
+                this.stream.Dispose();
+                File.Delete(this.path);
+            }
+
+            private static byte[] CreateIndex(IndexEntry[] entries)
+            {
+                using (MemoryStream index = new MemoryStream())
+                {
+                    index.Write(Encoding.ASCII.GetBytes("DIRC"), 0, 4);
+                    WriteUInt32(index, 3);
+                    WriteUInt32(index, (uint)entries.Length);
+
+                    foreach (IndexEntry entry in entries)
+                    {
+                        long entryStart = index.Position;
+
+                        // ctime through size, and then the SHA
+                        index.Write(new byte[40], 0, 40);
+                        index.Write(entry.Sha, 0, entry.Sha.Length);
+
+                        ushort flags = (ushort)(entry.PathBytes.Length | (entry.Stage << MergeStageShift));
+                        if (entry.SkipWorktree)
+                        {
+                            flags |= ExtendedBit;
+                        }
+
+                        WriteUInt16(index, flags);
+                        if (entry.SkipWorktree)
+                        {
+                            WriteUInt16(index, SkipWorktreeBit);
+                        }
+
+                        index.Write(entry.PathBytes, 0, entry.PathBytes.Length);
+                        long entryLength = index.Position - entryStart;
+                        index.Write(new byte[8], 0, (int)(8 - (entryLength % 8)));
+                    }
+
+                    index.Write(new byte[20], 0, 20);
+                    return index.ToArray();
+                }
+            }
+        }
+
+        private class ByteComparer : IComparer<byte[]>
+        {
+            public int Compare(byte[] x, byte[] y)
+            {
+                for (int i = 0; i < x.Length && i < y.Length; ++i)
+                {
+                    if (x[i] != y[i])
+                    {
+                        return x[i] - y[i];
+                    }
+                }
+
+                return x.Length - y.Length;
+            }
+        }
+    }
+}
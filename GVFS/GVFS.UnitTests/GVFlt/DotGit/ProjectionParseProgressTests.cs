@@ -0,0 +1,180 @@
+﻿using GVFS.Common.Git;
+using GVFS.Common.Tracing;
+using GVFS.GVFlt.DotGit;
+using GVFS.Tests.Should;
+using GVFS.UnitTests.Mock.Common;
+using NUnit.Framework;
+using System.Linq;
+using System.Text;
+using System.Threading;
+using System.Threading.Tasks;
+
+namespace GVFS.UnitTests.GVFlt.DotGit
+{
+    [TestFixture]
+    public class ProjectionParseProgressTests
+    {
+        private const int MaxWaitMs = 10000;
+
+        [TestCase]
+        public void FoldersAreServedOnceTheParseIsPastThem()
+        {
+            ProjectionParseProgress progress = new ProjectionParseProgress();
+            ProjectionTree.Builder builder = CreateBuilder(progress);
+            AddFile(builder, "a/b/file1.txt");
+            AddFile(builder, "a/b/file2.txt");
+
+            Task<string> waitForB = StartWaiting(progress, "a\\b", lookupCount: 1);
+
+            AddFile(builder, "a/c/file3.txt");
+            waitForB.Wait(MaxWaitMs).ShouldBeTrue();
+            waitForB.Result.ShouldEqual("file1.txt, file2.txt");
+
+            // The parse is past every path that could be in a\a, and so it is not in the projection
+            ProjectionTree tree;
+            int folderIndex;
+            progress.TryWaitForFolder("a\\a", 3, out tree, out folderIndex).ShouldBeTrue();
+            tree.ShouldBeNull();
+
+            // Paths with upper case letters wait until the parse is past their lower case form
+            Task<string> waitForUpperCaseC = StartWaiting(progress, "A\\C", lookupCount: 3);
+            AddFile(builder, "d/file4.txt");
+            waitForUpperCaseC.Wait(MaxWaitMs).ShouldBeTrue();
+            waitForUpperCaseC.Result.ShouldEqual("file3.txt");
+
+            // The root folder, and folders that could have more children in the next block, wait for the whole parse
+            Task<string> waitForRoot = StartWaiting(progress, string.Empty, lookupCount: 4);
+            Task<string> waitForD = StartWaiting(progress, "d", lookupCount: 5);
+            builder.Finish();
+            waitForRoot.IsCompleted.ShouldBeFalse();
+            waitForD.IsCompleted.ShouldBeFalse();
+
+            progress.Complete();
+            waitForRoot.Wait(MaxWaitMs).ShouldBeTrue();
+            waitForRoot.Result.ShouldBeNull();
+            waitForD.Wait(MaxWaitMs).ShouldBeTrue();
+            waitForD.Result.ShouldBeNull();
+
+            EventMetadata metadata = GetStats(progress);
+            metadata["FolderLookups"].ShouldEqual(5);
+            metadata["LookupsThatWaited"].ShouldEqual(4);
+            metadata["LookupsThatWaitedForFullParse"].ShouldEqual(2);
+        }
+
+        [TestCase]
+        public void FoldersInTheIndexWithMoreThanOneCaseWaitForTheWholeParse()
+        {
+            ProjectionParseProgress progress = new ProjectionParseProgress();
+            ProjectionTree.Builder builder = CreateBuilder(progress);
+            AddFile(builder, "A/file1.txt");
+            AddFile(builder, "D/file2.txt");
+            AddFile(builder, "a/file3.txt");
+            AddFile(builder, "e/file4.txt");
+
+            // D is only in the index once, but paths in d could still follow until the parse is past d
+            Task<string> waitForD = StartWaiting(progress, "d", lookupCount: 1);
+            AddFile(builder, "f/file5.txt");
+            waitForD.Wait(MaxWaitMs).ShouldBeTrue();
+            waitForD.Result.ShouldEqual("file2.txt");
+
+            // The parse is past a as well, but A has more children than were added with either case
+            Task<string> waitForA = StartWaiting(progress, "A", lookupCount: 2);
+
+            builder.Finish();
+            progress.Complete();
+            waitForA.Wait(MaxWaitMs).ShouldBeTrue();
+            waitForA.Result.ShouldBeNull();
+        }
+
+        [TestCase]
+        public void OnlyTheFirstUnfinishedBlockMovesTheParseForward()
+        {
+            ProjectionParseProgress progress = new ProjectionParseProgress();
+            progress.Start(blockCount: 2);
+
+            ProjectionTree.Builder firstBlock = CreateBuilder(progress, blockIndex: 0);
+            ProjectionTree.Builder secondBlock = CreateBuilder(progress, blockIndex: 1);
+            AddFile(firstBlock, "a/file1.txt");
+            AddFile(firstBlock, "b/file2.txt");
+            AddFile(secondBlock, "b/file3.txt");
+            AddFile(secondBlock, "c/file4.txt");
+            AddFile(secondBlock, "d/file5.txt");
+
+            Task<string> waitForB = StartWaiting(progress, "b", lookupCount: 1);
+            Task<string> waitForC = StartWaiting(progress, "c", lookupCount: 2);
+            GetChildNames(progress, "a").ShouldEqual("file1.txt");
+
+            // b is in both blocks, and so it waits for the whole parse
+            firstBlock.Finish();
+            progress.FinishBlock(0);
+            waitForC.Wait(MaxWaitMs).ShouldBeTrue();
+            waitForC.Result.ShouldEqual("file4.txt");
+            waitForB.IsCompleted.ShouldBeFalse();
+
+            secondBlock.Finish();
+            progress.FinishBlock(1);
+            progress.Complete();
+            waitForB.Wait(MaxWaitMs).ShouldBeTrue();
+            waitForB.Result.ShouldBeNull();
+        }
+
+        private static ProjectionTree.Builder CreateBuilder(ProjectionParseProgress progress, int blockIndex = 0)
+        {
+            ProjectionTree.Builder builder = new ProjectionTree.Builder(new MockTracer(), estimatedEntryCount: 0);
+            builder.FolderAdded = (tree, folderPath, folderIndex, isParsedPast) =>
+                progress.AddFolder(blockIndex, tree, folderPath, folderIndex, isParsedPast);
+            return builder;
+        }
+
+        /// <summary>
+        /// Looks up folderPath on another thread, and returns once that thread is waiting (which it is once it has made
+        /// the lookupCount-th lookup)
+        /// </summary>
+        private static Task<string> StartWaiting(ProjectionParseProgress progress, string folderPath, int lookupCount)
+        {
+            Task<string> lookup = Task.Run(() => GetChildNames(progress, folderPath));
+            while ((int)GetStats(progress)["FolderLookups"] < lookupCount)
+            {
+                Thread.Sleep(1);
+            }
+
+            lookup.IsCompleted.ShouldBeFalse();
+            return lookup;
+        }
+
+        private static EventMetadata GetStats(ProjectionParseProgress progress)
+        {
+            EventMetadata metadata = new EventMetadata();
+            progress.AddStatsToTelemetry(metadata);
+            return metadata;
+        }
+
+        private static void AddFile(ProjectionTree.Builder builder, string path)
+        {
+            byte[] pathBuffer = Encoding.UTF8.GetBytes(path);
+            builder.AddFile(pathBuffer, pathBuffer.Length, new byte[20], offset: 0);
+        }
+
+        /// <returns>
+        /// The names of the folder's children, "missing" if the folder is not in the projection, or null if the caller
+        /// must wait for the whole projection
+        /// </returns>
+        private static string GetChildNames(ProjectionParseProgress progress, string folderPath)
+        {
+            ProjectionTree tree;
+            int folderIndex;
+            if (!progress.TryWaitForFolder(folderPath, folderPath.Length, out tree, out folderIndex))
+            {
+                return null;
+            }
+
+            if (tree == null)
+            {
+                return "missing";
+            }
+
+            int firstChild = tree.GetFirstChild(folderIndex);
+            return string.Join(", ", Enumerable.Range(firstChild, tree.GetChildCount(folderIndex)).Select(tree.GetName));
+        }
+    }
+}
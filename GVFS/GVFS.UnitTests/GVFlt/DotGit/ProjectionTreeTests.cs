@@ -0,0 +1,434 @@
+﻿using GVFS.Common.Git;
+using GVFS.GVFlt.DotGit;
+using GVFS.Tests.Should;
+using GVFS.UnitTests.Category;
+using GVFS.UnitTests.Mock.Common;
+using NUnit.Framework;
+using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Linq;
+using System.Text;
+
+namespace GVFS.UnitTests.GVFlt.DotGit
+{
+    [TestFixture]
+    public class ProjectionTreeTests
+    {
+        private static readonly string[] IndexPaths = new string[]
+        {
+            ".gitattributes",
+            "A/B/file1.txt",
+            "A/B/file2.txt",
+            "A/C.txt",
+            "A/D/E/file3.txt",
+            "Readme.md",
+            "a/b/file4.txt",
+            "a/c.TXT",
+            "b.txt",
+            "z/file5.txt",
+        };
+
+        [TestCase]
+        public void ChildrenAreSortedIgnoringCase()
+        {
+            ProjectionTree tree = BuildTree(new MockTracer(), "B.txt", "Z/a.txt", "a.txt", "c/x.txt", "c/W.txt");
+
+            GetChildNames(tree, ProjectionTree.RootIndex).ShouldMatchInOrder(new string[] { "a.txt", "B.txt", "c", "Z" });
+            GetChildNames(tree, GetIndex(tree, "c")).ShouldMatchInOrder(new string[] { "W.txt", "x.txt" });
+            tree.Count.ShouldEqual(7);
+        }
+
+        [TestCase]
+        public void FoldersWithTheSameNameAreMerged()
+        {
+            MockTracer tracer = new MockTracer();
+            ProjectionTree tree = BuildTree(tracer, IndexPaths);
+
+            GetChildNames(tree, ProjectionTree.RootIndex).ShouldMatchInOrder(new string[] { ".gitattributes", "A", "b.txt", "Readme.md", "z" });
+            GetChildNames(tree, GetIndex(tree, "A")).ShouldMatchInOrder(new string[] { "B", "C.txt", "D" });
+            GetChildNames(tree, GetIndex(tree, "A/B")).ShouldMatchInOrder(new string[] { "file1.txt", "file2.txt", "file4.txt" });
+
+            // a/c.TXT is a duplicate of A/C.txt
+            tracer.RelatedWarningEvents.Count.ShouldEqual(1);
+            GetDescription(tree, GetIndex(tree, "A/C.txt")).ShouldEqual("C.txt " + CreateSha("A/C.txt"));
+        }
+
+        [TestCase]
+        public void TryGetChildIgnoresCase()
+        {
+            ProjectionTree tree = BuildTree(new MockTracer(), IndexPaths);
+
+            int folderIndex;
+            tree.TryGetChild(ProjectionTree.RootIndex, "a", out folderIndex).ShouldBeTrue();
+            tree.IsFolder(folderIndex).ShouldBeTrue();
+            tree.GetName(folderIndex).ShouldEqual("A");
+            tree.NameEquals(folderIndex, "a").ShouldBeFalse();
+            tree.NameEquals(folderIndex, "A").ShouldBeTrue();
+
+            int fileIndex;
+            tree.TryGetChild(folderIndex, "xc.TXTx", 1, 5, out fileIndex).ShouldBeTrue();
+            tree.IsFolder(fileIndex).ShouldBeFalse();
+            tree.GetSha(fileIndex).ToString().ShouldEqual(CreateSha("A/C.txt"));
+
+            byte[] path = Encoding.UTF8.GetBytes("a/d/e");
+            tree.TryGetFolder(path, path.Length, out folderIndex).ShouldBeTrue();
+            GetChildNames(tree, folderIndex).ShouldMatchInOrder(new string[] { "file3.txt" });
+
+            tree.TryGetChild(ProjectionTree.RootIndex, "B", out fileIndex).ShouldBeFalse();
+            tree.TryGetFolder(path, 3, out folderIndex).ShouldBeTrue();
+            tree.TryGetFolder(Encoding.UTF8.GetBytes("b.txt"), 5, out folderIndex).ShouldBeFalse();
+        }
+
+        [TestCase]
+        public void NonAsciiNamesAreSortedLikeStringComparer()
+        {
+            string[] names = new string[] { "e.txt", "f.txt", "z.txt", "É.txt", "éa.txt", "ä.txt", "_.txt", "日本.txt" };
+            ProjectionTree tree = BuildTree(new MockTracer(), names.OrderBy(name => Encoding.UTF8.GetBytes(name), new ByteComparer()).ToArray());
+
+            GetChildNames(tree, ProjectionTree.RootIndex).ShouldMatchInOrder(names.OrderBy(name => name, StringComparer.OrdinalIgnoreCase));
+
+            int fileIndex;
+            tree.TryGetChild(ProjectionTree.RootIndex, "ÉA.TXT", out fileIndex).ShouldBeTrue();
+            tree.GetName(fileIndex).ShouldEqual("éa.txt");
+        }
+
+        [TestCase]
+        public void MergingBlocksMatchesBuildingOneTree()
+        {
+            MockTracer tracer = new MockTracer();
+            string expected = GetDescription(BuildTree(tracer, IndexPaths), ProjectionTree.RootIndex);
+
+            for (int firstSplit = 1; firstSplit < IndexPaths.Length; ++firstSplit)
+            {
+                for (int secondSplit = firstSplit; secondSplit < IndexPaths.Length; ++secondSplit)
+                {
+                    List<ProjectionTree> blocks = new List<ProjectionTree>()
+                    {
+                        BuildTree(tracer, IndexPaths.Take(firstSplit).ToArray()),
+                        BuildTree(tracer, IndexPaths.Skip(firstSplit).Take(secondSplit - firstSplit).ToArray()),
+                        BuildTree(tracer, IndexPaths.Skip(secondSplit).ToArray()),
+                    };
+
+                    ProjectionTree tree = ProjectionTree.Builder.Merge(tracer, blocks);
+                    GetDescription(tree, ProjectionTree.RootIndex).ShouldEqual(expected);
+                    tree.Count.ShouldEqual(14);
+                }
+            }
+        }
+
+        [TestCase]
+        [Category(CategoryConstants.ExceptionExpected)]
+        public void FileWhereFolderIsExpectedThrows()
+        {
+            Assert.Throws<InvalidDataException>(() => BuildTree(new MockTracer(), "A", "a/file.txt"));
+        }
+
+        [TestCase]
+        public void FileAfterFolderWithTheSameNameIsSkipped()
+        {
+            // An index from a case sensitive file system can have a folder and a file whose names only differ by case
+            MockTracer tracer = new MockTracer();
+            ProjectionTree tree = BuildTree(tracer, "B/x", "b");
+
+            GetChildNames(tree, ProjectionTree.RootIndex).ShouldMatchInOrder(new string[] { "B" });
+            GetChildNames(tree, GetIndex(tree, "B")).ShouldMatchInOrder(new string[] { "x" });
+            tree.Count.ShouldEqual(2);
+            tracer.RelatedWarningEvents.Count.ShouldEqual(1);
+        }
+
+        [TestCase]
+        public void FilesAndFoldersCanBeAddedAndRemoved()
+        {
+            ProjectionTree tree = BuildTree(new MockTracer(), IndexPaths);
+            int count = tree.Count;
+
+            int folderIndex = tree.AddFolder(GetIndex(tree, "A/B"), "New");
+            int fileIndex = tree.SetFile(folderIndex, "new.txt", new Sha1Id(CreateSha("new")), offset: 10);
+            tree.GetOffset(fileIndex).ShouldEqual(10);
+            tree.Count.ShouldEqual(count + 2);
+            GetChildNames(tree, GetIndex(tree, "A/B")).ShouldMatchInOrder(new string[] { "file1.txt", "file2.txt", "file4.txt", "New" });
+            GetDescription(tree, GetIndex(tree, "a/b/new/NEW.txt")).ShouldEqual("new.txt " + CreateSha("new"));
+
+            // Replacing a file keeps its name
+            tree.SetFile(GetIndex(tree, "A"), "c.txt", new Sha1Id(CreateSha("changed")), ProjectionTree.InvalidOffset);
+            tree.Count.ShouldEqual(count + 2);
+            GetDescription(tree, GetIndex(tree, "A/C.txt")).ShouldEqual("C.txt " + CreateSha("changed"));
+
+            tree.RemoveChild(GetIndex(tree, "A/B"), GetIndex(tree, "A/B/file2.txt"));
+            tree.RemoveChild(ProjectionTree.RootIndex, GetIndex(tree, "A"));
+            GetChildNames(tree, ProjectionTree.RootIndex).ShouldMatchInOrder(new string[] { ".gitattributes", "b.txt", "Readme.md", "z" });
+            tree.Count.ShouldEqual(4 + 1);
+            tree.UnusedEntryCount.ShouldBeAtLeast(count);
+        }
+
+        [TestCase]
+        public void SizesAreKeptWithEntries()
+        {
+            ProjectionTree tree = BuildTree(new MockTracer(), IndexPaths);
+            int folderIndex = GetIndex(tree, "A");
+            int fileIndex = GetIndex(tree, "A/C.txt");
+            tree.IsSizeSet(fileIndex).ShouldBeFalse();
+            tree.ChildrenHaveSizes(folderIndex).ShouldBeFalse();
+
+            tree.SetSize(fileIndex, 100);
+            tree.SetChildrenHaveSizes(folderIndex);
+            tree.IsSizeSet(fileIndex).ShouldBeTrue();
+            tree.GetSize(fileIndex).ShouldEqual(100);
+            tree.IsFolder(folderIndex).ShouldBeTrue();
+            tree.ChildrenHaveSizes(folderIndex).ShouldBeTrue();
+
+            // A new file does not have its size yet
+            tree.SetFile(folderIndex, "new.txt", new Sha1Id(CreateSha("new")), ProjectionTree.InvalidOffset);
+            tree.ChildrenHaveSizes(GetIndex(tree, "A")).ShouldBeFalse();
+            tree.GetSize(GetIndex(tree, "A/C.txt")).ShouldEqual(100);
+        }
+
+        [TestCase]
+        public void ChangingACloneDoesNotChangeTheTree()
+        {
+            ProjectionTree tree = BuildTree(new MockTracer(), IndexPaths);
+            string description = GetDescription(tree, ProjectionTree.RootIndex);
+            int folderIndex = GetIndex(tree, "A");
+            tree.SetSize(GetIndex(tree, "A/C.txt"), 100);
+            tree.SetChildrenHaveSizes(folderIndex);
+
+            ProjectionTree clone = tree.Clone();
+            clone.SetFile(GetIndexToChange(clone, "A/B"), "new.txt", new Sha1Id(CreateSha("new")), ProjectionTree.InvalidOffset);
+            clone.RemoveChild(ProjectionTree.RootIndex, GetIndex(clone, "z"));
+            clone.SetFile(GetIndexToChange(clone, "A"), "C.txt", new Sha1Id(CreateSha("changed")), ProjectionTree.InvalidOffset);
+            clone.Count.ShouldEqual(tree.Count - 1);
+            GetChildNames(clone, GetIndex(clone, "A/B")).ShouldMatchInOrder(new string[] { "file1.txt", "file2.txt", "file4.txt", "new.txt" });
+            GetDescription(clone, GetIndex(clone, "A/C.txt")).ShouldEqual("C.txt " + CreateSha("changed"));
+
+            GetDescription(tree, ProjectionTree.RootIndex).ShouldEqual(description);
+            tree.ChildrenHaveSizes(folderIndex).ShouldBeTrue();
+            tree.GetSize(GetIndex(tree, "A/C.txt")).ShouldEqual(100);
+
+            // The changed file no longer has its size, but the folders that were not changed are still the same
+            clone.ChildrenHaveSizes(GetIndex(clone, "A")).ShouldBeFalse();
+            GetDescription(clone, GetIndex(clone, "A/D")).ShouldEqual(GetDescription(tree, GetIndex(tree, "A/D")));
+        }
+
+        [TestCase]
+        [Category(CategoryConstants.ExceptionExpected)]
+        public void TreeCannotBeChangedOnceCloned()
+        {
+            ProjectionTree tree = BuildTree(new MockTracer(), IndexPaths);
+            ProjectionTree clone = tree.Clone();
+            Assert.Throws<InvalidOperationException>(() => tree.RemoveChild(ProjectionTree.RootIndex, GetIndex(tree, "z")));
+
+            // Cloning it again copies everything
+            ProjectionTree secondClone = tree.Clone();
+            secondClone.RemoveChild(ProjectionTree.RootIndex, GetIndex(secondClone, "z"));
+            clone.RemoveChild(GetIndexToChange(clone, "A"), GetIndex(clone, "A/C.txt"));
+            GetDescription(secondClone, GetIndex(secondClone, "A")).ShouldEqual(GetDescription(tree, GetIndex(tree, "A")));
+            GetDescription(clone, GetIndex(clone, "z")).ShouldEqual(GetDescription(tree, GetIndex(tree, "z")));
+        }
+
+        [TestCase]
+        public void ChildTableMatchesBinarySearch()
+        {
+            ProjectionTree tree = BuildTree(new MockTracer(), IndexPaths);
+            ProjectionTree tableTree = BuildTree(new MockTracer(), IndexPaths);
+            tableTree.BuildChildTable();
+
+            List<string> paths = IndexPaths.Concat(IndexPaths.Select(path => path.ToUpperInvariant())).ToList();
+            paths.AddRange(new string[] { "A/B", "a/d", "A/B/missing.txt", "missing", "A/C.txt/file1.txt", string.Empty, "A//B/" });
+            foreach (string path in paths)
+            {
+                int index;
+                bool found = tree.TryGetPath(path, path.Length, '/', out index);
+                int tableIndex;
+                tableTree.TryGetPath(path, path.Length, '/', out tableIndex).ShouldEqual(found, path);
+                if (found)
+                {
+                    tableIndex.ShouldEqual(index, path);
+                }
+            }
+
+            int fileIndex;
+            tableTree.TryGetPath("A//B/FILE2.TXT", 14, '/', out fileIndex).ShouldBeTrue();
+            tableTree.GetName(fileIndex).ShouldEqual("file2.txt");
+            tableTree.TryGetPath("A/C.txt/file1.txt", 17, '/', out fileIndex).ShouldBeFalse();
+
+            // The table is kept up to date as the tree (or a clone that shares the table) is changed
+            ProjectionTree clone = tableTree.Clone();
+            clone.SetFile(GetIndexToChange(clone, "A/B"), "new.txt", new Sha1Id(CreateSha("new")), ProjectionTree.InvalidOffset);
+            clone.AddFolder(GetIndexToChange(clone, "A"), "New");
+            clone.RemoveChild(GetIndexToChange(clone, "A/B"), GetIndex(clone, "A/B/file1.txt"));
+            clone.TryGetPath("a/b/NEW.txt", 11, '/', out fileIndex).ShouldBeTrue();
+            clone.GetName(fileIndex).ShouldEqual("new.txt");
+            clone.TryGetPath("A/new", 5, '/', out fileIndex).ShouldBeTrue();
+            clone.GetName(fileIndex).ShouldEqual("New");
+            clone.TryGetPath("A/B/file1.txt", 13, '/', out fileIndex).ShouldBeFalse();
+            clone.TryGetPath("A/B/file4.txt", 13, '/', out fileIndex).ShouldBeTrue();
+            clone.GetName(fileIndex).ShouldEqual("file4.txt");
+
+            tableTree.TryGetPath("A/B/file1.txt", 13, '/', out fileIndex).ShouldBeTrue();
+            tableTree.TryGetPath("a/b/NEW.txt", 11, '/', out fileIndex).ShouldBeFalse();
+            foreach (string path in IndexPaths)
+            {
+                int index;
+                tree.TryGetPath(path, path.Length, '/', out index).ShouldBeTrue(path);
+                tableTree.TryGetPath(path, path.Length, '/', out fileIndex).ShouldBeTrue(path);
+                fileIndex.ShouldEqual(index, path);
+            }
+        }
+
+        [TestCase]
+        public void SnapshotCanBeReadBack()
+        {
+            ProjectionTree tree = BuildTree(new MockTracer(), IndexPaths);
+            tree.BuildChildTable();
+            int fileIndex = GetIndex(tree, "A/C.txt");
+            tree.SetSize(fileIndex, 100);
+            tree.SetOffset(fileIndex, 10, updateTime: 1);
+            tree.SetChildrenHaveSizes(GetIndex(tree, "A"));
+
+            byte[] indexChecksum = Enumerable.Range(0, 20).Select(i => (byte)i).ToArray();
+            string snapshotPath = Path.GetTempFileName();
+            try
+            {
+                tree.WriteSnapshot(snapshotPath, indexChecksum);
+
+                ProjectionTree snapshot;
+                string error;
+                ProjectionTree.TryReadSnapshot(snapshotPath, indexChecksum, out snapshot, out error).ShouldBeTrue(error);
+                GetDescription(snapshot, ProjectionTree.RootIndex).ShouldEqual(GetDescription(tree, ProjectionTree.RootIndex));
+                snapshot.Count.ShouldEqual(tree.Count);
+
+                int snapshotIndex;
+                snapshot.TryGetPath("a/b/FILE2.txt", 13, '/', out snapshotIndex).ShouldBeTrue();
+                snapshot.GetName(snapshotIndex).ShouldEqual("file2.txt");
+
+                // Sizes are kept, but offsets are not
+                snapshotIndex = GetIndex(snapshot, "A/C.txt");
+                snapshot.GetSize(snapshotIndex).ShouldEqual(100);
+                snapshot.GetOffset(snapshotIndex).ShouldEqual(ProjectionTree.InvalidOffset);
+                snapshot.ChildrenHaveSizes(GetIndex(snapshot, "A")).ShouldBeFalse();
+
+                indexChecksum[0] = 0xFF;
+                ProjectionTree.TryReadSnapshot(snapshotPath, indexChecksum, out snapshot, out error).ShouldBeFalse();
+                snapshot.ShouldBeNull();
+            }
+            finally
+            {
+                File.Delete(snapshotPath);
+            }
+        }
+
+        [TestCase]
+        public void CorruptSnapshotIsNotRead()
+        {
+            ProjectionTree tree = BuildTree(new MockTracer(), IndexPaths);
+            byte[] indexChecksum = new byte[20];
+            string snapshotPath = Path.GetTempFileName();
+            try
+            {
+                tree.WriteSnapshot(snapshotPath, indexChecksum);
+                byte[] snapshotBytes = File.ReadAllBytes(snapshotPath);
+
+                ProjectionTree snapshot;
+                string error;
+                File.WriteAllBytes(snapshotPath, snapshotBytes.Take(snapshotBytes.Length - 1).ToArray());
+                ProjectionTree.TryReadSnapshot(snapshotPath, indexChecksum, out snapshot, out error).ShouldBeFalse();
+
+                // Flipping any byte of the entries (after the 48 byte header) must not produce a tree that is unsafe to
+                // use, although a tree with a changed SHA or size is still read
+                for (int i = 48; i < snapshotBytes.Length; ++i)
+                {
+                    byte[] corruptBytes = (byte[])snapshotBytes.Clone();
+                    corruptBytes[i] ^= 0x80;
+                    File.WriteAllBytes(snapshotPath, corruptBytes);
+                    if (ProjectionTree.TryReadSnapshot(snapshotPath, indexChecksum, out snapshot, out error))
+                    {
+                        GetDescription(snapshot, ProjectionTree.RootIndex);
+                    }
+                }
+            }
+            finally
+            {
+                File.Delete(snapshotPath);
+            }
+        }
+
+        private static ProjectionTree BuildTree(MockTracer tracer, params string[] paths)
+        {
+            ProjectionTree.Builder builder = new ProjectionTree.Builder(tracer, paths.Length);
+            for (int i = 0; i < paths.Length; ++i)
+            {
+                byte[] path = Encoding.UTF8.GetBytes(paths[i]);
+                byte[] sha = new byte[20];
+                new Sha1Id(CreateSha(paths[i])).ToBuffer(sha);
+                builder.AddFile(path, path.Length, sha, offset: i);
+            }
+
+            return builder.Finish();
+        }
+
+        private static string CreateSha(string path)
+        {
+            return path.GetHashCode().ToString("X8") + new string('0', 32);
+        }
+
+        private static int GetIndex(ProjectionTree tree, string path)
+        {
+            int index = ProjectionTree.RootIndex;
+            foreach (string name in path.Split('/'))
+            {
+                tree.TryGetChild(index, name, out index).ShouldBeTrue(path);
+            }
+
+            return index;
+        }
+
+        // Walks path in the way that changes to a clone must, so that each folder on the way is one that can be changed
+        private static int GetIndexToChange(ProjectionTree tree, string path)
+        {
+            int index = ProjectionTree.RootIndex;
+            foreach (string name in path.Split('/'))
+            {
+                int childIndex;
+                tree.TryGetChild(index, name, out childIndex).ShouldBeTrue(path);
+                index = tree.PrepareToChangeChild(index, childIndex);
+            }
+
+            return index;
+        }
+
+        private static IEnumerable<string> GetChildNames(ProjectionTree tree, int folderIndex)
+        {
+            int firstChild = tree.GetFirstChild(folderIndex);
+            return Enumerable.Range(firstChild, tree.GetChildCount(folderIndex)).Select(tree.GetName);
+        }
+
+        private static string GetDescription(ProjectionTree tree, int index)
+        {
+            if (!tree.IsFolder(index))
+            {
+                return tree.GetName(index) + " " + tree.GetSha(index);
+            }
+
+            int firstChild = tree.GetFirstChild(index);
+            IEnumerable<string> children = Enumerable.Range(firstChild, tree.GetChildCount(index)).Select(child => GetDescription(tree, child));
+            return tree.GetName(index) + "(" + string.Join(", ", children) + ")";
+        }
+
+        private class ByteComparer : IComparer<byte[]>
+        {
+            public int Compare(byte[] x, byte[] y)
+            {
+                for (int i = 0; i < Math.Min(x.Length, y.Length); ++i)
+                {
+                    if (x[i] != y[i])
+                    {
+                        return x[i] - y[i];
+                    }
+                }
+
+                return x.Length - y.Length;
+            }
+        }
+    }
+}
@@ -14,6 +14,7 @@ using System.IO;
 using System.Net;
 using System.Reflection;
 using System.Threading;
+using System.Threading.Tasks;
 
 namespace GVFS.UnitTests.Git
 {
@@ -73,6 +74,65 @@ namespace GVFS.UnitTests.Git
             }
         }
 
+        [TestCase]
+        public void BatchDownloadReportsResultForEachObject()
+        {
+            const string FirstSha = "1111111111111111111111111111111111111111";
+            const string SecondSha = "2222222222222222222222222222222222222222";
+
+            MockFileSystemWithCallbacks fileSystem = new MockFileSystemWithCallbacks();
+            fileSystem.OnFileExists = () => true;
+            fileSystem.OnOpenFileStream = (path, mode, access) => new MemoryStream();
+            MockBatchHttpGitObjects httpObjects = new MockBatchHttpGitObjects(new MockTracer(), new MockEnlistment(), objectId => ValidTestObjectFileContents);
+            GVFSGitObjects dut = this.CreateTestableGVFSGitObjects(httpObjects, fileSystem);
+
+            Dictionary<string, GitObjects.DownloadAndSaveObjectResult> results = dut.TryDownloadAndSaveObjects(
+                new[] { FirstSha, SecondSha, FirstSha, GVFSConstants.AllZeroSha },
+                GVFSGitObjects.RequestSource.FileStreamCallback);
+
+            results.Count.ShouldEqual(3);
+            results[FirstSha].ShouldEqual(GitObjects.DownloadAndSaveObjectResult.Success);
+            results[SecondSha].ShouldEqual(GitObjects.DownloadAndSaveObjectResult.Success);
+            results[GVFSConstants.AllZeroSha].ShouldEqual(GitObjects.DownloadAndSaveObjectResult.Error);
+        }
+
+        [TestCase]
+        public void DownloadObjectContentReturnsContentBeforeSavingObject()
+        {
+            byte[] objectContents = System.Text.Encoding.ASCII.GetBytes(ValidTestObjectFileContents);
+            using (ManualResetEvent objectWritten = new ManualResetEvent(initialState: false))
+            {
+                MockFileSystemWithCallbacks fileSystem = new MockFileSystemWithCallbacks();
+                fileSystem.OnFileExists = () => false;
+                fileSystem.OnOpenFileStream = (path, mode, access) =>
+                {
+                    if (access == FileAccess.Write)
+                    {
+                        objectWritten.Set();
+                        return new MemoryStream();
+                    }
+
+                    return new MemoryStream(objectContents);
+                };
+
+                MockHttpGitObjects httpObjects = new MockHttpGitObjects();
+                using (httpObjects.InputStream = new MemoryStream(objectContents))
+                {
+                    httpObjects.MediaType = GVFSConstants.MediaTypes.LooseObjectMediaType;
+                    GVFSGitObjects dut = this.CreateTestableGVFSGitObjects(httpObjects, fileSystem);
+
+                    byte[] looseObjectContent;
+                    Task looseObjectSaved;
+                    dut.TryDownloadObjectContent(ValidTestObjectFileContents, GVFSGitObjects.RequestSource.NamedPipeMessage, out looseObjectContent, out looseObjectSaved)
+                        .ShouldEqual(GitObjects.DownloadAndSaveObjectResult.Success);
+                    looseObjectContent.ShouldEqual(objectContents);
+
+                    looseObjectSaved.Wait(TimeSpan.FromSeconds(10)).ShouldEqual(true);
+                    objectWritten.WaitOne(0).ShouldEqual(true);
+                }
+            }
+        }
+
         [TestCase]
         [Category(CategoryConstants.ExceptionExpected)]
         public void FailsZeroByteLooseObjectsDownloads()
@@ -135,7 +195,7 @@ namespace GVFS.UnitTests.Git
             }
         }
 
-        private GVFSGitObjects CreateTestableGVFSGitObjects(MockHttpGitObjects httpObjects, MockFileSystemWithCallbacks fileSystem)
+        private GVFSGitObjects CreateTestableGVFSGitObjects(GitObjectsHttpRequestor httpObjects, MockFileSystemWithCallbacks fileSystem)
         {
             MockTracer tracer = new MockTracer();
             GVFSEnlistment enlistment = new GVFSEnlistment(TestEnlistmentRoot, "https://fakeRepoUrl", "fakeGitBinPath", gvfsHooksRoot: null);
@@ -0,0 +1,358 @@
+﻿using GVFS.Common.Git;
+using GVFS.Tests.Should;
+using GVFS.UnitTests.Category;
+using NUnit.Framework;
+using System.Collections.Generic;
+using System.IO;
+using System.Linq;
+using System.Reflection;
+using System.Security.Cryptography;
+using System.Text;
+
+namespace GVFS.UnitTests.Git
+{
+    [TestFixture]
+    public class GitIndexReaderTests
+    {
+        private const ushort ExtendedBit = 0x4000;
+        private const ushort SkipWorktreeBit = 0x4000;
+
+        [TestCase]
+        public void ReadsVersion4Index()
+        {
+            List<EntryData> entries = ReadEntries(this.GetDataPath("index_v4"), expectedVersion: 4);
+
+            entries.Select(entry => entry.Path).ShouldMatchInOrder(new string[] { "anothernewfile.txt", "test.txt", "test1.txt", "test2.txt" });
+            entries.Select(entry => entry.SkipWorktree).ShouldMatchInOrder(new bool[] { false, false, true, false });
+            entries.Select(entry => entry.Offset).ShouldMatchInOrder(new long[] { 12, 94, 166, 237 });
+            entries.Select(entry => entry.ReplaceIndex).ShouldMatchInOrder(new int[] { 0, 0, 4, 4 });
+            entries.Select(entry => entry.ShaFirstByte).ShouldMatchInOrder(new byte[] { 0x79, 0x4d, 0xca, 0x86 });
+        }
+
+        [TestCase]
+        public void ReadsVersion2Index()
+        {
+            string[] paths = new string[] { "a.txt", "folder/a.txt", "folder/b.txt", "folder/sub/c.txt", "z" };
+            byte[] index = CreateIndex(2, paths, skipWorktree: null);
+
+            List<EntryData> entries = ReadEntries(index, expectedVersion: 2);
+            entries.Select(entry => entry.Path).ShouldMatchInOrder(paths);
+            entries.Select(entry => entry.ShaFirstByte).ShouldMatchInOrder(new byte[] { 0, 1, 2, 3, 4 });
+            entries.Select(entry => entry.SkipWorktree).ShouldMatchInOrder(new bool[] { false, false, false, false, false });
+
+            // Entries are padded to a multiple of eight bytes with 1 - 8 NULs
+            entries.Select(entry => entry.Offset).ShouldMatchInOrder(new long[] { 12, 84, 164, 244, 324 });
+
+            // v2 paths are not prefix compressed, and so ReplaceIndex is the length of the prefix shared with the previous path
+            entries.Select(entry => entry.ReplaceIndex).ShouldMatchInOrder(new int[] { 0, 0, 7, 7, 0 });
+        }
+
+        [TestCase]
+        public void ReadsVersion3SkipWorktreeBits()
+        {
+            string[] paths = new string[] { "a", "b", "c" };
+            byte[] index = CreateIndex(3, paths, skipWorktree: new bool[] { true, false, true });
+
+            List<EntryData> entries = ReadEntries(index, expectedVersion: 3);
+            entries.Select(entry => entry.Path).ShouldMatchInOrder(paths);
+            entries.Select(entry => entry.SkipWorktree).ShouldMatchInOrder(new bool[] { true, false, true });
+        }
+
+        [TestCase]
+        public void ReadsPathsTooLongForFlags()
+        {
+            // Paths of 0xFFF bytes or more have 0xFFF in their flags, and are found by their NUL terminator
+            string[] paths = new string[] { "folder/" + new string('a', 4000), "folder/" + new string('a', 4000) + "b", "folder/c" };
+            byte[] index = CreateIndex(2, paths, skipWorktree: null);
+
+            List<EntryData> entries = ReadEntries(index, expectedVersion: 2);
+            entries.Select(entry => entry.Path).ShouldMatchInOrder(paths);
+            entries.Select(entry => entry.ReplaceIndex).ShouldMatchInOrder(new int[] { 0, 4007, 7 });
+        }
+
+        [TestCase]
+        public void StopsWhenCallbackReturnsFalse()
+        {
+            int entriesRead = 0;
+            using (FileStream indexStream = new FileStream(this.GetDataPath("index_v4"), FileMode.Open, FileAccess.Read, FileShare.Read))
+            using (GitIndexReader indexReader = new GitIndexReader(indexStream))
+            {
+                indexReader.ForEachEntry(
+                    entry =>
+                    {
+                        entriesRead++;
+                        return entry.GetPath() != "test.txt";
+                    })
+                    .ShouldEqual(false);
+            }
+
+            entriesRead.ShouldEqual(2);
+        }
+
+        [TestCase]
+        public void EnumerateEntriesMatchesForEachEntry()
+        {
+            string indexPath = this.GetDataPath("index_v4");
+            List<EntryData> expectedEntries = ReadEntries(indexPath, expectedVersion: 4);
+            using (FileStream indexStream = new FileStream(indexPath, FileMode.Open, FileAccess.Read, FileShare.Read))
+            using (GitIndexReader indexReader = new GitIndexReader(indexStream))
+            {
+                List<EntryData> entries = indexReader.EnumerateEntries().Select(entry => new EntryData(entry)).ToList();
+                entries.Select(entry => entry.Path).ShouldMatchInOrder(expectedEntries.Select(entry => entry.Path));
+                entries.Select(entry => entry.Offset).ShouldMatchInOrder(expectedEntries.Select(entry => entry.Offset));
+                entries.Select(entry => entry.ReplaceIndex).ShouldMatchInOrder(expectedEntries.Select(entry => entry.ReplaceIndex));
+                entries.Select(entry => entry.SkipWorktree).ShouldMatchInOrder(expectedEntries.Select(entry => entry.SkipWorktree));
+            }
+        }
+
+        [TestCase]
+        [Category(CategoryConstants.ExceptionExpected)]
+        public void ThrowsOnTruncatedIndex()
+        {
+            byte[] index = File.ReadAllBytes(this.GetDataPath("index_v4"));
+            Assert.Throws<EndOfStreamException>(() => ReadEntries(index.Take(120).ToArray(), expectedVersion: 4));
+        }
+
+        [TestCase]
+        [Category(CategoryConstants.ExceptionExpected)]
+        public void ThrowsOnIncorrectSignature()
+        {
+            byte[] index = CreateIndex(2, new string[] { "a" }, skipWorktree: null);
+            index[0] = (byte)'X';
+            Assert.Throws<InvalidDataException>(() => ReadEntries(index, expectedVersion: 2));
+        }
+
+        [TestCase]
+        public void ReadsEntryBlocksFromOffsetTable()
+        {
+            string[] paths = new string[] { "a.txt", "folder/a.txt", "folder/b.txt", "folder/sub/c.txt", "z" };
+            byte[] index = CreateIndex(2, paths, skipWorktree: null, entriesPerBlock: 2);
+
+            List<GitIndexEntryBlock> entryBlocks;
+            List<EntryData> entries = ReadEntriesByBlock(index, out entryBlocks);
+            entryBlocks.Select(block => block.Offset).ShouldMatchInOrder(new long[] { 12, 164, 324 });
+            entryBlocks.Select(block => block.EntryCount).ShouldMatchInOrder(new uint[] { 2, 2, 1 });
+            entries.Select(entry => entry.Path).ShouldMatchInOrder(paths);
+            entries.Select(entry => entry.Offset).ShouldMatchInOrder(new long[] { 12, 84, 164, 244, 324 });
+
+            // The first entry of a block does not share a prefix with the entry before it
+            entries.Select(entry => entry.ReplaceIndex).ShouldMatchInOrder(new int[] { 0, 0, 0, 7, 0 });
+        }
+
+        [TestCase]
+        public void ReadsSingleBlockWithoutValidOffsetTable()
+        {
+            string[] paths = new string[] { "a", "b", "c" };
+            List<GitIndexEntryBlock> entryBlocks;
+
+            ReadEntriesByBlock(CreateIndex(2, paths, skipWorktree: null), out entryBlocks).Select(entry => entry.Path).ShouldMatchInOrder(paths);
+            entryBlocks.Count.ShouldEqual(1);
+            entryBlocks[0].Offset.ShouldEqual(12);
+            entryBlocks[0].EntryCount.ShouldEqual(3U);
+
+            // The EOIE extension's hash of the extension headers is the last 20 bytes before the index's checksum
+            byte[] index = CreateIndex(2, paths, skipWorktree: null, entriesPerBlock: 1);
+            index[index.Length - 21] ^= 0xFF;
+            ReadEntriesByBlock(index, out entryBlocks).Select(entry => entry.Path).ShouldMatchInOrder(paths);
+            entryBlocks.Count.ShouldEqual(1);
+        }
+
+        [TestCase]
+        public void IndexOfFindsFirstMatch()
+        {
+            for (int length = 1; length < 40; length++)
+            {
+                for (int matchIndex = 0; matchIndex < length; matchIndex++)
+                {
+                    byte[] buffer = Enumerable.Repeat((byte)'a', length).ToArray();
+                    buffer[matchIndex] = (byte)'/';
+                    GitIndexReader.IndexOf(buffer, 0, length, (byte)'/').ShouldEqual(matchIndex);
+                    GitIndexReader.IndexOf(buffer, matchIndex, length - matchIndex, (byte)'/').ShouldEqual(matchIndex);
+                    GitIndexReader.IndexOf(buffer, 0, matchIndex, (byte)'/').ShouldEqual(-1);
+                }
+            }
+
+            // Bytes just above and below the value being searched for do not match
+            GitIndexReader.IndexOf(new byte[] { 0x2E, 0x30, 0xAF, 0x2E, 0x30, 0xAF, 0x2E, 0x30, 0x2F }, 0, 9, (byte)'/').ShouldEqual(8);
+        }
+
+        private static List<EntryData> ReadEntries(string indexPath, uint expectedVersion)
+        {
+            List<EntryData> entries = new List<EntryData>();
+            using (FileStream indexStream = new FileStream(indexPath, FileMode.Open, FileAccess.Read, FileShare.Read))
+            using (GitIndexReader indexReader = new GitIndexReader(indexStream))
+            {
+                indexReader.Version.ShouldEqual(expectedVersion);
+                indexReader.ForEachEntry(
+                    entry =>
+                    {
+                        entries.Add(new EntryData(entry));
+                        return true;
+                    })
+                    .ShouldEqual(true);
+
+                entries.Count.ShouldEqual((int)indexReader.EntryCount);
+            }
+
+            return entries;
+        }
+
+        private static List<EntryData> ReadEntries(byte[] index, uint expectedVersion)
+        {
+            string indexPath = Path.GetTempFileName();
+            try
+            {
+                File.WriteAllBytes(indexPath, index);
+                return ReadEntries(indexPath, expectedVersion);
+            }
+            finally
+            {
+                File.Delete(indexPath);
+            }
+        }
+
+        private static List<EntryData> ReadEntriesByBlock(byte[] index, out List<GitIndexEntryBlock> entryBlocks)
+        {
+            List<EntryData> entries = new List<EntryData>();
+            string indexPath = Path.GetTempFileName();
+            try
+            {
+                File.WriteAllBytes(indexPath, index);
+                using (FileStream indexStream = new FileStream(indexPath, FileMode.Open, FileAccess.Read, FileShare.Read))
+                using (GitIndexReader indexReader = new GitIndexReader(indexStream))
+                {
+                    entryBlocks = indexReader.GetEntryBlocks();
+                    foreach (GitIndexEntryBlock entryBlock in entryBlocks)
+                    {
+                        indexReader.ForEachEntry(
+                            entryBlock,
+                            entry =>
+                            {
+                                entries.Add(new EntryData(entry));
+                                return true;
+                            })
+                            .ShouldEqual(true);
+                    }
+                }
+            }
+            finally
+            {
+                File.Delete(indexPath);
+            }
+
+            return entries;
+        }
+
+        private static byte[] CreateIndex(uint version, string[] paths, bool[] skipWorktree, int entriesPerBlock = 0)
+        {
+            using (MemoryStream index = new MemoryStream())
+            {
+                index.Write(Encoding.ASCII.GetBytes("DIRC"), 0, 4);
+                WriteUInt32(index, version);
+                WriteUInt32(index, (uint)paths.Length);
+
+                List<uint> blockOffsets = new List<uint>();
+                for (int i = 0; i < paths.Length; i++)
+                {
+                    long entryStart = index.Position;
+                    if (entriesPerBlock > 0 && i % entriesPerBlock == 0)
+                    {
+                        blockOffsets.Add((uint)entryStart);
+                    }
+
+                    bool isSkipWorktree = skipWorktree != null && skipWorktree[i];
+                    byte[] path = Encoding.UTF8.GetBytes(paths[i]);
+
+                    // ctime through size, and then the SHA
+                    index.Write(new byte[40], 0, 40);
+                    index.Write(Enumerable.Repeat((byte)i, 20).ToArray(), 0, 20);
+
+                    ushort flags = (ushort)System.Math.Min(path.Length, 0xFFF);
+                    if (isSkipWorktree)
+                    {
+                        flags |= ExtendedBit;
+                    }
+
+                    WriteUInt16(index, flags);
+                    if (isSkipWorktree)
+                    {
+                        WriteUInt16(index, SkipWorktreeBit);
+                    }
+
+                    index.Write(path, 0, path.Length);
+                    long entryLength = index.Position - entryStart;
+                    index.Write(new byte[8], 0, (int)(8 - (entryLength % 8)));
+                }
+
+                if (entriesPerBlock > 0)
+                {
+                    WriteEntryOffsetTable(index, blockOffsets, paths.Length, entriesPerBlock);
+                }
+
+                index.Write(new byte[20], 0, 20);
+                return index.ToArray();
+            }
+        }
+
+        private static void WriteEntryOffsetTable(MemoryStream index, List<uint> blockOffsets, int entryCount, int entriesPerBlock)
+        {
+            // IEOT: version 1 and then the offset and entry count of each block
+            uint extensionsOffset = (uint)index.Position;
+            index.Write(Encoding.ASCII.GetBytes("IEOT"), 0, 4);
+            WriteUInt32(index, (uint)(4 + (8 * blockOffsets.Count)));
+            WriteUInt32(index, 1);
+            for (int i = 0; i < blockOffsets.Count; i++)
+            {
+                WriteUInt32(index, blockOffsets[i]);
+                WriteUInt32(index, (uint)System.Math.Min(entriesPerBlock, entryCount - (i * entriesPerBlock)));
+            }
+
+            // EOIE: the offset of the first extension and the SHA1 of the headers of the extensions
+            byte[] extensionHeaders = new byte[8];
+            System.Array.Copy(index.GetBuffer(), extensionsOffset, extensionHeaders, 0, 8);
+            index.Write(Encoding.ASCII.GetBytes("EOIE"), 0, 4);
+            WriteUInt32(index, 24);
+            WriteUInt32(index, extensionsOffset);
+            using (SHA1 sha1 = SHA1.Create())
+            {
+                index.Write(sha1.ComputeHash(extensionHeaders), 0, 20);
+            }
+        }
+
+        private static void WriteUInt32(Stream stream, uint value)
+        {
+            WriteUInt16(stream, (ushort)(value >> 16));
+            WriteUInt16(stream, (ushort)value);
+        }
+
+        private static void WriteUInt16(Stream stream, ushort value)
+        {
+            stream.WriteByte((byte)(value >> 8));
+            stream.WriteByte((byte)value);
+        }
+
+        private string GetDataPath(string fileName)
+        {
+            string workingDirectory = Path.GetDirectoryName(Assembly.GetExecutingAssembly().Location);
+            return Path.Combine(workingDirectory, "Data", fileName);
+        }
+
+        private class EntryData
+        {
+            public EntryData(GitIndexEntry entry)
+            {
+                this.Path = entry.GetPath();
+                this.Offset = entry.Offset;
+                this.SkipWorktree = entry.SkipWorktree;
+                this.ReplaceIndex = entry.ReplaceIndex;
+                this.ShaFirstByte = entry.Sha[0];
+            }
+
+            public string Path { get; }
+            public long Offset { get; }
+            public bool SkipWorktree { get; }
+            public int ReplaceIndex { get; }
+            public byte ShaFirstByte { get; }
+        }
+    }
+}
@@ -0,0 +1,68 @@
+﻿using GVFS.Common.Git;
+using GVFS.Tests.Should;
+using GVFS.UnitTests.Category;
+using NUnit.Framework;
+using System;
+using System.IO;
+using System.Linq;
+
+namespace GVFS.UnitTests.Git
+{
+    [TestFixture]
+    public class GitPackIndexTests
+    {
+        private const string FirstSha = "0A0B0C0D0E0F101112131415161718191A1B1C1D";
+        private const string SecondSha = "FF0102030405060708090A0B0C0D0E0F10111213";
+
+        [TestCase]
+        public void ReadsEveryShaInTheIndex()
+        {
+            using (MemoryStream idx = CreateIndex(version: 2, shas: new[] { FirstSha, SecondSha }))
+            {
+                GitPackIndex.GetShas(idx).ShouldMatchInOrder(new[] { FirstSha, SecondSha });
+            }
+        }
+
+        [TestCase]
+        [Category(CategoryConstants.ExceptionExpected)]
+        public void ThrowsOnUnsupportedVersion()
+        {
+            using (MemoryStream idx = CreateIndex(version: 1, shas: new[] { FirstSha }))
+            {
+                Assert.Throws<InvalidDataException>(() => GitPackIndex.GetShas(idx).ToList());
+            }
+        }
+
+        private static MemoryStream CreateIndex(uint version, string[] shas)
+        {
+            MemoryStream idx = new MemoryStream();
+            WriteBigEndian(idx, 0xff744f63);
+            WriteBigEndian(idx, version);
+
+            // Fanout table: the number of objects whose first byte is less than or equal to each bucket
+            for (int bucket = 0; bucket < 256; ++bucket)
+            {
+                WriteBigEndian(idx, (uint)shas.Count(sha => Convert.ToByte(sha.Substring(0, 2), 16) <= bucket));
+            }
+
+            foreach (string sha in shas)
+            {
+                for (int i = 0; i < sha.Length; i += 2)
+                {
+                    idx.WriteByte(Convert.ToByte(sha.Substring(i, 2), 16));
+                }
+            }
+
+            idx.Position = 0;
+            return idx;
+        }
+
+        private static void WriteBigEndian(Stream stream, uint value)
+        {
+            stream.WriteByte((byte)(value >> 24));
+            stream.WriteByte((byte)(value >> 16));
+            stream.WriteByte((byte)(value >> 8));
+            stream.WriteByte((byte)value);
+        }
+    }
+}
@@ -0,0 +1,284 @@
+﻿using GVFS.Common;
+using GVFS.Common.Git;
+using GVFS.Common.Http;
+using GVFS.Tests.Should;
+using GVFS.UnitTests.Mock.Common;
+using GVFS.UnitTests.Mock.FileSystem;
+using GVFS.UnitTests.Mock.Git;
+using NUnit.Framework;
+using System;
+using System.Collections.Generic;
+using System.Linq;
+using System.Threading;
+
+namespace GVFS.UnitTests.Git
+{
+    [TestFixture]
+    public class SpeculativeObjectPrefetcherTests
+    {
+        private const string TreeSha = "1000000000000000000000000000000000000000";
+        private const int HighBudget = 10 * 1024 * 1024;
+
+        [TestCase]
+        public void PrefetchesRemainingTreeEntriesAfterSiblingRequests()
+        {
+            PrefetchTestRepo repo = new PrefetchTestRepo();
+            string[] entryShas = Enumerable.Range(1, 10).Select(i => CreateSha(0x2000 + i)).ToArray();
+            repo.AddTree(TreeSha, entryShas);
+            repo.LocalObjects.Add(TreeSha);
+
+            RecordingGitObjects gitObjects = this.CreateGitObjects(repo);
+            SpeculativeObjectPrefetcher prefetcher = new SpeculativeObjectPrefetcher(new MockTracer(), repo, gitObjects, HighBudget);
+
+            this.DemandDownload(prefetcher, repo, TreeSha);
+            this.DemandDownload(prefetcher, repo, entryShas[0]);
+            prefetcher.ProcessPendingWork().ShouldEqual(false);
+
+            this.DemandDownload(prefetcher, repo, entryShas[1]);
+            prefetcher.ProcessPendingWork().ShouldEqual(true);
+
+            gitObjects.Batches.Count.ShouldEqual(1);
+            gitObjects.Batches[0].ShouldMatchInOrder(entryShas.Skip(2));
+        }
+
+        [TestCase]
+        public void PrefetchesAncestorsDuringCommitWalk()
+        {
+            PrefetchTestRepo repo = new PrefetchTestRepo();
+            string[] commitShas = Enumerable.Range(1, 40).Select(i => CreateSha(0x3000 + i)).ToArray();
+            for (int i = 0; i < commitShas.Length - 1; ++i)
+            {
+                repo.AddCommit(commitShas[i], commitShas[i + 1]);
+            }
+
+            RecordingGitObjects gitObjects = this.CreateGitObjects(repo);
+            SpeculativeObjectPrefetcher prefetcher = new SpeculativeObjectPrefetcher(new MockTracer(), repo, gitObjects, HighBudget);
+
+            this.DemandDownload(prefetcher, repo, commitShas[0]);
+            prefetcher.ProcessPendingWork().ShouldEqual(false);
+
+            this.DemandDownload(prefetcher, repo, commitShas[1]);
+            while (prefetcher.ProcessPendingWork())
+            {
+            }
+
+            // Each downloaded ancestor leads to its parent, up to the lookahead limit
+            List<string> prefetched = gitObjects.Batches.SelectMany(batch => batch).ToList();
+            prefetched.Count.ShouldEqual(16);
+            prefetched.ShouldMatchInOrder(commitShas.Skip(2).Take(16));
+        }
+
+        [TestCase]
+        public void DoesNotPrefetchForUnrelatedRequests()
+        {
+            PrefetchTestRepo repo = new PrefetchTestRepo();
+            repo.AddTree(TreeSha, CreateSha(0x4001), CreateSha(0x4002), CreateSha(0x4003));
+            repo.LocalObjects.Add(TreeSha);
+            repo.AddCommit(CreateSha(0x5001), CreateSha(0x5002));
+            repo.AddCommit(CreateSha(0x5003), CreateSha(0x5004));
+
+            RecordingGitObjects gitObjects = this.CreateGitObjects(repo);
+            SpeculativeObjectPrefetcher prefetcher = new SpeculativeObjectPrefetcher(new MockTracer(), repo, gitObjects, HighBudget);
+
+            this.DemandDownload(prefetcher, repo, TreeSha);
+            this.DemandDownload(prefetcher, repo, CreateSha(0x4001));
+            this.DemandDownload(prefetcher, repo, CreateSha(0x5001));
+            this.DemandDownload(prefetcher, repo, CreateSha(0x5003));
+            prefetcher.ProcessPendingWork().ShouldEqual(false);
+
+            gitObjects.Batches.Count.ShouldEqual(0);
+            prefetcher.GetStatistics()["UnpredictedDemandRequests"].ShouldEqual(4L);
+        }
+
+        [TestCase]
+        public void DemandRequestsForQueuedObjectsAreCountedAsPredicted()
+        {
+            PrefetchTestRepo repo = new PrefetchTestRepo();
+            string[] entryShas = Enumerable.Range(1, 4).Select(i => CreateSha(0x6000 + i)).ToArray();
+            repo.AddTree(TreeSha, entryShas);
+            repo.LocalObjects.Add(TreeSha);
+
+            RecordingGitObjects gitObjects = this.CreateGitObjects(repo);
+
+            // With no budget, the predictions stay queued
+            SpeculativeObjectPrefetcher prefetcher = new SpeculativeObjectPrefetcher(new MockTracer(), repo, gitObjects, bytesPerSecond: 0);
+            this.DemandDownload(prefetcher, repo, entryShas[0]);
+            this.DemandDownload(prefetcher, repo, TreeSha);
+            prefetcher.ProcessPendingWork();
+            this.DemandDownload(prefetcher, repo, entryShas[1]);
+            this.DemandDownload(prefetcher, repo, entryShas[2]);
+            prefetcher.ProcessPendingWork().ShouldEqual(false);
+            this.DemandDownload(prefetcher, repo, entryShas[3]);
+
+            gitObjects.Batches.Count.ShouldEqual(0);
+            prefetcher.GetStatistics()["PredictedDemandRequests"].ShouldEqual(1L);
+        }
+
+        [TestCase]
+        public void BudgetIsChargedForTheBytesDownloaded()
+        {
+            PrefetchTestRepo repo = new PrefetchTestRepo();
+            string[] entryShas = Enumerable.Range(1, 200).Select(i => CreateSha(0x7000 + i)).ToArray();
+            repo.AddTree(TreeSha, entryShas);
+            repo.LocalObjects.Add(TreeSha);
+
+            // The first batch uses far more than a second's budget, and so the next batch waits for the budget to refill
+            RecordingGitObjects gitObjects = this.CreateGitObjects(repo);
+            gitObjects.ObjectSize = 1024 * 1024;
+            SpeculativeObjectPrefetcher prefetcher = new SpeculativeObjectPrefetcher(new MockTracer(), repo, gitObjects, bytesPerSecond: 64 * 1024);
+            this.DemandDownload(prefetcher, repo, TreeSha);
+            this.DemandDownload(prefetcher, repo, entryShas[0]);
+            this.DemandDownload(prefetcher, repo, entryShas[1]);
+            prefetcher.ProcessPendingWork().ShouldEqual(true);
+            prefetcher.ProcessPendingWork().ShouldEqual(false);
+
+            gitObjects.Batches.Count.ShouldEqual(1);
+            prefetcher.GetStatistics()["SpeculativeBytesDownloaded"].ShouldEqual((long)gitObjects.Batches[0].Count * gitObjects.ObjectSize);
+        }
+
+        [TestCase]
+        public void DemandDownloadsCancelTheSpeculativeBatch()
+        {
+            PrefetchTestRepo repo = new PrefetchTestRepo();
+            string[] entryShas = Enumerable.Range(1, 10).Select(i => CreateSha(0x8000 + i)).ToArray();
+            repo.AddTree(TreeSha, entryShas);
+            repo.LocalObjects.Add(TreeSha);
+
+            RecordingGitObjects gitObjects = this.CreateGitObjects(repo);
+            SpeculativeObjectPrefetcher prefetcher = new SpeculativeObjectPrefetcher(new MockTracer(), repo, gitObjects, HighBudget);
+            this.DemandDownload(prefetcher, repo, TreeSha);
+            this.DemandDownload(prefetcher, repo, entryShas[0]);
+            this.DemandDownload(prefetcher, repo, entryShas[1]);
+
+            // Demand downloads start while the batch is waiting for the server
+            string[] demandShas = Enumerable.Range(1, 4).Select(i => CreateSha(0x9000 + i)).ToArray();
+            gitObjects.OnDownload = cancellationToken =>
+            {
+                foreach (string demandSha in demandShas)
+                {
+                    prefetcher.OnDemandDownloadStarted(demandSha);
+                }
+
+                cancellationToken.ThrowIfCancellationRequested();
+            };
+
+            prefetcher.ProcessPendingWork().ShouldEqual(true);
+            prefetcher.GetStatistics()["SpeculativeObjectsCancelled"].ShouldEqual(8L);
+            prefetcher.ProcessPendingWork().ShouldEqual(false);
+
+            // Once the demand downloads have finished, the cancelled batch is downloaded again
+            gitObjects.OnDownload = null;
+            foreach (string demandSha in demandShas)
+            {
+                prefetcher.OnDemandDownloadCompleted(demandSha, succeeded: true);
+            }
+
+            prefetcher.ProcessPendingWork().ShouldEqual(true);
+            gitObjects.Batches.Count.ShouldEqual(2);
+            gitObjects.Batches[1].ShouldMatchInOrder(entryShas.Skip(2));
+            prefetcher.GetStatistics()["SpeculativeObjectsDownloaded"].ShouldEqual(8L);
+        }
+
+        private static string CreateSha(int value)
+        {
+            return value.ToString("x40");
+        }
+
+        private void DemandDownload(SpeculativeObjectPrefetcher prefetcher, PrefetchTestRepo repo, string sha)
+        {
+            prefetcher.OnDemandDownloadStarted(sha);
+            repo.LocalObjects.Add(sha);
+            prefetcher.OnDemandDownloadCompleted(sha, succeeded: true);
+        }
+
+        private RecordingGitObjects CreateGitObjects(PrefetchTestRepo repo)
+        {
+            MockTracer tracer = new MockTracer();
+            GVFSEnlistment enlistment = new GVFSEnlistment("mock:\\src", "https://fakeRepoUrl", "fakeGitBinPath", gvfsHooksRoot: null);
+            GVFSContext context = new GVFSContext(tracer, new MockFileSystemWithCallbacks(), repo, enlistment);
+            return new RecordingGitObjects(context, new MockHttpGitObjects(tracer, new MockEnlistment()), repo);
+        }
+
+        private class PrefetchTestRepo : GitRepo
+        {
+            private Dictionary<string, string[]> treeEntries = new Dictionary<string, string[]>(StringComparer.OrdinalIgnoreCase);
+            private Dictionary<string, string[]> commitParents = new Dictionary<string, string[]>(StringComparer.OrdinalIgnoreCase);
+
+            public PrefetchTestRepo()
+                : base(new MockTracer())
+            {
+                this.LocalObjects = new HashSet<string>(StringComparer.OrdinalIgnoreCase);
+            }
+
+            public HashSet<string> LocalObjects { get; }
+
+            public void AddTree(string sha, params string[] entryShas)
+            {
+                this.treeEntries.Add(sha, entryShas);
+            }
+
+            public void AddCommit(string sha, params string[] parentShas)
+            {
+                this.commitParents.Add(sha, parentShas);
+            }
+
+            public override bool ObjectExists(string blobSha)
+            {
+                return this.LocalObjects.Contains(blobSha);
+            }
+
+            public override string[] GetTreeEntryShas(string treeSha)
+            {
+                string[] entryShas;
+                return this.LocalObjects.Contains(treeSha) && this.treeEntries.TryGetValue(treeSha, out entryShas) ? entryShas : null;
+            }
+
+            public override string[] GetCommitParentShas(string commitSha)
+            {
+                string[] parentShas;
+                return this.LocalObjects.Contains(commitSha) && this.commitParents.TryGetValue(commitSha, out parentShas) ? parentShas : null;
+            }
+        }
+
+        private class RecordingGitObjects : GVFSGitObjects
+        {
+            private PrefetchTestRepo repo;
+
+            public RecordingGitObjects(GVFSContext context, GitObjectsHttpRequestor objectRequestor, PrefetchTestRepo repo)
+                : base(context, objectRequestor)
+            {
+                this.repo = repo;
+                this.Batches = new List<List<string>>();
+            }
+
+            public List<List<string>> Batches { get; }
+
+            public int ObjectSize { get; set; } = 100;
+
+            public Action<CancellationToken> OnDownload { get; set; }
+
+            public override Dictionary<string, DownloadAndSaveObjectResult> TryDownloadAndSaveObjects(
+                IEnumerable<string> objectIds,
+                RequestSource requestSource,
+                CancellationToken cancellationToken,
+                out long bytesDownloaded)
+            {
+                requestSource.ShouldEqual(RequestSource.SpeculativePrefetch);
+
+                List<string> batch = objectIds.ToList();
+                this.Batches.Add(batch);
+                this.OnDownload?.Invoke(cancellationToken);
+
+                Dictionary<string, DownloadAndSaveObjectResult> results = new Dictionary<string, DownloadAndSaveObjectResult>(StringComparer.OrdinalIgnoreCase);
+                foreach (string objectId in batch)
+                {
+                    this.repo.LocalObjects.Add(objectId);
+                    results[objectId] = DownloadAndSaveObjectResult.Success;
+                }
+
+                bytesDownloaded = (long)batch.Count * this.ObjectSize;
+                return results;
+            }
+        }
+    }
+}
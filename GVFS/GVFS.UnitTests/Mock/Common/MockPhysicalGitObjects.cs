@@ -36,8 +36,9 @@ namespace GVFS.UnitTests.Mock.Common
             }
         }
 
-        public override GitProcess.Result IndexTempPackFile(string tempPackPath)
+        public override GitProcess.Result IndexTempPackFile(string tempPackPath, out string packfilePath)
         {
+            packfilePath = null;
             return new GitProcess.Result(string.Empty, "TestFailure", GitProcess.Result.GenericFailureCode);
         }
     }
@@ -36,7 +36,8 @@ namespace GVFS.UnitTests.Mock.Git
             Func<IEnumerable<string>> objectIdGenerator,
             Func<int, GitEndPointResponseData, RetryWrapper<GitObjectTaskResult>.CallbackResult> onSuccess,
             Action<RetryWrapper<GitObjectTaskResult>.ErrorEventArgs> onFailure,
-            bool preferBatchedLooseObjects)
+            bool preferBatchedLooseObjects,
+            CancellationToken cancellationToken)
         {
             return this.TryDownloadObjects(objectIdGenerator(), onSuccess, onFailure, preferBatchedLooseObjects);
         }
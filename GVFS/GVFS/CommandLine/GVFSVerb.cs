@@ -108,6 +108,10 @@ namespace GVFS.CommandLine
             Dictionary<string, string> optionalSettings = new Dictionary<string, string>
             {
                 { "status.aheadbehind", "false" },
+
+                // Have git write the Index Entry Offset Table, so that GVFS can parse the index on multiple threads
+                { "index.recordEndOfIndexEntries", "true" },
+                { "index.recordOffsetTable", "true" },
             };
 
             if (!TrySetConfig(enlistment, optionalSettings, isRequired: false))
@@ -17,6 +17,11 @@ namespace GVFS.CommandLine
 #   See {0} config setting
 ########################################################################
 {1}";
+
+        // See ParallelHookMarker and CommandFilterSeparator in GitHooksLoader/HookPlan.cpp
+        private const char HookParallelMarker = '&';
+        private const char HookCommandFilterSeparator = '|';
+
         public static bool InstallHooks(GVFSEnlistment enlistment, out string error)
         {
             error = string.Empty;
@@ -54,7 +59,7 @@ namespace GVFS.CommandLine
         {
             IEnumerable<string> valuableHooksLines = defaultHooksLines.Where(line => !string.IsNullOrEmpty(line.Trim()));
 
-            if (valuableHooksLines.Contains(GVFSConstants.GVFSHooksExecutableName, StringComparer.OrdinalIgnoreCase))
+            if (valuableHooksLines.Select(GetHookApplication).Contains(GVFSConstants.GVFSHooksExecutableName, StringComparer.OrdinalIgnoreCase))
             {
                 throw new HooksConfigurationException(
                     "GVFS.Hooks.exe should not be specified in the configuration for "
@@ -95,11 +100,23 @@ namespace GVFS.CommandLine
             }
         }
 
+        /// <summary>
+        /// Returns the application that a line of a hook-name.hooks file runs, without its parallel marker or command filter
+        /// </summary>
+        private static string GetHookApplication(string hooksLine)
+        {
+            return hooksLine.Split(HookCommandFilterSeparator)[0].Trim().TrimStart(HookParallelMarker).Trim();
+        }
+
         private static bool TryInstallGitCommandHooks(GVFSEnlistment enlistment, string hookName, string commandHookPath, out string errorMessage)
         {
             // The GitHooksLoader requires the following setup to invoke a hook:
             //      Copy GithooksLoader.exe to hook-name.exe
             //      Create a text file named hook-name.hooks that lists the applications to execute for the hook, one application per line
+            //          Consecutive lines that start with '&' list applications that are independent of each other, and are run in parallel
+            //          An application followed by '|' and a comma separated list of git commands is only run for those commands, and
+            //          commands that start with '!' are left out, e.g. "hook.exe|checkout,reset" or "hook.exe|!status,!log"
+            //      GitHooksLoader compiles hook-name.hooks into hook-name.hooks.plan, and compiles it again whenever hook-name.hooks changes
 
             string gitHooksloaderPath = Path.Combine(Path.GetDirectoryName(Assembly.GetExecutingAssembly().Location), GVFSConstants.DotGit.Hooks.LoaderExecutable);
             if (!TryAction(() => CopyGitHooksLoader(gitHooksloaderPath, commandHookPath), out errorMessage))
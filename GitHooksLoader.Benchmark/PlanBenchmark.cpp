@@ -0,0 +1,164 @@
+// GitHooksLoader.Benchmark
+//
+// Compares the work GitHooksLoader does to get from its .hooks file to the command line of each hook: reading and
+// expanding the .hooks text on every run (as the loader used to), compiling a HookPlan (the first run after .hooks
+// changes), and loading the saved plan (every other run).  Each is repeated and reported as microseconds per run.
+//
+// Usage: GitHooksLoader.Benchmark [--hooks <count>] [--iterations <count>]
+
+#include "stdafx.h"
+#include "HookPlan.h"
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+namespace
+{
+    const wchar_t *HookName = L"pre-command";
+    const wchar_t *GitArguments[] = { L"pre-command.exe", L"status", L"--porcelain", L"--git-pid=1234" };
+
+    LARGE_INTEGER tickFrequency;
+
+    // GitHooksLoader before hook plans: read .hooks, then expand each line and build its command line
+    size_t BuildCommandLinesFromText(const std::wstring &executingLoader)
+    {
+        size_t totalLength = 0;
+        std::wifstream hooksList(executingLoader + L".hooks");
+        for (std::wstring hookApplication; std::getline(hooksList, hookApplication); )
+        {
+            if (hookApplication.empty() || hookApplication.at(0) == '#')
+            {
+                continue;
+            }
+
+            if (hookApplication.at(0) == L'&')
+            {
+                hookApplication.erase(0, 1);
+            }
+
+            wchar_t expandedPath[MAX_PATH + 1];
+            DWORD length = ExpandEnvironmentStrings(hookApplication.c_str(), expandedPath, MAX_PATH);
+            if (length == 0 || length > MAX_PATH)
+            {
+                continue;
+            }
+
+            std::wstring commandLine = std::wstring(expandedPath) + L" " + HookName;
+            for (size_t x = 1; x < ARRAYSIZE(GitArguments); x++)
+            {
+                commandLine += L" " + std::wstring(GitArguments[x]);
+            }
+
+            totalLength += commandLine.size();
+        }
+
+        return totalLength;
+    }
+
+    size_t BuildCommandLinesFromPlan(const std::wstring &executingLoader)
+    {
+        HookPlan hookPlan;
+        hookPlan.Load(executingLoader, HookName, GitArguments[1]);
+
+        std::wstring hookArguments;
+        for (size_t x = 1; x < ARRAYSIZE(GitArguments); x++)
+        {
+            hookArguments += L" ";
+            hookArguments += GitArguments[x];
+        }
+
+        size_t totalLength = 0;
+        for (const std::vector<PlannedHook> &hookGroup : hookPlan.GetHookGroups())
+        {
+            for (const PlannedHook &plannedHook : hookGroup)
+            {
+                std::wstring commandLine = plannedHook.commandLinePrefix + hookArguments;
+                totalLength += commandLine.size();
+            }
+        }
+
+        return totalLength;
+    }
+
+    void Measure(const char *name, int iterations, const std::function<void()> &prepare, const std::function<size_t()> &run)
+    {
+        std::vector<double> microseconds;
+        size_t checksum = 0;
+        for (int i = 0; i < iterations; ++i)
+        {
+            prepare();
+
+            LARGE_INTEGER startTime;
+            LARGE_INTEGER endTime;
+            QueryPerformanceCounter(&startTime);
+            checksum += run();
+            QueryPerformanceCounter(&endTime);
+            microseconds.push_back((endTime.QuadPart - startTime.QuadPart) * 1000000.0 / tickFrequency.QuadPart);
+        }
+
+        std::sort(microseconds.begin(), microseconds.end());
+        printf(
+            "%-24s p50 %9.1f us   p90 %9.1f us   p99 %9.1f us   (checksum %zu)\n",
+            name,
+            microseconds[microseconds.size() / 2],
+            microseconds[microseconds.size() * 9 / 10],
+            microseconds[microseconds.size() * 99 / 100],
+            checksum / static_cast<size_t>(iterations));
+    }
+}
+
+int wmain(int argc, WCHAR *argv[])
+{
+    int hookCount = 4;
+    int iterations = 2000;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (wcscmp(argv[i], L"--hooks") == 0)
+        {
+            hookCount = _wtoi(argv[i + 1]);
+        }
+        else if (wcscmp(argv[i], L"--iterations") == 0)
+        {
+            iterations = _wtoi(argv[i + 1]);
+        }
+    }
+
+    if (hookCount < 1 || iterations < 1 || (argc % 2) == 0)
+    {
+        fwprintf(stderr, L"Usage: %s [--hooks <count>] [--iterations <count>]\n", argv[0]);
+        return 1;
+    }
+
+    QueryPerformanceFrequency(&tickFrequency);
+
+    // A .hooks file like the ones GVFS installs: other hooks first, GVFS.Hooks last
+    wchar_t tempFolder[MAX_PATH + 1];
+    GetTempPath(MAX_PATH + 1, tempFolder);
+    std::wstring executingLoader = std::wstring(tempFolder) + L"GitHooksLoader.Benchmark." + std::to_wstring(GetCurrentProcessId());
+    std::wstring hooksPath = executingLoader + L".hooks";
+    std::wstring planPath = hooksPath + L".plan";
+    {
+        std::wofstream hooksFile(hooksPath);
+        hooksFile << L"########################################################################\n";
+        hooksFile << L"#   Automatically generated file, do not modify.\n";
+        hooksFile << L"########################################################################\n";
+        for (int i = 1; i < hookCount; ++i)
+        {
+            hooksFile << L"%SystemRoot%\\System32\\where.exe\n";
+        }
+
+        hooksFile << L"GVFS.Hooks.exe\n";
+    }
+
+    printf("%d hooks, %d iterations\n", hookCount, iterations);
+    Measure("read .hooks", iterations, []() {}, [&]() { return BuildCommandLinesFromText(executingLoader); });
+    Measure("compile plan", iterations, [&]() { DeleteFile(planPath.c_str()); }, [&]() { return BuildCommandLinesFromPlan(executingLoader); });
+    Measure("load saved plan", iterations, []() {}, [&]() { return BuildCommandLinesFromPlan(executingLoader); });
+
+    DeleteFile(planPath.c_str());
+    DeleteFile(hooksPath.c_str());
+    return 0;
+}
@@ -0,0 +1,436 @@
+// GitHooksLoader.PerfTraceReport
+//
+// Summarizes the perf trace that GitHooksLoader writes when GITHOOKSLOADER_PERFTRACE is set (one JSON object per line
+// in .gvfs\logs\githooksloader_perftrace_<yyyyMMdd>.jsonl).  For each git verb, and for each hook (hook name and hook
+// application), it reports how many runs there were, how many failed, how the hooks were run, and percentiles of the
+// time each run took: createMs (starting the hook) plus waitMs (waiting for it to exit).  Hooks that were not run
+// because their command filter left out the git command are counted as skipped, and not as runs.
+//
+// Usage: GitHooksLoader.PerfTraceReport [--by verb|hook|all] <trace file> [<trace file> ...]
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace
+{
+    struct HookRun
+    {
+        std::string hook;
+        std::string gitVerb;
+        std::string application;
+        std::string runMode;
+        double createMs = 0;
+        double waitMs = 0;
+        long exitCode = 0;
+    };
+
+    const char *SkippedRunMode = "skipped";
+
+    struct RunSummary
+    {
+        std::vector<double> totalMs;
+        std::vector<double> createMs;
+        int failures = 0;
+        int skipped = 0;
+        std::map<std::string, int> runModes;
+    };
+
+    // Reads the flat objects that GitHooksLoader writes: string, number and boolean values, with no nesting
+    class TraceLineParser
+    {
+    public:
+        explicit TraceLineParser(const std::string &line)
+            : line(line), position(0)
+        {
+        }
+
+        bool TryParse(std::map<std::string, std::string> &values)
+        {
+            this->SkipWhitespace();
+            if (!this->Consume('{'))
+            {
+                return false;
+            }
+
+            this->SkipWhitespace();
+            if (this->Consume('}'))
+            {
+                return this->AtEnd();
+            }
+
+            while (true)
+            {
+                std::string name;
+                std::string value;
+                this->SkipWhitespace();
+                if (!this->TryParseString(name))
+                {
+                    return false;
+                }
+
+                this->SkipWhitespace();
+                if (!this->Consume(':'))
+                {
+                    return false;
+                }
+
+                this->SkipWhitespace();
+                if (this->Peek() == '"' ? !this->TryParseString(value) : !this->TryParseLiteral(value))
+                {
+                    return false;
+                }
+
+                values[name] = value;
+                this->SkipWhitespace();
+                if (this->Consume('}'))
+                {
+                    return this->AtEnd();
+                }
+
+                if (!this->Consume(','))
+                {
+                    return false;
+                }
+            }
+        }
+
+    private:
+        char Peek() const
+        {
+            return this->position < this->line.size() ? this->line[this->position] : '\0';
+        }
+
+        bool Consume(char expected)
+        {
+            if (this->Peek() != expected)
+            {
+                return false;
+            }
+
+            ++this->position;
+            return true;
+        }
+
+        void SkipWhitespace()
+        {
+            while (this->Peek() == ' ' || this->Peek() == '\t' || this->Peek() == '\r')
+            {
+                ++this->position;
+            }
+        }
+
+        bool AtEnd()
+        {
+            this->SkipWhitespace();
+            return this->position == this->line.size();
+        }
+
+        bool TryParseString(std::string &value)
+        {
+            if (!this->Consume('"'))
+            {
+                return false;
+            }
+
+            value.clear();
+            while (this->position < this->line.size())
+            {
+                char c = this->line[this->position++];
+                if (c == '"')
+                {
+                    return true;
+                }
+
+                if (c != '\\')
+                {
+                    value += c;
+                    continue;
+                }
+
+                if (this->position >= this->line.size())
+                {
+                    return false;
+                }
+
+                char escaped = this->line[this->position++];
+                switch (escaped)
+                {
+                    case 'n': value += '\n'; break;
+                    case 'r': value += '\r'; break;
+                    case 't': value += '\t'; break;
+                    case 'b': value += '\b'; break;
+                    case 'f': value += '\f'; break;
+                    case 'u':
+                        {
+                            // The loader only escapes control characters this way
+                            if (this->position + 4 > this->line.size())
+                            {
+                                return false;
+                            }
+
+                            unsigned long codePoint = strtoul(this->line.substr(this->position, 4).c_str(), NULL, 16);
+                            value += codePoint < 0x80 ? static_cast<char>(codePoint) : '?';
+                            this->position += 4;
+                            break;
+                        }
+
+                    default: value += escaped; break;
+                }
+            }
+
+            return false;
+        }
+
+        bool TryParseLiteral(std::string &value)
+        {
+            size_t start = this->position;
+            while (this->position < this->line.size() && strchr(",} \t\r", this->line[this->position]) == NULL)
+            {
+                ++this->position;
+            }
+
+            value = this->line.substr(start, this->position - start);
+            return !value.empty();
+        }
+
+        const std::string &line;
+        size_t position;
+    };
+
+    bool TryParseHookRun(const std::string &line, HookRun &run)
+    {
+        std::map<std::string, std::string> values;
+        TraceLineParser parser(line);
+        if (!parser.TryParse(values) ||
+            values.count("hook") == 0 ||
+            values.count("createMs") == 0 ||
+            values.count("waitMs") == 0)
+        {
+            return false;
+        }
+
+        run.hook = values["hook"];
+        run.gitVerb = values["gitVerb"];
+        run.application = values["application"];
+        run.runMode = values["runMode"];
+        run.createMs = atof(values["createMs"].c_str());
+        run.waitMs = atof(values["waitMs"].c_str());
+        run.exitCode = atol(values["exitCode"].c_str());
+        return true;
+    }
+
+    std::string GetGitVerb(const HookRun &run)
+    {
+        // Match git-<verb> and <verb> the way GVFS.Hooks does
+        std::string verb = run.gitVerb;
+        std::transform(verb.begin(), verb.end(), verb.begin(), [](char c) { return static_cast<char>(tolower(static_cast<unsigned char>(c))); });
+        if (verb.compare(0, 4, "git-") == 0)
+        {
+            verb.erase(0, 4);
+        }
+
+        return verb.empty() ? "(none)" : verb;
+    }
+
+    std::string GetHookKey(const HookRun &run)
+    {
+        // The application is whatever the .hooks file says, and so only its file name is shown
+        size_t nameStart = run.application.find_last_of("\\/");
+        std::string application = nameStart == std::string::npos ? run.application : run.application.substr(nameStart + 1);
+        return run.hook + " " + application;
+    }
+
+    void AddRun(RunSummary &summary, const HookRun &run)
+    {
+        if (run.runMode == SkippedRunMode)
+        {
+            ++summary.skipped;
+            return;
+        }
+
+        summary.totalMs.push_back(run.createMs + run.waitMs);
+        summary.createMs.push_back(run.createMs);
+        summary.runModes[run.runMode.empty() ? "?" : run.runMode]++;
+        if (run.exitCode != 0)
+        {
+            ++summary.failures;
+        }
+    }
+
+    double Percentile(const std::vector<double> &sortedValues, double percentile)
+    {
+        // Nearest rank
+        size_t rank = static_cast<size_t>(percentile / 100.0 * sortedValues.size() + 0.999999);
+        return sortedValues[std::min(std::max<size_t>(rank, 1), sortedValues.size()) - 1];
+    }
+
+    void PrintReport(const char *title, std::map<std::string, RunSummary> &summaries)
+    {
+        // Most expensive first, by the total time spent in hooks
+        std::vector<std::pair<double, std::string>> order;
+        size_t nameWidth = strlen(title);
+        for (auto &entry : summaries)
+        {
+            double totalMs = 0;
+            for (double ms : entry.second.totalMs)
+            {
+                totalMs += ms;
+            }
+
+            order.emplace_back(totalMs, entry.first);
+            nameWidth = std::max(nameWidth, entry.first.size());
+        }
+
+        std::sort(order.begin(), order.end(), [](const std::pair<double, std::string> &left, const std::pair<double, std::string> &right)
+        {
+            return left.first != right.first ? left.first > right.first : left.second < right.second;
+        });
+
+        int width = static_cast<int>(nameWidth);
+        printf(
+            "%-*s %8s %8s %8s %10s %10s %10s %10s %10s %12s  %s\n",
+            width, title, "runs", "failed", "skipped", "p50 ms", "p90 ms", "p99 ms", "max ms", "p50 create", "total ms", "run modes");
+
+        for (const std::pair<double, std::string> &entry : order)
+        {
+            RunSummary &summary = summaries[entry.second];
+            std::sort(summary.totalMs.begin(), summary.totalMs.end());
+            std::sort(summary.createMs.begin(), summary.createMs.end());
+
+            std::string runModes;
+            for (const auto &runMode : summary.runModes)
+            {
+                runModes += (runModes.empty() ? "" : ", ") + runMode.first + "=" + std::to_string(runMode.second);
+            }
+
+            if (summary.totalMs.empty())
+            {
+                printf(
+                    "%-*s %8d %8d %8d %10s %10s %10s %10s %10s %12.1f\n",
+                    width, entry.second.c_str(), 0, 0, summary.skipped, "-", "-", "-", "-", "-", entry.first);
+                continue;
+            }
+
+            printf(
+                "%-*s %8zu %8d %8d %10.2f %10.2f %10.2f %10.2f %10.2f %12.1f  %s\n",
+                width,
+                entry.second.c_str(),
+                summary.totalMs.size(),
+                summary.failures,
+                summary.skipped,
+                Percentile(summary.totalMs, 50),
+                Percentile(summary.totalMs, 90),
+                Percentile(summary.totalMs, 99),
+                summary.totalMs.back(),
+                Percentile(summary.createMs, 50),
+                entry.first,
+                runModes.c_str());
+        }
+
+        printf("\n");
+    }
+
+    int Usage(const char *program)
+    {
+        fprintf(stderr, "Usage: %s [--by verb|hook|all] <trace file> [<trace file> ...]\n", program);
+        return 1;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    std::string groupBy = "all";
+    std::vector<std::string> traceFiles;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--by") == 0 && i + 1 < argc)
+        {
+            groupBy = argv[++i];
+        }
+        else if (argv[i][0] == '-')
+        {
+            return Usage(argv[0]);
+        }
+        else
+        {
+            traceFiles.push_back(argv[i]);
+        }
+    }
+
+    if (traceFiles.empty() || (groupBy != "verb" && groupBy != "hook" && groupBy != "all"))
+    {
+        return Usage(argv[0]);
+    }
+
+    std::map<std::string, RunSummary> byVerb;
+    std::map<std::string, RunSummary> byHook;
+    size_t runCount = 0;
+    size_t skippedLaunches = 0;
+    size_t skippedLines = 0;
+    for (const std::string &traceFile : traceFiles)
+    {
+        std::ifstream trace(traceFile);
+        if (!trace)
+        {
+            fprintf(stderr, "Unable to open '%s'\n", traceFile.c_str());
+            return 1;
+        }
+
+        for (std::string line; std::getline(trace, line); )
+        {
+            if (line.empty() || line == "\r")
+            {
+                continue;
+            }
+
+            // A git command that was killed can leave a partial line behind
+            HookRun run;
+            if (!TryParseHookRun(line, run))
+            {
+                ++skippedLines;
+                continue;
+            }
+
+            AddRun(byVerb[GetGitVerb(run)], run);
+            AddRun(byHook[GetHookKey(run)], run);
+            if (run.runMode == SkippedRunMode)
+            {
+                ++skippedLaunches;
+            }
+            else
+            {
+                ++runCount;
+            }
+        }
+    }
+
+    printf("%zu hook runs and %zu skipped launches in %zu trace file(s)", runCount, skippedLaunches, traceFiles.size());
+    if (skippedLines > 0)
+    {
+        printf(", %zu unreadable line(s) skipped", skippedLines);
+    }
+
+    printf("\n\n");
+    if (runCount == 0 && skippedLaunches == 0)
+    {
+        return 0;
+    }
+
+    if (groupBy != "hook")
+    {
+        PrintReport("git verb", byVerb);
+    }
+
+    if (groupBy != "verb")
+    {
+        PrintReport("hook", byHook);
+    }
+
+    return 0;
+}
@@ -0,0 +1,886 @@
+#include "stdafx.h"
+#include "GVFSHooks.h"
+#include <algorithm>
+#include <climits>
+#include <cwctype>
+#include <functional>
+#include <thread>
+#include <vector>
+
+// This is a native port of the parts of GVFS.Hooks (see GVFS.Hooks/Program.cs) that run for most git commands,
+// and must make the same decisions.  Anything that it does not handle is left to GVFS.Hooks.
+
+namespace
+{
+    const wchar_t *PreCommandHook = L"pre-command";
+    const wchar_t *PostCommandHook = L"post-command";
+    const wchar_t *GitPidArg = L"--git-pid=";
+    const wchar_t *GVFSHooksApplicationName = L"GVFS.Hooks";
+
+    // See NamedPipeMessages (LockNamedPipeMessages.cs)
+    const char *AcquireLockRequest = "AcquireLock";
+    const char *AcquireLockAcceptResult = "LockAcquired";
+    const char *AcquireLockAvailableResult = "LockAvailable";
+    const char *ReleaseLockRequest = "ReleaseLock";
+    const char MessageSeparator = '|';
+    const char ReleaseLockSectionSeparator = '<';
+    const int MaxReportedFileNames = 100;
+
+    const DWORD MountPipeConnectTimeoutMs = 3000;
+    const DWORD PostCommandSpinnerDelayMs = 500;
+    const DWORD SpinnerIntervalMs = 100;
+
+    // Keep in sync with GVFS.Hooks/KnownGitCommands.cs
+    const wchar_t *KnownGitCommands[] =
+    {
+        L"add",
+        L"am",
+        L"annotate",
+        L"apply",
+        L"archive",
+        L"bisect--helper",
+        L"blame",
+        L"branch",
+        L"bundle",
+        L"cat-file",
+        L"check-attr",
+        L"check-ignore",
+        L"check-mailmap",
+        L"check-ref-format",
+        L"checkout",
+        L"checkout-index",
+        L"cherry",
+        L"cherry-pick",
+        L"clean",
+        L"clone",
+        L"column",
+        L"commit",
+        L"commit-tree",
+        L"config",
+        L"count-objects",
+        L"credential",
+        L"describe",
+        L"diff",
+        L"diff-files",
+        L"diff-index",
+        L"diff-tree",
+        L"fast-export",
+        L"fetch",
+        L"fetch-pack",
+        L"fmt-merge-msg",
+        L"for-each-ref",
+        L"format-patch",
+        L"fsck",
+        L"fsck-objects",
+        L"gc",
+        L"get-tar-commit-id",
+        L"grep",
+        L"hash-object",
+        L"help",
+        L"index-pack",
+        L"init",
+        L"init-db",
+        L"interpret-trailers",
+        L"log",
+        L"ls-files",
+        L"ls-remote",
+        L"ls-tree",
+        L"mailinfo",
+        L"mailsplit",
+        L"merge",
+        L"merge-base",
+        L"merge-file",
+        L"merge-index",
+        L"merge-ours",
+        L"merge-recursive",
+        L"merge-recursive-ours",
+        L"merge-recursive-theirs",
+        L"merge-subtree",
+        L"merge-tree",
+        L"mktag",
+        L"mktree",
+        L"mv",
+        L"name-rev",
+        L"notes",
+        L"pack-objects",
+        L"pack-redundant",
+        L"pack-refs",
+        L"patch-id",
+        L"pickaxe",
+        L"prune",
+        L"prune-packed",
+        L"pull",
+        L"push",
+        L"read-tree",
+        L"rebase",
+        L"rebase--helper",
+        L"receive-pack",
+        L"reflog",
+        L"remote",
+        L"remote-ext",
+        L"remote-fd",
+        L"repack",
+        L"replace",
+        L"rerere",
+        L"reset",
+        L"rev-list",
+        L"rev-parse",
+        L"revert",
+        L"rm",
+        L"send-pack",
+        L"shortlog",
+        L"show",
+        L"show-branch",
+        L"show-ref",
+        L"stage",
+        L"status",
+        L"stripspace",
+        L"symbolic-ref",
+        L"tag",
+        L"unpack-file",
+        L"unpack-objects",
+        L"update-index",
+        L"update-ref",
+        L"update-server-info",
+        L"upload-archive",
+        L"upload-archive--writer",
+        L"var",
+        L"verify-commit",
+        L"verify-pack",
+        L"verify-tag",
+        L"version",
+        L"whatchanged",
+        L"worktree",
+        L"write-tree",
+
+        // Externals
+        L"bisect",
+        L"filter-branch",
+        L"gui",
+        L"merge-octopus",
+        L"merge-one-file",
+        L"merge-resolve",
+        L"mergetool",
+        L"parse-remote",
+        L"quiltimport",
+        L"rebase",
+        L"submodule",
+    };
+
+    // Commands that never take the GVFS lock, keep in sync with ShouldLock in GVFS.Hooks/Program.cs
+    const wchar_t *NoLockGitCommands[] =
+    {
+        L"blame",
+        L"branch",
+        L"cat-file",
+        L"check-attr",
+        L"config",
+        L"credential",
+        L"diff",
+        L"diff-files",
+        L"diff-index",
+        L"diff-tree",
+        L"difftool",
+        L"fetch",
+        L"for-each-ref",
+        L"help",
+        L"index-pack",
+        L"log",
+        L"ls-files",
+        L"ls-tree",
+        L"merge-base",
+        L"name-rev",
+        L"push",
+        L"remote",
+        L"rev-list",
+        L"rev-parse",
+        L"show",
+        L"show-ref",
+        L"symbolic-ref",
+        L"tag",
+        L"unpack-objects",
+        L"update-ref",
+        L"version",
+        L"web--browse",
+    };
+
+    // Commands that GVFS.Hooks rejects in a GVFS repo, see CheckForLegalCommands
+    const wchar_t *UnsupportedGitCommands[] =
+    {
+        L"fsck",
+        L"gc",
+        L"gui",
+        L"prune",
+        L"repack",
+        L"submodule",
+        L"worktree",
+    };
+
+    template <size_t Count>
+    bool ContainsCommand(const wchar_t *(&commands)[Count], const std::wstring &command)
+    {
+        for (const wchar_t *knownCommand : commands)
+        {
+            if (command == knownCommand)
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool ContainsArg(const std::vector<std::wstring> &args, const wchar_t *expectedArg)
+    {
+        return std::find(args.begin(), args.end(), expectedArg) != args.end();
+    }
+
+    bool ContainsArgIgnoreCase(const std::vector<std::wstring> &args, const wchar_t *expectedArg)
+    {
+        for (const std::wstring &arg : args)
+        {
+            if (_wcsicmp(arg.c_str(), expectedArg) == 0)
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    std::wstring ToLower(std::wstring value)
+    {
+        for (wchar_t &c : value)
+        {
+            c = towlower(c);
+        }
+
+        return value;
+    }
+
+    std::wstring GetGitCommand(const std::vector<std::wstring> &args)
+    {
+        return ::GetGitCommand(args[1]);
+    }
+
+    bool IsFile(const std::wstring &path)
+    {
+        DWORD attributes = GetFileAttributes(path.c_str());
+        return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY) == 0;
+    }
+
+    bool IsDirectory(const std::wstring &path)
+    {
+        DWORD attributes = GetFileAttributes(path.c_str());
+        return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+    }
+
+    bool TryGetEnlistmentRoot(std::wstring &enlistmentRoot)
+    {
+        // The closest directory that contains .gvfs (Paths.GetGVFSEnlistmentRoot), or empty if there is none
+        DWORD length = GetCurrentDirectory(0, NULL);
+        std::vector<wchar_t> currentDirectory(length);
+        length = GetCurrentDirectory(length, currentDirectory.data());
+        if (length == 0 || length >= currentDirectory.size())
+        {
+            return false;
+        }
+
+        std::wstring directory(currentDirectory.data(), length);
+        while (!directory.empty() && directory.back() == L'\\')
+        {
+            directory.pop_back();
+        }
+
+        while (!directory.empty())
+        {
+            // DirectoryInfo.FullName includes the separator for the root of a drive
+            std::wstring candidate = directory.back() == L':' ? directory + L"\\" : directory;
+            if (IsDirectory(candidate + (candidate.back() == L'\\' ? L".gvfs" : L"\\.gvfs")))
+            {
+                enlistmentRoot = candidate;
+                return true;
+            }
+
+            size_t separator = directory.rfind(L'\\');
+            if (separator == std::wstring::npos)
+            {
+                break;
+            }
+
+            directory.resize(separator);
+        }
+
+        enlistmentRoot.clear();
+        return true;
+    }
+
+    bool TryGetMountPipeName(const std::wstring &enlistmentRoot, std::wstring &pipeName)
+    {
+        // See Paths.GetNamedPipeName, which upper cases with the current culture.  That only matches towupper for ASCII.
+        pipeName = L"\\\\.\\pipe\\GVFS_";
+        for (wchar_t c : enlistmentRoot)
+        {
+            if (c > 0x7F)
+            {
+                return false;
+            }
+
+            pipeName += c == L':' ? L'_' : towupper(c);
+        }
+
+        return true;
+    }
+
+    bool IsLegalCommand(const std::vector<std::wstring> &args, const std::wstring &command, const std::wstring &enlistmentRoot)
+    {
+        // Returns false for anything that GVFS.Hooks would reject, so that GVFS.Hooks reports the error
+        if (ContainsCommand(UnsupportedGitCommands, command))
+        {
+            return false;
+        }
+
+        if (command == L"update-index")
+        {
+            return
+                !ContainsArgIgnoreCase(args, L"--split-index") &&
+                !ContainsArgIgnoreCase(args, L"--no-split-index") &&
+                !ContainsArgIgnoreCase(args, L"--index-version") &&
+                !ContainsArgIgnoreCase(args, L"--skip-worktree") &&
+                !ContainsArgIgnoreCase(args, L"--no-skip-worktree");
+        }
+
+        if (command == L"status")
+        {
+            // During a merge or revert conflict GVFS.Hooks checks the status settings in the repo's config
+            std::wstring dotGitRoot = enlistmentRoot + L"\\src\\.git\\";
+            if ((IsFile(dotGitRoot + L"MERGE_HEAD") || IsFile(dotGitRoot + L"REVERT_HEAD")) &&
+                (!ContainsArg(args, L"--no-renames") || !ContainsArg(args, L"--no-breaks")))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool TryShouldLock(const std::vector<std::wstring> &args, const std::wstring &command, bool &shouldLock)
+    {
+        if (ContainsCommand(NoLockGitCommands, command) ||
+            (command == L"reset" && ContainsArg(args, L"--soft")))
+        {
+            shouldLock = false;
+            return true;
+        }
+
+        // An unknown command might be an alias, which GVFS.Hooks has to ask git about
+        shouldLock = true;
+        return ContainsCommand(KnownGitCommands, command);
+    }
+
+    bool IsGitEnvVarDisabled(const wchar_t *name)
+    {
+        wchar_t value[16];
+        DWORD length = GetEnvironmentVariable(name, value, ARRAYSIZE(value));
+        if (length == 0 || length >= ARRAYSIZE(value))
+        {
+            return false;
+        }
+
+        return
+            _wcsicmp(value, L"false") == 0 ||
+            _wcsicmp(value, L"no") == 0 ||
+            _wcsicmp(value, L"off") == 0 ||
+            _wcsicmp(value, L"0") == 0;
+    }
+
+    bool CheckGVFSLockAvailabilityOnly(const std::vector<std::wstring> &args, const std::wstring &command)
+    {
+        return
+            command == L"status" &&
+            (ContainsArgIgnoreCase(args, L"--no-lock-index") || IsGitEnvVarDisabled(L"GIT_OPTIONAL_LOCKS"));
+    }
+
+    bool IsUnattended()
+    {
+        wchar_t value[4];
+        DWORD length = GetEnvironmentVariable(L"GVFS_UNATTENDED", value, ARRAYSIZE(value));
+        return length == 1 && value[0] == L'1';
+    }
+
+    bool IsAdminElevated()
+    {
+        BYTE adminSid[SECURITY_MAX_SID_SIZE];
+        DWORD adminSidSize = sizeof(adminSid);
+        BOOL isMember = FALSE;
+        return
+            CreateWellKnownSid(WinBuiltinAdministratorsSid, NULL, adminSid, &adminSidSize) &&
+            CheckTokenMembership(NULL, adminSid, &isMember) &&
+            isMember;
+    }
+
+    bool TryGetGitPid(const std::vector<std::wstring> &args, DWORD &pid)
+    {
+        const size_t gitPidArgLength = wcslen(GitPidArg);
+        int pidArgCount = 0;
+        for (const std::wstring &arg : args)
+        {
+            if (arg.compare(0, gitPidArgLength, GitPidArg) == 0)
+            {
+                ++pidArgCount;
+                wchar_t *end;
+                pid = wcstoul(arg.c_str() + gitPidArgLength, &end, 10);
+                if (*end != L'\0' || end == arg.c_str() + gitPidArgLength)
+                {
+                    return false;
+                }
+            }
+        }
+
+        if (pidArgCount != 1)
+        {
+            return false;
+        }
+
+        // GVFS.Hooks fails the hook if git has already gone
+        HANDLE gitProcess = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
+        if (gitProcess == NULL)
+        {
+            return false;
+        }
+
+        CloseHandle(gitProcess);
+        return true;
+    }
+
+    std::string ToUtf8(const std::wstring &value)
+    {
+        std::string utf8Value;
+        if (!value.empty())
+        {
+            int length = WideCharToMultiByte(CP_UTF8, 0, value.c_str(), static_cast<int>(value.size()), NULL, 0, NULL, NULL);
+            utf8Value.resize(length);
+            WideCharToMultiByte(CP_UTF8, 0, value.c_str(), static_cast<int>(value.size()), &utf8Value[0], length, NULL, NULL);
+        }
+
+        return utf8Value;
+    }
+
+    std::wstring FromUtf8(const std::string &value)
+    {
+        std::wstring wideValue;
+        if (!value.empty())
+        {
+            int length = MultiByteToWideChar(CP_UTF8, 0, value.c_str(), static_cast<int>(value.size()), NULL, 0);
+            wideValue.resize(length);
+            MultiByteToWideChar(CP_UTF8, 0, value.c_str(), static_cast<int>(value.size()), &wideValue[0], length);
+        }
+
+        return wideValue;
+    }
+
+    std::vector<std::string> Split(const std::string &value, char separator, bool removeEmptyEntries)
+    {
+        std::vector<std::string> parts;
+        size_t start = 0;
+        while (true)
+        {
+            size_t end = value.find(separator, start);
+            std::string part = value.substr(start, end == std::string::npos ? std::string::npos : end - start);
+            if (!removeEmptyEntries || !part.empty())
+            {
+                parts.push_back(part);
+            }
+
+            if (end == std::string::npos)
+            {
+                return parts;
+            }
+
+            start = end + 1;
+        }
+    }
+
+    class MountPipe
+    {
+    public:
+        MountPipe()
+            : pipe(INVALID_HANDLE_VALUE)
+        {
+        }
+
+        ~MountPipe()
+        {
+            if (this->pipe != INVALID_HANDLE_VALUE)
+            {
+                CloseHandle(this->pipe);
+            }
+        }
+
+        bool Connect(const std::wstring &pipeName)
+        {
+            // Like NamedPipeClient.Connect, wait a while for an instance if they are all busy
+            this->pipe = CreateFile(pipeName.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+            if (this->pipe == INVALID_HANDLE_VALUE &&
+                GetLastError() == ERROR_PIPE_BUSY &&
+                WaitNamedPipe(pipeName.c_str(), MountPipeConnectTimeoutMs))
+            {
+                this->pipe = CreateFile(pipeName.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+            }
+
+            return this->pipe != INVALID_HANDLE_VALUE;
+        }
+
+        bool SendRequest(const std::string &message)
+        {
+            std::string line = message + "\r\n";
+            DWORD bytesWritten;
+            return
+                WriteFile(this->pipe, line.data(), static_cast<DWORD>(line.size()), &bytesWritten, NULL) &&
+                bytesWritten == line.size();
+        }
+
+        bool ReadResponse(std::string &response)
+        {
+            // Requests and responses alternate, and so nothing after the end of this response has been sent
+            response.clear();
+            char buffer[4096];
+            while (response.empty() || response.back() != '\n')
+            {
+                DWORD bytesRead;
+                if (!ReadFile(this->pipe, buffer, sizeof(buffer), &bytesRead, NULL) || bytesRead == 0)
+                {
+                    return false;
+                }
+
+                response.append(buffer, bytesRead);
+            }
+
+            while (!response.empty() && (response.back() == '\n' || response.back() == '\r'))
+            {
+                response.pop_back();
+            }
+
+            return true;
+        }
+
+    private:
+        HANDLE pipe;
+    };
+
+    std::string CreateLockRequest(const char *header, DWORD pid, bool isElevated, bool checkAvailabilityOnly, const std::string &parsedCommand)
+    {
+        // See NamedPipeMessages.LockData.  Booleans are formatted the way that .NET formats them.
+        std::string request = header;
+        request += MessageSeparator + std::to_string(pid);
+        request += MessageSeparator + std::string(isElevated ? "True" : "False");
+        request += MessageSeparator + std::string(checkAvailabilityOnly ? "True" : "False");
+        request += MessageSeparator + parsedCommand;
+        return request;
+    }
+
+    std::string GetMessageHeader(const std::string &message)
+    {
+        return message.substr(0, message.find(MessageSeparator));
+    }
+
+    std::string GenerateFullCommand(const std::vector<std::wstring> &args)
+    {
+        std::wstring fullCommand = L"git";
+        for (size_t i = 1; i < args.size(); ++i)
+        {
+            if (args[i].compare(0, wcslen(GitPidArg), GitPidArg) != 0)
+            {
+                fullCommand += L" " + args[i];
+            }
+        }
+
+        return ToUtf8(fullCommand);
+    }
+
+    void WriteUpdatePlaceholderFailures(std::vector<std::string> fileList, const wchar_t *failedOperation, const wchar_t *recoveryCommand)
+    {
+        if (fileList.empty())
+        {
+            return;
+        }
+
+        std::sort(
+            fileList.begin(),
+            fileList.end(),
+            [](const std::string &left, const std::string &right) { return _stricmp(left.c_str(), right.c_str()) < 0; });
+
+        fwprintf(stdout, L"\nGVFS was unable to %s the following files. To recover, close all handles to the files and run these commands:", failedOperation);
+        for (const std::string &file : fileList)
+        {
+            fwprintf(stdout, L"\n    %s%s", recoveryCommand, FromUtf8(file).c_str());
+        }
+
+        fwprintf(stdout, L"\n");
+    }
+
+    bool TryParseCount(const std::string &value, int &count)
+    {
+        char *end;
+        long parsedValue = strtol(value.c_str(), &end, 10);
+        if (value.empty() || *end != '\0' || parsedValue < 0 || parsedValue > INT_MAX)
+        {
+            return false;
+        }
+
+        count = static_cast<int>(parsedValue);
+        return true;
+    }
+
+    void WriteReleaseLockResponse(bool responseRead, const std::string &response)
+    {
+        // See the response handler in GVFS.Hooks' ReleaseGVFSLock, and ReleaseLockData for the format
+        size_t bodyStart = response.find(MessageSeparator);
+        std::string body = bodyStart == std::string::npos ? std::string() : response.substr(bodyStart + 1);
+        std::vector<std::string> sections = Split(body, ReleaseLockSectionSeparator, false);
+
+        int failedToUpdateCount;
+        int failedToDeleteCount;
+        if (!responseRead ||
+            body.empty() ||
+            sections.size() != 4 ||
+            !TryParseCount(sections[0], failedToUpdateCount) ||
+            !TryParseCount(sections[1], failedToDeleteCount))
+        {
+            fwprintf(stdout, L"\nError communicating with GVFS: Run 'git status' to check the status of your repo\n");
+            return;
+        }
+
+        if (failedToUpdateCount + failedToDeleteCount > MaxReportedFileNames)
+        {
+            fwprintf(
+                stdout,
+                L"\nGVFS failed to update %d files, run 'git status' to check the status of files in the repo\n",
+                failedToDeleteCount + failedToUpdateCount);
+        }
+        else if (failedToUpdateCount > 0 || failedToDeleteCount > 0)
+        {
+            WriteUpdatePlaceholderFailures(Split(sections[3], MessageSeparator, true), L"delete", L"git clean -f ");
+            WriteUpdatePlaceholderFailures(Split(sections[2], MessageSeparator, true), L"update", L"git checkout -- ");
+        }
+    }
+
+    bool IsConsoleOutputRedirectedToFile()
+    {
+        return GetFileType(GetStdHandle(STD_OUTPUT_HANDLE)) == FILE_TYPE_DISK;
+    }
+
+    void ShowStatusWhileRunning(const std::function<void()> &action, const wchar_t *message, DWORD initialDelayMs)
+    {
+        // See ConsoleHelper.ShowStatusWhileRunning
+        HANDLE actionIsDone = CreateEvent(NULL, TRUE, FALSE, NULL);
+        if (actionIsDone == NULL)
+        {
+            action();
+            return;
+        }
+
+        bool initialMessageWritten = false;
+        std::thread spinnerThread(
+            [&]()
+            {
+                // ConsoleHelper uses an em dash, which the C runtime cannot write to the console in the default locale
+                const wchar_t waiting[] = { L'-', L'\\', L'|', L'/' };
+                if (WaitForSingleObject(actionIsDone, initialDelayMs) != WAIT_TIMEOUT)
+                {
+                    return;
+                }
+
+                for (size_t retries = 1; ; ++retries)
+                {
+                    fwprintf(stdout, L"\r%s...%c", message, waiting[(retries / 2) % ARRAYSIZE(waiting)]);
+                    fflush(stdout);
+                    initialMessageWritten = true;
+                    if (WaitForSingleObject(actionIsDone, SpinnerIntervalMs) != WAIT_TIMEOUT)
+                    {
+                        // Clear out any trailing waiting character
+                        fwprintf(stdout, L"\r%s...", message);
+                        return;
+                    }
+                }
+            });
+
+        action();
+        SetEvent(actionIsDone);
+        spinnerThread.join();
+        CloseHandle(actionIsDone);
+
+        if (initialMessageWritten)
+        {
+            fwprintf(stdout, L"Succeeded\n");
+        }
+    }
+
+    bool TryAcquireGVFSLock(const std::vector<std::wstring> &args, const std::wstring &command, const std::wstring &pipeName)
+    {
+        DWORD pid;
+        MountPipe mountPipe;
+        if (!TryGetGitPid(args, pid) || !mountPipe.Connect(pipeName))
+        {
+            return false;
+        }
+
+        bool checkAvailabilityOnly = CheckGVFSLockAvailabilityOnly(args, command);
+        std::string response;
+        if (!mountPipe.SendRequest(CreateLockRequest(AcquireLockRequest, pid, IsAdminElevated(), checkAvailabilityOnly, GenerateFullCommand(args))) ||
+            !mountPipe.ReadResponse(response))
+        {
+            return false;
+        }
+
+        // When the lock is held by someone else, or GVFS is not ready, GVFS.Hooks asks again and reports progress.  A
+        // request that is denied has no effect, and so GVFS.Hooks can start over.
+        std::string result = GetMessageHeader(response);
+        return checkAvailabilityOnly ? result == AcquireLockAvailableResult : result == AcquireLockAcceptResult;
+    }
+
+    bool TryReleaseGVFSLock(const std::vector<std::wstring> &args, const std::wstring &pipeName)
+    {
+        DWORD pid;
+        MountPipe mountPipe;
+        if (!TryGetGitPid(args, pid) || !mountPipe.Connect(pipeName))
+        {
+            return false;
+        }
+
+        if (!mountPipe.SendRequest(CreateLockRequest(ReleaseLockRequest, pid, IsAdminElevated(), false, GenerateFullCommand(args))))
+        {
+            return false;
+        }
+
+        // The request has been made, and so from here on GVFS.Hooks cannot take over
+        std::function<void()> releaseLock =
+            [&mountPipe]()
+            {
+                std::string response;
+                bool responseRead = mountPipe.ReadResponse(response);
+                WriteReleaseLockResponse(responseRead, response);
+            };
+
+        if (IsUnattended() || IsConsoleOutputRedirectedToFile())
+        {
+            releaseLock();
+        }
+        else
+        {
+            ShowStatusWhileRunning(releaseLock, L"Waiting for GVFS to parse index and update placeholder files", PostCommandSpinnerDelayMs);
+        }
+
+        return true;
+    }
+}
+
+bool IsGVFSHooksApplication(const std::wstring &applicationName)
+{
+    size_t nameStart = applicationName.find_last_of(L"\\/");
+    std::wstring fileName = applicationName.substr(nameStart == std::wstring::npos ? 0 : nameStart + 1);
+
+    size_t extensionStart = fileName.rfind(L'.');
+    if (extensionStart != std::wstring::npos && _wcsicmp(fileName.c_str() + extensionStart, L".exe") == 0)
+    {
+        fileName.resize(extensionStart);
+    }
+
+    return _wcsicmp(fileName.c_str(), GVFSHooksApplicationName) == 0;
+}
+
+std::wstring GetGitCommand(const std::wstring &gitVerb)
+{
+    std::wstring command = ToLower(gitVerb);
+    if (command.compare(0, 4, L"git-") == 0)
+    {
+        command.erase(0, 4);
+    }
+
+    return command;
+}
+
+bool IsKnownGitCommand(const std::wstring &command)
+{
+    return ContainsCommand(KnownGitCommands, command);
+}
+
+bool TryGetEnlistmentMountPipeName(std::wstring &pipeName)
+{
+    std::wstring enlistmentRoot;
+    return TryGetEnlistmentRoot(enlistmentRoot) && !enlistmentRoot.empty() && TryGetMountPipeName(enlistmentRoot, pipeName);
+}
+
+bool TryRunGVFSHookInProcess(const wchar_t *hookName, int argc, WCHAR *argv[], int &exitCode)
+{
+    // The arguments that GVFS.Hooks would be run with: <hook> <git verb> [<other arguments>]
+    std::vector<std::wstring> args;
+    args.push_back(hookName);
+    for (int i = 1; i < argc; ++i)
+    {
+        args.push_back(argv[i]);
+    }
+
+    std::wstring enlistmentRoot;
+    if (args.size() < 2 || !TryGetEnlistmentRoot(enlistmentRoot))
+    {
+        return false;
+    }
+
+    if (enlistmentRoot.empty())
+    {
+        // Nothing to hook when being run outside of a GVFS repo
+        exitCode = 0;
+        return true;
+    }
+
+    std::wstring pipeName;
+    if (!TryGetMountPipeName(enlistmentRoot, pipeName))
+    {
+        return false;
+    }
+
+    std::wstring hookType = ToLower(args[0]);
+    std::wstring command = GetGitCommand(args);
+    bool shouldLock;
+
+    if (hookType == PreCommandHook)
+    {
+        // GVFS.Hooks prefetches commits before fetch and pull
+        if (!IsLegalCommand(args, command, enlistmentRoot) ||
+            command == L"fetch" ||
+            command == L"pull" ||
+            !TryShouldLock(args, command, shouldLock))
+        {
+            return false;
+        }
+
+        if (shouldLock && !TryAcquireGVFSLock(args, command, pipeName))
+        {
+            return false;
+        }
+    }
+    else if (hookType == PostCommandHook)
+    {
+        // The lock was not acquired if the command only checked whether it was available
+        if (!CheckGVFSLockAvailabilityOnly(args, command))
+        {
+            if (!TryShouldLock(args, command, shouldLock))
+            {
+                return false;
+            }
+
+            if (shouldLock && !TryReleaseGVFSLock(args, pipeName))
+            {
+                return false;
+            }
+        }
+    }
+    else
+    {
+        return false;
+    }
+
+    exitCode = 0;
+    return true;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+
+// Returns true if applicationName (a line from the .hooks file) is GVFS.Hooks
+bool IsGVFSHooksApplication(const std::wstring &applicationName);
+
+// The git command as GVFS.Hooks compares it: lower case, and without a "git-" prefix
+std::wstring GetGitCommand(const std::wstring &gitVerb);
+
+// Returns true if command (from GetGitCommand) is a git command rather than, possibly, an alias
+bool IsKnownGitCommand(const std::wstring &command);
+
+// The pipe of the GVFS mount for the enlistment that contains the current directory, as GVFS.Hooks finds it.  Returns
+// false when the current directory is not in an enlistment.
+bool TryGetEnlistmentMountPipeName(std::wstring &pipeName);
+
+// Runs the pre-command and post-command hooks of GVFS.Hooks in-process for the common cases (commands that do not
+// need the GVFS lock, and acquiring or releasing the lock when GVFS grants it straight away).  Returns false, having
+// had no effect, when GVFS.Hooks itself must be run (e.g. to report an error or to wait for the lock).
+bool TryRunGVFSHookInProcess(const wchar_t *hookName, int argc, WCHAR *argv[], int &exitCode);
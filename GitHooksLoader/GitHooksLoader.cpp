@@ -2,17 +2,69 @@
 //
 
 #include "stdafx.h"
-#include <fstream>
+#include "GVFSHooks.h"
+#include "HookPlan.h"
+#include <sddl.h>
+#include <TlHelp32.h>
 #include <string>
+#include <vector>
 
-int ExecuteHook(const std::wstring &applicationName, wchar_t *hookName, int argc, WCHAR *argv[]);
+struct HookProcess
+{
+    const PlannedHook *plannedHook;
+    HANDLE process;
+
+    // Files that hold the hook's output until it is replayed, NULL when the hook writes to our handles directly
+    HANDLE capturedOutput;
+    HANDLE capturedError;
+
+    // For the perf trace: how the hook was run, when we started it, when it was running, and when it exited
+    const char *runMode;
+    LARGE_INTEGER startTime;
+    LARGE_INTEGER startedTime;
+    LARGE_INTEGER endTime;
+};
+
+// Values of runMode
+const char *ProcessRunMode = "process";
+const char *StandbyHostRunMode = "standby";
+const char *InProcessRunMode = "inProcess";
+const char *SkippedRunMode = "skipped";
+
+LARGE_INTEGER tickFrequency = { 0 };
+bool perfTraceEnabled = false;
+HANDLE perfTraceFile = INVALID_HANDLE_VALUE;
+DWORD parentProcessId = 0;
+
+int ExecuteHook(HookProcess &hook, const std::wstring &hookArguments, wchar_t *hookName, int argc, WCHAR *argv[]);
+int ExecuteParallelHooks(const std::vector<PlannedHook> &plannedHooks, const std::wstring &hookArguments, wchar_t *hookName, int argc, WCHAR *argv[]);
+bool TryRunHookInProcess(HookProcess &hook, wchar_t *hookName, int argc, WCHAR *argv[], int &exitCode);
+HANDLE StartHook(const PlannedHook &plannedHook, const std::wstring &hookArguments, HANDLE stdOutput, HANDLE stdError, const char *&runMode);
+int GetHookExitCode(HANDLE process);
+HANDLE CreateCaptureFile();
+void ReplayCapturedOutput(HANDLE capture, DWORD stdHandle);
+
+// With GITHOOKSLOADER_PERFTRACE set, each hook run is appended as a line of JSON to a trace file for the day, in the
+// enlistment's .gvfs\logs folder.  GitHooksLoader.PerfTraceReport summarizes these files.
+bool OpenPerfTraceFile(const std::wstring &executingLoader);
+DWORD GetParentProcessId();
+void RecordTime(LARGE_INTEGER &time);
+void TraceHookRun(const HookProcess &hook, const wchar_t *hookName, int argc, WCHAR *argv[], bool isParallel, int exitCode);
+void AppendJsonString(std::string &json, const wchar_t *value);
+double GetElapsedMilliseconds(const LARGE_INTEGER &startTime, const LARGE_INTEGER &endTime);
+
+// A hook application can keep processes waiting for the loader to hand them a hook (see GVFS.Hooks' StandbyHost),
+// which saves launching a new process.  The hosts only serve the enlistment that the mount started them for.  These
+// return NULL when no standby host is available to run the hook.
+HANDLE StartHookInStandbyHost(const wchar_t *fullApplicationPath, const std::wstring &commandLine, HANDLE stdOutput, HANDLE stdError);
+HANDLE OpenStandbyHostProcess(HANDLE pipe, const wchar_t *fullApplicationPath);
+bool TryGetUserSid(std::wstring &userSid);
+bool TryRunInStandbyHost(HANDLE pipe, const std::wstring &commandLine, HANDLE stdOutput, HANDLE stdError);
+void AppendStandbyHostMessage(std::string &request, const char *header, const wchar_t *value, size_t length);
+std::string EncodeBase64(const std::string &data);
 
 int wmain(int argc, WCHAR *argv[])
 {
-	LARGE_INTEGER tickFrequency = { 0 };
-	LARGE_INTEGER startTime = { 0 }, endTime = { 0 };
-    bool perfTraceEnabled = false;
-
     size_t requiredCount = 0;
     if (getenv_s(&requiredCount, NULL, 0, "GITHOOKSLOADER_PERFTRACE") != 0)
     {
@@ -41,7 +93,7 @@ int wmain(int argc, WCHAR *argv[])
         fwprintf(stderr, L"Error splitting the path. Error code %d.\n", err);
         exit(2);
     }
-    
+
     std::wstring executingLoader = std::wstring(argv[0]);
     size_t exePartStart = executingLoader.rfind(L".exe");
 
@@ -50,70 +102,238 @@ int wmain(int argc, WCHAR *argv[])
         executingLoader.resize(exePartStart);
     }
 
-    std::wifstream hooksList(executingLoader + L".hooks");
-    int numHooksExecuted = 0;
-    for (std::wstring hookApplication; std::getline(hooksList, hookApplication); )
+    if (perfTraceEnabled)
+    {
+        perfTraceEnabled = OpenPerfTraceFile(executingLoader);
+    }
+
+    HookPlan hookPlan;
+    hookPlan.Load(executingLoader, hookName, argv[1]);
+    const std::vector<std::vector<PlannedHook>> &hookGroups = hookPlan.GetHookGroups();
+    const std::vector<PlannedHook> &skippedHooks = hookPlan.GetSkippedHooks();
+
+    if (hookGroups.empty() && skippedHooks.empty())
     {
-        // Skip comments and empty lines.
-        if (hookApplication.empty() || hookApplication.at(0) == '#')
+        fwprintf(stderr, L"No hooks found to execute\n");
+        exit(5);
+    }
+
+    if (perfTraceEnabled)
+    {
+        // Each of these is a launch that the hook's command filter saved
+        for (const PlannedHook &skippedHook : skippedHooks)
+        {
+            HookProcess hook = {};
+            hook.plannedHook = &skippedHook;
+            hook.runMode = SkippedRunMode;
+            TraceHookRun(hook, hookName, argc, argv, false, 0);
+        }
+    }
+
+    // The same for every hook, and appended to each hook's command line
+    std::wstring hookArguments;
+    for (int x = 1; x < argc; x++)
+    {
+        hookArguments += L" ";
+        hookArguments += argv[x];
+    }
+
+    for (const std::vector<PlannedHook> &hookGroup : hookGroups)
+    {
+        if (hookGroup.size() > 1)
         {
+            int groupExitCode = ExecuteParallelHooks(hookGroup, hookArguments, hookName, argc, argv);
+            if (0 != groupExitCode)
+            {
+                return groupExitCode;
+            }
+
             continue;
         }
 
-        numHooksExecuted++;
+        HookProcess hook = {};
+        hook.plannedHook = &hookGroup.front();
 
+        int hookExitCode = ExecuteHook(hook, hookArguments, hookName, argc, argv);
         if (perfTraceEnabled)
         {
-            QueryPerformanceCounter(&startTime);
+            TraceHookRun(hook, hookName, argc, argv, false, hookExitCode);
         }
 
-        int hookExitCode = ExecuteHook(hookApplication, hookName, argc, argv);
         if (0 != hookExitCode)
         {
             return hookExitCode;
         }
+    }
+
+    return 0;
+}
+
+int ExecuteHook(HookProcess &hook, const std::wstring &hookArguments, wchar_t *hookName, int argc, WCHAR *argv[])
+{
+    RecordTime(hook.startTime);
+
+    int exitCode;
+    if (TryRunHookInProcess(hook, hookName, argc, argv, exitCode))
+    {
+        return exitCode;
+    }
+
+    hook.process = StartHook(*hook.plannedHook, hookArguments, GetStdHandle(STD_OUTPUT_HANDLE), GetStdHandle(STD_ERROR_HANDLE), hook.runMode);
+    RecordTime(hook.startedTime);
+
+    // Wait until child process exits.
+    WaitForSingleObject(hook.process, INFINITE);
+    RecordTime(hook.endTime);
+
+    exitCode = GetHookExitCode(hook.process);
+    CloseHandle(hook.process);
+    return exitCode;
+}
+
+int ExecuteParallelHooks(const std::vector<PlannedHook> &plannedHooks, const std::wstring &hookArguments, wchar_t *hookName, int argc, WCHAR *argv[])
+{
+    std::vector<HookProcess> hooks(plannedHooks.size());
+    std::vector<int> inProcessExitCodes(hooks.size(), 0);
+
+    // GVFS.Hooks runs in process (as it would on its own, see ExecuteHook) before any of the group's processes
+    // are started.  It only does so when it has nothing to write to the console, and so its output cannot end up
+    // ahead of the output of the hooks listed before it.
+    for (size_t i = 0; i < hooks.size(); ++i)
+    {
+        HookProcess &hook = hooks[i];
+        hook.plannedHook = &plannedHooks[i];
+        RecordTime(hook.startTime);
+        TryRunHookInProcess(hook, hookName, argc, argv, inProcessExitCodes[i]);
+    }
+
+    bool isConsoleInUse = false;
+    for (HookProcess &hook : hooks)
+    {
+        if (hook.runMode == InProcessRunMode)
+        {
+            continue;
+        }
+
+        RecordTime(hook.startTime);
+
+        // The first process's output would be replayed first anyway, and so it can write to the console as it runs
+        if (!isConsoleInUse)
+        {
+            hook.capturedOutput = NULL;
+            hook.capturedError = NULL;
+            hook.process = StartHook(*hook.plannedHook, hookArguments, GetStdHandle(STD_OUTPUT_HANDLE), GetStdHandle(STD_ERROR_HANDLE), hook.runMode);
+            isConsoleInUse = true;
+        }
+        else
+        {
+            hook.capturedOutput = CreateCaptureFile();
+            hook.capturedError = CreateCaptureFile();
+            hook.process = StartHook(*hook.plannedHook, hookArguments, hook.capturedOutput, hook.capturedError, hook.runMode);
+        }
+
+        RecordTime(hook.startedTime);
+    }
+
+    // Wait until all of the child processes exit, noting when each one does for the perf trace
+    std::vector<HANDLE> runningProcesses;
+    std::vector<size_t> runningIndexes;
+    for (size_t i = 0; i < hooks.size(); ++i)
+    {
+        if (hooks[i].process != NULL)
+        {
+            runningProcesses.push_back(hooks[i].process);
+            runningIndexes.push_back(i);
+        }
+    }
+
+    while (!runningProcesses.empty())
+    {
+        DWORD waitResult = WaitForMultipleObjects(static_cast<DWORD>(runningProcesses.size()), runningProcesses.data(), FALSE, INFINITE);
+        if (waitResult >= WAIT_OBJECT_0 + runningProcesses.size())
+        {
+            fwprintf(stderr, L"WaitForMultipleObjects failed (%d).\n", GetLastError());
+            exit(7);
+        }
 
+        size_t exitedProcess = waitResult - WAIT_OBJECT_0;
+        RecordTime(hooks[runningIndexes[exitedProcess]].endTime);
+        runningProcesses.erase(runningProcesses.begin() + exitedProcess);
+        runningIndexes.erase(runningIndexes.begin() + exitedProcess);
+    }
+
+    // Report the hooks in the order they are listed, and as though they had run one after another: the
+    // first hook that fails determines the exit code, and the output of the hooks after it is discarded
+    int groupExitCode = 0;
+    for (size_t i = 0; i < hooks.size(); ++i)
+    {
+        HookProcess &hook = hooks[i];
+        int hookExitCode = hook.process != NULL ? GetHookExitCode(hook.process) : inProcessExitCodes[i];
         if (perfTraceEnabled)
         {
-            double elapsedTime;
-            QueryPerformanceCounter(&endTime);
-            elapsedTime = (endTime.QuadPart - startTime.QuadPart) * 1000.0 / tickFrequency.QuadPart;
-            fwprintf(stdout, L"%s: %s = %.2f milliseconds\n", executingLoader.c_str(), hookApplication.c_str(), elapsedTime);
+            TraceHookRun(hook, hookName, argc, argv, true, hookExitCode);
+        }
+
+        if (0 == groupExitCode)
+        {
+            ReplayCapturedOutput(hook.capturedOutput, STD_OUTPUT_HANDLE);
+            ReplayCapturedOutput(hook.capturedError, STD_ERROR_HANDLE);
+            groupExitCode = hookExitCode;
+        }
+
+        if (hook.process != NULL)
+        {
+            CloseHandle(hook.process);
+        }
+
+        if (hook.capturedOutput != NULL)
+        {
+            CloseHandle(hook.capturedOutput);
+            CloseHandle(hook.capturedError);
         }
     }
 
-    if (0 == numHooksExecuted)
+    return groupExitCode;
+}
+
+bool TryRunHookInProcess(HookProcess &hook, wchar_t *hookName, int argc, WCHAR *argv[], int &exitCode)
+{
+    // Most runs of GVFS.Hooks can be handled without starting a process
+    if (!hook.plannedHook->isGVFSHooks || !TryRunGVFSHookInProcess(hookName, argc, argv, exitCode))
     {
-        fwprintf(stderr, L"No hooks found to execute\n");
-        exit(5);
+        return false;
     }
 
-    return 0;
+    hook.runMode = InProcessRunMode;
+    hook.startedTime = hook.startTime;
+    RecordTime(hook.endTime);
+    return true;
 }
 
-int ExecuteHook(const std::wstring &applicationName, wchar_t *hookName, int argc, WCHAR *argv[])
+HANDLE StartHook(const PlannedHook &plannedHook, const std::wstring &hookArguments, HANDLE stdOutput, HANDLE stdError, const char *&runMode)
 {
-    wchar_t expandedPath[MAX_PATH + 1];
-    DWORD length = ExpandEnvironmentStrings(applicationName.c_str(), expandedPath, MAX_PATH);
-    if (length == 0 || length > MAX_PATH)
+    if (plannedHook.expandedPath[0] == L'\0')
     {
-        fwprintf(stderr, L"Unable to expand '%s'", applicationName.c_str());
+        fwprintf(stderr, L"Unable to expand '%s'", plannedHook.applicationName);
         exit(6);
     }
-    
-    std::wstring commandLine = std::wstring(expandedPath) + L" " + hookName;
-    for (int x = 1; x < argc; x++)
+
+    std::wstring commandLine = plannedHook.commandLinePrefix + hookArguments;
+
+    HANDLE standbyHost = StartHookInStandbyHost(plannedHook.resolvedPath, commandLine, stdOutput, stdError);
+    if (standbyHost != NULL)
     {
-        commandLine += L" " + std::wstring(argv[x]);
+        runMode = StandbyHostRunMode;
+        return standbyHost;
     }
-    
-    // Start the child process. 
+
+    // Start the child process.
     STARTUPINFO si;
     PROCESS_INFORMATION pi;
     ZeroMemory(&si, sizeof(si));
     si.cb = sizeof(si);
-    si.hStdOutput = GetStdHandle(STD_OUTPUT_HANDLE);
-    si.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+    si.hStdOutput = stdOutput;
+    si.hStdError = stdError;
     si.dwFlags = STARTF_USESTDHANDLES;
 
     ZeroMemory(&pi, sizeof(pi));
@@ -125,29 +345,450 @@ int ExecuteHook(const std::wstring &applicationName, wchar_t *hookName, int argc
         TRUE,           // Set handle inheritance to TRUE
         CREATE_NO_WINDOW, // Process creation flags
         NULL,           // Use parent's environment block
-        NULL,           // Use parent's starting directory 
+        NULL,           // Use parent's starting directory
         &si,            // Pointer to STARTUPINFO structure
         &pi)            // Pointer to PROCESS_INFORMATION structure
         )
     {
-        fwprintf(stderr, L"Could not execute '%s'. CreateProcess error (%d).\n", applicationName.c_str(), GetLastError());
+        fwprintf(stderr, L"Could not execute '%s'. CreateProcess error (%d).\n", plannedHook.applicationName, GetLastError());
         exit(3);
     }
 
-    // Wait until child process exits.
-    WaitForSingleObject(pi.hProcess, INFINITE);
+    CloseHandle(pi.hThread);
+    runMode = ProcessRunMode;
+    return pi.hProcess;
+}
 
+int GetHookExitCode(HANDLE process)
+{
     // Get process exit code to pass along
     DWORD exitCode;
-    if (!GetExitCodeProcess(pi.hProcess, &exitCode))
+    if (!GetExitCodeProcess(process, &exitCode))
     {
         fwprintf(stderr, L"GetExitCodeProcess failed (%d).\n", GetLastError());
         exit(4);
     }
 
-    // Close process and thread handles. 
-    CloseHandle(pi.hProcess);
-    CloseHandle(pi.hThread);
-
     return (int)exitCode;
-}
\ No newline at end of file
+}
+
+HANDLE CreateCaptureFile()
+{
+    wchar_t tempFolder[MAX_PATH + 1];
+    wchar_t tempFile[MAX_PATH + 1];
+    DWORD length = GetTempPath(MAX_PATH + 1, tempFolder);
+    if (length == 0 || length > MAX_PATH || GetTempFileName(tempFolder, L"ghl", 0, tempFile) == 0)
+    {
+        fwprintf(stderr, L"Unable to create a file for hook output (%d).\n", GetLastError());
+        exit(8);
+    }
+
+    // The handle is inherited by the hook, and the file is deleted once the hook and the loader have both closed it
+    SECURITY_ATTRIBUTES securityAttributes = { sizeof(SECURITY_ATTRIBUTES), NULL, TRUE };
+    HANDLE capture = CreateFile(
+        tempFile,
+        GENERIC_READ | GENERIC_WRITE,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        &securityAttributes,
+        CREATE_ALWAYS,
+        FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE,
+        NULL);
+    if (capture == INVALID_HANDLE_VALUE)
+    {
+        fwprintf(stderr, L"Unable to open '%s' for hook output (%d).\n", tempFile, GetLastError());
+        exit(8);
+    }
+
+    return capture;
+}
+
+void ReplayCapturedOutput(HANDLE capture, DWORD stdHandle)
+{
+    if (capture == NULL)
+    {
+        return;
+    }
+
+    // Anything we have written with the CRT (e.g. an error message) must come out before the replayed output
+    fflush(stdout);
+    fflush(stderr);
+
+    HANDLE target = GetStdHandle(stdHandle);
+    if (SetFilePointer(capture, 0, NULL, FILE_BEGIN) == INVALID_SET_FILE_POINTER)
+    {
+        fwprintf(stderr, L"Unable to read hook output (%d).\n", GetLastError());
+        exit(8);
+    }
+
+    char buffer[4096];
+    DWORD bytesRead;
+    while (ReadFile(capture, buffer, sizeof(buffer), &bytesRead, NULL) && bytesRead > 0)
+    {
+        DWORD bytesWritten;
+        if (!WriteFile(target, buffer, bytesRead, &bytesWritten, NULL))
+        {
+            // Nothing is reading our output any more
+            return;
+        }
+    }
+}
+
+bool OpenPerfTraceFile(const std::wstring &executingLoader)
+{
+    // The loader is installed in <enlistment>\src\.git\hooks.  Anywhere else the trace goes next to the loader.
+    std::wstring loaderFolder = executingLoader.substr(0, executingLoader.find_last_of(L"\\/") + 1);
+    wchar_t logsFolder[MAX_PATH + 1];
+    DWORD length = GetFullPathName((loaderFolder + L"..\\..\\..\\.gvfs\\logs").c_str(), MAX_PATH + 1, logsFolder, NULL);
+    DWORD attributes = length == 0 || length > MAX_PATH ? INVALID_FILE_ATTRIBUTES : GetFileAttributes(logsFolder);
+    std::wstring traceFolder = attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY) != 0 ?
+        std::wstring(logsFolder) + L"\\" :
+        loaderFolder;
+
+    // One file per day, named by local time like the GVFS logs
+    SYSTEMTIME localTime;
+    GetLocalTime(&localTime);
+    wchar_t traceFileName[64];
+    swprintf_s(traceFileName, L"githooksloader_perftrace_%04u%02u%02u.jsonl", localTime.wYear, localTime.wMonth, localTime.wDay);
+
+    // Every git command appends to the file, and so each event is a single write to the end of it
+    perfTraceFile = CreateFile(
+        (traceFolder + traceFileName).c_str(),
+        FILE_APPEND_DATA,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL,
+        OPEN_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL,
+        NULL);
+    if (perfTraceFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    parentProcessId = GetParentProcessId();
+    return true;
+}
+
+DWORD GetParentProcessId()
+{
+    HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
+    if (snapshot == INVALID_HANDLE_VALUE)
+    {
+        return 0;
+    }
+
+    DWORD currentProcessId = GetCurrentProcessId();
+    DWORD parentId = 0;
+    PROCESSENTRY32 processEntry;
+    processEntry.dwSize = sizeof(processEntry);
+    for (BOOL found = Process32First(snapshot, &processEntry); found; found = Process32Next(snapshot, &processEntry))
+    {
+        if (processEntry.th32ProcessID == currentProcessId)
+        {
+            parentId = processEntry.th32ParentProcessID;
+            break;
+        }
+    }
+
+    CloseHandle(snapshot);
+    return parentId;
+}
+
+void RecordTime(LARGE_INTEGER &time)
+{
+    if (perfTraceEnabled)
+    {
+        QueryPerformanceCounter(&time);
+    }
+}
+
+void TraceHookRun(const HookProcess &hook, const wchar_t *hookName, int argc, WCHAR *argv[], bool isParallel, int exitCode)
+{
+    // e.g. {"time":"2018-06-01T17:30:00.123Z","hook":"pre-command","gitVerb":"status","application":"GVFS.Hooks.exe",
+    //       "runMode":"standby","parallel":false,"createMs":1.250,"waitMs":20.500,"exitCode":0,"pid":1234,"parentPid":5678}
+    SYSTEMTIME time;
+    GetSystemTime(&time);
+    char buffer[64];
+    sprintf_s(
+        buffer,
+        "%04u-%02u-%02uT%02u:%02u:%02u.%03uZ",
+        time.wYear,
+        time.wMonth,
+        time.wDay,
+        time.wHour,
+        time.wMinute,
+        time.wSecond,
+        time.wMilliseconds);
+
+    std::string event = "{\"time\":\"";
+    event += buffer;
+    event += "\",\"hook\":";
+    AppendJsonString(event, hookName);
+    event += ",\"gitVerb\":";
+    AppendJsonString(event, argc > 1 ? argv[1] : L"");
+    event += ",\"application\":";
+    AppendJsonString(event, hook.plannedHook->applicationName);
+    event += ",\"runMode\":\"";
+    event += hook.runMode;
+    event += isParallel ? "\",\"parallel\":true" : "\",\"parallel\":false";
+
+    sprintf_s(
+        buffer,
+        ",\"createMs\":%.3f,\"waitMs\":%.3f",
+        GetElapsedMilliseconds(hook.startTime, hook.startedTime),
+        GetElapsedMilliseconds(hook.startedTime, hook.endTime));
+    event += buffer;
+    event += ",\"exitCode\":" + std::to_string(exitCode);
+    event += ",\"pid\":" + std::to_string(GetCurrentProcessId());
+    event += ",\"parentPid\":" + std::to_string(parentProcessId);
+    event += "}\n";
+
+    DWORD bytesWritten;
+    WriteFile(perfTraceFile, event.data(), static_cast<DWORD>(event.size()), &bytesWritten, NULL);
+}
+
+void AppendJsonString(std::string &json, const wchar_t *value)
+{
+    std::string utf8Value;
+    int utf8Length = WideCharToMultiByte(CP_UTF8, 0, value, -1, NULL, 0, NULL, NULL);
+    if (utf8Length > 1)
+    {
+        utf8Value.resize(utf8Length);
+        WideCharToMultiByte(CP_UTF8, 0, value, -1, &utf8Value[0], utf8Length, NULL, NULL);
+        utf8Value.resize(utf8Length - 1);
+    }
+
+    json += '"';
+    for (char c : utf8Value)
+    {
+        if (c == '"' || c == '\\')
+        {
+            json += '\\';
+            json += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            char escaped[8];
+            sprintf_s(escaped, "\\u%04x", static_cast<unsigned int>(c));
+            json += escaped;
+        }
+        else
+        {
+            json += c;
+        }
+    }
+
+    json += '"';
+}
+
+double GetElapsedMilliseconds(const LARGE_INTEGER &startTime, const LARGE_INTEGER &endTime)
+{
+    return (endTime.QuadPart - startTime.QuadPart) * 1000.0 / tickFrequency.QuadPart;
+}
+
+HANDLE StartHookInStandbyHost(const wchar_t *fullApplicationPath, const std::wstring &commandLine, HANDLE stdOutput, HANDLE stdError)
+{
+    // Standby hosts listen on a pipe named for their enlistment, application and user, e.g.
+    // GVFS_<enlistment root>.GVFS.Hooks.Standby.<SID> (see StandbyHost.GetPipeName)
+    const wchar_t *applicationFileName = wcsrchr(fullApplicationPath, L'\\');
+    if (applicationFileName == NULL)
+    {
+        return NULL;
+    }
+
+    std::wstring mountPipeName;
+    std::wstring userSid;
+    if (!TryGetEnlistmentMountPipeName(mountPipeName) || !TryGetUserSid(userSid))
+    {
+        return NULL;
+    }
+
+    std::wstring applicationName(applicationFileName + 1);
+    size_t extensionStart = applicationName.rfind(L'.');
+    if (extensionStart != std::wstring::npos)
+    {
+        applicationName.resize(extensionStart);
+    }
+
+    std::wstring pipeName = mountPipeName + L"." + applicationName + L".Standby." + userSid;
+    HANDLE pipe = CreateFile(pipeName.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+    if (pipe == INVALID_HANDLE_VALUE)
+    {
+        // No standby host is waiting (or they are all busy), which is not worth waiting for
+        return NULL;
+    }
+
+    HANDLE standbyHost = OpenStandbyHostProcess(pipe, fullApplicationPath);
+    if (standbyHost != NULL && !TryRunInStandbyHost(pipe, commandLine, stdOutput, stdError))
+    {
+        CloseHandle(standbyHost);
+        standbyHost = NULL;
+    }
+
+    CloseHandle(pipe);
+    return standbyHost;
+}
+
+HANDLE OpenStandbyHostProcess(HANDLE pipe, const wchar_t *fullApplicationPath)
+{
+    ULONG serverProcessId;
+    if (!GetNamedPipeServerProcessId(pipe, &serverProcessId))
+    {
+        return NULL;
+    }
+
+    HANDLE process = OpenProcess(SYNCHRONIZE | PROCESS_QUERY_LIMITED_INFORMATION, FALSE, serverProcessId);
+    if (process == NULL)
+    {
+        return NULL;
+    }
+
+    // Only hand the hook to the application that would otherwise have been launched for it
+    wchar_t imagePath[MAX_PATH + 1];
+    DWORD imagePathLength = MAX_PATH + 1;
+    if (!QueryFullProcessImageName(process, 0, imagePath, &imagePathLength) ||
+        _wcsicmp(imagePath, fullApplicationPath) != 0)
+    {
+        CloseHandle(process);
+        return NULL;
+    }
+
+    return process;
+}
+
+bool TryGetUserSid(std::wstring &userSid)
+{
+    HANDLE token;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY, &token))
+    {
+        return false;
+    }
+
+    union
+    {
+        TOKEN_USER tokenUser;
+        BYTE buffer[sizeof(TOKEN_USER) + SECURITY_MAX_SID_SIZE];
+    } tokenInformation;
+
+    bool sidFound = false;
+    DWORD tokenInformationLength;
+    if (GetTokenInformation(token, TokenUser, &tokenInformation, sizeof(tokenInformation), &tokenInformationLength))
+    {
+        LPWSTR sidString;
+        if (ConvertSidToStringSid(tokenInformation.tokenUser.User.Sid, &sidString))
+        {
+            userSid = sidString;
+            LocalFree(sidString);
+            sidFound = true;
+        }
+    }
+
+    CloseHandle(token);
+    return sidFound;
+}
+
+bool TryRunInStandbyHost(HANDLE pipe, const std::wstring &commandLine, HANDLE stdOutput, HANDLE stdError)
+{
+    // See NamedPipeMessages.RunHook for the format of the request
+    std::string request;
+    AppendStandbyHostMessage(request, "CommandLine", commandLine.c_str(), commandLine.size());
+
+    DWORD currentDirectoryLength = GetCurrentDirectory(0, NULL);
+    std::vector<wchar_t> currentDirectory(currentDirectoryLength);
+    currentDirectoryLength = GetCurrentDirectory(currentDirectoryLength, currentDirectory.data());
+    if (currentDirectoryLength == 0 || currentDirectoryLength >= currentDirectory.size())
+    {
+        return false;
+    }
+
+    AppendStandbyHostMessage(request, "CurrentDirectory", currentDirectory.data(), currentDirectoryLength);
+
+    wchar_t *environment = GetEnvironmentStrings();
+    if (environment == NULL)
+    {
+        return false;
+    }
+
+    for (const wchar_t *variable = environment; *variable != L'\0'; variable += wcslen(variable) + 1)
+    {
+        // Skip the current directory of each drive (e.g. "=C:=C:\src"), which is not an environment variable
+        if (variable[0] != L'=')
+        {
+            AppendStandbyHostMessage(request, "Environment", variable, wcslen(variable));
+        }
+    }
+
+    FreeEnvironmentStrings(environment);
+
+    // The host duplicates these from us, and so a handle that we do not have is sent as 0
+    ULONG_PTR outputHandle = stdOutput == INVALID_HANDLE_VALUE ? 0 : reinterpret_cast<ULONG_PTR>(stdOutput);
+    ULONG_PTR errorHandle = stdError == INVALID_HANDLE_VALUE ? 0 : reinterpret_cast<ULONG_PTR>(stdError);
+    request += "StandardHandles|" + std::to_string(static_cast<unsigned long long>(outputHandle)) + "," + std::to_string(static_cast<unsigned long long>(errorHandle)) + "\n";
+    request += "Run\n";
+
+    DWORD bytesWritten;
+    if (!WriteFile(pipe, request.data(), static_cast<DWORD>(request.size()), &bytesWritten, NULL) ||
+        bytesWritten != request.size())
+    {
+        return false;
+    }
+
+    std::string response;
+    char responseChar;
+    DWORD bytesRead;
+    while (ReadFile(pipe, &responseChar, 1, &bytesRead, NULL) && bytesRead == 1 && responseChar != '\n')
+    {
+        response += responseChar;
+    }
+
+    if (!response.empty() && response.back() == '\r')
+    {
+        response.pop_back();
+    }
+
+    return response == "Started";
+}
+
+void AppendStandbyHostMessage(std::string &request, const char *header, const wchar_t *value, size_t length)
+{
+    std::string utf8Value;
+    if (length > 0)
+    {
+        int utf8Length = WideCharToMultiByte(CP_UTF8, 0, value, static_cast<int>(length), NULL, 0, NULL, NULL);
+        utf8Value.resize(utf8Length);
+        WideCharToMultiByte(CP_UTF8, 0, value, static_cast<int>(length), &utf8Value[0], utf8Length, NULL, NULL);
+    }
+
+    request += header;
+    request += "|";
+    request += EncodeBase64(utf8Value);
+    request += "\n";
+}
+
+std::string EncodeBase64(const std::string &data)
+{
+    static const char Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    std::string encoded;
+    encoded.reserve(((data.size() + 2) / 3) * 4);
+    for (size_t i = 0; i < data.size(); i += 3)
+    {
+        size_t remaining = data.size() - i;
+        unsigned int triple = static_cast<unsigned char>(data[i]) << 16;
+        if (remaining > 1)
+        {
+            triple |= static_cast<unsigned char>(data[i + 1]) << 8;
+        }
+
+        if (remaining > 2)
+        {
+            triple |= static_cast<unsigned char>(data[i + 2]);
+        }
+
+        encoded += Alphabet[(triple >> 18) & 0x3F];
+        encoded += Alphabet[(triple >> 12) & 0x3F];
+        encoded += remaining > 1 ? Alphabet[(triple >> 6) & 0x3F] : '=';
+        encoded += remaining > 2 ? Alphabet[triple & 0x3F] : '=';
+    }
+
+    return encoded;
+}
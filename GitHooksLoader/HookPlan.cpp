@@ -0,0 +1,508 @@
+#include "stdafx.h"
+#include "HookPlan.h"
+#include "GVFSHooks.h"
+#include <fstream>
+
+namespace
+{
+    // Hooks listed on consecutive lines that start with this marker do not depend on each other, and are started
+    // together.  Their output is replayed in the order they are listed, after all of them have exited.
+    const wchar_t ParallelHookMarker = L'&';
+
+    // A hook that only needs to run for some git commands lists them after this separator, e.g. "hook.exe|checkout,reset".
+    // Commands marked with ExcludedCommandMarker are left out instead, e.g. "hook.exe|!status,!log".  The hook is run
+    // for a command that is listed and not left out, or for any command that is not left out when none are listed.
+    const wchar_t CommandFilterSeparator = L'|';
+    const wchar_t ExcludedCommandMarker = L'!';
+
+    // "GHLP", and change the version whenever the layout of the plan changes
+    const DWORD PlanSignature = 0x504C4847;
+    const DWORD PlanVersion = 2;
+
+    // A plan is a PlanHeader, hookCount PlanHooks, environmentVariableCount PlanEnvironmentVariables, and then a table of
+    // null terminated strings.  Strings are referred to by their offset (in characters) in the table.
+    struct PlanHeader
+    {
+        DWORD signature;
+        DWORD version;
+        FILETIME hooksLastWriteTime;
+        DWORD hooksFileSizeHigh;
+        DWORD hooksFileSizeLow;
+        DWORD hookName;
+        DWORD hookCount;
+        DWORD environmentVariableCount;
+        DWORD stringTableLength;
+    };
+
+    const DWORD ParallelHookFlag = 0x1;
+    const DWORD GVFSHooksFlag = 0x2;
+
+    struct PlanHook
+    {
+        DWORD flags;
+        DWORD applicationName;
+        DWORD expandedPath;
+        DWORD resolvedPath;
+        DWORD commandLinePrefix;
+
+        // Lists such as ",checkout,reset,", or empty
+        DWORD includedCommands;
+        DWORD excludedCommands;
+    };
+
+    // An environment variable that an application name refers to, and its value when the plan was compiled
+    struct PlanEnvironmentVariable
+    {
+        DWORD isSet;
+        DWORD name;
+        DWORD value;
+    };
+
+    class StringTable
+    {
+    public:
+        DWORD Add(const std::wstring &value)
+        {
+            DWORD offset = static_cast<DWORD>(this->strings.size());
+            this->strings.insert(this->strings.end(), value.c_str(), value.c_str() + value.size() + 1);
+            return offset;
+        }
+
+        const std::vector<wchar_t> &GetStrings() const
+        {
+            return this->strings;
+        }
+
+    private:
+        std::vector<wchar_t> strings;
+    };
+
+    bool TryGetEnvironmentVariable(const std::wstring &name, std::wstring &value)
+    {
+        SetLastError(ERROR_SUCCESS);
+        DWORD length = GetEnvironmentVariable(name.c_str(), NULL, 0);
+        if (length == 0)
+        {
+            value.clear();
+            return GetLastError() != ERROR_ENVVAR_NOT_FOUND;
+        }
+
+        std::vector<wchar_t> buffer(length);
+        length = GetEnvironmentVariable(name.c_str(), buffer.data(), length);
+        value.assign(buffer.data(), length < buffer.size() ? length : 0);
+        return true;
+    }
+
+    bool IsEnvironmentVariableUnchanged(const wchar_t *name, bool wasSet, const wchar_t *previousValue)
+    {
+        // Most values fit in the buffer, and the rest are compared in full
+        wchar_t value[MAX_PATH + 1];
+        SetLastError(ERROR_SUCCESS);
+        DWORD length = GetEnvironmentVariable(name, value, ARRAYSIZE(value));
+        if (length == 0)
+        {
+            bool isSet = GetLastError() != ERROR_ENVVAR_NOT_FOUND;
+            return isSet == wasSet && (!isSet || previousValue[0] == L'\0');
+        }
+
+        if (length < ARRAYSIZE(value))
+        {
+            return wasSet && wcscmp(value, previousValue) == 0;
+        }
+
+        std::wstring longValue;
+        return wasSet && TryGetEnvironmentVariable(name, longValue) && longValue == previousValue;
+    }
+
+    void AddEnvironmentVariables(const std::wstring &applicationName, std::vector<std::wstring> &names)
+    {
+        // Every run of characters between two '%'s could be a variable that ExpandEnvironmentStrings looks up
+        size_t start = applicationName.find(L'%');
+        while (start != std::wstring::npos)
+        {
+            size_t end = applicationName.find(L'%', start + 1);
+            if (end == std::wstring::npos)
+            {
+                break;
+            }
+
+            std::wstring name = applicationName.substr(start + 1, end - start - 1);
+            if (!name.empty())
+            {
+                bool isKnown = false;
+                for (const std::wstring &knownName : names)
+                {
+                    isKnown = isKnown || _wcsicmp(knownName.c_str(), name.c_str()) == 0;
+                }
+
+                if (!isKnown)
+                {
+                    names.push_back(name);
+                }
+            }
+
+            start = end;
+        }
+    }
+
+    void ParseCommandFilter(const std::wstring &filter, std::wstring &includedCommands, std::wstring &excludedCommands)
+    {
+        size_t start = 0;
+        while (start <= filter.size())
+        {
+            size_t end = filter.find(L',', start);
+            if (end == std::wstring::npos)
+            {
+                end = filter.size();
+            }
+
+            std::wstring command = filter.substr(start, end - start);
+            command.erase(0, command.find_first_not_of(L" \t"));
+            command.erase(command.find_last_not_of(L" \t") + 1);
+
+            bool isExcluded = !command.empty() && command[0] == ExcludedCommandMarker;
+            if (isExcluded)
+            {
+                command.erase(0, 1);
+            }
+
+            std::wstring &commands = isExcluded ? excludedCommands : includedCommands;
+            if (!command.empty())
+            {
+                // Listed the way that IsCommandListed looks for them
+                commands += (commands.empty() ? L"," : L"") + GetGitCommand(command) + L",";
+            }
+
+            start = end + 1;
+        }
+    }
+
+    bool IsCommandListed(const wchar_t *commands, const std::wstring &gitCommand)
+    {
+        return commands[0] != L'\0' && wcsstr(commands, (L"," + gitCommand + L",").c_str()) != NULL;
+    }
+
+    bool IsHookForCommand(const wchar_t *includedCommands, const wchar_t *excludedCommands, const std::wstring &gitCommand)
+    {
+        if (IsCommandListed(excludedCommands, gitCommand))
+        {
+            return false;
+        }
+
+        // An alias could stand for any of the commands that are listed, and so a hook that lists commands is still
+        // run for anything that git might be expanding
+        return
+            includedCommands[0] == L'\0' ||
+            IsCommandListed(includedCommands, gitCommand) ||
+            !IsKnownGitCommand(gitCommand);
+    }
+
+    void CompilePlan(const std::wstring &hooksPath, const wchar_t *hookName, const WIN32_FILE_ATTRIBUTE_DATA &hooksAttributes, std::vector<BYTE> &plan)
+    {
+        StringTable strings;
+        std::vector<PlanHook> hooks;
+        std::vector<std::wstring> environmentVariableNames;
+
+        PlanHeader header = {};
+        header.signature = PlanSignature;
+        header.version = PlanVersion;
+        header.hooksLastWriteTime = hooksAttributes.ftLastWriteTime;
+        header.hooksFileSizeHigh = hooksAttributes.nFileSizeHigh;
+        header.hooksFileSizeLow = hooksAttributes.nFileSizeLow;
+        header.hookName = strings.Add(hookName);
+
+        std::wifstream hooksList(hooksPath);
+        for (std::wstring hookApplication; std::getline(hooksList, hookApplication); )
+        {
+            // Skip comments and empty lines.
+            if (hookApplication.empty() || hookApplication.at(0) == '#')
+            {
+                continue;
+            }
+
+            PlanHook hook = {};
+            if (hookApplication.at(0) == ParallelHookMarker)
+            {
+                hookApplication.erase(0, 1);
+                hook.flags |= ParallelHookFlag;
+            }
+
+            std::wstring includedCommands;
+            std::wstring excludedCommands;
+            size_t filterStart = hookApplication.find(CommandFilterSeparator);
+            if (filterStart != std::wstring::npos)
+            {
+                ParseCommandFilter(hookApplication.substr(filterStart + 1), includedCommands, excludedCommands);
+                hookApplication.erase(filterStart);
+                hookApplication.erase(hookApplication.find_last_not_of(L" \t") + 1);
+            }
+
+            if (IsGVFSHooksApplication(hookApplication))
+            {
+                hook.flags |= GVFSHooksFlag;
+            }
+
+            // A line that cannot be expanded is reported when the hook is run, as it was before there were plans
+            wchar_t expandedPath[MAX_PATH + 1];
+            DWORD length = ExpandEnvironmentStrings(hookApplication.c_str(), expandedPath, MAX_PATH);
+            if (length == 0 || length > MAX_PATH)
+            {
+                expandedPath[0] = L'\0';
+            }
+
+            wchar_t resolvedPath[MAX_PATH + 1];
+            wchar_t *fileName = NULL;
+            length = expandedPath[0] == L'\0' ? 0 : SearchPath(NULL, expandedPath, L".exe", MAX_PATH + 1, resolvedPath, &fileName);
+            if (length == 0 || length > MAX_PATH || fileName == NULL)
+            {
+                resolvedPath[0] = L'\0';
+            }
+
+            hook.applicationName = strings.Add(hookApplication);
+            hook.expandedPath = strings.Add(expandedPath);
+            hook.resolvedPath = strings.Add(resolvedPath);
+            hook.commandLinePrefix = strings.Add(std::wstring(expandedPath) + L" " + hookName);
+            hook.includedCommands = strings.Add(includedCommands);
+            hook.excludedCommands = strings.Add(excludedCommands);
+            hooks.push_back(hook);
+
+            AddEnvironmentVariables(hookApplication, environmentVariableNames);
+        }
+
+        std::vector<PlanEnvironmentVariable> environmentVariables;
+        for (const std::wstring &name : environmentVariableNames)
+        {
+            std::wstring value;
+            PlanEnvironmentVariable environmentVariable = {};
+            environmentVariable.isSet = TryGetEnvironmentVariable(name, value) ? 1 : 0;
+            environmentVariable.name = strings.Add(name);
+            environmentVariable.value = strings.Add(value);
+            environmentVariables.push_back(environmentVariable);
+        }
+
+        header.hookCount = static_cast<DWORD>(hooks.size());
+        header.environmentVariableCount = static_cast<DWORD>(environmentVariables.size());
+        header.stringTableLength = static_cast<DWORD>(strings.GetStrings().size());
+
+        const BYTE *headerBytes = reinterpret_cast<const BYTE *>(&header);
+        const BYTE *hookBytes = reinterpret_cast<const BYTE *>(hooks.data());
+        const BYTE *environmentVariableBytes = reinterpret_cast<const BYTE *>(environmentVariables.data());
+        const BYTE *stringBytes = reinterpret_cast<const BYTE *>(strings.GetStrings().data());
+
+        plan.clear();
+        plan.insert(plan.end(), headerBytes, headerBytes + sizeof(header));
+        plan.insert(plan.end(), hookBytes, hookBytes + hooks.size() * sizeof(PlanHook));
+        plan.insert(plan.end(), environmentVariableBytes, environmentVariableBytes + environmentVariables.size() * sizeof(PlanEnvironmentVariable));
+        plan.insert(plan.end(), stringBytes, stringBytes + strings.GetStrings().size() * sizeof(wchar_t));
+    }
+
+    void SavePlan(const std::wstring &planPath, const std::vector<BYTE> &plan)
+    {
+        // Other git commands may be reading the plan, or saving their own, and so it is replaced in one step.  Failing
+        // to save it only means that the next run compiles the plan again.
+        std::wstring tempPath = planPath + L"." + std::to_wstring(GetCurrentProcessId()) + L".tmp";
+        HANDLE tempFile = CreateFile(tempPath.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (tempFile == INVALID_HANDLE_VALUE)
+        {
+            return;
+        }
+
+        DWORD bytesWritten;
+        bool written =
+            WriteFile(tempFile, plan.data(), static_cast<DWORD>(plan.size()), &bytesWritten, NULL) &&
+            bytesWritten == plan.size();
+        CloseHandle(tempFile);
+
+        if (!written || !MoveFileEx(tempPath.c_str(), planPath.c_str(), MOVEFILE_REPLACE_EXISTING))
+        {
+            DeleteFile(tempPath.c_str());
+        }
+    }
+}
+
+HookPlan::HookPlan()
+    : mappedPlan(NULL),
+      mappedPlanSize(0)
+{
+}
+
+HookPlan::~HookPlan()
+{
+    if (this->mappedPlan != NULL)
+    {
+        UnmapViewOfFile(this->mappedPlan);
+    }
+}
+
+void HookPlan::Load(const std::wstring &executingLoader, const wchar_t *hookName, const wchar_t *gitVerb)
+{
+    std::wstring gitCommand = GetGitCommand(gitVerb);
+    std::wstring hooksPath = executingLoader + L".hooks";
+    std::wstring planPath = hooksPath + L".plan";
+
+    WIN32_FILE_ATTRIBUTE_DATA hooksAttributes;
+    if (!GetFileAttributesEx(hooksPath.c_str(), GetFileExInfoStandard, &hooksAttributes))
+    {
+        // There are no hooks to run
+        return;
+    }
+
+    if (this->TryMapPlan(planPath) &&
+        this->TryReadPlan(this->mappedPlan, this->mappedPlanSize, hookName, gitCommand, hooksAttributes))
+    {
+        return;
+    }
+
+    if (this->mappedPlan != NULL)
+    {
+        // Out of date, and it must not stop SavePlan from replacing it
+        UnmapViewOfFile(this->mappedPlan);
+        this->mappedPlan = NULL;
+    }
+
+    CompilePlan(hooksPath, hookName, hooksAttributes, this->compiledPlan);
+    SavePlan(planPath, this->compiledPlan);
+
+    if (!this->TryReadPlan(this->compiledPlan.data(), this->compiledPlan.size(), hookName, gitCommand, hooksAttributes))
+    {
+        this->hookGroups.clear();
+        this->skippedHooks.clear();
+    }
+}
+
+bool HookPlan::TryMapPlan(const std::wstring &planPath)
+{
+    // The view keeps the plan readable after the file is replaced, and so the handles can be closed straight away
+    HANDLE planFile = CreateFile(
+        planPath.c_str(),
+        GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_DELETE,
+        NULL,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        NULL);
+    if (planFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER planSize;
+    HANDLE mapping = NULL;
+    if (GetFileSizeEx(planFile, &planSize) &&
+        planSize.QuadPart >= static_cast<LONGLONG>(sizeof(PlanHeader)) &&
+        planSize.QuadPart < MAXDWORD)
+    {
+        mapping = CreateFileMapping(planFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    }
+
+    if (mapping != NULL)
+    {
+        this->mappedPlan = static_cast<const BYTE *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        this->mappedPlanSize = static_cast<size_t>(planSize.QuadPart);
+        CloseHandle(mapping);
+    }
+
+    CloseHandle(planFile);
+    return this->mappedPlan != NULL;
+}
+
+bool HookPlan::TryReadPlan(const BYTE *plan, size_t planSize, const wchar_t *hookName, const std::wstring &gitCommand, const WIN32_FILE_ATTRIBUTE_DATA &hooksAttributes)
+{
+    this->hookGroups.clear();
+    this->skippedHooks.clear();
+    if (planSize < sizeof(PlanHeader))
+    {
+        return false;
+    }
+
+    // The plan is only good for the .hooks file it was compiled from
+    const PlanHeader *header = reinterpret_cast<const PlanHeader *>(plan);
+    if (header->signature != PlanSignature ||
+        header->version != PlanVersion ||
+        CompareFileTime(&header->hooksLastWriteTime, &hooksAttributes.ftLastWriteTime) != 0 ||
+        header->hooksFileSizeHigh != hooksAttributes.nFileSizeHigh ||
+        header->hooksFileSizeLow != hooksAttributes.nFileSizeLow)
+    {
+        return false;
+    }
+
+    size_t expectedSize =
+        sizeof(PlanHeader) +
+        static_cast<size_t>(header->hookCount) * sizeof(PlanHook) +
+        static_cast<size_t>(header->environmentVariableCount) * sizeof(PlanEnvironmentVariable) +
+        static_cast<size_t>(header->stringTableLength) * sizeof(wchar_t);
+    if (planSize != expectedSize)
+    {
+        return false;
+    }
+
+    const PlanHook *hooks = reinterpret_cast<const PlanHook *>(plan + sizeof(PlanHeader));
+    const PlanEnvironmentVariable *environmentVariables = reinterpret_cast<const PlanEnvironmentVariable *>(hooks + header->hookCount);
+    const wchar_t *strings = reinterpret_cast<const wchar_t *>(environmentVariables + header->environmentVariableCount);
+    DWORD stringTableLength = header->stringTableLength;
+    if (stringTableLength == 0 || strings[stringTableLength - 1] != L'\0' || header->hookName >= stringTableLength)
+    {
+        return false;
+    }
+
+    if (wcscmp(strings + header->hookName, hookName) != 0)
+    {
+        return false;
+    }
+
+    for (DWORD i = 0; i < header->environmentVariableCount; ++i)
+    {
+        const PlanEnvironmentVariable &environmentVariable = environmentVariables[i];
+        if (environmentVariable.name >= stringTableLength ||
+            environmentVariable.value >= stringTableLength ||
+            !IsEnvironmentVariableUnchanged(strings + environmentVariable.name, environmentVariable.isSet != 0, strings + environmentVariable.value))
+        {
+            return false;
+        }
+    }
+
+    bool previousHookIsParallel = false;
+    for (DWORD i = 0; i < header->hookCount; ++i)
+    {
+        const PlanHook &hook = hooks[i];
+        if (hook.applicationName >= stringTableLength ||
+            hook.expandedPath >= stringTableLength ||
+            hook.resolvedPath >= stringTableLength ||
+            hook.commandLinePrefix >= stringTableLength ||
+            hook.includedCommands >= stringTableLength ||
+            hook.excludedCommands >= stringTableLength)
+        {
+            this->hookGroups.clear();
+            this->skippedHooks.clear();
+            return false;
+        }
+
+        PlannedHook plannedHook;
+        plannedHook.applicationName = strings + hook.applicationName;
+        plannedHook.expandedPath = strings + hook.expandedPath;
+        plannedHook.resolvedPath = strings + hook.resolvedPath;
+        plannedHook.commandLinePrefix = strings + hook.commandLinePrefix;
+        plannedHook.isGVFSHooks = (hook.flags & GVFSHooksFlag) != 0;
+
+        if (!IsHookForCommand(strings + hook.includedCommands, strings + hook.excludedCommands, gitCommand))
+        {
+            // The hooks on either side of it were not listed together, and so are not run together
+            this->skippedHooks.push_back(plannedHook);
+            previousHookIsParallel = false;
+            continue;
+        }
+
+        bool isParallel = (hook.flags & ParallelHookFlag) != 0;
+        if (!isParallel ||
+            !previousHookIsParallel ||
+            this->hookGroups.back().size() == MAXIMUM_WAIT_OBJECTS)
+        {
+            this->hookGroups.emplace_back();
+        }
+
+        this->hookGroups.back().push_back(plannedHook);
+        previousHookIsParallel = isParallel;
+    }
+
+    return true;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// A hook listed in the .hooks file, ready to be run
+struct PlannedHook
+{
+    // The line from the .hooks file, for messages and the perf trace
+    const wchar_t *applicationName;
+
+    // applicationName with environment variables expanded, which CreateProcess searches for.  Empty if it could not be
+    // expanded.
+    const wchar_t *expandedPath;
+
+    // The full path that expandedPath resolved to when the plan was compiled, or empty if it did not resolve.  This is
+    // only used to find a standby host, which must be running this application.
+    const wchar_t *resolvedPath;
+
+    // expandedPath and the hook name, to which the arguments from git are appended
+    const wchar_t *commandLinePrefix;
+
+    bool isGVFSHooks;
+};
+
+// The hooks to run for a git command, in groups that are run one after another.  Each group is either a single hook, or
+// a run of hooks marked with ParallelHookMarker that are started together.  Hooks whose command filter leaves out the
+// git command are not run at all (see CommandFilterSeparator).
+//
+// Compiling <loader>.hooks into a plan means reading it, expanding environment variables and searching for each
+// application.  The plan is saved to <loader>.hooks.plan, which later runs map and use as is until .hooks changes (or
+// one of the environment variables that it uses).
+class HookPlan
+{
+public:
+    HookPlan();
+    ~HookPlan();
+
+    void Load(const std::wstring &executingLoader, const wchar_t *hookName, const wchar_t *gitVerb);
+
+    const std::vector<std::vector<PlannedHook>> &GetHookGroups() const
+    {
+        return this->hookGroups;
+    }
+
+    // The hooks that are listed, but not for this git command
+    const std::vector<PlannedHook> &GetSkippedHooks() const
+    {
+        return this->skippedHooks;
+    }
+
+private:
+    HookPlan(const HookPlan &) = delete;
+    HookPlan &operator=(const HookPlan &) = delete;
+
+    bool TryMapPlan(const std::wstring &planPath);
+    bool TryReadPlan(const BYTE *plan, size_t planSize, const wchar_t *hookName, const std::wstring &gitCommand, const WIN32_FILE_ATTRIBUTE_DATA &hooksAttributes);
+
+    const BYTE *mappedPlan;
+    size_t mappedPlanSize;
+    std::vector<BYTE> compiledPlan;
+    std::vector<std::vector<PlannedHook>> hookGroups;
+    std::vector<PlannedHook> skippedHooks;
+};